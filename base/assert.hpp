@@ -0,0 +1,22 @@
+#pragma once
+
+// The assertion macros on their own, for code that shouldn't
+// have to pull in the rest of util.hpp (and with it GL and glm).
+// assert_impl() is defined in util.cpp.
+
+#define ASSERT(cond) assert_impl((cond), __LINE__, __func__, __FILE__, #cond)
+
+void assert_impl(bool cond,
+                 int line,
+                 const char* func,
+                 const char* file,
+                 const char* expr);
+
+static inline bool c_assert_impl(bool cond,
+				 int line,
+				 const char* func,
+				 const char* file,
+				 const char* expr) { assert_impl(cond, line, func, file, expr);
+  return cond; }
+
+#define c_assert(cond) c_assert_impl((cond), __LINE__, __func__, __FILE__, #cond)
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+
+namespace vulkan {
+  //
+  // The rules device_memory_pool (vk_memory.hpp) uses to pick
+  // the block a request goes in. They're kept free of Vulkan
+  // types so that they can be tested on the CPU (make test).
+  //
+  enum class resource_tiling : uint8_t
+    {
+     linear,
+     optimal
+    };
+
+  namespace placement {
+    // the size of a normal block in a heap of heap_size bytes:
+    // small heaps get heap_size / heap_fraction instead of max_block_size
+    static inline uint64_t block_size(uint64_t heap_size,
+				      uint64_t max_block_size,
+				      uint64_t heap_fraction) {
+      return std::min(max_block_size, heap_size / heap_fraction);
+    }
+
+    // requests larger than half a normal block get a block of their own
+    static inline bool dedicated(uint64_t size, uint64_t block_size) {
+      return size > block_size / 2;
+    }
+
+    // with a bufferImageGranularity of 1 linear and optimal
+    // resources can't alias each other, so they share blocks
+    static inline resource_tiling block_tiling(resource_tiling tiling,
+					       uint64_t buffer_image_granularity) {
+      return buffer_image_granularity <= 1
+	? resource_tiling::linear
+	: tiling;
+    }
+
+    // whether a non-dedicated request of memory_type and (block_tiling()
+    // adjusted) tiling may be placed in an existing block
+    static inline bool shares_block(uint32_t block_memory_type,
+				    resource_tiling block_tiling,
+				    bool block_dedicated,
+				    uint32_t memory_type,
+				    resource_tiling tiling) {
+      return
+	!block_dedicated &&
+	block_memory_type == memory_type &&
+	block_tiling == tiling;
+    }
+  }
+}
@@ -0,0 +1,350 @@
+#include "tlsf.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+void tlsf::mapping(size_type size, uint32_t& fl, uint32_t& sl) {
+  if (size < k_sl_count) {
+    fl = 0;
+    sl = static_cast<uint32_t>(size);
+  }
+  else {
+    uint32_t msb = static_cast<uint32_t>(std::bit_width(size)) - 1;
+
+    fl = msb - k_sl_bits + 1;
+    sl = static_cast<uint32_t>(size >> (msb - k_sl_bits)) ^ k_sl_count;
+  }
+}
+
+uint32_t tlsf::new_node() {
+  uint32_t n = k_null;
+
+  if (!m_unused_nodes.empty()) {
+    n = m_unused_nodes.back();
+    m_unused_nodes.pop_back();
+
+    m_nodes[n] = node{};
+  }
+  else {
+    n = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back(node{});
+  }
+
+  return n;
+}
+
+void tlsf::insert_free(uint32_t n) {
+  uint32_t fl, sl;
+  mapping(m_nodes[n].size, fl, sl);
+
+  uint32_t& head = m_heads[fl * k_sl_count + sl];
+
+  m_nodes[n].free = true;
+  m_nodes[n].prev_free = k_null;
+  m_nodes[n].next_free = head;
+
+  if (head != k_null) {
+    m_nodes[head].prev_free = n;
+  }
+
+  head = n;
+
+  m_sl_bitmaps[fl] |= 1u << sl;
+  m_fl_bitmap |= uint64_t{1} << fl;
+}
+
+void tlsf::remove_free(uint32_t n) {
+  uint32_t fl, sl;
+  mapping(m_nodes[n].size, fl, sl);
+
+  uint32_t& head = m_heads[fl * k_sl_count + sl];
+
+  node& b = m_nodes[n];
+
+  if (b.prev_free != k_null) {
+    m_nodes[b.prev_free].next_free = b.next_free;
+  }
+
+  if (b.next_free != k_null) {
+    m_nodes[b.next_free].prev_free = b.prev_free;
+  }
+
+  if (head == n) {
+    head = b.next_free;
+
+    if (head == k_null) {
+      m_sl_bitmaps[fl] &= ~(1u << sl);
+
+      if (m_sl_bitmaps[fl] == 0) {
+        m_fl_bitmap &= ~(uint64_t{1} << fl);
+      }
+    }
+  }
+
+  b.free = false;
+  b.prev_free = k_null;
+  b.next_free = k_null;
+}
+
+uint32_t tlsf::find_free(size_type size) const {
+  // round up to the start of the next bin, so that
+  // anything found is guaranteed to be big enough
+  if (size >= k_sl_count) {
+    uint32_t msb = static_cast<uint32_t>(std::bit_width(size)) - 1;
+    size_type round = (size_type{1} << (msb - k_sl_bits)) - 1;
+
+    if (size > std::numeric_limits<size_type>::max() - round) {
+      return k_null;
+    }
+
+    size += round;
+  }
+
+  uint32_t fl, sl;
+  mapping(size, fl, sl);
+
+  uint32_t sl_map = m_sl_bitmaps[fl] & (~0u << sl);
+
+  if (sl_map == 0) {
+    if (fl + 1 >= k_fl_count) {
+      return k_null;
+    }
+
+    uint64_t fl_map = m_fl_bitmap & (~uint64_t{0} << (fl + 1));
+
+    if (fl_map == 0) {
+      return k_null;
+    }
+
+    fl = static_cast<uint32_t>(std::countr_zero(fl_map));
+    sl_map = m_sl_bitmaps[fl];
+  }
+
+  sl = static_cast<uint32_t>(std::countr_zero(sl_map));
+
+  return m_heads[fl * k_sl_count + sl];
+}
+
+void tlsf::reset(size_type capacity) {
+  m_nodes.clear();
+  m_unused_nodes.clear();
+
+  m_fl_bitmap = 0;
+  m_sl_bitmaps.fill(0);
+  m_heads.fill(k_null);
+
+  m_capacity = capacity;
+  m_used = 0;
+  m_num_allocations = 0;
+
+  // node 0 always starts the address ordered list,
+  // since merges keep the lower of the two nodes
+  if (capacity > 0) {
+    uint32_t n = new_node();
+
+    m_nodes[n].offset = 0;
+    m_nodes[n].size = capacity;
+
+    insert_free(n);
+  }
+}
+
+tlsf::allocation tlsf::allocate(size_type size, size_type alignment) {
+  allocation ret{};
+
+  if (size > 0 && c_assert(alignment > 0 && std::has_single_bit(alignment))) {
+    size_type search = size;
+
+    if (alignment > 1) {
+      search = size > std::numeric_limits<size_type>::max() - (alignment - 1)
+        ? std::numeric_limits<size_type>::max()
+        : size + alignment - 1;
+    }
+
+    uint32_t n = find_free(search);
+
+    if (n != k_null) {
+      remove_free(n);
+
+      size_type offset = m_nodes[n].offset;
+      size_type aligned = (offset + alignment - 1) & ~(alignment - 1);
+
+      // the padding in front keeps node n, which goes
+      // back into the free bins; the allocation gets a new node
+      if (aligned != offset) {
+        uint32_t a = new_node();
+
+        m_nodes[a].offset = aligned;
+        m_nodes[a].size = m_nodes[n].size - (aligned - offset);
+        m_nodes[a].prev_phys = n;
+        m_nodes[a].next_phys = m_nodes[n].next_phys;
+
+        if (m_nodes[a].next_phys != k_null) {
+          m_nodes[m_nodes[a].next_phys].prev_phys = a;
+        }
+
+        m_nodes[n].size = aligned - offset;
+        m_nodes[n].next_phys = a;
+
+        insert_free(n);
+
+        n = a;
+      }
+
+      size_type remainder = m_nodes[n].size - size;
+
+      if (remainder >= k_min_split) {
+        uint32_t t = new_node();
+
+        m_nodes[t].offset = m_nodes[n].offset + size;
+        m_nodes[t].size = remainder;
+        m_nodes[t].prev_phys = n;
+        m_nodes[t].next_phys = m_nodes[n].next_phys;
+
+        if (m_nodes[t].next_phys != k_null) {
+          m_nodes[m_nodes[t].next_phys].prev_phys = t;
+        }
+
+        m_nodes[n].size = size;
+        m_nodes[n].next_phys = t;
+
+        insert_free(t);
+      }
+
+      m_used += m_nodes[n].size;
+      m_num_allocations++;
+
+      ret.offset = m_nodes[n].offset;
+      ret.size = size;
+      ret.node = n;
+    }
+  }
+
+  return ret;
+}
+
+void tlsf::free(uint32_t n) {
+  if (c_assert(n < m_nodes.size()) &&
+      c_assert(!m_nodes[n].free) &&
+      c_assert(m_nodes[n].size > 0)) {
+
+    m_used -= m_nodes[n].size;
+    m_num_allocations--;
+
+    uint32_t prev = m_nodes[n].prev_phys;
+
+    if (prev != k_null && m_nodes[prev].free) {
+      remove_free(prev);
+
+      m_nodes[prev].size += m_nodes[n].size;
+      m_nodes[prev].next_phys = m_nodes[n].next_phys;
+
+      if (m_nodes[n].next_phys != k_null) {
+        m_nodes[m_nodes[n].next_phys].prev_phys = prev;
+      }
+
+      m_nodes[n] = node{};
+      m_unused_nodes.push_back(n);
+
+      n = prev;
+    }
+
+    uint32_t next = m_nodes[n].next_phys;
+
+    if (next != k_null && m_nodes[next].free) {
+      remove_free(next);
+
+      m_nodes[n].size += m_nodes[next].size;
+      m_nodes[n].next_phys = m_nodes[next].next_phys;
+
+      if (m_nodes[next].next_phys != k_null) {
+        m_nodes[m_nodes[next].next_phys].prev_phys = n;
+      }
+
+      m_nodes[next] = node{};
+      m_unused_nodes.push_back(next);
+    }
+
+    insert_free(n);
+  }
+}
+
+tlsf::stats tlsf::get_stats() const {
+  stats ret{};
+
+  ret.capacity = m_capacity;
+  ret.used = m_used;
+  ret.allocations = m_num_allocations;
+
+  for (uint32_t n = m_nodes.empty() ? k_null : 0; n != k_null; n = m_nodes[n].next_phys) {
+    if (m_nodes[n].free) {
+      ret.free_ranges++;
+      ret.largest_free = std::max(ret.largest_free, m_nodes[n].size);
+    }
+  }
+
+  return ret;
+}
+
+bool tlsf::validate() const {
+  bool good = true;
+
+  size_type expected_offset = 0;
+  size_type used = 0;
+  uint32_t allocations = 0;
+  uint32_t free_ranges = 0;
+  uint32_t prev = k_null;
+
+  for (uint32_t n = m_nodes.empty() ? k_null : 0; good && n != k_null; n = m_nodes[n].next_phys) {
+    const node& b = m_nodes[n];
+
+    good =
+      c_assert(b.offset == expected_offset) &&
+      c_assert(b.size > 0) &&
+      c_assert(b.prev_phys == prev) &&
+      c_assert(!(b.free && prev != k_null && m_nodes[prev].free));
+
+    expected_offset += b.size;
+    prev = n;
+
+    if (b.free) {
+      free_ranges++;
+    }
+    else {
+      used += b.size;
+      allocations++;
+    }
+  }
+
+  good =
+    good &&
+    c_assert(expected_offset == m_capacity) &&
+    c_assert(used == m_used) &&
+    c_assert(allocations == m_num_allocations);
+
+  uint32_t binned = 0;
+
+  for (uint32_t fl = 0; good && fl < k_fl_count; ++fl) {
+    good = c_assert(((m_fl_bitmap >> fl) & 1) == (m_sl_bitmaps[fl] != 0 ? 1 : 0));
+
+    for (uint32_t sl = 0; good && sl < k_sl_count; ++sl) {
+      uint32_t head = m_heads[fl * k_sl_count + sl];
+
+      good = c_assert(((m_sl_bitmaps[fl] >> sl) & 1) == (head != k_null ? 1u : 0u));
+
+      for (uint32_t n = head; good && n != k_null; n = m_nodes[n].next_free) {
+        uint32_t nfl, nsl;
+        mapping(m_nodes[n].size, nfl, nsl);
+
+        good =
+          c_assert(m_nodes[n].free) &&
+          c_assert(nfl == fl && nsl == sl);
+
+        binned++;
+      }
+    }
+  }
+
+  return good && c_assert(binned == free_ranges);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "assert.hpp"
+
+#include <array>
+#include <vector>
+#include <stdint.h>
+
+//
+// Two level segregated fit allocator over an abstract [0, capacity) range.
+//
+// It never touches the memory it manages - all bookkeeping lives in a node
+// array on the side - so it works just as well for GPU memory that the CPU
+// can't see. Callers get back an offset and a node index; the node index
+// is what's handed back to free().
+//
+// Free ranges are binned by size: the first level is the power of two,
+// the second splits each power of two into k_sl_count linear steps.
+// A bitmap per level makes finding a big enough range two bit scans,
+// so allocate() and free() are O(1) no matter how fragmented things get.
+// Neighbouring free ranges are merged on free().
+//
+// There's nothing Vulkan specific here, and only assert.hpp is
+// included, so the logic can be exercised on the CPU without a device
+// (see base/tests and make test).
+//
+class tlsf {
+public:
+  using size_type = uint64_t;
+
+  static constexpr uint32_t k_null = UINT32_MAX;
+
+  struct allocation {
+    size_type offset{0};
+    size_type size{0};
+    uint32_t node{k_null};
+
+    bool ok() const { return node != k_null; }
+  };
+
+  struct stats {
+    size_type capacity{0};
+    size_type used{0}; // including alignment padding that couldn't be split off
+    size_type largest_free{0};
+    uint32_t allocations{0};
+    uint32_t free_ranges{0};
+  };
+
+private:
+  static constexpr uint32_t k_sl_bits = 5;
+  static constexpr uint32_t k_sl_count = 1 << k_sl_bits;
+
+  // sizes below k_sl_count all land in first level 0,
+  // one second level bin per byte
+  static constexpr uint32_t k_fl_count = 64 - k_sl_bits + 1;
+
+  // remainders smaller than this stay attached to the allocation
+  static constexpr size_type k_min_split = 16;
+
+  struct node {
+    size_type offset{0};
+    size_type size{0};
+
+    // neighbours in address order
+    uint32_t prev_phys{k_null};
+    uint32_t next_phys{k_null};
+
+    // neighbours in the node's size bin; only valid while free
+    uint32_t prev_free{k_null};
+    uint32_t next_free{k_null};
+
+    bool free{false};
+  };
+
+  std::vector<node> m_nodes{};
+  std::vector<uint32_t> m_unused_nodes{};
+
+  uint64_t m_fl_bitmap{0};
+  std::array<uint32_t, k_fl_count> m_sl_bitmaps{};
+  std::array<uint32_t, k_fl_count * k_sl_count> m_heads{};
+
+  size_type m_capacity{0};
+  size_type m_used{0};
+  uint32_t m_num_allocations{0};
+
+  static void mapping(size_type size, uint32_t& fl, uint32_t& sl);
+
+  uint32_t new_node();
+
+  void insert_free(uint32_t n);
+
+  void remove_free(uint32_t n);
+
+  uint32_t find_free(size_type size) const;
+
+public:
+  tlsf() = default;
+
+  explicit tlsf(size_type capacity) {
+    reset(capacity);
+  }
+
+  // forgets every allocation
+  void reset(size_type capacity);
+
+  // alignment must be a power of two; returns an allocation
+  // with ok() == false if there's no free range big enough
+  allocation allocate(size_type size, size_type alignment = 1);
+
+  void free(uint32_t node);
+
+  size_type capacity() const { return m_capacity; }
+
+  size_type used() const { return m_used; }
+
+  uint32_t num_allocations() const { return m_num_allocations; }
+
+  bool empty() const { return m_num_allocations == 0; }
+
+  stats get_stats() const;
+
+  // walks every node and checks that the ranges tile [0, capacity),
+  // that no two free ranges are adjacent and that the bins agree
+  // with the node array; meant for tests and debugging
+  bool validate() const;
+};
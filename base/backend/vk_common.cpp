@@ -152,61 +152,10 @@ namespace vulkan {
     return set;
   }
 
-  void write_device_memory(VkDevice device,
-			   VkDeviceMemory memory,
-			   const void* data,
-			   VkDeviceSize size) {
-    void* mapped_memory = nullptr;
-
-    VK_FN(vkMapMemory(device,
-		      memory,
-		      0,
-		      size,
-		      0,
-		      &mapped_memory));
-
-    ASSERT(mapped_memory != nullptr);
-    ASSERT(api_ok());
-      
-    if (api_ok() && mapped_memory != nullptr) {
-      memcpy(mapped_memory, data, size);
-
-      vkUnmapMemory(device,
-		    memory);
-    }
-  }
-    
-  VkDeviceMemory make_device_memory(VkDevice device,
-				    const void* data,
-				    VkDeviceSize size,
-				    VkDeviceSize alloc_size,
-				    uint32_t index) {
-    VkDeviceMemory memory{VK_NULL_HANDLE};
-    VkMemoryAllocateInfo info = {};
-      
-    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    info.pNext = nullptr;
-    info.allocationSize = alloc_size;
-    info.memoryTypeIndex = index;
-
-    VK_FN(vkAllocateMemory(device,
-			   &info,
-			   nullptr,
-			   &memory));
-
-    if (api_ok() &&
-	memory != VK_NULL_HANDLE &&
-	data != nullptr) {
-      write_device_memory(device, memory, data, size);
-    }
-
-    return memory;
-  }
-
-  VkBuffer make_buffer(const device_resource_properties& resource_props,
-		       VkBufferCreateFlags create_flags,
-		       VkBufferUsageFlags usage_flags,
-		       VkDeviceSize sz) {
+  VkBufferCreateInfo make_buffer_create_info(const device_resource_properties& resource_props,
+					     VkBufferCreateFlags create_flags,
+					     VkBufferUsageFlags usage_flags,
+					     VkDeviceSize sz) {
     VkBufferCreateInfo create_info = {};
 
     create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -218,6 +167,18 @@ namespace vulkan {
     create_info.pQueueFamilyIndices = resource_props.queue_family_indices.data();
     create_info.size = sz;
 
+    return create_info;
+  }
+
+  VkBuffer make_buffer(const device_resource_properties& resource_props,
+		       VkBufferCreateFlags create_flags,
+		       VkBufferUsageFlags usage_flags,
+		       VkDeviceSize sz) {
+    VkBufferCreateInfo create_info = make_buffer_create_info(resource_props,
+							     create_flags,
+							     usage_flags,
+							     sz);
+
     VkBuffer buffer{VK_NULL_HANDLE};
       
     VK_FN(vkCreateBuffer(resource_props.device,
@@ -228,10 +189,10 @@ namespace vulkan {
     return buffer;
   }
 
-  VkDescriptorBufferInfo make_descriptor_buffer_info(VkBuffer buffer, VkDeviceSize size) {
+  VkDescriptorBufferInfo make_descriptor_buffer_info(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
     VkDescriptorBufferInfo info = {};
     info.buffer = buffer;
-    info.offset = 0;
+    info.offset = offset;
     info.range = size;
     return info;
   }
@@ -276,12 +237,13 @@ namespace vulkan {
 
   bool write_descriptor_set(VkDevice device,
 			    VkBuffer buffer,
+			    VkDeviceSize offset,
 			    VkDeviceSize size,
 			    VkDescriptorSet descset,
 			    uint32_t binding_index,
 			    uint32_t array_element,
 			    VkDescriptorType descriptor_type) {
-    auto buffer_info = make_descriptor_buffer_info(buffer, size);
+    auto buffer_info = make_descriptor_buffer_info(buffer, offset, size);
       
     auto write_desc_set = make_write_descriptor_buffer_set(descset,
 							   &buffer_info,
@@ -298,66 +260,6 @@ namespace vulkan {
 
     return api_ok();
   }
-
-  std::optional<buffer_reqs> get_buffer_requirements(const device_resource_properties& resource_props,
-						     VkBufferCreateFlags create_flags,
-						     VkBufferUsageFlags usage_flags,
-						     VkMemoryPropertyFlags memory_property_flags,
-						     VkDeviceSize desired_size) {      
-    std::optional<buffer_reqs> ret;
-
-    int32_t out_property_index;
-    VkDeviceSize out_device_size;
-    
-    if (resource_props.ok()) {
-      
-      VkBuffer dummy = make_buffer(resource_props,
-				   create_flags,
-				   usage_flags,
-				   desired_size);
-      
-      if (H_OK(dummy)) {
-	VkMemoryRequirements req = {};
-	
-	vkGetBufferMemoryRequirements(resource_props.device,
-				      dummy,
-				      &req);
-
-	out_device_size = req.size;
-
-	VkPhysicalDeviceMemoryProperties mem_props = {};
-
-	vkGetPhysicalDeviceMemoryProperties(resource_props.physical_device,
-					    &mem_props);
-	
-	out_property_index =
-	  find_memory_properties(&mem_props,
-				 req.memoryTypeBits,
-				 memory_property_flags);
-	
-	ASSERT(out_property_index != -1);
-
-	
-	if (desired_size <= req.size &&
-	    out_property_index != -1) {
-	  
-	  buffer_reqs r
-	    {
-	     out_device_size,
-	     static_cast<uint32_t>(out_property_index)
-	    };
-
-	  if (r.ok()) {
-	    ret = r;
-	  }
-	}
-
-	vkDestroyBuffer(resource_props.device, dummy, nullptr);
-      }     
-    }
-    
-    return ret;
-  }
   
   void one_shot_command_buffer(const device_resource_properties& properties,
 			       one_shot_command_fn_ok_t f_ok,
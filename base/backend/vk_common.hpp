@@ -72,6 +72,8 @@ namespace vulkan {
       best_fit     // not implemented yet
     };
 
+      // needn't match the swapchain's image count; a frame waits
+      // for whichever submission last drew to the image it acquires
       static inline constexpr uint32_t k_max_frames_in_flight{BASE_VK_SWAPCHAIN_IMAGE_USE_MAX_AVAILABLE};
       
       static inline constexpr uint32_t k_desired_swapchain_image_count{BASE_VK_SWAPCHAIN_IMAGE_USE_MAX_AVAILABLE};
@@ -80,23 +82,71 @@ namespace vulkan {
       
       namespace m_render {
         static inline constexpr bool k_use_frustum_culling{false};
-        static inline constexpr bool k_allow_more_frames_than_fences{false};
+        // re-record each frame's command buffer from the visible set
+        // (see k_use_frustum_culling) instead of replaying the ones
+        // recorded at setup. Each swapchain image gets its own
+        // transient command pool, which is reset as a whole.
+        static inline constexpr bool k_record_command_buffers_per_frame{false};
+        // log the average and worst recording time every
+        // k_record_log_period frames; the static path logs
+        // its one-off recording time at setup.
+        static inline constexpr bool k_log_record_time{true};
+        static inline constexpr uint32_t k_record_log_period{600};
+        // with per frame recording, split the first subpass's draws
+        // into secondary command buffers that are recorded in parallel
+        // on k_record_threads threads (0: one per core). Each buffer
+        // gets a contiguous range of at least k_min_draws_per_chunk
+        // visible objects and the buffers execute in range order, so
+        // what's drawn doesn't depend on thread scheduling.
+        static inline constexpr bool k_record_secondary_parallel{false};
+        static inline constexpr uint32_t k_record_threads{0};
+        static inline constexpr uint32_t k_min_draws_per_chunk{32};
+
+        // cull and build the first subpass's draws on the GPU: a compute
+        // pass tests every model's bounds against the frustum and writes
+        // indirect draws plus a count, which one
+        // vkCmdDrawIndexedIndirectCount consumes. The CPU only uploads
+        // the frustum planes each frame. Needs VK_KHR_draw_indirect_count,
+        // multiDrawIndirect and drawIndirectFirstInstance; the CPU
+        // path is used on devices without them.
+        static inline constexpr bool k_gpu_driven{false};
+        // read each frame's draws back once the GPU is done with them and
+        // compare them with module_geom::frustum's results for the same
+        // planes; spheres within k_cull_validation_epsilon of a plane
+        // can go either way and aren't counted
+        static inline constexpr bool k_validate_gpu_culling{false};
+        static inline constexpr float k_cull_validation_epsilon{1e-4f};
+
+        static_assert(!k_record_secondary_parallel || k_record_command_buffers_per_frame,
+                      "k_record_secondary_parallel requires k_record_command_buffers_per_frame");
+        static_assert(!k_gpu_driven || !k_record_command_buffers_per_frame,
+                      "k_gpu_driven records its command buffers once, at setup");
       }
       namespace m_setup_vertex_buffer {
-        static inline constexpr bool k_use_staging{false};
+        static inline constexpr bool k_use_staging{true};
+      }
+      namespace m_setup_vertex_data {
+        // run each generated mesh through mesh_optimize
+        // (vertex cache, overdraw and vertex fetch ordering)
+        // before it's appended to the vertex buffer
+        static inline constexpr bool k_optimize_meshes{true};
+        // log the simulated ACMR/ATVR before and after optimizing
+        static inline constexpr bool k_log_optimize_report{false};
+        // every .bmesh in here (see mesh_bake.hpp, `make bake`)
+        // is appended after the generated meshes
+        static inline constexpr const char* k_baked_mesh_path{"resources/baked"};
       }
       namespace m_setup {
         static inline constexpr bool k_use_single_pass{true};
       }
+      namespace m_setup_instance_buffer {
+        // instances each command buffer can draw; the ones
+        // beyond this in a frame are dropped
+        static inline constexpr uint32_t k_max_instances{1 << 14};
+      }
       namespace m_select_present_mode {
         static inline constexpr present_mode_select k_select_method{present_mode_select::fifo};
       }
-
-      static_assert((k_max_frames_in_flight == k_desired_swapchain_image_count) ||
-                    m_render::k_allow_more_frames_than_fences,
-                    "invalid frame count configuration; must ensure either of the given conditions hold:\n"
-                    "\tst_config::c_renderer::k_max_frames_in_flight == st_config::c_renderer::k_desired_swapchain_image_count, or\n"
-                    "\tst_config::c_renderer::m_render::k_allow_more_frames_than_fences == true");
     }
 
     namespace c_image_pool {
@@ -110,6 +160,63 @@ namespace vulkan {
         static inline constexpr bool k_always_produce_optimal_images{true};
       }
     }
+    namespace c_uniform_block_pool {
+      // each frame's region of the uniform ring; every block
+      // gets a slot at the same offset within each region.
+      // Rounded up to the device's uniform offset alignment.
+      static inline constexpr VkDeviceSize k_region_size{VkDeviceSize{64} << 10};
+    }
+
+    namespace c_upload {
+      // staging buffer uploads are copied out of a persistently
+      // mapped ring of this size; see vk_upload.hpp
+      static inline constexpr VkDeviceSize k_ring_size{VkDeviceSize{32} << 20};
+      // submit copies on a transfer only queue family when the device
+      // has one, handing the buffers over to the graphics queue.
+      // Otherwise they go through the graphics queue.
+      static inline constexpr bool k_use_transfer_queue{true};
+      // log how much each flush() submitted
+      static inline constexpr bool k_log_flushes{false};
+    }
+
+    namespace c_pipeline_pool {
+      // setup creates its pipelines as parallel jobs on k_threads
+      // threads (0: one per core), each loading its own SPIR-V
+      static inline constexpr bool k_parallel_create{true};
+      static inline constexpr uint32_t k_threads{0};
+    }
+
+    namespace c_pipeline_cache {
+      // pipelines are created against a VkPipelineCache that's
+      // loaded from and saved to k_path (see vk_pipeline_cache.hpp)
+      static inline constexpr bool k_enabled{true};
+      static inline constexpr const char* k_path{"resources/pipeline_cache"};
+      // log how long setup spent creating pipelines, and whether
+      // the cache was warm, to compare cold and warm starts
+      static inline constexpr bool k_log_timing{true};
+    }
+
+    namespace c_gpu_profiler {
+      // time the render pass, its subpasses and the culling dispatch
+      // with timestamp queries (see vk_profiler.hpp)
+      static inline constexpr bool k_enabled{true};
+      // timestamps each command buffer can write
+      static inline constexpr uint32_t k_max_queries{16};
+      // log the average of each scope every k_log_period frames;
+      // 0 doesn't log
+      static inline constexpr uint32_t k_log_period{600};
+    }
+
+    namespace c_device_memory_pool {
+      // the size of each vkAllocateMemory() call the pool makes;
+      // heaps smaller than k_heap_fraction blocks get
+      // blocks of heap size / k_heap_fraction instead.
+      // Requests larger than half a block get a block of their own.
+      static inline constexpr VkDeviceSize k_block_size{VkDeviceSize{64} << 20};
+      static inline constexpr VkDeviceSize k_heap_fraction{8};
+      // log the pool's statistics once the renderer is set up
+      static inline constexpr bool k_log_stats{true};
+    }
   }
 
   
@@ -277,6 +384,7 @@ namespace vulkan {
     VkExtent3D required{UINT32_MAX, UINT32_MAX, UINT32_MAX};
     uint32_t bytes_per_pixel{UINT32_MAX};
     uint32_t memory_type_index{UINT32_MAX};
+    VkDeviceSize alignment{1};
 
     VkDeviceSize memory_size() const {
       ASSERT(ok());
@@ -576,23 +684,19 @@ namespace vulkan {
                                       const VkDescriptorSetLayout* layouts,
                                       uint32_t num_sets);
 
-  void write_device_memory(VkDevice device,
-                           VkDeviceMemory memory,
-                           const void* data,
-                           VkDeviceSize size);
-  
-  VkDeviceMemory make_device_memory(VkDevice device,
-                                    const void* data,
-                                    VkDeviceSize size,
-                                    VkDeviceSize alloc_size,
-                                    uint32_t memory_property_index);
+  // the returned create info points into
+  // resource_props.queue_family_indices
+  VkBufferCreateInfo make_buffer_create_info(const device_resource_properties& resource_props,
+                                             VkBufferCreateFlags create_flags,
+                                             VkBufferUsageFlags usage_flags,
+                                             VkDeviceSize sz);
 
   VkBuffer make_buffer(const device_resource_properties& resource_props,
                        VkBufferCreateFlags create_flags,
                        VkBufferUsageFlags usage_flags,
                        VkDeviceSize sz);
 
-  VkDescriptorBufferInfo make_descriptor_buffer_info(VkBuffer buffer, VkDeviceSize size);
+  VkDescriptorBufferInfo make_descriptor_buffer_info(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
 
   VkWriteDescriptorSet make_write_descriptor_buffer_set(VkDescriptorSet descset,
                                                         const VkDescriptorBufferInfo* buffer_info,
@@ -608,30 +712,13 @@ namespace vulkan {
   
   bool write_descriptor_set(VkDevice device,
                             VkBuffer buffer,
+                            VkDeviceSize offset,
                             VkDeviceSize size,
                             VkDescriptorSet descset,
                             uint32_t binding_index,
                             uint32_t array_element,
                             VkDescriptorType descriptor_type);
 
-  struct buffer_reqs {
-    VkDeviceSize required_size{std::numeric_limits<VkDeviceSize>::max()};
-    uint32_t memory_property_index{UINT32_MAX};
-
-    bool ok() const {
-      return
-        c_assert(required_size > 0) &&
-        c_assert(required_size != std::numeric_limits<VkDeviceSize>::max()) &&
-        c_assert(memory_property_index != UINT32_MAX);
-    }
-  };
-
-  std::optional<buffer_reqs> get_buffer_requirements(const device_resource_properties& resource_props,
-                                                     VkBufferCreateFlags create_flags,
-                                                     VkBufferUsageFlags usage_flags,
-                                                     VkMemoryPropertyFlags memory_property_flags,
-                                                     VkDeviceSize desired_size);
-
   enum class one_shot_command_error
   {
   device_resource_properties,
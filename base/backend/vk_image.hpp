@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vk_common.hpp"
+#include "vk_memory.hpp"
 #include <iostream>
 
 namespace vulkan {
@@ -106,7 +107,7 @@ namespace vulkan {
 
   private:
     struct make_image_data {
-      VkDeviceMemory memory{VK_NULL_HANDLE};
+      device_allocation memory{};
       VkImage handle{VK_NULL_HANDLE};
       VkImageView view_handle{VK_NULL_HANDLE};
       bool memory_bound{false};
@@ -139,7 +140,7 @@ namespace vulkan {
       }
 
       bool ok_memory() const {
-	return c_assert(H_OK(memory));
+	return memory.ok();
       }
 
       bool ok_handle() const {
@@ -151,17 +152,27 @@ namespace vulkan {
       }
       
       make_image_data& make_image_memory() {
-	if (ok_pre() && CA_H_NULL(memory)) {
+	if (ok_pre() &&
+	    c_assert(self->m_memory_pool != nullptr) &&
+	    CA_H_NULL(memory.memory)) {
 	  image_requirements reqs = self->get_image_requirements(*properties, *params);
 
-	  if (reqs.ok()) {	  	  
-	    memory = make_device_memory(properties->device,
-					params->data,
-					params->calc_data_size(),
-					reqs.memory_size(),
-					reqs.memory_type_index);
+	  if (reqs.ok()) {
+	    auto opt_memory =
+	      self->m_memory_pool->allocate(reqs.memory_type_index,
+					    reqs.memory_size(),
+					    reqs.alignment,
+					    to_resource_tiling(params->tiling));
+
+	    if (c_assert(opt_memory.has_value())) {
+	      memory = opt_memory.value();
+
+	      if (params->data != nullptr &&
+		  c_assert(memory.mapped != nullptr)) {
+		memcpy(memory.mapped, params->data, params->calc_data_size());
+	      }
+	    }
 	  }
-
 	}
 
 	return *this;
@@ -183,8 +194,8 @@ namespace vulkan {
 	if (ok_pre() && !memory_bound && ok_handle()) {
 	  VK_FN(vkBindImageMemory(properties->device,
 				  handle,
-				  memory,
-				  0));
+				  memory.memory,
+				  memory.offset));
 	  memory_bound = api_ok();
 	}
 	return *this;
@@ -243,10 +254,8 @@ namespace vulkan {
 	free_device_handle<VkImage,
 			   &vkDestroyImage>(properties->device,
 					    handle);
-	
-	free_device_handle<VkDeviceMemory,
-			   &vkFreeMemory>(properties->device,
-					  memory);
+
+	self->m_memory_pool->free(memory);
       }     
       
       bool ok() const {
@@ -261,7 +270,7 @@ namespace vulkan {
     darray<void*> m_user_ptrs;
     darray<VkImage> m_images;
     darray<VkImageView> m_image_views;
-    darray<VkDeviceMemory> m_device_memories;
+    darray<device_allocation> m_device_memories;
     darray<VkFormat> m_formats;
     darray<VkImageLayout> m_layouts_initial;
     darray<VkImageLayout> m_layouts_final;
@@ -282,25 +291,7 @@ namespace vulkan {
 
     darray<VkImageUsageFlags> m_usage_flags;
 
-    // We will not call vkGetPhysicalDeviceImageFormatProperties()
-    // if g_vk_result is not equal to VK_SUCCESS beforehand. We may as well
-    // consider this a false result, given that at that point something
-    // else that's wrong has happened.
-    bool image_create_info_valid(VkPhysicalDevice physical_device, const VkImageCreateInfo& create_info) const {
-      VkImageFormatProperties properties;
-
-      VK_FN(vkGetPhysicalDeviceImageFormatProperties(physical_device,
-						     create_info.format,
-						     create_info.imageType,
-						     create_info.tiling,
-						     create_info.usage,
-						     create_info.flags,
-						     &properties));
-
-      ASSERT(api_ok());
-
-      return api_ok();
-    }
+    device_memory_pool* m_memory_pool{nullptr};
 
     VkImageCreateInfo make_image_create_info(const device_resource_properties& properties,
 					     const image_gen_params& params) const {
@@ -420,48 +411,27 @@ namespace vulkan {
 
       VkImageCreateInfo create_info = make_image_create_info(properties, params);
 
-      if (image_create_info_valid(properties.physical_device,
-				  create_info)) {
-	
-	VkImage dummy_image{VK_NULL_HANDLE};
-	
-	VK_FN(vkCreateImage(properties.device,
-			    &create_info,
-			    nullptr,
-			    &dummy_image));
-    
-	if (api_ok() && dummy_image != VK_NULL_HANDLE) {
-	  VkMemoryRequirements req = {};
+      // nothing is returned if the device doesn't
+      // support images with these parameters
+      auto opt_req = m_memory_pool->image_requirements(create_info);
 
-	  vkGetImageMemoryRequirements(properties.device,
-				       dummy_image,
-				       &req);
-      
-	  ret.required = calc_minimum_dimensions(params, req);
-      
-	  // find an appropriate memory type index
-	  // for our image that we can base the storage
-	  // off of
-	  {
-	    VkPhysicalDeviceMemoryProperties memory_properties = {};
-      
-	    vkGetPhysicalDeviceMemoryProperties(properties.physical_device,
-						&memory_properties);
+      if (opt_req.has_value()) {
+	const VkMemoryRequirements& req = opt_req.value();
 
-	
-	    int32_t memory_type_index =
-	      find_memory_properties(&memory_properties,
-				     req.memoryTypeBits,
-				     params.memory_property_flags);
-      
-	    ASSERT(memory_type_index != -1);
+	ret.required = calc_minimum_dimensions(params, req);
+	ret.alignment = req.alignment;
 
-	    ret.memory_type_index =
-	      static_cast<uint32_t>(memory_type_index);
-	  }
+	// find an appropriate memory type index
+	// for our image that we can base the storage
+	// off of
+	int32_t memory_type_index =
+	  m_memory_pool->find_memory_type(req.memoryTypeBits,
+					  params.memory_property_flags);
 
-	  vkDestroyImage(properties.device, dummy_image, nullptr);
-	}
+	ASSERT(memory_type_index != -1);
+
+	ret.memory_type_index =
+	  static_cast<uint32_t>(memory_type_index);
       }
 
       ASSERT(ret.ok());
@@ -476,7 +446,7 @@ namespace vulkan {
       m_images.push_back(VK_NULL_HANDLE);
       m_image_views.push_back(VK_NULL_HANDLE);
       
-      m_device_memories.push_back(VK_NULL_HANDLE);
+      m_device_memories.push_back(device_allocation{});
       
       m_formats.push_back(VK_FORMAT_UNDEFINED);
 
@@ -504,18 +474,30 @@ namespace vulkan {
             
       return index;
     } 
+
+    void free_image(VkDevice device, index_type index) {
+      free_device_handle<VkImageView, &vkDestroyImageView>(device, m_image_views[index]);
+      free_device_handle<VkImage, &vkDestroyImage>(device, m_images[index]);
+      m_memory_pool->free(m_device_memories[index]);
+    }
     
   public:
     image_pool()
       : index_traits_this_type(m_user_ptrs)
     {}
 
+    void set_memory_pool(device_memory_pool* p) {
+      if (c_assert(m_memory_pool == nullptr)) {
+	m_memory_pool = p;
+      }
+    }
+
     bool ok_image(index_type index) const {
       bool r =
 	(index < this->length()) &&
 	(m_images.at(index) != VK_NULL_HANDLE) &&
 	(m_image_views.at(index) != VK_NULL_HANDLE) &&
-	(m_device_memories.at(index) != VK_NULL_HANDLE) &&
+	(m_device_memories.at(index).memory != VK_NULL_HANDLE) &&
 	(m_formats.at(index) != VK_FORMAT_UNDEFINED) &&
 	(m_layouts_final.at(index) != VK_IMAGE_LAYOUT_UNDEFINED) &&
 	(m_widths.at(index) != UINT32_MAX) &&
@@ -529,8 +511,13 @@ namespace vulkan {
       return r;
     }
 
+    // If replace is set, the new image takes its index, and the
+    // image that was there is freed; the caller has to know the
+    // GPU is done with it. Attachments that are sized to the
+    // swapchain are remade this way, so their indices stay valid.
     index_type make_image(const device_resource_properties& properties,
-			  const image_gen_params& params) {
+			  const image_gen_params& params,
+			  index_type replace = k_unset) {
       index_type img_index = k_unset;
       
       make_image_data mid{};
@@ -569,7 +556,7 @@ namespace vulkan {
 	  .all();
 	
 	// create dst image
-	// we null out the data ptr since ::make_device_memory()
+	// we null out the data ptr since make_image_memory()
 	// checks for a non-null value, and if it is non-null,
 	// writes the memory to the newly created memory - this is unnecessary.
 	// also we use device local memory here; this is very important.
@@ -669,8 +656,14 @@ namespace vulkan {
 	      
       if (good) {
 	ASSERT(mid_used != nullptr);
-	
-	img_index = new_image();
+
+	if (replace != k_unset && c_assert(ok_image(replace))) {
+	  free_image(properties.device, replace);
+	  img_index = replace;
+	}
+	else {
+	  img_index = new_image();
+	}
 
 	m_user_ptrs[img_index] = params.data;
 	  
@@ -709,9 +702,7 @@ namespace vulkan {
     void free_mem(VkDevice device) {
       for (index_type index{0}; index < length(); ++index) {
 	if (ok_image(index)) {
-	  free_device_handle<VkImageView, &vkDestroyImageView>(device, m_image_views[index]);
-	  free_device_handle<VkImage, &vkDestroyImage>(device, m_images[index]);
-	  free_device_handle<VkDeviceMemory, &vkFreeMemory>(device, m_device_memories[index]);
+	  free_image(device, index);
 	}
       }
 
@@ -927,6 +918,7 @@ namespace vulkan {
       m_descriptor_set_layouts.clear();
       m_descriptor_sets.clear();
       m_descriptor_types.clear();
+      m_descriptor_bindings.clear();
     }
 
     bool ok_descriptor_set(index_type index) const {
@@ -1020,9 +1012,27 @@ namespace vulkan {
 	fmap_end;	
     }
 
+    // dynamic uniform and storage buffers are bound with one
+    // offset per descriptor; this is how many the set takes
+    uint32_t dynamic_offset_count(index_type index) const {
+      uint32_t count = 0;
+      if (ok_descriptor_set(index)) {
+	VkDescriptorType type = m_descriptor_types.at(index);
+
+	if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+	    type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC) {
+	  for (const auto& binding: m_descriptor_bindings.at(index)) {
+	    count += binding.descriptorCount;
+	  }
+	}
+      }
+      return count;
+    }
+
     bool write_buffer(index_type index,
 		      VkDevice device,
 		      VkBuffer buf,
+		      VkDeviceSize buf_offset,
 		      VkDeviceSize buf_size,
 		      uint32_t binding_index,
 		      uint32_t array_element_index) const {
@@ -1030,6 +1040,7 @@ namespace vulkan {
       if (ok_descriptor_set(index)) {
 	r = write_descriptor_set(device,
 				 buf,
+				 buf_offset,
 				 buf_size,
 				 m_descriptor_sets.at(index),
 				 binding_index,
@@ -0,0 +1,630 @@
+#include "vk_memory.hpp"
+
+namespace vulkan {
+  VkMemoryRequirements device_memory_pool::query_buffer_requirements(const VkBufferCreateInfo& create_info,
+									 VkBuffer buffer) const {
+    VkMemoryRequirements ret = {};
+
+#if defined(VK_KHR_maintenance4)
+    if (m_get_device_buffer_requirements != nullptr) {
+      VkDeviceBufferMemoryRequirementsKHR info = {};
+
+      info.sType = VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS_KHR;
+      info.pNext = nullptr;
+      info.pCreateInfo = &create_info;
+
+      VkMemoryRequirements2 req = {};
+
+      req.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+      req.pNext = nullptr;
+
+      m_get_device_buffer_requirements(m_device, &info, &req);
+
+      return req.memoryRequirements;
+    }
+#endif
+
+    if (buffer != VK_NULL_HANDLE) {
+      vkGetBufferMemoryRequirements(m_device,
+				    buffer,
+				    &ret);
+
+      return ret;
+    }
+
+    VkBuffer dummy{VK_NULL_HANDLE};
+
+    VK_FN(vkCreateBuffer(m_device,
+			 &create_info,
+			 nullptr,
+			 &dummy));
+
+    if (H_OK(dummy)) {
+      vkGetBufferMemoryRequirements(m_device,
+				    dummy,
+				    &ret);
+
+      vkDestroyBuffer(m_device, dummy, nullptr);
+    }
+
+    return ret;
+  }
+
+  VkMemoryRequirements device_memory_pool::query_image_requirements(const VkImageCreateInfo& create_info) const {
+    VkMemoryRequirements ret = {};
+
+    // An unsupported configuration (VK_ERROR_FORMAT_NOT_SUPPORTED) is an
+    // answer, not a failure, so this isn't run through VK_FN and doesn't
+    // end up in g_vk_result. Any result other than VK_SUCCESS, or limits
+    // the create info exceeds, return a zero size, which
+    // image_requirements() caches as unsupported.
+    VkImageFormatProperties properties = {};
+
+    VkResult result =
+      vkGetPhysicalDeviceImageFormatProperties(m_physical_device,
+					       create_info.format,
+					       create_info.imageType,
+					       create_info.tiling,
+					       create_info.usage,
+					       create_info.flags,
+					       &properties);
+
+    if (result != VK_SUCCESS &&
+	result != VK_ERROR_FORMAT_NOT_SUPPORTED) {
+      write_logf("vkGetPhysicalDeviceImageFormatProperties -> %" PRId32 "; "
+		 "treating format %" PRId32 " as unsupported\n",
+		 static_cast<int32_t>(result),
+		 static_cast<int32_t>(create_info.format));
+    }
+
+    // the format can be supported while these parameters aren't
+    bool supported =
+      result == VK_SUCCESS &&
+      create_info.extent.width <= properties.maxExtent.width &&
+      create_info.extent.height <= properties.maxExtent.height &&
+      create_info.extent.depth <= properties.maxExtent.depth &&
+      create_info.mipLevels <= properties.maxMipLevels &&
+      create_info.arrayLayers <= properties.maxArrayLayers &&
+      (create_info.samples & properties.sampleCounts) != 0;
+
+    if (supported) {
+#if defined(VK_KHR_maintenance4)
+      if (m_get_device_image_requirements != nullptr) {
+	VkDeviceImageMemoryRequirementsKHR info = {};
+
+	info.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS_KHR;
+	info.pNext = nullptr;
+	info.pCreateInfo = &create_info;
+	info.planeAspect = static_cast<VkImageAspectFlagBits>(0);
+
+	VkMemoryRequirements2 req = {};
+
+	req.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	req.pNext = nullptr;
+
+	m_get_device_image_requirements(m_device, &info, &req);
+
+	return req.memoryRequirements;
+      }
+#endif
+
+      VkImage dummy{VK_NULL_HANDLE};
+
+      VK_FN(vkCreateImage(m_device,
+			  &create_info,
+			  nullptr,
+			  &dummy));
+
+      if (H_OK(dummy)) {
+	vkGetImageMemoryRequirements(m_device,
+				     dummy,
+				     &ret);
+
+	vkDestroyImage(m_device, dummy, nullptr);
+      }
+    }
+
+    return ret;
+  }
+
+  VkDeviceSize device_memory_pool::block_size(uint32_t memory_type) const {
+    namespace config = st_config::c_device_memory_pool;
+
+    uint32_t heap = m_memory_properties.memoryTypes[memory_type].heapIndex;
+    VkDeviceSize heap_size = m_memory_properties.memoryHeaps[heap].size;
+
+    return placement::block_size(heap_size,
+				 config::k_block_size,
+				 config::k_heap_fraction);
+  }
+
+  bool device_memory_pool::host_visible(uint32_t memory_type) const {
+    return
+      (m_memory_properties.memoryTypes[memory_type].propertyFlags &
+       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+  }
+
+  uint32_t device_memory_pool::new_block(uint32_t memory_type,
+					 VkDeviceSize size,
+					 resource_tiling tiling,
+					 bool dedicated) {
+    uint32_t ret = UINT32_MAX;
+
+    VkMemoryAllocateInfo alloc_info = {};
+
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.pNext = nullptr;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+
+    VK_FN(vkAllocateMemory(m_device,
+			   &alloc_info,
+			   nullptr,
+			   &memory));
+
+    void* mapped = nullptr;
+
+    if (H_OK(memory) && host_visible(memory_type)) {
+      VK_FN(vkMapMemory(m_device,
+			memory,
+			0,
+			VK_WHOLE_SIZE,
+			0,
+			&mapped));
+    }
+
+    if (c_assert(H_OK(memory))) {
+      if (!m_unused_blocks.empty()) {
+	ret = m_unused_blocks.back();
+	m_unused_blocks.pop_back();
+      }
+      else {
+	ret = static_cast<uint32_t>(m_blocks.size());
+	m_blocks.emplace_back();
+      }
+
+      block& b = m_blocks[ret];
+
+      b.memory = memory;
+      b.mapped = static_cast<uint8_t*>(mapped);
+      b.allocator.reset(size);
+      b.memory_type = memory_type;
+      b.tiling = tiling;
+      b.dedicated = dedicated;
+    }
+
+    return ret;
+  }
+
+  void device_memory_pool::free_block(uint32_t index) {
+    block& b = m_blocks[index];
+
+    // freeing the memory unmaps it
+    free_device_handle<VkDeviceMemory, &vkFreeMemory>(m_device, b.memory);
+
+    b = block{};
+    m_unused_blocks.push_back(index);
+  }
+
+  // one empty block of each kind is kept around, so that freeing and then
+  // allocating the same resource doesn't go back to the driver each time
+  bool device_memory_pool::keep_empty_block(uint32_t index) const {
+    const block& b = m_blocks[index];
+
+    bool keep = !b.dedicated;
+
+    for (uint32_t i = 0; keep && i < m_blocks.size(); ++i) {
+      const block& other = m_blocks[i];
+
+      keep =
+	i == index ||
+	other.memory == VK_NULL_HANDLE ||
+	!placement::shares_block(other.memory_type,
+				 other.tiling,
+				 other.dedicated,
+				 b.memory_type,
+				 b.tiling) ||
+	!other.allocator.empty();
+    }
+
+    return keep;
+  }
+
+  bool device_memory_pool::init(VkPhysicalDevice physical_device,
+				VkDevice device,
+				bool use_device_queries,
+				const darray<buffer_usage>& buffer_usages) {
+    if (c_assert(m_device == VK_NULL_HANDLE) &&
+	c_assert(physical_device != VK_NULL_HANDLE) &&
+	c_assert(device != VK_NULL_HANDLE)) {
+      VkPhysicalDeviceProperties properties = {};
+
+      vkGetPhysicalDeviceProperties(physical_device, &properties);
+      vkGetPhysicalDeviceMemoryProperties(physical_device, &m_memory_properties);
+
+      m_limits = properties.limits;
+      m_buffer_image_granularity = properties.limits.bufferImageGranularity;
+      m_physical_device = physical_device;
+      m_device = device;
+
+#if defined(VK_KHR_maintenance4)
+      if (use_device_queries) {
+	m_get_device_buffer_requirements =
+	  reinterpret_cast<PFN_vkGetDeviceBufferMemoryRequirementsKHR>(vkGetDeviceProcAddr(device,
+											   "vkGetDeviceBufferMemoryRequirementsKHR"));
+	m_get_device_image_requirements =
+	  reinterpret_cast<PFN_vkGetDeviceImageMemoryRequirementsKHR>(vkGetDeviceProcAddr(device,
+											  "vkGetDeviceImageMemoryRequirementsKHR"));
+      }
+#endif
+
+      for (const buffer_usage& u: buffer_usages) {
+	buffer_key key{};
+
+	key.flags = u.flags;
+	key.usage = u.usage;
+
+	cache_buffer_requirements(key);
+      }
+    }
+
+    return ok();
+  }
+
+  void device_memory_pool::free_mem() {
+    for (uint32_t i = 0; i < m_blocks.size(); ++i) {
+      if (m_blocks[i].memory != VK_NULL_HANDLE) {
+	ASSERT(m_blocks[i].allocator.empty());
+
+	free_device_handle<VkDeviceMemory, &vkFreeMemory>(m_device, m_blocks[i].memory);
+      }
+    }
+
+    m_blocks.clear();
+    m_unused_blocks.clear();
+
+    m_buffer_requirements.clear();
+    m_image_requirements.clear();
+    m_requirements_hits = 0;
+
+#if defined(VK_KHR_maintenance4)
+    m_get_device_buffer_requirements = nullptr;
+    m_get_device_image_requirements = nullptr;
+#endif
+
+    m_physical_device = VK_NULL_HANDLE;
+    m_device = VK_NULL_HANDLE;
+  }
+
+  std::optional<device_allocation> device_memory_pool::allocate(uint32_t memory_type_index,
+								VkDeviceSize size,
+								VkDeviceSize alignment,
+								resource_tiling tiling) {
+    std::optional<device_allocation> ret{};
+
+    if (ok() &&
+	c_assert(memory_type_index < m_memory_properties.memoryTypeCount) &&
+	c_assert(size > 0)) {
+
+      tiling = placement::block_tiling(tiling, m_buffer_image_granularity);
+
+      alignment = std::max(alignment, VkDeviceSize{1});
+
+      VkDeviceSize normal_size = block_size(memory_type_index);
+
+      uint32_t index = UINT32_MAX;
+      tlsf::allocation a{};
+
+      if (placement::dedicated(size, normal_size)) {
+	index = new_block(memory_type_index, size, tiling, true);
+
+	if (index != UINT32_MAX) {
+	  a = m_blocks[index].allocator.allocate(size);
+	}
+      }
+      else {
+	for (uint32_t i = 0; !a.ok() && i < m_blocks.size(); ++i) {
+	  block& b = m_blocks[i];
+
+	  if (b.memory != VK_NULL_HANDLE &&
+	      placement::shares_block(b.memory_type,
+				      b.tiling,
+				      b.dedicated,
+				      memory_type_index,
+				      tiling)) {
+	    a = b.allocator.allocate(size, alignment);
+	    index = i;
+	  }
+	}
+
+	if (!a.ok()) {
+	  index = new_block(memory_type_index, normal_size, tiling, false);
+
+	  if (index != UINT32_MAX) {
+	    a = m_blocks[index].allocator.allocate(size, alignment);
+	  }
+	}
+      }
+
+      if (index != UINT32_MAX && c_assert(a.ok())) {
+	const block& b = m_blocks[index];
+
+	device_allocation d{};
+
+	d.memory = b.memory;
+	d.offset = a.offset;
+	d.size = size;
+	d.mapped = b.mapped != nullptr ? b.mapped + a.offset : nullptr;
+	d.block = index;
+	d.node = a.node;
+
+	ret = d;
+      }
+    }
+
+    return ret;
+  }
+
+  void device_memory_pool::free(device_allocation& allocation) {
+    if (allocation.block != UINT32_MAX &&
+	c_assert(allocation.block < m_blocks.size()) &&
+	c_assert(m_blocks[allocation.block].memory == allocation.memory)) {
+      block& b = m_blocks[allocation.block];
+
+      b.allocator.free(allocation.node);
+
+      if (b.allocator.empty() && !keep_empty_block(allocation.block)) {
+	free_block(allocation.block);
+      }
+    }
+
+    allocation = device_allocation{};
+  }
+
+  bool device_memory_pool::host_coherent(const device_allocation& allocation) const {
+    bool ret = false;
+
+    if (c_assert(allocation.block < m_blocks.size())) {
+      uint32_t memory_type = m_blocks[allocation.block].memory_type;
+
+      ret =
+	(m_memory_properties.memoryTypes[memory_type].propertyFlags &
+	 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    return ret;
+  }
+
+  void device_memory_pool::flush(const device_allocation& allocation,
+				 VkDeviceSize offset,
+				 VkDeviceSize size) const {
+    if (c_assert(allocation.mapped != nullptr) &&
+	c_assert(offset + size <= allocation.size) &&
+	!host_coherent(allocation)) {
+      const block& b = m_blocks[allocation.block];
+
+      VkDeviceSize atom = std::max(m_limits.nonCoherentAtomSize, VkDeviceSize{1});
+
+      VkDeviceSize begin = allocation.offset + offset;
+      VkDeviceSize end = begin + size;
+
+      begin -= begin % atom;
+      end = ((end + atom - 1) / atom) * atom;
+
+      VkMappedMemoryRange range = {};
+
+      range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+      range.pNext = nullptr;
+      range.memory = b.memory;
+      range.offset = begin;
+      range.size = end >= b.allocator.capacity() ? VK_WHOLE_SIZE : end - begin;
+
+      VK_FN(vkFlushMappedMemoryRanges(m_device, 1, &range));
+    }
+  }
+
+  int32_t device_memory_pool::find_memory_type(uint32_t memory_type_bits,
+					       VkMemoryPropertyFlags flags) const {
+    return find_memory_properties(&m_memory_properties,
+				  memory_type_bits,
+				  flags);
+  }
+
+  device_memory_pool::buffer_requirements_map::const_iterator
+  device_memory_pool::cache_buffer_requirements(const buffer_key& key) {
+    // memoryTypeBits and alignment are the same for every
+    // size and sharing mode, so any buffer will do
+    VkBufferCreateInfo create_info = {};
+
+    create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = key.flags;
+    create_info.usage = key.usage;
+    create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    create_info.queueFamilyIndexCount = 0;
+    create_info.pQueueFamilyIndices = nullptr;
+    create_info.size = 1;
+
+    VkMemoryRequirements req = query_buffer_requirements(create_info, VK_NULL_HANDLE);
+
+    auto ret = m_buffer_requirements.cend();
+
+    if (c_assert(req.memoryTypeBits != 0)) {
+      ret = m_buffer_requirements.emplace(key, buffer_memory{ req.alignment, req.memoryTypeBits }).first;
+    }
+
+    return ret;
+  }
+
+  std::optional<VkMemoryRequirements> device_memory_pool::buffer_requirements(const VkBufferCreateInfo& create_info,
+									       VkBuffer buffer) {
+    std::optional<VkMemoryRequirements> ret{};
+
+    if (ok()) {
+      buffer_key key{};
+
+      key.flags = create_info.flags;
+      key.usage = create_info.usage;
+
+      buffer_requirements_map::const_iterator it = m_buffer_requirements.find(key);
+
+      if (it != m_buffer_requirements.cend()) {
+	m_requirements_hits++;
+      }
+      else {
+	write_logf("buffer flags 0x%" PRIx32 ", usage 0x%" PRIx32 " weren't given to init(); "
+		   "querying their requirements now\n",
+		   key.flags,
+		   key.usage);
+
+	it = cache_buffer_requirements(key);
+      }
+
+      if (it != m_buffer_requirements.cend()) {
+	// drivers may pad the size, so it always
+	// comes from a query for this buffer
+	VkMemoryRequirements req = query_buffer_requirements(create_info, buffer);
+
+	if (c_assert(req.size >= create_info.size)) {
+	  req.alignment = it->second.alignment;
+	  req.memoryTypeBits = it->second.memory_type_bits;
+
+	  ret = req;
+	}
+      }
+    }
+
+    return ret;
+  }
+
+  std::optional<VkMemoryRequirements> device_memory_pool::image_requirements(const VkImageCreateInfo& create_info) {
+    std::optional<VkMemoryRequirements> ret{};
+
+    if (ok()) {
+      image_key key{};
+
+      key.flags = create_info.flags;
+      key.type = static_cast<uint32_t>(create_info.imageType);
+      key.format = static_cast<uint32_t>(create_info.format);
+      key.width = create_info.extent.width;
+      key.height = create_info.extent.height;
+      key.depth = create_info.extent.depth;
+      key.mip_levels = create_info.mipLevels;
+      key.array_layers = create_info.arrayLayers;
+      key.samples = static_cast<uint32_t>(create_info.samples);
+      key.tiling = static_cast<uint32_t>(create_info.tiling);
+      key.usage = create_info.usage;
+
+      auto it = m_image_requirements.find(key);
+
+      if (it != m_image_requirements.end()) {
+	m_requirements_hits++;
+      }
+      else if (api_ok()) {
+	it = m_image_requirements.emplace(key, query_image_requirements(create_info)).first;
+      }
+
+      if (it != m_image_requirements.end() && it->second.size > 0) {
+	ret = it->second;
+      }
+    }
+
+    return ret;
+  }
+
+  device_memory_pool::stats device_memory_pool::get_stats() const {
+    stats ret{};
+
+    for (const block& b: m_blocks) {
+      if (b.memory != VK_NULL_HANDLE) {
+	tlsf::stats s = b.allocator.get_stats();
+
+	ret.blocks++;
+
+	if (b.dedicated) {
+	  ret.dedicated_blocks++;
+	}
+
+	ret.allocations += s.allocations;
+	ret.free_ranges += s.free_ranges;
+	ret.reserved += s.capacity;
+	ret.used += s.used;
+	ret.largest_free = std::max(ret.largest_free, s.largest_free);
+      }
+    }
+
+    ret.requirements_cached =
+      static_cast<uint32_t>(m_buffer_requirements.size() + m_image_requirements.size());
+    ret.requirements_hits = m_requirements_hits;
+
+    return ret;
+  }
+
+  void device_memory_pool::print_stats() const {
+    stats s = get_stats();
+
+    write_logf("device memory pool: %" PRIu32 " allocations in %" PRIu32 " blocks (%" PRIu32 " dedicated)\n"
+	       "\treserved = %" PRIu64 " bytes, used = %" PRIu64 " bytes\n"
+	       "\tfree ranges = %" PRIu32 ", largest free range = %" PRIu64 " bytes\n"
+	       "\tbufferImageGranularity = %" PRIu64 "\n"
+	       "\trequirements cached = %" PRIu32 ", cache hits = %" PRIu32 "\n",
+	       s.allocations,
+	       s.blocks,
+	       s.dedicated_blocks,
+	       static_cast<uint64_t>(s.reserved),
+	       static_cast<uint64_t>(s.used),
+	       s.free_ranges,
+	       static_cast<uint64_t>(s.largest_free),
+	       static_cast<uint64_t>(m_buffer_image_granularity),
+	       s.requirements_cached,
+	       s.requirements_hits);
+  }
+
+  std::optional<buffer_reqs> get_buffer_requirements(const device_resource_properties& resource_props,
+						     device_memory_pool& memory_pool,
+						     VkBufferCreateFlags create_flags,
+						     VkBufferUsageFlags usage_flags,
+						     VkMemoryPropertyFlags memory_property_flags,
+						     VkDeviceSize desired_size,
+						     VkBuffer buffer) {
+    std::optional<buffer_reqs> ret;
+
+    if (resource_props.ok()) {
+      auto opt_req =
+	memory_pool.buffer_requirements(make_buffer_create_info(resource_props,
+								create_flags,
+								usage_flags,
+								desired_size),
+					buffer);
+
+      if (c_assert(opt_req.has_value())) {
+	const VkMemoryRequirements& req = opt_req.value();
+
+	int32_t out_property_index =
+	  memory_pool.find_memory_type(req.memoryTypeBits,
+				       memory_property_flags);
+
+	ASSERT(out_property_index != -1);
+
+	if (desired_size <= req.size &&
+	    out_property_index != -1) {
+
+	  buffer_reqs r
+	    {
+	     req.size,
+	     static_cast<uint32_t>(out_property_index),
+	     req.alignment
+	    };
+
+	  if (r.ok()) {
+	    ret = r;
+	  }
+	}
+      }
+    }
+
+    return ret;
+  }
+}
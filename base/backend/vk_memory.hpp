@@ -0,0 +1,271 @@
+#pragma once
+
+#include "vk_common.hpp"
+#include "tlsf.hpp"
+#include "memory_placement.hpp"
+
+#include <unordered_map>
+
+namespace vulkan {
+  //
+  // Device memory sub-allocation.
+  //
+  // vkAllocateMemory() is slow, and drivers only have to support
+  // maxMemoryAllocationCount (commonly 4096) live allocations, so rather
+  // than one allocation per buffer or image, the pool allocates large blocks
+  // per memory type and places resources inside them with a tlsf allocator.
+  //
+  // Host visible blocks are mapped once, for their whole lifetime;
+  // device_allocation::mapped points at the allocation's first byte.
+  // Memory shared between resources can't be mapped more than once,
+  // so callers write through that pointer instead of vkMapMemory().
+  //
+  // bufferImageGranularity: a linear resource (a buffer, or a linearly
+  // tiled image) and an optimally tiled image that are closer than the
+  // granularity alias each other on some hardware. When the device reports
+  // a granularity above 1 the two kinds of resource get separate blocks,
+  // which keeps them apart without padding every allocation. The placement
+  // rules themselves live in memory_placement.hpp.
+  //
+  // The pool also answers memory requirement queries. A buffer's
+  // memoryTypeBits and alignment only depend on its create flags and usage
+  // (the spec guarantees this), so those are queried once per combination,
+  // up front in init(). Its size isn't guaranteed to be anything but at
+  // least the requested size - drivers may pad it - so that's asked for
+  // every buffer. Images are cached by all of their creation parameters,
+  // the first time each is seen. Queries go through
+  // vkGetDevice*MemoryRequirements (VK_KHR_maintenance4) when the
+  // device has it; otherwise through the buffer being bound, or
+  // a throwaway buffer or image.
+  //
+  static inline resource_tiling to_resource_tiling(VkImageTiling tiling) {
+    return tiling == VK_IMAGE_TILING_OPTIMAL
+      ? resource_tiling::optimal
+      : resource_tiling::linear;
+  }
+
+  struct device_allocation {
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    VkDeviceSize offset{0};
+    VkDeviceSize size{0};
+
+    // nullptr unless the memory type is host visible
+    void* mapped{nullptr};
+
+    uint32_t block{UINT32_MAX};
+    uint32_t node{UINT32_MAX};
+
+    bool ok() const {
+      return
+	c_assert(H_OK(memory)) &&
+	c_assert(block != UINT32_MAX);
+    }
+  };
+
+  class device_memory_pool {
+  public:
+    struct stats {
+      uint32_t blocks{0}; // live vkAllocateMemory() allocations
+      uint32_t dedicated_blocks{0};
+      uint32_t allocations{0};
+      uint32_t free_ranges{0};
+      VkDeviceSize reserved{0}; // sum of block sizes
+      VkDeviceSize used{0};
+      VkDeviceSize largest_free{0};
+      uint32_t requirements_cached{0};
+      uint32_t requirements_hits{0};
+    };
+
+  private:
+    struct block {
+      VkDeviceMemory memory{VK_NULL_HANDLE};
+      uint8_t* mapped{nullptr};
+      tlsf allocator{};
+      uint32_t memory_type{UINT32_MAX};
+      resource_tiling tiling{resource_tiling::linear};
+      bool dedicated{false};
+    };
+
+    // the parameters that memory requirements depend on; all 32
+    // bit fields so that there's no padding to hash or compare.
+    // A buffer's size isn't part of its key; see buffer_requirements()
+    struct buffer_key {
+      uint32_t flags;
+      uint32_t usage;
+    };
+
+    struct image_key {
+      uint32_t flags;
+      uint32_t type;
+      uint32_t format;
+      uint32_t width;
+      uint32_t height;
+      uint32_t depth;
+      uint32_t mip_levels;
+      uint32_t array_layers;
+      uint32_t samples;
+      uint32_t tiling;
+      uint32_t usage;
+    };
+
+    template <class keyType>
+    struct key_bits_hash {
+      size_t operator()(const keyType& k) const {
+        // FNV-1a
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&k);
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(keyType); ++i) {
+          h ^= bytes[i];
+          h *= 1099511628211ull;
+        }
+        return static_cast<size_t>(h);
+      }
+    };
+
+    template <class keyType>
+    struct key_bits_equal {
+      bool operator()(const keyType& a, const keyType& b) const {
+        return memcmp(&a, &b, sizeof(keyType)) == 0;
+      }
+    };
+
+    template <class keyType, class valueType>
+    using requirements_map = std::unordered_map<keyType,
+                                                valueType,
+                                                key_bits_hash<keyType>,
+                                                key_bits_equal<keyType>>;
+
+    // what's shared by every buffer with the same key
+    struct buffer_memory {
+      VkDeviceSize alignment;
+      uint32_t memory_type_bits;
+    };
+
+    using buffer_requirements_map = requirements_map<buffer_key, buffer_memory>;
+
+    VkPhysicalDevice m_physical_device{VK_NULL_HANDLE};
+    VkDevice m_device{VK_NULL_HANDLE};
+
+    VkPhysicalDeviceMemoryProperties m_memory_properties{};
+    VkPhysicalDeviceLimits m_limits{};
+    VkDeviceSize m_buffer_image_granularity{1};
+
+    darray<block> m_blocks{};
+    darray<uint32_t> m_unused_blocks{};
+
+    // a size of 0 records an image configuration
+    // the device doesn't support
+    buffer_requirements_map m_buffer_requirements{};
+    requirements_map<image_key, VkMemoryRequirements> m_image_requirements{};
+    uint32_t m_requirements_hits{0};
+
+#if defined(VK_KHR_maintenance4)
+    PFN_vkGetDeviceBufferMemoryRequirementsKHR m_get_device_buffer_requirements{nullptr};
+    PFN_vkGetDeviceImageMemoryRequirementsKHR m_get_device_image_requirements{nullptr};
+#endif
+
+    // buffer may be null; it's only used without VK_KHR_maintenance4,
+    // and a throwaway buffer is made from create_info if it's null
+    VkMemoryRequirements query_buffer_requirements(const VkBufferCreateInfo& create_info,
+						   VkBuffer buffer) const;
+
+    buffer_requirements_map::const_iterator cache_buffer_requirements(const buffer_key& key);
+
+    VkMemoryRequirements query_image_requirements(const VkImageCreateInfo& create_info) const;
+
+    VkDeviceSize block_size(uint32_t memory_type) const;
+
+    bool host_visible(uint32_t memory_type) const;
+
+    uint32_t new_block(uint32_t memory_type,
+		       VkDeviceSize size,
+		       resource_tiling tiling,
+		       bool dedicated);
+
+    void free_block(uint32_t index);
+
+    bool keep_empty_block(uint32_t index) const;
+
+  public:
+    struct buffer_usage {
+      VkBufferCreateFlags flags;
+      VkBufferUsageFlags usage;
+    };
+
+    // use_device_queries is set if the device was
+    // created with VK_KHR_maintenance4 enabled.
+    // The requirements of every buffer_usage are queried here;
+    // others still work, but are queried the first time they're seen
+    bool init(VkPhysicalDevice physical_device,
+	      VkDevice device,
+	      bool use_device_queries,
+	      const darray<buffer_usage>& buffer_usages);
+
+    // every allocation has to be released first
+    void free_mem();
+
+    bool ok() const {
+      return c_assert(m_device != VK_NULL_HANDLE);
+    }
+
+    std::optional<device_allocation> allocate(uint32_t memory_type_index,
+					      VkDeviceSize size,
+					      VkDeviceSize alignment,
+					      resource_tiling tiling);
+
+    // resets the allocation; a null allocation is ignored
+    void free(device_allocation& allocation);
+
+    // makes host writes to [offset, offset + size) of a mapped allocation
+    // visible to the device. Host coherent memory doesn't need this,
+    // so it's a no-op there; otherwise the range is widened to
+    // nonCoherentAtomSize, which allocations that get flushed
+    // should be aligned to.
+    void flush(const device_allocation& allocation,
+	       VkDeviceSize offset,
+	       VkDeviceSize size) const;
+
+    bool host_coherent(const device_allocation& allocation) const;
+
+    const VkPhysicalDeviceLimits& limits() const {
+      return m_limits;
+    }
+
+    // -1 if no memory type in memory_type_bits has all of the flags
+    int32_t find_memory_type(uint32_t memory_type_bits, VkMemoryPropertyFlags flags) const;
+
+    // memoryTypeBits and alignment come from the cache. The size is
+    // queried: pass the buffer that was created with create_info, so that
+    // devices without VK_KHR_maintenance4 don't need a throwaway one
+    std::optional<VkMemoryRequirements> buffer_requirements(const VkBufferCreateInfo& create_info,
+							    VkBuffer buffer = VK_NULL_HANDLE);
+
+    // empty if the device doesn't support images created with create_info
+    std::optional<VkMemoryRequirements> image_requirements(const VkImageCreateInfo& create_info);
+
+    stats get_stats() const;
+
+    void print_stats() const;
+  };
+
+  struct buffer_reqs {
+    VkDeviceSize required_size{std::numeric_limits<VkDeviceSize>::max()};
+    uint32_t memory_property_index{UINT32_MAX};
+    VkDeviceSize alignment{1};
+
+    bool ok() const {
+      return
+        c_assert(required_size > 0) &&
+        c_assert(required_size != std::numeric_limits<VkDeviceSize>::max()) &&
+        c_assert(memory_property_index != UINT32_MAX);
+    }
+  };
+
+  std::optional<buffer_reqs> get_buffer_requirements(const device_resource_properties& resource_props,
+                                                     device_memory_pool& memory_pool,
+                                                     VkBufferCreateFlags create_flags,
+                                                     VkBufferUsageFlags usage_flags,
+                                                     VkMemoryPropertyFlags memory_property_flags,
+                                                     VkDeviceSize desired_size,
+                                                     VkBuffer buffer = VK_NULL_HANDLE);
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "vk_common.hpp"
+#include "mesh_optimize.hpp"
+#include "primitives.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -157,141 +159,53 @@ namespace vulkan {
       return *this;
     }
 
-    mesh_builder& sphere() {
-      mesh_builder tmp{};      
+    // Appends a compile time table (see primitives.hpp)
+    // with a single copy; its white vertex colors become
+    // the builder's color.
+    template <size_t N>
+    mesh_builder& table(const primitives::table<primitives::vulkan_vertex, N>& t) {
+      static_assert(sizeof(vertex_data) == sizeof(primitives::vulkan_vertex));
       
-      real_t step = 0.33333333333f;
-
-      auto cart = [](real_t phi, real_t theta) -> vec3_t {
-		    vec3_t ret;
-		    ret.x = glm::cos(theta) * glm::cos(phi);
-		    ret.y = glm::sin(phi);
-		    ret.z = glm::sin(theta) * glm::cos(phi);
-		    return ret;
-		  };
-
-      for (real_t phi = -glm::half_pi<real_t>(); phi <= glm::half_pi<real_t>(); phi += step) {
-	for (real_t theta = 0.0f; theta <= glm::two_pi<real_t>(); theta += step) {
-	  auto bl = cart(phi, theta); 
-	  auto br = cart(phi, theta + step);
-	  auto tr = cart(phi + step, theta + step);
-	  auto tl = cart(phi + step, theta);
-
-	  // upper triangle
-	  tmp.triangle(// positions
-		       tl,  
-		       tr,
-		       br,
-		       // texture coordinates
-		       k_tc_tl,
-		       k_tc_tr,
-		       k_tc_br,
-		       // colors
-		       color,
-		       color,
-		       color,
-		       // normals
-		       tl,
-		       br,
-		       bl);
+      size_t first = vertices.size();
+      
+      vertices.resize(first + N);
+      memcpy(&vertices[first], t.data(), sizeof(vertex_data) * N);
 
-	  // lower triangle
-	  tmp.triangle(// positions
-		       tl,  
-		       br,
-		       bl,
-		       // texture coordinates
-		       k_tc_tl,
-		       k_tc_br,
-		       k_tc_bl,
-		       // colors
-		       color,
-		       color,
-		       color,
-		       // normals
-		       tl,
-		       br,
-		       bl);
+      if (color != vec3_t{R(1.0)}) {
+	for (size_t i = first; i < vertices.size(); ++i) {
+	  vertices[i].color = color;
 	}
       }
-
-      vertices = vertices + tmp.vertices;
       
       return *this;
     }
     
+    mesh_builder& sphere() {
+      return table(primitives::k_vulkan_sphere);
+    }
+    
     mesh_builder& quad() {
-      mesh_builder tmp{};
-
-      // flip first triangle to top,
-      // since initially it will be
-      // the lower half by default
-      
-      tmp
-	.forward(*this)
-	.triangle();
-
-      // HACK: in place modify;
-      // this should be done using a protocol
-      // of some kind that makes mapping easier,
-      // but for now it's less of an issue.
-
-      tmp.vertices[1].position.y = R(k_tri_ps);
-      tmp.vertices[1].st.y = R(0);
-      tmp.vertices[2].position.x = R(k_tri_ps);
-      tmp.vertices[2].st.x = R(1);
-
-      // second triangle;
-      // we let this remain as is
-      tmp
-	.triangle();
-
-      vertices = vertices + tmp.vertices;
-      
-      return *this;
+      return table(primitives::k_vulkan_quad);
     }
 
+    // each face is a quad, turned and moved into place
     mesh_builder& cube() {
-      mesh_builder tmp;
+      return table(primitives::k_vulkan_cube);
+    }
 
-      tmp
-	.set_color(color)
-	// left face
-	.quad()
-	.with_rotate(R3v(0, 1, 0), // axis
-		     glm::half_pi<real_t>())
-	.with_translate(R3v(-1, 0, 0))
-	.push()
-	// right face
-	.quad()
-	.with_rotate(R3v(0, 1, 0), // axis
-		     glm::half_pi<real_t>())
-	.with_translate(R3v(1, 0, 0))
-	.push()
-	// up face
-	.quad()
-	.with_rotate(R3v(1, 0, 0),
-		     -glm::half_pi<real_t>())
-	.with_translate(R3v(0, 1, 0))
-	.push()
-	// down face
-	.quad()
-	.with_rotate(R3v(1, 0, 0),
-		     glm::half_pi<real_t>())
-	.with_translate(R3v(0, -1, 0))
-	.push()
-	// front face
-	.quad()
-	.with_translate(R3v(0, 0, 1))
-	.push()
-	// back face
-	.quad()
-	.with_translate(R3v(0, 0, -1))
-	.push()
-	// 
-	.flatten();
+    // Appends an imported mesh (see mesh_import.hpp) as a triangle list;
+    // its vertex colors are modulated by the builder's color.
+    mesh_builder& mesh(const mesh_optimize::indexed_mesh<::vertex>& m) {
+      vertices.reserve(vertices.size() + m.indices.size());
       
-      vertices = vertices + tmp.vertices;
+      for (mesh_optimize::index_t i: m.indices) {
+	const ::vertex& v = m.vertices[i];
+	
+	vertices.push_back({ v.position,
+			     v.uv,
+			     vec3_t{v.color} * color,
+			     v.normal });
+      }
       
       return *this;
     }
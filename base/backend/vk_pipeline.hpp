@@ -2,6 +2,7 @@
 
 #include "vk_common.hpp"
 #include "vk_image.hpp"
+#include "parallel.hpp"
 
 #include <iostream>
 
@@ -103,8 +104,9 @@ namespace vulkan {
   };
   
   struct pipeline_gen_params {
+    // the viewport and scissor are dynamic, and set to the
+    // swapchain's extent by whatever records the draws
     VkRenderPass render_pass{VK_NULL_HANDLE};
-    VkExtent2D viewport_extent{};
     
     std::string vert_spv_path{};
     std::string frag_spv_path{};
@@ -112,6 +114,14 @@ namespace vulkan {
     pipeline_layout_pool::index_type pipeline_layout_index{pipeline_layout_pool::k_unset};
 
     uint32_t subpass_index{UINT32_MAX};
+
+    // vertex_data's layout is used if these are left empty
+    darray<VkVertexInputAttributeDescription> vertex_attributes{};
+    uint32_t vertex_stride{0};
+
+    VkPrimitiveTopology topology{VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+
+    bool depth_write{true};
     
     bool ok() const {
       bool r =
@@ -119,12 +129,25 @@ namespace vulkan {
 	c_assert(!frag_spv_path.empty()) &&
 	c_assert(H_OK(render_pass)) &&
 	c_assert(pipeline_layout_index != pipeline_layout_pool::k_unset) &&
-	c_assert(subpass_index != UINT32_MAX);
+	c_assert(subpass_index != UINT32_MAX) &&
+	c_assert(vertex_attributes.empty() == (vertex_stride == 0));
 	
       return r;
     }
   };
 
+  struct compute_pipeline_gen_params {
+    std::string comp_spv_path{};
+
+    pipeline_layout_pool::index_type pipeline_layout_index{pipeline_layout_pool::k_unset};
+
+    bool ok() const {
+      return
+	c_assert(!comp_spv_path.empty()) &&
+	c_assert(pipeline_layout_index != pipeline_layout_pool::k_unset);
+    }
+  };
+
   class pipeline_pool : index_traits<int16_t,
 				     darray<VkPipeline>> {
   public:
@@ -136,6 +159,9 @@ namespace vulkan {
     darray<pipeline_layout_pool::index_type> m_pipeline_layouts;
 
     pipeline_layout_pool* m_pipeline_layout_pool{nullptr};
+
+    // optional
+    VkPipelineCache m_pipeline_cache{VK_NULL_HANDLE};
     
     index_type new_pipeline() {
       index_type index{this->length()};
@@ -146,21 +172,37 @@ namespace vulkan {
       return index;
     }
 
-    VkShaderModule make_shader_module(const device_resource_properties& properties,
-				      darray<uint8_t> spv_code) const {
-      VkShaderModule ret{VK_NULL_HANDLE};
+    // reads a SPIR-V file and makes a module of it; like
+    // create_graphics_pipeline(), safe to call from any thread
+    static VkResult make_shader_module(const device_resource_properties& properties,
+				       const std::string& spv_path,
+				       VkShaderModule& module) {
+      module = VK_NULL_HANDLE;
+      
+      darray<uint8_t> spv_code = read_file(spv_path);
 
-      if (api_ok()) {
+      VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+      
+      if (!spv_code.empty() && (spv_code.size() % sizeof(uint32_t)) == 0) {
 	VkShaderModuleCreateInfo create_info = {};
 
 	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	create_info.codeSize = spv_code.size();
 	create_info.pCode = reinterpret_cast<uint32_t*>(spv_code.data());
       
-	VK_FN(vkCreateShaderModule(properties.device, &create_info, nullptr, &ret));
+	result = vkCreateShaderModule(properties.device, &create_info, nullptr, &module);
       }
 
-      return ret;
+      return result;
+    }
+
+    // free_device_handle() waits for the device to go idle,
+    // which isn't something worker threads can do
+    static void destroy_shader_module(VkDevice device, VkShaderModule& module) {
+      if (module != VK_NULL_HANDLE) {
+	vkDestroyShaderModule(device, module, nullptr);
+	module = VK_NULL_HANDLE;
+      }
     }
     
   public:
@@ -174,6 +216,10 @@ namespace vulkan {
       }
     }
     
+    void set_pipeline_cache(VkPipelineCache cache) {
+      m_pipeline_cache = cache;
+    }
+    
     void free_mem(VkDevice device) {
       for (VkPipeline& pipeline: m_pipelines) {
 	free_device_handle<VkPipeline, &vkDestroyPipeline>(device, pipeline);
@@ -194,164 +240,289 @@ namespace vulkan {
       return r;
     }
 
-    index_type make_pipeline(const device_resource_properties& properties,
-			     const pipeline_gen_params& params) {
-      index_type pipeline_index{k_unset};
+    // the attributes used when a pipeline_gen_params doesn't give any
+    static darray<VkVertexInputAttributeDescription> vertex_data_attributes() {
+      VkVertexInputAttributeDescription iad_position = {};
+      iad_position.location = 0;
+      iad_position.binding = 0;
+      iad_position.format = VK_FORMAT_R32G32B32_SFLOAT;
+      iad_position.offset = offsetof(vertex_data, position);
+
+      VkVertexInputAttributeDescription iad_texture = {};
+      iad_texture.location = 1;
+      iad_texture.binding = 0;
+      iad_texture.format = VK_FORMAT_R32G32_SFLOAT;
+      iad_texture.offset = offsetof(vertex_data, st);
+
+      VkVertexInputAttributeDescription iad_color = {};
+      iad_color.location = 2;
+      iad_color.binding = 0;
+      iad_color.format = VK_FORMAT_R32G32B32_SFLOAT;
+      iad_color.offset = offsetof(vertex_data, color);
+
+      VkVertexInputAttributeDescription iad_normal = {};
+      iad_normal.location = 3;
+      iad_normal.binding = 0;
+      iad_normal.format = VK_FORMAT_R32G32B32_SFLOAT;
+      iad_normal.offset = offsetof(vertex_data, normal);
+
+      return
+	{
+	 iad_position,
+	 iad_texture,
+	 iad_color,
+	 iad_normal
+	};
+    }
 
-      if (c_assert(m_pipeline_layout_pool != nullptr) &&
-	  properties.ok() &&
-	  params.ok()) {
+    // Only touches its arguments and the device, so any number of
+    // these can run at once: vkCreateShaderModule() and
+    // vkCreateGraphicsPipelines() are free threaded, and a pipeline
+    // cache synchronizes itself. Errors are returned rather
+    // than put through VK_FN.
+    static VkResult create_graphics_pipeline(const device_resource_properties& properties,
+					     const pipeline_gen_params& params,
+					     VkPipelineLayout layout,
+					     VkPipelineCache cache,
+					     VkPipeline& pl_object) {
+      pl_object = VK_NULL_HANDLE;
+      
+      //
+      // create shader programs
+      // 
+      VkShaderModule vshader_module{VK_NULL_HANDLE};
+      VkShaderModule fshader_module{VK_NULL_HANDLE};
 
-	std::cout << "BEGIN PIPELINE CREATION FOR " << params.vert_spv_path << ", " << params.frag_spv_path << std::endl; 
-	
-	VkPipeline pl_object{VK_NULL_HANDLE};
+      VkResult result = make_shader_module(properties, params.vert_spv_path, vshader_module);
 
-	//
-	// create shader programs
-	// 
-	auto spv_vshader = read_file(params.vert_spv_path);
-	auto spv_fshader = read_file(params.frag_spv_path);
-		
-	ASSERT(!spv_vshader.empty());
-	ASSERT(!spv_fshader.empty());
-	
-	VkShaderModule vshader_module = make_shader_module(properties, spv_vshader);
-	VkShaderModule fshader_module = make_shader_module(properties, spv_fshader);
-
-	ASSERT(vshader_module != VK_NULL_HANDLE);
-	ASSERT(fshader_module != VK_NULL_HANDLE);
-
-	VkPipelineShaderStageCreateInfo vshader_create = {};
-	vshader_create.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vshader_create.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vshader_create.module = vshader_module;
-	vshader_create.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fshader_create = {};
-	fshader_create.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fshader_create.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fshader_create.module = fshader_module;
-	fshader_create.pName = "main";
-
-	std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages =
-	  {
-	   vshader_create,
-	   fshader_create
-	  };
-
-	auto vertex_input_state = default_vertex_input_state_settings();
-
-	VkVertexInputAttributeDescription iad_position = {};
-	iad_position.location = 0;
-	iad_position.binding = 0;
-	iad_position.format = VK_FORMAT_R32G32B32_SFLOAT;
-	iad_position.offset = offsetof(vertex_data, position);
-
-	VkVertexInputAttributeDescription iad_texture = {};
-	iad_texture.location = 1;
-	iad_texture.binding = 0;
-	iad_texture.format = VK_FORMAT_R32G32_SFLOAT;
-	iad_texture.offset = offsetof(vertex_data, st);
-
-	VkVertexInputAttributeDescription iad_color = {};
-	iad_color.location = 2;
-	iad_color.binding = 0;
-	iad_color.format = VK_FORMAT_R32G32B32_SFLOAT;
-	iad_color.offset = offsetof(vertex_data, color);
-
-	VkVertexInputAttributeDescription iad_normal = {};
-	iad_normal.location = 3;
-	iad_normal.binding = 0;
-	iad_normal.format = VK_FORMAT_R32G32B32_SFLOAT;
-	iad_normal.offset = offsetof(vertex_data, normal);
-	
-	darray<VkVertexInputAttributeDescription> input_attrs =
-	  {
-	   iad_position,
-	   iad_texture,
-	   iad_color,
-	   iad_normal
-	  };
-
-	vertex_input_state.vertexAttributeDescriptionCount = input_attrs.size();
-	vertex_input_state.pVertexAttributeDescriptions = input_attrs.data();
+      if (result == VK_SUCCESS) {
+	result = make_shader_module(properties, params.frag_spv_path, fshader_module);
+      }
+
+      if (result != VK_SUCCESS) {
+	destroy_shader_module(properties.device, vshader_module);
+	return result;
+      }
+
+      VkPipelineShaderStageCreateInfo vshader_create = {};
+      vshader_create.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      vshader_create.stage = VK_SHADER_STAGE_VERTEX_BIT;
+      vshader_create.module = vshader_module;
+      vshader_create.pName = "main";
+
+      VkPipelineShaderStageCreateInfo fshader_create = {};
+      fshader_create.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      fshader_create.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+      fshader_create.module = fshader_module;
+      fshader_create.pName = "main";
+
+      std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages =
+	{
+	 vshader_create,
+	 fshader_create
+	};
+
+      auto vertex_input_state = default_vertex_input_state_settings();
+
+      darray<VkVertexInputAttributeDescription> input_attrs =
+	params.vertex_attributes.empty()
+	? vertex_data_attributes()
+	: params.vertex_attributes;
+
+      vertex_input_state.vertexAttributeDescriptionCount = input_attrs.size();
+      vertex_input_state.pVertexAttributeDescriptions = input_attrs.data();
 	
-	VkVertexInputBindingDescription ibd = {};
-	ibd.binding = 0;
-	ibd.stride = sizeof(vertex_data);
-	ibd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+      VkVertexInputBindingDescription ibd = {};
+      ibd.binding = 0;
+      ibd.stride = params.vertex_stride != 0 ? params.vertex_stride : sizeof(vertex_data);
+      ibd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-	vertex_input_state.vertexBindingDescriptionCount = 1;
-	vertex_input_state.pVertexBindingDescriptions = &ibd;
+      vertex_input_state.vertexBindingDescriptionCount = 1;
+      vertex_input_state.pVertexBindingDescriptions = &ibd;
 		
-	auto input_assembly_state = default_input_assembly_state_settings();
+      auto input_assembly_state = default_input_assembly_state_settings();
+      input_assembly_state.topology = params.topology;
 	
-	auto viewport = make_viewport(R2(0), params.viewport_extent, 0.0f, 1.0f);
+      // set when the command buffer is recorded, so
+      // that pipelines outlive swapchain recreation
+      auto viewport_state = default_viewport_state_settings();
+      viewport_state.viewportCount = 1;
+      viewport_state.pViewports = nullptr;
+      viewport_state.scissorCount = 1;
+      viewport_state.pScissors = nullptr;
+
+      std::array<VkDynamicState, 2> dynamic_states =
+	{
+	 VK_DYNAMIC_STATE_VIEWPORT,
+	 VK_DYNAMIC_STATE_SCISSOR
+	};
+
+      VkPipelineDynamicStateCreateInfo dynamic_state = {};
+      dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+      dynamic_state.pNext = nullptr;
+      dynamic_state.flags = 0;
+      dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+      dynamic_state.pDynamicStates = dynamic_states.data();
+
+      auto rasterization_state = default_rasterization_state_settings();
+      auto multisample_state = default_multisample_state_settings();
 	
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = params.viewport_extent;
-
-	auto viewport_state = default_viewport_state_settings();
-	viewport_state.viewportCount = 1;
-	viewport_state.pViewports = &viewport;
-	viewport_state.scissorCount = 1;
-	viewport_state.pScissors = &scissor;
-
-	auto rasterization_state = default_rasterization_state_settings();
-	auto multisample_state = default_multisample_state_settings();
+      auto color_blend_attach_state = default_color_blend_attach_state_settings();
+      auto color_blend_state = default_color_blend_state_settings();
+      color_blend_state.attachmentCount = 1;
+      color_blend_state.pAttachments = &color_blend_attach_state;
 	
-	auto color_blend_attach_state = default_color_blend_attach_state_settings();
-	auto color_blend_state = default_color_blend_state_settings();
-	color_blend_state.attachmentCount = 1;
-	color_blend_state.pAttachments = &color_blend_attach_state;
+
+      VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {};
+      depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+      depth_stencil_state.pNext = nullptr;
+      depth_stencil_state.flags = 0;
+      depth_stencil_state.depthTestEnable = VK_TRUE;
+      depth_stencil_state.depthWriteEnable = params.depth_write ? VK_TRUE : VK_FALSE;
+      depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
+      depth_stencil_state.depthBoundsTestEnable = VK_FALSE;
+      depth_stencil_state.stencilTestEnable = VK_FALSE;
+      depth_stencil_state.minDepthBounds = 0.0f;
+      depth_stencil_state.maxDepthBounds = 1.0f;
+      depth_stencil_state.front = default_stencilop_state();
+      depth_stencil_state.back = default_stencilop_state();
 	
+      VkGraphicsPipelineCreateInfo pipeline_info = {};
+      pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+      pipeline_info.stageCount = 2;
+      pipeline_info.pStages = shader_stages.data();
+      pipeline_info.pVertexInputState = &vertex_input_state;
+      pipeline_info.pInputAssemblyState = &input_assembly_state;
+      pipeline_info.pViewportState = &viewport_state;
+      pipeline_info.pRasterizationState = &rasterization_state;
+      pipeline_info.pMultisampleState = &multisample_state;
+      pipeline_info.pDepthStencilState = &depth_stencil_state;
+      pipeline_info.pColorBlendState = &color_blend_state;
+      pipeline_info.pDynamicState = &dynamic_state;
+      pipeline_info.layout = layout;
+      pipeline_info.renderPass = params.render_pass;
+      pipeline_info.subpass = params.subpass_index;
+      pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+      pipeline_info.basePipelineIndex = -1;
+
+      result = vkCreateGraphicsPipelines(properties.device,
+					 cache,
+					 1,
+					 &pipeline_info,
+					 nullptr,
+					 &pl_object);
+
+      destroy_shader_module(properties.device, vshader_module);
+      destroy_shader_module(properties.device, fshader_module);
+
+      return result;
+    }
+
+    index_type make_pipeline(const device_resource_properties& properties,
+			     const pipeline_gen_params& params) {
+      return make_pipelines(properties, { params }).at(0);
+    }
+
+    // Creates a pipeline for each of params, as parallel jobs on
+    // workers if it's given. Returns once every job has finished,
+    // with the indices in the same order as params; a pipeline
+    // that couldn't be created gets k_unset.
+    darray<index_type> make_pipelines(const device_resource_properties& properties,
+				      const darray<pipeline_gen_params>& params,
+				      worker_pool* workers = nullptr) {
+      darray<index_type> indices(params.size(), k_unset);
+
+      bool good =
+	c_assert(m_pipeline_layout_pool != nullptr) &&
+	properties.ok();
+
+      // layouts are looked up here, since the
+      // layout pool isn't meant for other threads
+      darray<VkPipelineLayout> layouts(params.size(), VK_NULL_HANDLE);
+      
+      for (size_t i = 0; i < params.size() && good; ++i) {
+	good = params[i].ok();
 
-	VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {};
-	depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depth_stencil_state.pNext = nullptr;
-	depth_stencil_state.flags = 0;
-	depth_stencil_state.depthTestEnable = VK_TRUE;
-	depth_stencil_state.depthWriteEnable = VK_TRUE;
-	depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
-	depth_stencil_state.depthBoundsTestEnable = VK_FALSE;
-	depth_stencil_state.stencilTestEnable = VK_FALSE;
-	depth_stencil_state.minDepthBounds = 0.0f;
-	depth_stencil_state.maxDepthBounds = 1.0f;
-	depth_stencil_state.front = default_stencilop_state();
-	depth_stencil_state.back = default_stencilop_state();
+	if (good) {
+	  layouts[i] = m_pipeline_layout_pool->pipeline_layout(params[i].pipeline_layout_index);
+	  good = c_assert(layouts[i] != VK_NULL_HANDLE);
+	}
+      }
+
+      if (good) {
+	darray<VkResult> results(params.size(), VK_SUCCESS);
+	darray<VkPipeline> pipelines(params.size(), VK_NULL_HANDLE);
 	
-	VkGraphicsPipelineCreateInfo pipeline_info = {};
-	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipeline_info.stageCount = 2;
-	pipeline_info.pStages = shader_stages.data();
-	pipeline_info.pVertexInputState = &vertex_input_state;
-	pipeline_info.pInputAssemblyState = &input_assembly_state;
-	pipeline_info.pViewportState = &viewport_state;
-	pipeline_info.pRasterizationState = &rasterization_state;
-	pipeline_info.pMultisampleState = &multisample_state;
-	pipeline_info.pDepthStencilState = &depth_stencil_state;
-	pipeline_info.pColorBlendState = &color_blend_state;
-	pipeline_info.pDynamicState = nullptr;
+	auto job = [this, &properties, &params, &layouts, &results, &pipelines](size_t i) {
+	  results[i] = create_graphics_pipeline(properties,
+						params[i],
+						layouts[i],
+						m_pipeline_cache,
+						pipelines[i]);
+	};
+
+	if (workers != nullptr) {
+	  workers->run(params.size(), job);
+	}
+	else {
+	  for (size_t i = 0; i < params.size(); ++i) {
+	    job(i);
+	  }
+	}
+
+	// registered in order, so the indices don't
+	// depend on which job finished first
+	for (size_t i = 0; i < params.size(); ++i) {
+	  VK_FN(results[i]);
+
+	  std::cout << "PIPELINE CREATION FOR " << params[i].vert_spv_path << ", " << params[i].frag_spv_path
+		    << (results[i] == VK_SUCCESS ? ": OK" : ": FAILED") << std::endl;
+	  
+	  if (results[i] == VK_SUCCESS && pipelines[i] != VK_NULL_HANDLE) {
+	    indices[i] = new_pipeline();
+
+	    m_pipeline_layouts[indices[i]] = params[i].pipeline_layout_index;
+	    m_pipelines[indices[i]] = pipelines[i];
+	  }
+	}
+      }
+
+      return indices;
+    }
+
+    index_type make_compute_pipeline(const device_resource_properties& properties,
+				     const compute_pipeline_gen_params& params) {
+      index_type pipeline_index{k_unset};
+
+      if (c_assert(m_pipeline_layout_pool != nullptr) &&
+	  properties.ok() &&
+	  params.ok()) {
+	VkPipeline pl_object{VK_NULL_HANDLE};
+
+	VkShaderModule cshader_module{VK_NULL_HANDLE};
+
+	VK_FN(make_shader_module(properties, params.comp_spv_path, cshader_module));
+
+	ASSERT(cshader_module != VK_NULL_HANDLE);
+
+	VkComputePipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = cshader_module;
+	pipeline_info.stage.pName = "main";
 	pipeline_info.layout = m_pipeline_layout_pool->pipeline_layout(params.pipeline_layout_index);
-	pipeline_info.renderPass = params.render_pass;
-	pipeline_info.subpass = params.subpass_index;
 	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 	pipeline_info.basePipelineIndex = -1;
 
-	VK_FN(vkCreateGraphicsPipelines(properties.device,
-					VK_NULL_HANDLE,
-					1,
-					&pipeline_info,
-					nullptr,
-					&pl_object));
+	VK_FN(vkCreateComputePipelines(properties.device,
+				       m_pipeline_cache,
+				       1,
+				       &pipeline_info,
+				       nullptr,
+				       &pl_object));
 
-	//
-	// Free memory
-	//
-	
-	free_device_handle<VkShaderModule, &vkDestroyShaderModule>(properties.device, vshader_module);
-	free_device_handle<VkShaderModule, &vkDestroyShaderModule>(properties.device, fshader_module);
+	free_device_handle<VkShaderModule, &vkDestroyShaderModule>(properties.device, cshader_module);
 
 	if (H_OK(pl_object)) {
 	  pipeline_index = new_pipeline();
@@ -359,8 +530,6 @@ namespace vulkan {
 	  m_pipeline_layouts[pipeline_index] = params.pipeline_layout_index;
 	  m_pipelines[pipeline_index] = pl_object;
 	}
-
-	std::cout << "END PIPELINE CREATION FOR " << params.vert_spv_path << ", " << params.frag_spv_path << std::endl; 
       }
 
       return pipeline_index;
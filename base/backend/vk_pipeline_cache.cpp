@@ -0,0 +1,226 @@
+#include "vk_pipeline_cache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace vulkan {
+  uint64_t pipeline_cache::hash(const uint8_t* bytes, size_t size) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+      h ^= bytes[i];
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+
+  pipeline_cache::file_header pipeline_cache::make_file_header() const {
+    file_header header = {};
+
+    header.magic = k_magic;
+    header.header_size = sizeof(file_header);
+    header.vendor_id = m_device_properties.vendorID;
+    header.device_id = m_device_properties.deviceID;
+    header.driver_version = m_device_properties.driverVersion;
+
+    memcpy(header.uuid, m_device_properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    return header;
+  }
+
+  darray<uint8_t> pipeline_cache::load() const {
+    darray<uint8_t> file = read_file(m_path);
+
+    if (file.empty()) {
+      write_logf("pipeline cache: no file at %s, starting cold", m_path.c_str());
+      return {};
+    }
+
+    const char* reject = nullptr;
+
+    file_header expected = make_file_header();
+    file_header header = {};
+
+    if (file.size() < sizeof(file_header)) {
+      reject = "truncated header";
+    }
+    else {
+      memcpy(&header, file.data(), sizeof(file_header));
+
+      const uint8_t* data = file.data() + sizeof(file_header);
+      size_t data_size = file.size() - sizeof(file_header);
+
+      if (header.magic != k_magic ||
+	  header.header_size != sizeof(file_header)) {
+	reject = "not a pipeline cache";
+      }
+      else if (header.vendor_id != expected.vendor_id ||
+	       header.device_id != expected.device_id ||
+	       header.driver_version != expected.driver_version ||
+	       memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) != 0) {
+	reject = "written for another device or driver";
+      }
+      else if (header.data_size != data_size) {
+	reject = "truncated data";
+      }
+      else if (header.data_hash != hash(data, data_size)) {
+	reject = "corrupt data";
+      }
+      // the driver's own VkPipelineCacheHeaderVersionOne:
+      // length, version, vendor, device, uuid
+      else if (data_size < 16 + VK_UUID_SIZE) {
+	reject = "data too small for its header";
+      }
+      else {
+	uint32_t fields[4] = {};
+
+	memcpy(fields, data, sizeof(fields));
+
+	if (fields[0] < 16 + VK_UUID_SIZE ||
+	    fields[0] > data_size ||
+	    fields[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+	    fields[2] != expected.vendor_id ||
+	    fields[3] != expected.device_id ||
+	    memcmp(data + 16, expected.uuid, VK_UUID_SIZE) != 0) {
+	  reject = "driver header doesn't match the device";
+	}
+      }
+    }
+
+    if (reject != nullptr) {
+      write_logf("pipeline cache: ignoring %s (%s), starting cold", m_path.c_str(), reject);
+      return {};
+    }
+
+    return darray<uint8_t>(file.begin() + sizeof(file_header), file.end());
+  }
+
+  bool pipeline_cache::init(VkPhysicalDevice physical_device,
+			    VkDevice device,
+			    const std::string& directory) {
+    if (c_assert(m_device == VK_NULL_HANDLE) &&
+	c_assert(physical_device != VK_NULL_HANDLE) &&
+	c_assert(device != VK_NULL_HANDLE)) {
+      m_device = device;
+
+      vkGetPhysicalDeviceProperties(physical_device, &m_device_properties);
+
+      std::stringstream name;
+
+      name << directory << "/pipelines_";
+
+      for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+	name << std::hex << std::setw(2) << std::setfill('0')
+	     << static_cast<uint32_t>(m_device_properties.pipelineCacheUUID[i]);
+      }
+
+      name << "_" << std::hex << m_device_properties.driverVersion << ".bin";
+
+      m_path = name.str();
+
+      std::error_code err{};
+      fs::create_directories(fs::path{directory}, err);
+
+      darray<uint8_t> data = load();
+
+      VkPipelineCacheCreateInfo create_info = {};
+      create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+      create_info.pNext = nullptr;
+      create_info.flags = 0;
+      create_info.initialDataSize = data.size();
+      create_info.pInitialData = null_if_empty(data);
+
+      VkResult result = vkCreatePipelineCache(m_device, &create_info, nullptr, &m_cache);
+
+      if (result != VK_SUCCESS && !data.empty()) {
+	write_logf("pipeline cache: the driver rejected %s, starting cold", m_path.c_str());
+
+	data.clear();
+
+	create_info.initialDataSize = 0;
+	create_info.pInitialData = nullptr;
+
+	result = vkCreatePipelineCache(m_device, &create_info, nullptr, &m_cache);
+      }
+
+      VK_FN(result);
+
+      if (H_OK(m_cache)) {
+	m_stats.loaded_bytes = data.size();
+	m_stats.warm = !data.empty();
+
+	// nothing to write back until something's been added
+	m_saved_hash = hash(data.data(), data.size());
+      }
+    }
+
+    return H_OK(m_cache);
+  }
+
+  bool pipeline_cache::save() {
+    bool ret = false;
+
+    if (H_OK(m_cache)) {
+      size_t size = 0;
+
+      VK_FN(vkGetPipelineCacheData(m_device, m_cache, &size, nullptr));
+
+      darray<uint8_t> data(size, 0);
+
+      if (size > 0) {
+	VK_FN(vkGetPipelineCacheData(m_device, m_cache, &size, data.data()));
+	data.resize(size);
+      }
+
+      uint64_t data_hash = hash(data.data(), data.size());
+
+      ret = api_ok();
+
+      if (ret && data_hash != m_saved_hash) {
+	file_header header = make_file_header();
+	header.data_size = data.size();
+	header.data_hash = data_hash;
+
+	std::string tmp_path = m_path + ".tmp";
+
+	{
+	  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+
+	  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+	  ret = static_cast<bool>(file);
+	}
+
+	if (ret) {
+	  std::error_code err{};
+	  fs::rename(fs::path{tmp_path}, fs::path{m_path}, err);
+
+	  ret = !err;
+	}
+
+	if (ret) {
+	  m_saved_hash = data_hash;
+	  m_stats.saved_bytes = data.size();
+	}
+	else {
+	  write_logf("pipeline cache: couldn't write %s", m_path.c_str());
+	}
+      }
+    }
+
+    return ret;
+  }
+
+  void pipeline_cache::free_mem() {
+    if (H_OK(m_cache)) {
+      save();
+
+      vkDestroyPipelineCache(m_device, m_cache, nullptr);
+      m_cache = VK_NULL_HANDLE;
+    }
+
+    m_device = VK_NULL_HANDLE;
+  }
+}
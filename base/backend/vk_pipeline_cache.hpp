@@ -0,0 +1,87 @@
+#pragma once
+
+#include "vk_common.hpp"
+
+namespace vulkan {
+  //
+  // A VkPipelineCache that outlives the process.
+  //
+  // The cache's data is kept in a file named after the device's
+  // pipelineCacheUUID and driver version, so a driver update or a
+  // different GPU starts from an empty cache rather than feeding a
+  // driver data it didn't write. The file starts with a header of our
+  // own - the device's identity, the data's size and a hash of it - in
+  // front of the driver's blob, and both that and the blob's
+  // VkPipelineCacheHeaderVersionOne are checked before anything is
+  // handed to vkCreatePipelineCache(). A file that fails any check is
+  // ignored, and so is data the driver rejects; either way the cache
+  // starts empty and the file is replaced on the next save().
+  //
+  // save() writes to a temporary file that's renamed over the old
+  // one, so a crash mid-write can't leave a truncated cache behind.
+  //
+  class pipeline_cache {
+  public:
+    struct stats {
+      size_t loaded_bytes{0}; // accepted from disk by init()
+      size_t saved_bytes{0}; // written by the last save()
+      bool warm{false}; // init() started from a file
+    };
+
+  private:
+    static constexpr inline uint32_t k_magic = 0x43504b56; // "VKPC"
+
+    struct file_header {
+      uint32_t magic;
+      uint32_t header_size;
+      uint32_t vendor_id;
+      uint32_t device_id;
+      uint32_t driver_version;
+      uint8_t uuid[VK_UUID_SIZE];
+      uint32_t padding;
+      uint64_t data_size;
+      uint64_t data_hash;
+    };
+
+    static_assert(sizeof(file_header) == 56, "file_header has to be tightly packed");
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    VkPipelineCache m_cache{VK_NULL_HANDLE};
+    VkPhysicalDeviceProperties m_device_properties{};
+
+    std::string m_path{};
+
+    uint64_t m_saved_hash{0};
+
+    stats m_stats{};
+
+    static uint64_t hash(const uint8_t* bytes, size_t size);
+
+    file_header make_file_header() const;
+
+    // empty if path doesn't hold a cache this device can use
+    darray<uint8_t> load() const;
+
+  public:
+    // the file is kept in directory, which is created if it doesn't
+    // exist. Returns false only if no cache could be created at all;
+    // a missing or unusable file just means an empty cache.
+    bool init(VkPhysicalDevice physical_device,
+	      VkDevice device,
+	      const std::string& directory);
+
+    // saves, then destroys the cache
+    void free_mem();
+
+    // writes the cache out if it's changed since the last save
+    bool save();
+
+    VkPipelineCache handle() const {
+      return m_cache;
+    }
+
+    const stats& get_stats() const {
+      return m_stats;
+    }
+  };
+}
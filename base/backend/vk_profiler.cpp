@@ -0,0 +1,202 @@
+#include "vk_profiler.hpp"
+
+#include <sstream>
+#include <string.h>
+
+namespace vulkan {
+  bool gpu_profiler::init(VkPhysicalDevice physical_device,
+			  VkDevice device,
+			  uint32_t queue_family,
+			  uint32_t slot_count,
+			  uint32_t queries_per_slot) {
+    bool good =
+      c_assert(m_pool == VK_NULL_HANDLE) &&
+      c_assert(slot_count > 0) &&
+      c_assert(queries_per_slot > 0);
+
+    if (good) {
+      VkPhysicalDeviceProperties properties = {};
+      vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+      uint32_t family_count = 0;
+      vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+
+      darray<VkQueueFamilyProperties> families(family_count);
+      vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+      uint32_t valid_bits =
+	queue_family < family_count
+	? families[queue_family].timestampValidBits
+	: 0;
+
+      good = valid_bits > 0 && properties.limits.timestampPeriod > 0.0f;
+
+      if (good) {
+	m_valid_mask = valid_bits >= 64 ? UINT64_MAX : (uint64_t{1} << valid_bits) - 1;
+	m_period = static_cast<double>(properties.limits.timestampPeriod);
+      }
+      else {
+	write_logf("gpu profiler: queue family %" PRIu32 " has no timestamp support", queue_family);
+      }
+    }
+
+    if (good) {
+      VkQueryPoolCreateInfo create_info = {};
+      create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      create_info.pNext = nullptr;
+      create_info.flags = 0;
+      create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      create_info.queryCount = slot_count * queries_per_slot;
+      create_info.pipelineStatistics = 0;
+
+      VK_FN(vkCreateQueryPool(device, &create_info, nullptr, &m_pool));
+
+      good = H_OK(m_pool);
+    }
+
+    if (good) {
+      m_device = device;
+      m_queries_per_slot = queries_per_slot;
+      m_slots.resize(slot_count);
+      m_results.resize(queries_per_slot, 0);
+    }
+
+    return good;
+  }
+
+  void gpu_profiler::free_mem() {
+    if (m_device != VK_NULL_HANDLE) {
+      free_device_handle<VkQueryPool, &vkDestroyQueryPool>(m_device, m_pool);
+
+      m_slots.clear();
+      m_device = VK_NULL_HANDLE;
+    }
+  }
+
+  void gpu_profiler::commands_reset(VkCommandBuffer cmd_buffer, uint32_t slot_index) {
+    if (ok()) {
+      slot& s = m_slots.at(slot_index);
+
+      s.scopes.clear();
+      s.used = 0;
+      s.submitted = false;
+
+      vkCmdResetQueryPool(cmd_buffer,
+			  m_pool,
+			  slot_index * m_queries_per_slot,
+			  m_queries_per_slot);
+    }
+  }
+
+  uint32_t gpu_profiler::commands_timestamp(VkCommandBuffer cmd_buffer,
+					    uint32_t slot_index,
+					    VkPipelineStageFlagBits stage) {
+    uint32_t query = k_no_query;
+
+    if (ok()) {
+      slot& s = m_slots.at(slot_index);
+
+      if (s.used < m_queries_per_slot) {
+	query = s.used++;
+
+	vkCmdWriteTimestamp(cmd_buffer,
+			    stage,
+			    m_pool,
+			    slot_index * m_queries_per_slot + query);
+      }
+    }
+
+    return query;
+  }
+
+  void gpu_profiler::scope(uint32_t slot_index, const char* name, uint32_t begin, uint32_t end) {
+    if (ok() && begin != k_no_query && end != k_no_query) {
+      m_slots.at(slot_index).scopes.push_back({ name, begin, end });
+    }
+  }
+
+  void gpu_profiler::submitted(uint32_t slot_index) {
+    if (ok()) {
+      m_slots.at(slot_index).submitted = true;
+    }
+  }
+
+  gpu_profiler::scope_time& gpu_profiler::scope_stats(const char* name) {
+    for (scope_time& t: m_stats.scopes) {
+      if (strcmp(t.name, name) == 0) {
+	return t;
+      }
+    }
+
+    m_stats.scopes.push_back({});
+    m_stats.scopes.back().name = name;
+
+    return m_stats.scopes.back();
+  }
+
+  void gpu_profiler::collect(uint32_t slot_index) {
+    if (ok()) {
+      slot& s = m_slots.at(slot_index);
+
+      if (s.submitted && s.used > 0) {
+	// no VK_QUERY_RESULT_WAIT_BIT: the submission's done,
+	// and if it somehow isn't this frame goes unmeasured
+	VkResult result = vkGetQueryPoolResults(m_device,
+						m_pool,
+						slot_index * m_queries_per_slot,
+						s.used,
+						s.used * sizeof(uint64_t),
+						m_results.data(),
+						sizeof(uint64_t),
+						VK_QUERY_RESULT_64_BIT);
+
+	if (result == VK_SUCCESS) {
+	  for (const scope& sc: s.scopes) {
+	    uint64_t ticks = (m_results[sc.end] - m_results[sc.begin]) & m_valid_mask;
+	    double ms = static_cast<double>(ticks) * m_period / 1000000.0;
+
+	    scope_time& t = scope_stats(sc.name);
+	    t.last_ms = ms;
+	    t.total_ms += ms;
+	    t.samples++;
+	  }
+
+	  m_stats.slots_read++;
+	}
+	else if (result == VK_NOT_READY) {
+	  m_stats.slots_skipped++;
+	}
+	else if (api_ok()) {
+	  g_vk_result = result;
+	}
+
+	// a static command buffer is submitted again without being
+	// re-recorded, so its scopes are kept
+	s.submitted = false;
+      }
+    }
+  }
+
+  void gpu_profiler::reset_stats() {
+    for (scope_time& t: m_stats.scopes) {
+      t.total_ms = 0.0;
+      t.samples = 0;
+    }
+  }
+
+  void gpu_profiler::print_stats() const {
+    std::stringstream ss;
+
+    ss << "gpu profiler (" << m_stats.slots_read << " frames read, "
+       << m_stats.slots_skipped << " skipped):\n";
+
+    for (const scope_time& t: m_stats.scopes) {
+      double average = t.samples > 0 ? t.total_ms / static_cast<double>(t.samples) : 0.0;
+
+      ss << "  " << t.name << ": " << average << " ms average over "
+	 << t.samples << " frames, " << t.last_ms << " ms last\n";
+    }
+
+    write_logf("%s", ss.str().c_str());
+  }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "vk_common.hpp"
+
+namespace vulkan {
+  //
+  // GPU timings from VkQueryPool timestamps.
+  //
+  // The pool holds one range of queries per slot, and a slot belongs
+  // to one command buffer: the renderer uses a slot per swapchain
+  // image. commands_reset() goes at the start of the buffer, before
+  // anything is written to the slot's range, so a buffer that's
+  // recorded once and submitted every frame resets its own queries
+  // each time it runs. commands_timestamp() writes a query and
+  // returns its index; scope() names the interval between two of
+  // them, so neighbouring scopes can share a timestamp (the end of
+  // one subpass is the start of the next).
+  //
+  // collect() reads a slot's results back. It's only called once the
+  // timeline says the slot's last submission has finished - for the
+  // renderer, when it's about to reuse the image's command buffer a
+  // couple of frames later - so the results are already there and
+  // reading them never waits. A slot whose results somehow aren't
+  // ready is skipped rather than waited on.
+  //
+  // Timestamps can't be written inside a subpass whose contents are
+  // secondary command buffers, so scopes have to start and end
+  // outside of those.
+  //
+  class gpu_profiler {
+  public:
+    static constexpr inline uint32_t k_no_query = UINT32_MAX;
+
+    struct scope_time {
+      const char* name{nullptr};
+      double last_ms{0.0};
+      // since the last reset_stats()
+      double total_ms{0.0};
+      uint32_t samples{0};
+    };
+
+    struct stats {
+      darray<scope_time> scopes{};
+      uint64_t slots_read{0};
+      // results that weren't ready when collect() asked for them
+      uint64_t slots_skipped{0};
+    };
+
+  private:
+    struct scope {
+      const char* name;
+      uint32_t begin;
+      uint32_t end;
+    };
+
+    struct slot {
+      darray<scope> scopes{};
+      uint32_t used{0};
+      bool submitted{false};
+    };
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    VkQueryPool m_pool{VK_NULL_HANDLE};
+
+    uint32_t m_queries_per_slot{0};
+
+    // nanoseconds per tick
+    double m_period{1.0};
+
+    // bits of a timestamp that are meaningful
+    uint64_t m_valid_mask{0};
+
+    darray<slot> m_slots{};
+    darray<uint64_t> m_results{};
+
+    stats m_stats{};
+
+    scope_time& scope_stats(const char* name);
+
+  public:
+    // Returns false, and leaves the profiler off, if queue_family
+    // can't write timestamps; every other call is then a no-op.
+    bool init(VkPhysicalDevice physical_device,
+	      VkDevice device,
+	      uint32_t queue_family,
+	      uint32_t slot_count,
+	      uint32_t queries_per_slot);
+
+    void free_mem();
+
+    bool ok() const {
+      return m_pool != VK_NULL_HANDLE;
+    }
+
+    // first thing in slot's command buffer, outside a render pass;
+    // forgets the scopes recorded for the slot before
+    void commands_reset(VkCommandBuffer cmd_buffer, uint32_t slot_index);
+
+    // k_no_query when the slot is out of queries
+    uint32_t commands_timestamp(VkCommandBuffer cmd_buffer,
+				uint32_t slot_index,
+				VkPipelineStageFlagBits stage);
+
+    // name has to outlive the profiler
+    void scope(uint32_t slot_index, const char* name, uint32_t begin, uint32_t end);
+
+    // slot's command buffer has been submitted
+    void submitted(uint32_t slot_index);
+
+    // slot's last submission is known to be complete
+    void collect(uint32_t slot_index);
+
+    const stats& get_stats() const {
+      return m_stats;
+    }
+
+    void reset_stats();
+
+    void print_stats() const;
+  };
+}
@@ -0,0 +1,703 @@
+#include "vk_reflect.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace vulkan {
+  namespace spirv {
+    constexpr uint32_t k_magic = 0x07230203;
+    constexpr size_t k_header_words = 5;
+
+    // opcodes
+    constexpr uint32_t k_op_entry_point = 15;
+    constexpr uint32_t k_op_type_int = 21;
+    constexpr uint32_t k_op_type_float = 22;
+    constexpr uint32_t k_op_type_vector = 23;
+    constexpr uint32_t k_op_type_matrix = 24;
+    constexpr uint32_t k_op_type_image = 25;
+    constexpr uint32_t k_op_type_sampler = 26;
+    constexpr uint32_t k_op_type_sampled_image = 27;
+    constexpr uint32_t k_op_type_array = 28;
+    constexpr uint32_t k_op_type_runtime_array = 29;
+    constexpr uint32_t k_op_type_struct = 30;
+    constexpr uint32_t k_op_type_pointer = 32;
+    constexpr uint32_t k_op_constant = 43;
+    constexpr uint32_t k_op_spec_constant = 50;
+    constexpr uint32_t k_op_variable = 59;
+    constexpr uint32_t k_op_decorate = 71;
+    constexpr uint32_t k_op_member_decorate = 72;
+
+    // decorations
+    constexpr uint32_t k_decoration_block = 2;
+    constexpr uint32_t k_decoration_buffer_block = 3;
+    constexpr uint32_t k_decoration_array_stride = 6;
+    constexpr uint32_t k_decoration_matrix_stride = 7;
+    constexpr uint32_t k_decoration_builtin = 11;
+    constexpr uint32_t k_decoration_location = 30;
+    constexpr uint32_t k_decoration_binding = 33;
+    constexpr uint32_t k_decoration_descriptor_set = 34;
+    constexpr uint32_t k_decoration_offset = 35;
+
+    // storage classes
+    constexpr uint32_t k_storage_uniform_constant = 0;
+    constexpr uint32_t k_storage_input = 1;
+    constexpr uint32_t k_storage_uniform = 2;
+    constexpr uint32_t k_storage_push_constant = 9;
+    constexpr uint32_t k_storage_storage_buffer = 12;
+
+    // image dimensions
+    constexpr uint32_t k_dim_buffer = 5;
+    constexpr uint32_t k_dim_subpass_data = 6;
+
+    struct id_info {
+      uint32_t opcode{0};
+
+      // every word after the result id; constants and
+      // variables start with their result type
+      darray<uint32_t> operands{};
+
+      uint32_t set{UINT32_MAX};
+      uint32_t binding{UINT32_MAX};
+      uint32_t location{UINT32_MAX};
+      uint32_t array_stride{0};
+
+      bool builtin{false};
+      bool block{false};
+      bool buffer_block{false};
+
+      // struct members
+      darray<uint32_t> member_offsets{};
+      darray<uint32_t> member_matrix_strides{};
+
+      uint32_t operand(size_t i) const {
+	return i < operands.size() ? operands[i] : 0;
+      }
+    };
+
+    struct module {
+      darray<id_info> ids{};
+      darray<uint32_t> variables{};
+      VkShaderStageFlags stage{0};
+
+      const id_info& at(uint32_t id) const {
+	static const id_info k_none{};
+	return id < ids.size() ? ids[id] : k_none;
+      }
+    };
+
+    static VkShaderStageFlags stage_of(uint32_t execution_model) {
+      switch (execution_model) {
+      case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+      case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+      case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+      case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+      case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+      case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+      default: return 0;
+      }
+    }
+
+    static void set_member(darray<uint32_t>& members, uint32_t member, uint32_t value) {
+      if (members.size() <= member) {
+	members.resize(member + 1, 0);
+      }
+      members[member] = value;
+    }
+
+    // the low word of an integer constant; 0 for anything else
+    static uint32_t constant_value(const module& m, uint32_t id) {
+      const id_info& c = m.at(id);
+
+      return
+	(c.opcode == k_op_constant || c.opcode == k_op_spec_constant)
+	? c.operand(1)
+	: 0;
+    }
+
+    // strips any arrays off type, multiplying count by their lengths;
+    // a runtime array makes count 0
+    static uint32_t strip_arrays(const module& m, uint32_t type, uint32_t& count) {
+      count = 1;
+
+      while (m.at(type).opcode == k_op_type_array ||
+	     m.at(type).opcode == k_op_type_runtime_array) {
+	const id_info& a = m.at(type);
+
+	count *= a.opcode == k_op_type_array ? constant_value(m, a.operand(1)) : 0;
+	type = a.operand(0);
+      }
+
+      return type;
+    }
+
+    // the byte size of a block member; matrices
+    // are laid out with their member's stride
+    static uint32_t type_size(const module& m, uint32_t type, uint32_t matrix_stride = 0) {
+      const id_info& t = m.at(type);
+
+      uint32_t size = 0;
+
+      switch (t.opcode) {
+      case k_op_type_int:
+      case k_op_type_float:
+	size = t.operand(0) / 8;
+	break;
+
+      case k_op_type_vector:
+	size = t.operand(1) * type_size(m, t.operand(0));
+	break;
+
+      case k_op_type_matrix:
+	size = t.operand(1) * (matrix_stride != 0 ? matrix_stride : type_size(m, t.operand(0)));
+	break;
+
+      case k_op_type_array: {
+	uint32_t length = constant_value(m, t.operand(1));
+
+	size = length * (t.array_stride != 0
+			 ? t.array_stride
+			 : type_size(m, t.operand(0), matrix_stride));
+      } break;
+
+      case k_op_type_struct:
+	for (size_t member = 0; member < t.operands.size(); ++member) {
+	  uint32_t offset = member < t.member_offsets.size() ? t.member_offsets[member] : 0;
+	  uint32_t stride = member < t.member_matrix_strides.size() ? t.member_matrix_strides[member] : 0;
+
+	  size = std::max(size, offset + type_size(m, t.operands[member], stride));
+	}
+	break;
+
+      default:
+	// runtime arrays take up no space of their own
+	break;
+      }
+
+      return size;
+    }
+
+    // nullopt if the variable isn't a descriptor
+    static std::optional<VkDescriptorType> descriptor_type(const module& m,
+							   uint32_t storage_class,
+							   uint32_t type) {
+      std::optional<VkDescriptorType> ret{};
+
+      const id_info& t = m.at(type);
+
+      switch (storage_class) {
+      case k_storage_uniform_constant:
+	if (t.opcode == k_op_type_sampled_image) {
+	  ret = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	}
+	else if (t.opcode == k_op_type_sampler) {
+	  ret = VK_DESCRIPTOR_TYPE_SAMPLER;
+	}
+	else if (t.opcode == k_op_type_image) {
+	  uint32_t dim = t.operand(1);
+	  bool storage = t.operand(5) == 2;
+
+	  if (dim == k_dim_subpass_data) {
+	    ret = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	  }
+	  else if (dim == k_dim_buffer) {
+	    ret = storage
+	      ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+	      : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+	  }
+	  else {
+	    ret = storage
+	      ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+	      : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	  }
+	}
+	break;
+
+      case k_storage_uniform:
+	// pre-1.3 storage buffers are uniform BufferBlocks
+	if (t.buffer_block) {
+	  ret = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+	else if (t.block) {
+	  ret = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	}
+	break;
+
+      case k_storage_storage_buffer:
+	ret = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	break;
+      }
+
+      return ret;
+    }
+
+    static std::optional<module> parse(const uint32_t* words, size_t word_count, const char*& error) {
+      if (word_count < k_header_words || words[0] != k_magic) {
+	error = "not SPIR-V";
+	return std::nullopt;
+      }
+
+      module m{};
+
+      // word 3 is the bound on every id in the module
+      m.ids.resize(words[3]);
+
+      auto define = [&m](uint32_t id, uint32_t opcode, const uint32_t* begin, const uint32_t* end) -> bool {
+	bool ok = id < m.ids.size();
+	if (ok) {
+	  m.ids[id].opcode = opcode;
+	  m.ids[id].operands.assign(begin, end);
+	}
+	return ok;
+      };
+
+      size_t i = k_header_words;
+
+      while (i < word_count && error == nullptr) {
+	const uint32_t* w = words + i;
+
+	uint32_t length = w[0] >> 16;
+	uint32_t opcode = w[0] & 0xffff;
+
+	if (length == 0 || i + length > word_count) {
+	  error = "truncated instruction";
+	  break;
+	}
+
+	const uint32_t* end = w + length;
+
+	bool ok = true;
+
+	switch (opcode) {
+	case k_op_entry_point:
+	  ok = length > 2;
+	  if (ok && m.stage == 0) {
+	    m.stage = stage_of(w[1]);
+	  }
+	  break;
+
+	case k_op_decorate:
+	  ok = length > 2 && w[1] < m.ids.size();
+	  if (ok) {
+	    id_info& d = m.ids[w[1]];
+	    uint32_t value = length > 3 ? w[3] : 0;
+
+	    switch (w[2]) {
+	    case k_decoration_block: d.block = true; break;
+	    case k_decoration_buffer_block: d.buffer_block = true; break;
+	    case k_decoration_array_stride: d.array_stride = value; break;
+	    case k_decoration_builtin: d.builtin = true; break;
+	    case k_decoration_location: d.location = value; break;
+	    case k_decoration_binding: d.binding = value; break;
+	    case k_decoration_descriptor_set: d.set = value; break;
+	    }
+	  }
+	  break;
+
+	case k_op_member_decorate:
+	  ok = length > 3 && w[1] < m.ids.size();
+	  if (ok && length > 4) {
+	    id_info& d = m.ids[w[1]];
+
+	    if (w[3] == k_decoration_offset) {
+	      set_member(d.member_offsets, w[2], w[4]);
+	    }
+	    else if (w[3] == k_decoration_matrix_stride) {
+	      set_member(d.member_matrix_strides, w[2], w[4]);
+	    }
+	  }
+	  break;
+
+	case k_op_type_int:
+	case k_op_type_float:
+	case k_op_type_vector:
+	case k_op_type_matrix:
+	case k_op_type_image:
+	case k_op_type_sampler:
+	case k_op_type_sampled_image:
+	case k_op_type_array:
+	case k_op_type_runtime_array:
+	case k_op_type_struct:
+	case k_op_type_pointer:
+	  ok = length > 1 && define(w[1], opcode, w + 2, end);
+	  break;
+
+	case k_op_constant:
+	case k_op_spec_constant:
+	case k_op_variable:
+	  ok = length > 3 && define(w[2], opcode, w + 3, end);
+	  if (ok) {
+	    // keep the result type in front
+	    m.ids[w[2]].operands.insert(m.ids[w[2]].operands.begin(), w[1]);
+
+	    if (opcode == k_op_variable) {
+	      m.variables.push_back(w[2]);
+	    }
+	  }
+	  break;
+	}
+
+	if (!ok) {
+	  error = "malformed instruction";
+	}
+
+	i += length;
+      }
+
+      if (error == nullptr && m.stage == 0) {
+	error = "no entry point for a supported stage";
+      }
+
+      return error == nullptr ? std::make_optional(std::move(m)) : std::nullopt;
+    }
+  }
+
+  static bool format_components(VkFormat format,
+				uint32_t& components,
+				shader_reflection::component_kind& kind) {
+    using kind_t = shader_reflection::component_kind;
+
+    bool ok = true;
+
+    switch (format) {
+    case VK_FORMAT_R32_SFLOAT: components = 1; kind = kind_t::sfloat; break;
+    case VK_FORMAT_R32G32_SFLOAT: components = 2; kind = kind_t::sfloat; break;
+    case VK_FORMAT_R32G32B32_SFLOAT: components = 3; kind = kind_t::sfloat; break;
+    case VK_FORMAT_R32G32B32A32_SFLOAT: components = 4; kind = kind_t::sfloat; break;
+
+    case VK_FORMAT_R16G16_SFLOAT: components = 2; kind = kind_t::sfloat; break;
+    case VK_FORMAT_R16G16B16A16_SFLOAT: components = 4; kind = kind_t::sfloat; break;
+
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SNORM:
+    case VK_FORMAT_B8G8R8A8_UNORM: components = 4; kind = kind_t::sfloat; break;
+
+    case VK_FORMAT_R32_SINT: components = 1; kind = kind_t::sint; break;
+    case VK_FORMAT_R32G32_SINT: components = 2; kind = kind_t::sint; break;
+    case VK_FORMAT_R32G32B32_SINT: components = 3; kind = kind_t::sint; break;
+    case VK_FORMAT_R32G32B32A32_SINT: components = 4; kind = kind_t::sint; break;
+
+    case VK_FORMAT_R32_UINT: components = 1; kind = kind_t::uint; break;
+    case VK_FORMAT_R32G32_UINT: components = 2; kind = kind_t::uint; break;
+    case VK_FORMAT_R32G32B32_UINT: components = 3; kind = kind_t::uint; break;
+    case VK_FORMAT_R32G32B32A32_UINT: components = 4; kind = kind_t::uint; break;
+    case VK_FORMAT_R8G8B8A8_UINT: components = 4; kind = kind_t::uint; break;
+
+    default:
+      ok = false;
+      break;
+    }
+
+    return ok;
+  }
+
+  std::optional<shader_reflection> reflect_spirv(const uint32_t* words, size_t word_count) {
+    const char* error = nullptr;
+
+    auto opt_module = spirv::parse(words, word_count, error);
+
+    if (!opt_module) {
+      write_logf("reflect_spirv: %s", error);
+      return std::nullopt;
+    }
+
+    const spirv::module& m = opt_module.value();
+
+    shader_reflection r{};
+    r.stages = m.stage;
+
+    bool ok = true;
+
+    for (uint32_t id: m.variables) {
+      const spirv::id_info& var = m.at(id);
+      const spirv::id_info& pointer = m.at(var.operand(0));
+
+      uint32_t storage_class = var.operand(1);
+      uint32_t pointee = pointer.operand(1);
+
+      if (storage_class == spirv::k_storage_push_constant) {
+	const spirv::id_info& block = m.at(pointee);
+
+	uint32_t offset = block.member_offsets.empty()
+	  ? 0
+	  : *std::min_element(block.member_offsets.begin(), block.member_offsets.end());
+
+	uint32_t end = spirv::type_size(m, pointee);
+
+	r.push_constant_ranges.push_back({ m.stage, offset, end - offset });
+      }
+      else if (storage_class == spirv::k_storage_input) {
+	bool vertex_input =
+	  m.stage == VK_SHADER_STAGE_VERTEX_BIT &&
+	  !var.builtin &&
+	  !m.at(pointee).builtin &&
+	  var.location != UINT32_MAX;
+
+	if (vertex_input) {
+	  uint32_t count = 1;
+	  uint32_t type = spirv::strip_arrays(m, pointee, count);
+
+	  // a matrix takes one location per column
+	  uint32_t locations = 1;
+
+	  if (m.at(type).opcode == spirv::k_op_type_matrix) {
+	    locations = m.at(type).operand(1);
+	    type = m.at(type).operand(0);
+	  }
+
+	  uint32_t components = 1;
+
+	  if (m.at(type).opcode == spirv::k_op_type_vector) {
+	    components = m.at(type).operand(1);
+	    type = m.at(type).operand(0);
+	  }
+
+	  const spirv::id_info& scalar = m.at(type);
+
+	  shader_reflection::component_kind kind =
+	    scalar.opcode == spirv::k_op_type_float
+	    ? shader_reflection::component_kind::sfloat
+	    : scalar.operand(1) != 0
+	    ? shader_reflection::component_kind::sint
+	    : shader_reflection::component_kind::uint;
+
+	  ok = ok && c_assert(scalar.operand(0) == 32);
+
+	  for (uint32_t l = 0; l < count * locations; ++l) {
+	    r.vertex_inputs.push_back({ var.location + l, components, kind });
+	  }
+	}
+      }
+      else if (var.set != UINT32_MAX && var.binding != UINT32_MAX) {
+	uint32_t count = 1;
+	uint32_t type = spirv::strip_arrays(m, pointee, count);
+
+	auto opt_type = spirv::descriptor_type(m, storage_class, type);
+
+	if (opt_type) {
+	  r.bindings.push_back({ var.set, var.binding, opt_type.value(), count, m.stage });
+	}
+      }
+    }
+
+    std::sort(r.bindings.begin(), r.bindings.end(),
+	      [](const shader_reflection::binding& a, const shader_reflection::binding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	      });
+
+    std::sort(r.vertex_inputs.begin(), r.vertex_inputs.end(),
+	      [](const shader_reflection::vertex_input& a, const shader_reflection::vertex_input& b) {
+		return a.location < b.location;
+	      });
+
+    // glslc only ever emits one push constant block per
+    // entry point, but fold any others into its range
+    if (r.push_constant_ranges.size() > 1) {
+      VkPushConstantRange range = r.push_constant_ranges.at(0);
+
+      uint32_t end = range.offset + range.size;
+
+      for (const VkPushConstantRange& other: r.push_constant_ranges) {
+	end = std::max(end, other.offset + other.size);
+	range.offset = std::min(range.offset, other.offset);
+      }
+
+      range.size = end - range.offset;
+      r.push_constant_ranges = { range };
+    }
+
+    return ok ? std::make_optional(r) : std::nullopt;
+  }
+
+  std::optional<shader_reflection> reflect_spv_file(const std::string& path) {
+    darray<uint8_t> bytes = read_file(path);
+
+    std::optional<shader_reflection> ret{};
+
+    if (bytes.empty() || (bytes.size() % sizeof(uint32_t)) != 0) {
+      write_logf("reflect_spv_file: can't read SPIR-V from %s", path.c_str());
+    }
+    else {
+      darray<uint32_t> words(bytes.size() / sizeof(uint32_t), 0);
+      memcpy(words.data(), bytes.data(), bytes.size());
+
+      ret = reflect_spirv(words.data(), words.size());
+
+      if (!ret) {
+	write_logf("reflect_spv_file: couldn't reflect %s", path.c_str());
+      }
+    }
+
+    return ret;
+  }
+
+  std::optional<shader_reflection> reflect_spv_files(const darray<std::string>& paths) {
+    shader_reflection merged{};
+
+    bool ok = c_assert(!paths.empty());
+
+    for (size_t i = 0; i < paths.size() && ok; ++i) {
+      auto r = reflect_spv_file(paths[i]);
+
+      ok = r.has_value() && merged.merge(r.value());
+
+      if (!ok) {
+	write_logf("reflect_spv_files: %s doesn't agree with the stages before it", paths[i].c_str());
+      }
+    }
+
+    return ok ? std::make_optional(merged) : std::nullopt;
+  }
+
+  bool shader_reflection::merge(const shader_reflection& other) {
+    bool ok = true;
+
+    for (const binding& b: other.bindings) {
+      auto it = std::find_if(bindings.begin(), bindings.end(),
+			     [&b](const binding& x) {
+			       return x.set == b.set && x.binding == b.binding;
+			     });
+
+      if (it == bindings.end()) {
+	bindings.push_back(b);
+      }
+      else if (it->type != b.type || it->count != b.count) {
+	write_logf("shader_reflection: set %" PRIu32 ", binding %" PRIu32 " is declared differently by two stages",
+		   b.set,
+		   b.binding);
+	ok = false;
+      }
+      else {
+	it->stages |= b.stages;
+      }
+    }
+
+    std::sort(bindings.begin(), bindings.end(),
+	      [](const binding& a, const binding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	      });
+
+    if (!other.push_constant_ranges.empty()) {
+      const VkPushConstantRange& theirs = other.push_constant_ranges.at(0);
+
+      if (push_constant_ranges.empty()) {
+	push_constant_ranges.push_back(theirs);
+      }
+      else {
+	VkPushConstantRange& ours = push_constant_ranges.at(0);
+
+	uint32_t end = std::max(ours.offset + ours.size, theirs.offset + theirs.size);
+
+	ours.offset = std::min(ours.offset, theirs.offset);
+	ours.size = end - ours.offset;
+	ours.stageFlags |= theirs.stageFlags;
+      }
+    }
+
+    if (!other.vertex_inputs.empty()) {
+      ok = ok && c_assert(vertex_inputs.empty());
+      vertex_inputs = other.vertex_inputs;
+    }
+
+    stages |= other.stages;
+
+    return ok;
+  }
+
+  std::optional<descriptor_set_gen_params> shader_reflection::set_params(uint32_t set,
+									 bool dynamic,
+									 uint32_t min_bindings) const {
+    darray<binding> declared{};
+
+    VkShaderStageFlags set_stages = 0;
+
+    uint32_t count = min_bindings;
+
+    for (const binding& b: bindings) {
+      if (b.set == set) {
+	declared.push_back(b);
+
+	set_stages |= b.stages;
+	count = std::max(count, b.binding + 1);
+      }
+    }
+
+    if (declared.empty()) {
+      write_logf("shader_reflection: no shader declares set %" PRIu32, set);
+      return std::nullopt;
+    }
+
+    VkDescriptorType type = declared.at(0).type;
+
+    if (dynamic) {
+      if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+	type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+      }
+      else if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+	type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+      }
+    }
+
+    descriptor_set_gen_params params{};
+
+    params.stages.assign(count, set_stages);
+    params.descriptor_counts.assign(count, 1);
+    params.type = type;
+
+    bool ok = true;
+
+    for (const binding& b: declared) {
+      // a descriptor_set_gen_params has one type for all of its bindings
+      if (b.type != declared.at(0).type) {
+	write_logf("shader_reflection: set %" PRIu32 " mixes descriptor types", set);
+	ok = false;
+      }
+      // runtime sized arrays would need descriptor indexing
+      else if (b.count == 0) {
+	write_logf("shader_reflection: set %" PRIu32 ", binding %" PRIu32 " is an unsized array",
+		   set,
+		   b.binding);
+	ok = false;
+      }
+      else {
+	params.stages[b.binding] = b.stages;
+	params.descriptor_counts[b.binding] = b.count;
+      }
+    }
+
+    return ok ? std::make_optional(params) : std::nullopt;
+  }
+
+  bool shader_reflection::accepts_vertex_attributes(const darray<VkVertexInputAttributeDescription>& attributes) const {
+    bool ok = true;
+
+    for (const vertex_input& input: vertex_inputs) {
+      auto it = std::find_if(attributes.begin(), attributes.end(),
+			     [&input](const VkVertexInputAttributeDescription& a) {
+			       return a.location == input.location;
+			     });
+
+      uint32_t components = 0;
+      component_kind kind = component_kind::sfloat;
+
+      if (it == attributes.end()) {
+	write_logf("vertex input at location %" PRIu32 " has no attribute", input.location);
+	ok = false;
+      }
+      else if (!format_components(it->format, components, kind)) {
+	write_logf("vertex input at location %" PRIu32 " has an unrecognized format 0x%" PRIx32,
+		   input.location,
+		   static_cast<uint32_t>(it->format));
+	ok = false;
+      }
+      else if (components != input.components || kind != input.kind) {
+	write_logf("vertex input at location %" PRIu32 " reads %" PRIu32 " components, its attribute has %" PRIu32,
+		   input.location,
+		   input.components,
+		   components);
+	ok = false;
+      }
+    }
+
+    return ok;
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "vk_common.hpp"
+#include "vk_image.hpp"
+
+#include <optional>
+
+namespace vulkan {
+  //
+  // What a compiled shader declares, read straight out of its SPIR-V:
+  // the descriptor bindings, the push constant block and the vertex
+  // inputs. Only the handful of instructions that describe those are
+  // decoded; everything else is skipped over.
+  //
+  // SPIR-V can't say everything a layout needs. Uniform and storage
+  // buffers come back as the plain descriptor types, since whether
+  // they're bound with dynamic offsets is the renderer's choice, and
+  // vertex inputs only carry their component count and kind - the
+  // offsets and packed formats (e.g. debug_vertex's UNORM color) are
+  // still the C++ side's to describe. They're checked against what
+  // the shader reads by accepts_vertex_attributes().
+  //
+  struct shader_reflection {
+    struct binding {
+      uint32_t set;
+      uint32_t binding;
+      VkDescriptorType type;
+      uint32_t count;
+      VkShaderStageFlags stages;
+    };
+
+    enum class component_kind
+      {
+       sfloat, // includes the normalized formats
+       sint,
+       uint
+      };
+
+    struct vertex_input {
+      uint32_t location;
+      uint32_t components;
+      component_kind kind;
+    };
+
+    VkShaderStageFlags stages{0};
+
+    // sorted by set, then binding
+    darray<binding> bindings{};
+
+    // empty, or a single range covering every stage's block
+    darray<VkPushConstantRange> push_constant_ranges{};
+
+    // the vertex stage's, sorted by location
+    darray<vertex_input> vertex_inputs{};
+
+    // Folds another stage's declarations into this one. Bindings
+    // both declare take the union of their stages; they have to
+    // agree on type and count.
+    bool merge(const shader_reflection& other);
+
+    // The bindings declared under set, as a descriptor set that
+    // covers bindings [0, max(highest + 1, min_bindings)); bindings
+    // no shader declares are padded with a single descriptor of the
+    // set's type, read by all of the set's stages. Every binding
+    // has to have the same type, which with dynamic set is the
+    // dynamic variant for uniform and storage buffers.
+    std::optional<descriptor_set_gen_params> set_params(uint32_t set,
+							bool dynamic,
+							uint32_t min_bindings = 0) const;
+
+    // every location the vertex stage reads has to be covered by an
+    // attribute with the same component count and kind
+    bool accepts_vertex_attributes(const darray<VkVertexInputAttributeDescription>& attributes) const;
+  };
+
+  std::optional<shader_reflection> reflect_spirv(const uint32_t* words, size_t word_count);
+
+  std::optional<shader_reflection> reflect_spv_file(const std::string& path);
+
+  // the merged reflection of every stage in paths
+  std::optional<shader_reflection> reflect_spv_files(const darray<std::string>& paths);
+}
@@ -0,0 +1,76 @@
+#include "vk_timeline.hpp"
+
+namespace vulkan {
+  bool gpu_timeline::init(VkDevice device) {
+    bool good =
+      c_assert(m_device == VK_NULL_HANDLE) &&
+      c_assert(device != VK_NULL_HANDLE);
+
+    if (good) {
+      m_device = device;
+
+      VkSemaphoreTypeCreateInfo type_info = {};
+      type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+      type_info.pNext = nullptr;
+      type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+      type_info.initialValue = 0;
+
+      VkSemaphoreCreateInfo create_info = {};
+      create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      create_info.pNext = &type_info;
+      create_info.flags = 0;
+
+      VK_FN(vkCreateSemaphore(m_device, &create_info, nullptr, &m_semaphore));
+
+      m_submitted = 0;
+      m_completed = 0;
+
+      good = H_OK(m_semaphore);
+    }
+
+    return good;
+  }
+
+  void gpu_timeline::free_mem() {
+    if (m_device != VK_NULL_HANDLE) {
+      free_device_handle<VkSemaphore, &vkDestroySemaphore>(m_device, m_semaphore);
+
+      m_device = VK_NULL_HANDLE;
+    }
+  }
+
+  uint64_t gpu_timeline::completed() {
+    if (m_semaphore != VK_NULL_HANDLE) {
+      uint64_t value = 0;
+
+      VK_FN(vkGetSemaphoreCounterValue(m_device, m_semaphore, &value));
+
+      if (api_ok()) {
+	m_completed = std::max(m_completed, value);
+      }
+    }
+
+    return m_completed;
+  }
+
+  bool gpu_timeline::wait(uint64_t value, uint64_t timeout_ns) {
+    bool good = c_assert(value <= m_submitted);
+
+    if (good && value > m_completed) {
+      VkSemaphoreWaitInfo wait_info = {};
+      wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+      wait_info.pNext = nullptr;
+      wait_info.flags = 0;
+      wait_info.semaphoreCount = 1;
+      wait_info.pSemaphores = &m_semaphore;
+      wait_info.pValues = &value;
+
+      VK_FN(vkWaitSemaphores(m_device, &wait_info, timeout_ns));
+
+      // a timeout leaves the counter short of value
+      good = api_ok() && completed() >= value;
+    }
+
+    return good;
+  }
+}
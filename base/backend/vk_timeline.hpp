@@ -0,0 +1,63 @@
+#pragma once
+
+#include "vk_common.hpp"
+
+namespace vulkan {
+  //
+  // A Vulkan 1.2 timeline semaphore that every graphics queue
+  // submission signals. Each submission takes the next value, so the
+  // counter says how far the GPU has got through everything submitted
+  // so far: anything that remembers the value of the submission that
+  // last used it can tell whether it's free again with reached(),
+  // which doesn't call into the driver once the value is known to be
+  // passed, or block on it with wait().
+  //
+  // Only submissions to the graphics queue signal it; values have to
+  // be signaled in increasing order, which a single queue guarantees.
+  // Not thread safe, for the same reason.
+  //
+  class gpu_timeline {
+    VkDevice m_device{VK_NULL_HANDLE};
+    VkSemaphore m_semaphore{VK_NULL_HANDLE};
+
+    // the last value handed out by next_signal()
+    uint64_t m_submitted{0};
+
+    // the last value read back from the semaphore
+    uint64_t m_completed{0};
+
+  public:
+    bool init(VkDevice device);
+
+    void free_mem();
+
+    bool ok() const {
+      return m_semaphore != VK_NULL_HANDLE;
+    }
+
+    VkSemaphore semaphore() const {
+      return m_semaphore;
+    }
+
+    // The value for the submission that's about to be made to
+    // signal. Every value that's handed out has to be submitted, in
+    // the order they were handed out.
+    uint64_t next_signal() {
+      return ++m_submitted;
+    }
+
+    uint64_t submitted() const {
+      return m_submitted;
+    }
+
+    // reads the counter back
+    uint64_t completed();
+
+    bool reached(uint64_t value) {
+      return value <= m_completed || value <= completed();
+    }
+
+    // value has to have been handed out by next_signal()
+    bool wait(uint64_t value, uint64_t timeout_ns = UINT64_MAX);
+  };
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vk_common.hpp"
+#include "vk_memory.hpp"
 
 namespace vulkan {
 
@@ -25,107 +26,91 @@ namespace vulkan {
     }    
   };
   
+  //
+  // Every uniform block lives in one persistently mapped ring buffer.
+  // The ring is split into one region per recorded command buffer, and
+  // each block has a slot at the same offset within every region.
+  // Descriptors point at the slots in region 0; the region a command
+  // buffer reads from is picked with a dynamic offset when the set
+  // is bound, so updating a block never touches descriptors, never
+  // maps memory, and never writes a region the GPU could still be
+  // reading - as long as the caller only updates the region of a
+  // command buffer whose last submission has completed.
+  //
   class uniform_block_pool : index_traits<int16_t, darray<VkDeviceSize>> {
   public:
     typedef index_traits_this_type::index_type index_type;
     static inline constexpr index_type k_unset = index_traits_this_type::k_unset;
     
   private:
+    struct ring {
+      VkBuffer buffer{VK_NULL_HANDLE};
+      device_allocation memory{};
+      VkDeviceSize region_size{0};
+      VkDeviceSize slot_alignment{1};
+      VkDeviceSize used{0}; // bytes of each region taken by slots
+      uint32_t num_regions{0};
+
+      bool ok() const {
+	return
+	  c_assert(H_OK(buffer)) &&
+	  c_assert(memory.mapped != nullptr) &&
+	  c_assert(num_regions > 0);
+      }
+    };
+
+    ring m_ring{};
+
     // uniform block data
-    darray<VkDeviceSize> m_dev_sizes{};
+    darray<VkDeviceSize> m_slot_offsets{};
     darray<uint32_t> m_user_sizes{};
-    darray<VkDeviceMemory> m_device_memories{};
-    darray<VkBuffer> m_buffers{};
     darray<void*> m_user_ptrs{};
 
     descriptor_set_pool* m_descriptor_set_pool{nullptr};
+
+    device_memory_pool* m_memory_pool{nullptr};
     
     index_type new_uniform_block() {
       index_type i{this->length()};
       
-      m_dev_sizes.push_back(num_max<VkDeviceSize>());
+      m_slot_offsets.push_back(num_max<VkDeviceSize>());
       m_user_sizes.push_back(UINT32_MAX);      
-      
-      m_device_memories.push_back(VK_NULL_HANDLE);
-      m_buffers.push_back(VK_NULL_HANDLE);
-
       m_user_ptrs.push_back(nullptr);
 
       return i;
     }
 
-    VkBuffer make_uniform_buffer(const device_resource_properties& resource_props,
-				 VkDeviceSize sz) const {
-      
-      return vulkan::make_buffer(resource_props,
-				 0,
-				 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				 sz);
+    static inline constexpr VkBufferUsageFlags k_usage_flags =
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
+    static VkDeviceSize align_up(VkDeviceSize x, VkDeviceSize alignment) {
+      return ((x + alignment - 1) / alignment) * alignment;
     }
-    
-    bool is_valid(const device_resource_properties& resource_props,
-		  VkDeviceSize desired_size,
-		  VkDeviceSize& out_required_size,
-		  int32_t& out_property_index) const {
-      
-      bool ret = false;
-
-      VkBuffer dummy = make_uniform_buffer(resource_props,
-					   desired_size);
-      
-      if (H_OK(dummy)) {
-	VkMemoryRequirements req = {};
-	
-	vkGetBufferMemoryRequirements(resource_props.device,
-				      dummy,
-				      &req);
-
-	out_required_size = req.size;
-
-	VkPhysicalDeviceMemoryProperties mem_props = {};
-
-	vkGetPhysicalDeviceMemoryProperties(resource_props.physical_device,
-					    &mem_props);
-	
-	out_property_index =
-	  find_memory_properties(&mem_props,
-				 req.memoryTypeBits,
-				 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-				 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	
-	ASSERT(out_property_index != -1);
 
-	ret =
-	  desired_size <= req.size &&
-	  out_property_index != -1;
-
-	vkDestroyBuffer(resource_props.device, dummy, nullptr);
-      }
-      
-      ASSERT(ret);
-            
-      return ret;
+    uint8_t* slot_ptr(index_type which, uint32_t region) const {
+      return
+	static_cast<uint8_t*>(m_ring.memory.mapped) +
+	region * m_ring.region_size +
+	m_slot_offsets[which];
     }
     
   public:
     uniform_block_pool()
-      : index_traits_this_type(m_dev_sizes)	    
+      : index_traits_this_type(m_slot_offsets)	    
     {}
 
     void free_mem(VkDevice device) {
-      for (index_type i{0}; i < this->length(); ++i) {
-	free_device_handle<VkDeviceMemory, &vkFreeMemory>(device,
-							  m_device_memories[i]);
-
-	free_device_handle<VkBuffer, &vkDestroyBuffer>(device,
-						       m_buffers[i]);
+      free_device_handle<VkBuffer, &vkDestroyBuffer>(device,
+						     m_ring.buffer);
+      
+      if (m_memory_pool != nullptr) {
+	m_memory_pool->free(m_ring.memory);
       }
 
-      m_device_memories.clear();
-      m_buffers.clear();
+      m_ring = ring{};
+
       m_user_ptrs.clear();
-      m_dev_sizes.clear();
+      m_slot_offsets.clear();
       m_user_sizes.clear();
     }
 
@@ -134,70 +119,130 @@ namespace vulkan {
 	m_descriptor_set_pool = p;
       }
     }
+
+    void set_memory_pool(device_memory_pool* p) {
+      if (c_assert(m_memory_pool == nullptr)) {
+	m_memory_pool = p;
+      }
+    }
+
+    // has to be called once, before any blocks are made
+    bool make_ring(const device_resource_properties& properties,
+		   uint32_t num_regions) {
+      bool ret = false;
+
+      if (c_assert(m_memory_pool != nullptr) &&
+	  c_assert(m_ring.buffer == VK_NULL_HANDLE) &&
+	  c_assert(num_regions > 0) &&
+	  properties.ok()) {
+	const VkPhysicalDeviceLimits& limits = m_memory_pool->limits();
+
+	// region boundaries double as flush boundaries when the
+	// memory isn't host coherent
+	VkDeviceSize atom = std::max(limits.nonCoherentAtomSize, VkDeviceSize{1});
+	
+	m_ring.slot_alignment = std::max(limits.minUniformBufferOffsetAlignment,
+					 VkDeviceSize{1});
+	
+	m_ring.region_size = align_up(st_config::c_uniform_block_pool::k_region_size,
+				      std::max(m_ring.slot_alignment, atom));
+	
+	m_ring.num_regions = num_regions;
+
+	VkDeviceSize size = m_ring.region_size * num_regions;
+
+	// the buffer comes first: its memory size
+	// is whatever the driver says it needs
+	m_ring.buffer = vulkan::make_buffer(properties,
+					    0,
+					    k_usage_flags,
+					    size);
+
+	std::optional<VkMemoryRequirements> opt_req{};
+
+	if (H_OK(m_ring.buffer)) {
+	  opt_req =
+	    m_memory_pool->buffer_requirements(make_buffer_create_info(properties,
+								       0,
+								       k_usage_flags,
+								       size),
+					       m_ring.buffer);
+	}
+
+	if (c_assert(opt_req.has_value())) {
+	  const VkMemoryRequirements& req = opt_req.value();
+
+	  int32_t memory_type =
+	    m_memory_pool->find_memory_type(req.memoryTypeBits,
+					    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	  // update_block() flushes when it's not coherent
+	  if (memory_type == -1) {
+	    memory_type =
+	      m_memory_pool->find_memory_type(req.memoryTypeBits,
+					      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	  }
+
+	  if (c_assert(memory_type != -1)) {
+	    auto opt_memory = m_memory_pool->allocate(static_cast<uint32_t>(memory_type),
+						      req.size,
+						      std::max(req.alignment, atom),
+						      resource_tiling::linear);
+
+	    if (c_assert(opt_memory.has_value())) {
+	      m_ring.memory = opt_memory.value();
+	    }
+	  }
+	}
+
+	if (H_OK(m_ring.buffer) && m_ring.memory.memory != VK_NULL_HANDLE) {
+	  VK_FN(vkBindBufferMemory(properties.device,
+				   m_ring.buffer,
+				   m_ring.memory.memory,
+				   m_ring.memory.offset));
+	  ret = api_ok();
+	}
+      }
+
+      ASSERT(ret);
+
+      return ret;
+    }
     
     index_type make_uniform_block(const device_resource_properties& properties,
 				  const uniform_block_gen_params& params)  {
       index_type ret{k_unset};
 
       if (c_assert(m_descriptor_set_pool != nullptr) &&
+	  c_assert(m_memory_pool != nullptr) &&
+	  m_ring.ok() &&
 	  properties.ok() &&
 	  params.ok() &&
 	  m_descriptor_set_pool->ok_descriptor_set(params.descriptor_set_index)) {
-	int32_t memory_property_index = -1;
-	// THIS needs to be queried from is_valid and passed to
-	// make_buffer_memory. It's the required size.
-	VkDeviceSize required_size = 0;
-	
-	bool valid = is_valid(properties,
-			      static_cast<VkDeviceSize>(params.block_size),
-			      required_size,
-			      memory_property_index);
-
-	if (c_assert(valid)) {
-	  VkBuffer ubuffer{VK_NULL_HANDLE};
-	  VkDeviceMemory device_memory{VK_NULL_HANDLE};
-      
-	  if (api_ok()) {
-	    device_memory = make_device_memory(properties.device,
-					       params.block_data,
-					       params.block_size,
-					       required_size,
-					       memory_property_index);
-	  }
+	VkDeviceSize slot = align_up(m_ring.used, m_ring.slot_alignment);
+	VkDeviceSize size = static_cast<VkDeviceSize>(params.block_size);
 
-	  if (H_OK(device_memory)) {
-	    ubuffer = make_uniform_buffer(properties,
-					  params.block_size);
-	  }
-      
-	  bool bound = false;
-	  if (H_OK(ubuffer)) {	
-	    VK_FN(vkBindBufferMemory(properties.device,
-				     ubuffer,
-				     device_memory,
-				     0));
-	    bound = api_ok();
-	  }      
-
-	  if (bound) {
-	    
-	    bool write_result = m_descriptor_set_pool->write_buffer(params.descriptor_set_index,
-								    properties.device,
-								    ubuffer,
-								    static_cast<VkDeviceSize>(params.block_size),
-								    params.binding_index,
-								    params.array_element_index);
-
-	    if (c_assert(write_result)) {							    
-	      ret = new_uniform_block();
-
-	      m_dev_sizes[ret] = required_size;
-	      m_user_sizes[ret] = params.block_size;
-	
-	      m_device_memories[ret] = device_memory;
-	      m_buffers[ret] = ubuffer;
+	if (c_assert(slot + size <= m_ring.region_size)) {
+	  bool write_result = m_descriptor_set_pool->write_buffer(params.descriptor_set_index,
+								  properties.device,
+								  m_ring.buffer,
+								  slot,
+								  size,
+								  params.binding_index,
+								  params.array_element_index);
+
+	  if (c_assert(write_result)) {							    
+	    ret = new_uniform_block();
+
+	    m_slot_offsets[ret] = slot;
+	    m_user_sizes[ret] = params.block_size;
+	    m_user_ptrs[ret] = params.block_data;
+
+	    m_ring.used = slot + size;
 
-	      m_user_ptrs[ret] = params.block_data;
+	    for (uint32_t region = 0; region < m_ring.num_regions; ++region) {
+	      update_block(ret, region);
 	    }
 	  }
 	}
@@ -211,17 +256,42 @@ namespace vulkan {
     VkBuffer buffer(index_type which) const {
       VkBuffer ret{VK_NULL_HANDLE};
       if (ok_index(which)) {
-	ret = m_buffers.at(which);
+	ret = m_ring.buffer;
       }
       return ret;
     }
 
-    void update_block(index_type which, VkDevice device) const {
-      if (ok_index(which)) {
-	write_device_memory(device,
-			    m_device_memories.at(which),
-			    m_user_ptrs.at(which),
-			    static_cast<VkDeviceSize>(m_user_sizes.at(which)));
+    uint32_t num_regions() const {
+      return m_ring.num_regions;
+    }
+
+    // where which's slot in region starts, relative to buffer(which)
+    VkDeviceSize block_offset(index_type which, uint32_t region) const {
+      VkDeviceSize ret{0};
+      if (ok_index(which) && c_assert(region < m_ring.num_regions)) {
+	ret = region * m_ring.region_size + m_slot_offsets[which];
+      }
+      return ret;
+    }
+
+    // passed for each of the uniform descriptor set's
+    // descriptors when it's bound for a command buffer that reads region
+    uint32_t dynamic_offset(uint32_t region) const {
+      ASSERT(region < m_ring.num_regions);
+      return static_cast<uint32_t>(region * m_ring.region_size);
+    }
+
+    // copies the block's data into its slot in region;
+    // the GPU must be done with any submission reading region
+    void update_block(index_type which, uint32_t region) const {
+      if (ok_index(which) && c_assert(region < m_ring.num_regions)) {
+	memcpy(slot_ptr(which, region),
+	       m_user_ptrs[which],
+	       static_cast<size_t>(m_user_sizes[which]));
+
+	m_memory_pool->flush(m_ring.memory,
+			     block_offset(which, region),
+			     static_cast<VkDeviceSize>(m_user_sizes[which]));
       }
     }
   };
@@ -240,14 +310,14 @@ namespace vulkan {
       return r;
     }
 
-    bool cmd_buffer_update(VkCommandBuffer cmd_buffer) const {
+    bool cmd_buffer_update(VkCommandBuffer cmd_buffer, uint32_t region) const {
       bool r = ok();
       if (r) {
 	VkBuffer ubuffer = pool->buffer(index);
 
 	vkCmdUpdateBuffer(cmd_buffer,
 			  ubuffer,
-			  0,
+			  pool->block_offset(index, region),
 			  sizeof(data),
 			  static_cast<const void*>(&data));
       }
@@ -0,0 +1,477 @@
+#include "vk_upload.hpp"
+
+#include <string.h>
+
+namespace vulkan {
+  static VkCommandPool make_upload_command_pool(VkDevice device, uint32_t family) {
+    VkCommandPoolCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    create_info.pNext = nullptr;
+    // batches' command buffers are re-recorded each time they're reused
+    create_info.flags =
+      VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    create_info.queueFamilyIndex = family;
+
+    VkCommandPool pool{VK_NULL_HANDLE};
+
+    VK_FN(vkCreateCommandPool(device, &create_info, nullptr, &pool));
+
+    return pool;
+  }
+
+  static VkCommandBuffer make_upload_command_buffer(VkDevice device, VkCommandPool pool) {
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer cmd{VK_NULL_HANDLE};
+
+    VK_FN(vkAllocateCommandBuffers(device, &alloc_info, &cmd));
+
+    return cmd;
+  }
+
+  bool upload_manager::init(VkDevice device,
+			    gpu_timeline& timeline,
+			    queue transfer_queue,
+			    queue graphics_queue,
+			    VkBuffer ring,
+			    void* ring_mapped,
+			    VkDeviceSize ring_size) {
+    bool good =
+      c_assert(m_device == VK_NULL_HANDLE) &&
+      c_assert(device != VK_NULL_HANDLE) &&
+      c_assert(timeline.ok()) &&
+      c_assert(H_OK(transfer_queue.handle)) &&
+      c_assert(H_OK(graphics_queue.handle)) &&
+      c_assert(H_OK(ring)) &&
+      c_assert(ring_mapped != nullptr) &&
+      c_assert(ring_size > 0);
+
+    if (good) {
+      m_device = device;
+      m_timeline = &timeline;
+      m_transfer_queue = transfer_queue;
+      m_graphics_queue = graphics_queue;
+
+      m_ring = ring;
+      m_ring_mapped = static_cast<uint8_t*>(ring_mapped);
+      m_ring_size = ring_size;
+
+      m_graphics_pool = make_upload_command_pool(m_device, m_graphics_queue.family);
+
+      if (separate_families()) {
+	m_transfer_pool = make_upload_command_pool(m_device, m_transfer_queue.family);
+      }
+
+      good =
+	H_OK(m_graphics_pool) &&
+	(!separate_families() || H_OK(m_transfer_pool));
+    }
+
+    return good;
+  }
+
+  void upload_manager::free_mem() {
+    if (m_device != VK_NULL_HANDLE) {
+      while (wait_oldest()) {}
+
+      for (batch& b: m_free_batches) {
+	free_device_handle<VkSemaphore, &vkDestroySemaphore>(m_device, b.transferred);
+      }
+
+      m_free_batches.clear();
+
+      // the command buffers go with their pools
+      free_device_handle<VkCommandPool, &vkDestroyCommandPool>(m_device, m_transfer_pool);
+      free_device_handle<VkCommandPool, &vkDestroyCommandPool>(m_device, m_graphics_pool);
+
+      m_copies.clear();
+      m_graphics_fns.clear();
+
+      m_device = VK_NULL_HANDLE;
+      m_timeline = nullptr;
+    }
+  }
+
+  std::optional<VkDeviceSize> upload_manager::ring_alloc(VkDeviceSize size) {
+    size = ((size + k_ring_alignment - 1) / k_ring_alignment) * k_ring_alignment;
+
+    if (m_ring_used == 0) {
+      m_ring_head = 0;
+      m_ring_tail = 0;
+    }
+    // head caught up with tail
+    else if (m_ring_head == m_ring_tail) {
+      return std::nullopt;
+    }
+
+    std::optional<VkDeviceSize> offset{};
+    VkDeviceSize skipped = 0;
+
+    // free space is [head, end) and [0, tail)
+    if (m_ring_head >= m_ring_tail) {
+      if (size <= m_ring_size - m_ring_head) {
+	offset = m_ring_head;
+      }
+      // a run can't wrap, so what's left at the end is skipped
+      else if (size <= m_ring_tail) {
+	offset = 0;
+	skipped = m_ring_size - m_ring_head;
+      }
+    }
+    // free space is [head, tail)
+    else if (size <= m_ring_tail - m_ring_head) {
+      offset = m_ring_head;
+    }
+
+    if (offset) {
+      m_ring_head = offset.value() + size;
+      m_ring_used += size + skipped;
+      m_open_bytes += size + skipped;
+    }
+
+    return offset;
+  }
+
+  std::optional<upload_manager::batch> upload_manager::acquire_batch() {
+    batch b{};
+
+    if (!m_free_batches.empty()) {
+      b = m_free_batches.back();
+      m_free_batches.pop_back();
+    }
+    else {
+      b.graphics_cmd = make_upload_command_buffer(m_device, m_graphics_pool);
+
+      if (separate_families()) {
+	b.transfer_cmd = make_upload_command_buffer(m_device, m_transfer_pool);
+
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VK_FN(vkCreateSemaphore(m_device, &semaphore_info, nullptr, &b.transferred));
+      }
+    }
+
+    bool good =
+      H_OK(b.graphics_cmd) &&
+      (!separate_families() || (H_OK(b.transfer_cmd) && H_OK(b.transferred)));
+
+    return good ? std::make_optional(b) : std::nullopt;
+  }
+
+  void upload_manager::retire(batch& b) {
+    m_ring_tail = b.ring_end;
+    m_ring_used -= b.ring_bytes;
+
+    b.id = k_no_ticket;
+    m_free_batches.push_back(b);
+  }
+
+  bool upload_manager::wait_oldest() {
+    bool waited = !m_in_flight.empty();
+
+    if (waited) {
+      batch b = m_in_flight.front();
+      m_in_flight.pop_front();
+
+      waited = m_timeline->wait(b.id);
+
+      retire(b);
+    }
+
+    return waited;
+  }
+
+  void upload_manager::record_copies(VkCommandBuffer cmd) const {
+    darray<VkBufferCopy> regions{};
+
+    // one vkCmdCopyBuffer() per run of copies into the same buffer
+    for (size_t i = 0; i < m_copies.size(); ++i) {
+      regions.push_back(m_copies[i].region);
+
+      bool last_of_run =
+	i + 1 == m_copies.size() ||
+	m_copies[i + 1].dst != m_copies[i].dst;
+
+      if (last_of_run) {
+	vkCmdCopyBuffer(cmd,
+			m_ring,
+			m_copies[i].dst,
+			static_cast<uint32_t>(regions.size()),
+			regions.data());
+
+	regions.clear();
+      }
+    }
+  }
+
+  bool upload_manager::upload_buffer(VkBuffer dst,
+				     VkDeviceSize dst_offset,
+				     const void* data,
+				     VkDeviceSize size,
+				     VkPipelineStageFlags dst_stage,
+				     VkAccessFlags dst_access) {
+    bool good =
+      c_assert(m_device != VK_NULL_HANDLE) &&
+      c_assert(H_OK(dst)) &&
+      c_assert(data != nullptr);
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    VkDeviceSize copied = 0;
+
+    while (good && copied < size) {
+      // at most half the ring at once, so that a large upload can
+      // go ahead while the batch before it is still in flight
+      VkDeviceSize chunk = std::min(size - copied, m_ring_size / 2);
+
+      auto offset = ring_alloc(chunk);
+
+      while (good && !offset.has_value()) {
+	// make room: submit what's queued and
+	// wait for the oldest batch to finish
+	flush();
+
+	good = c_assert(wait_oldest());
+
+	if (good) {
+	  m_stats.ring_stalls++;
+	  offset = ring_alloc(chunk);
+	}
+      }
+
+      if (good) {
+	memcpy(m_ring_mapped + offset.value(), bytes + copied, chunk);
+
+	VkBufferCopy region = {};
+	region.srcOffset = offset.value();
+	region.dstOffset = dst_offset + copied;
+	region.size = chunk;
+
+	m_copies.push_back({ dst, region, dst_stage, dst_access });
+
+	copied += chunk;
+      }
+    }
+
+    return good;
+  }
+
+  bool upload_manager::record_graphics(record_fn_t fn) {
+    bool good = c_assert(static_cast<bool>(fn));
+
+    if (good) {
+      m_graphics_fns.push_back(fn);
+    }
+
+    return good;
+  }
+
+  upload_manager::ticket upload_manager::flush() {
+    if (m_copies.empty() && m_graphics_fns.empty()) {
+      return k_no_ticket;
+    }
+
+    auto opt_batch = acquire_batch();
+
+    if (!c_assert(opt_batch.has_value())) {
+      return k_no_ticket;
+    }
+
+    batch b = opt_batch.value();
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkPipelineStageFlags dst_stages = 0;
+
+    darray<VkBufferMemoryBarrier> releases{};
+    darray<VkBufferMemoryBarrier> acquires{};
+
+    for (const copy& c: m_copies) {
+      VkBufferMemoryBarrier barrier = {};
+      barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      barrier.pNext = nullptr;
+      barrier.srcQueueFamilyIndex = m_transfer_queue.family;
+      barrier.dstQueueFamilyIndex = m_graphics_queue.family;
+      barrier.buffer = c.dst;
+      barrier.offset = c.region.dstOffset;
+      barrier.size = c.region.size;
+
+      // the release only makes the copy available; the
+      // acquire makes it visible to how it's read
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = 0;
+      releases.push_back(barrier);
+
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = c.dst_access;
+      acquires.push_back(barrier);
+
+      dst_stages |= c.dst_stage;
+    }
+
+    bool transfer_submitted = false;
+
+    VK_FN(vkBeginCommandBuffer(b.graphics_cmd, &begin_info));
+
+    if (!m_copies.empty()) {
+      if (separate_families()) {
+	VK_FN(vkBeginCommandBuffer(b.transfer_cmd, &begin_info));
+
+	record_copies(b.transfer_cmd);
+
+	vkCmdPipelineBarrier(b.transfer_cmd,
+			     VK_PIPELINE_STAGE_TRANSFER_BIT,
+			     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			     0,
+			     0, nullptr,
+			     static_cast<uint32_t>(releases.size()), releases.data(),
+			     0, nullptr);
+
+	VK_FN(vkEndCommandBuffer(b.transfer_cmd));
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &b.transfer_cmd;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &b.transferred;
+
+	VK_FN(vkQueueSubmit(m_transfer_queue.handle, 1, &submit_info, VK_NULL_HANDLE));
+
+	transfer_submitted = api_ok();
+
+	// the semaphore wait covers the release; the
+	// acquire's source scope is empty
+	vkCmdPipelineBarrier(b.graphics_cmd,
+			     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			     dst_stages,
+			     0,
+			     0, nullptr,
+			     static_cast<uint32_t>(acquires.size()), acquires.data(),
+			     0, nullptr);
+      }
+      else {
+	record_copies(b.graphics_cmd);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+
+	for (const copy& c: m_copies) {
+	  barrier.dstAccessMask |= c.dst_access;
+	}
+
+	vkCmdPipelineBarrier(b.graphics_cmd,
+			     VK_PIPELINE_STAGE_TRANSFER_BIT,
+			     dst_stages,
+			     0,
+			     1, &barrier,
+			     0, nullptr,
+			     0, nullptr);
+      }
+    }
+
+    for (const record_fn_t& fn: m_graphics_fns) {
+      fn(b.graphics_cmd);
+    }
+
+    VK_FN(vkEndCommandBuffer(b.graphics_cmd));
+
+    // taken last: nothing else can be submitted to the
+    // graphics queue between this and the submit
+    b.id = m_timeline->next_signal();
+
+    VkSemaphore signal_semaphore = m_timeline->semaphore();
+    uint64_t wait_value = 0; // binary; ignored
+    
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext = nullptr;
+    timeline_info.waitSemaphoreValueCount = transfer_submitted ? 1 : 0;
+    timeline_info.pWaitSemaphoreValues = &wait_value;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &b.id;
+    
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &b.graphics_cmd;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &signal_semaphore;
+
+    if (transfer_submitted) {
+      submit_info.waitSemaphoreCount = 1;
+      submit_info.pWaitSemaphores = &b.transferred;
+      submit_info.pWaitDstStageMask = &dst_stages;
+    }
+
+    VK_FN(vkQueueSubmit(m_graphics_queue.handle, 1, &submit_info, VK_NULL_HANDLE));
+
+    b.ring_end = m_ring_head;
+    b.ring_bytes = m_open_bytes;
+
+    m_open_bytes = 0;
+
+    m_stats.submissions += transfer_submitted ? 2 : 1;
+    m_stats.copies += m_copies.size();
+
+    VkDeviceSize bytes = 0;
+
+    for (const copy& c: m_copies) {
+      bytes += c.region.size;
+    }
+
+    m_stats.bytes += bytes;
+
+    STATIC_IF (st_config::c_upload::k_log_flushes) {
+      write_logf("upload flush %" PRIu64 ": %" PRIu64 " copies, %" PRIu64 " bytes, %" PRIu64 " recorded on the graphics queue",
+		 b.id,
+		 static_cast<uint64_t>(m_copies.size()),
+		 static_cast<uint64_t>(bytes),
+		 static_cast<uint64_t>(m_graphics_fns.size()));
+    }
+
+    m_copies.clear();
+    m_graphics_fns.clear();
+
+    m_in_flight.push_back(b);
+
+    return b.id;
+  }
+
+  void upload_manager::poll() {
+    while (!m_in_flight.empty() &&
+	   m_timeline->reached(m_in_flight.front().id)) {
+      batch b = m_in_flight.front();
+      m_in_flight.pop_front();
+
+      retire(b);
+    }
+  }
+
+  bool upload_manager::complete(ticket t) {
+    poll();
+    return m_timeline->reached(t);
+  }
+
+  bool upload_manager::wait(ticket t) {
+    bool good = m_timeline->wait(t);
+
+    if (good) {
+      poll();
+    }
+
+    return good;
+  }
+}
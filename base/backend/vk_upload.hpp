@@ -0,0 +1,181 @@
+#pragma once
+
+#include "vk_common.hpp"
+#include "vk_timeline.hpp"
+
+#include <deque>
+
+namespace vulkan {
+  //
+  // Batched, asynchronous uploads.
+  //
+  // upload_buffer() copies its data into a persistently mapped staging
+  // ring straight away and queues a copy out of it; nothing is
+  // submitted until flush(), which puts every queued copy into one
+  // command buffer. The caller never waits on the GPU: each flush()
+  // returns a ticket, which is the gpu_timeline value its graphics
+  // submission signals, and complete() says whether the GPU has got
+  // that far. Ring space is reclaimed as batches complete. The only
+  // time a caller can block is when the ring is full, in which case
+  // the oldest batch is waited on; that's counted in
+  // stats::ring_stalls.
+  //
+  // When the transfer queue belongs to another family than the
+  // graphics queue, the copies run there. The range each copy writes
+  // is released to the graphics family at the end of the transfer
+  // submission and acquired by a small graphics submission that waits
+  // on the transfer's semaphore. Anything recorded with
+  // record_graphics() goes into that same graphics command buffer,
+  // after the acquires. Because the graphics submission goes ahead of
+  // anything the renderer submits afterwards, draws submitted after a
+  // flush() see its data without the CPU waiting for it.
+  //
+  // With a single family there's only the graphics command buffer:
+  // the copies, a barrier, then whatever was recorded.
+  //
+  // Not thread safe; it's driven by the thread that submits to the
+  // graphics queue.
+  //
+  class upload_manager {
+  public:
+    // a gpu_timeline value
+    typedef uint64_t ticket;
+
+    // the ticket for "nothing to wait for"
+    static constexpr inline ticket k_no_ticket = 0;
+
+    struct queue {
+      uint32_t family{UINT32_MAX};
+      VkQueue handle{VK_NULL_HANDLE};
+    };
+
+    struct stats {
+      uint64_t submissions{0};
+      uint64_t copies{0};
+      VkDeviceSize bytes{0};
+      // times a caller had to wait for ring space
+      uint32_t ring_stalls{0};
+    };
+
+    typedef std::function<void(VkCommandBuffer)> record_fn_t;
+
+  private:
+    struct copy {
+      VkBuffer dst;
+      VkBufferCopy region;
+
+      // how the graphics queue reads it
+      VkPipelineStageFlags dst_stage;
+      VkAccessFlags dst_access;
+    };
+
+    struct batch {
+      ticket id{k_no_ticket};
+
+      VkCommandBuffer transfer_cmd{VK_NULL_HANDLE};
+      VkCommandBuffer graphics_cmd{VK_NULL_HANDLE};
+      VkSemaphore transferred{VK_NULL_HANDLE};
+
+      // where the ring's tail moves when this completes,
+      // and how many bytes that gives back
+      VkDeviceSize ring_end{0};
+      VkDeviceSize ring_bytes{0};
+    };
+
+    static constexpr inline VkDeviceSize k_ring_alignment = 16;
+
+    VkDevice m_device{VK_NULL_HANDLE};
+
+    gpu_timeline* m_timeline{nullptr};
+
+    queue m_transfer_queue{};
+    queue m_graphics_queue{};
+
+    VkCommandPool m_transfer_pool{VK_NULL_HANDLE};
+    VkCommandPool m_graphics_pool{VK_NULL_HANDLE};
+
+    VkBuffer m_ring{VK_NULL_HANDLE};
+    uint8_t* m_ring_mapped{nullptr};
+    VkDeviceSize m_ring_size{0};
+
+    VkDeviceSize m_ring_head{0};
+    VkDeviceSize m_ring_tail{0};
+    VkDeviceSize m_ring_used{0};
+
+    // what the next flush() submits
+    darray<copy> m_copies{};
+    darray<record_fn_t> m_graphics_fns{};
+    VkDeviceSize m_open_bytes{0};
+
+    // oldest first
+    std::deque<batch> m_in_flight{};
+    darray<batch> m_free_batches{};
+
+    stats m_stats{};
+
+    bool separate_families() const {
+      return m_transfer_queue.family != m_graphics_queue.family;
+    }
+
+    std::optional<VkDeviceSize> ring_alloc(VkDeviceSize size);
+
+    std::optional<batch> acquire_batch();
+
+    // batch's timeline value has been reached
+    void retire(batch& b);
+
+    // waits for the oldest batch in flight
+    bool wait_oldest();
+
+    void record_copies(VkCommandBuffer cmd) const;
+
+  public:
+    // ring is host visible and coherent, mapped at ring_mapped, and
+    // was created with VK_BUFFER_USAGE_TRANSFER_SRC_BIT. It's still
+    // owned by the caller, who frees it after free_mem(). timeline
+    // is the one graphics_queue's other submissions signal, and has
+    // to outlive this.
+    bool init(VkDevice device,
+	      gpu_timeline& timeline,
+	      queue transfer_queue,
+	      queue graphics_queue,
+	      VkBuffer ring,
+	      void* ring_mapped,
+	      VkDeviceSize ring_size);
+
+    // waits for everything in flight
+    void free_mem();
+
+    // Copies data into the ring and queues a copy of it into
+    // [dst_offset, dst_offset + size) of dst. dst_stage and dst_access
+    // are how the graphics queue reads dst afterwards. Data that
+    // doesn't fit in the ring at once is split across batches.
+    // The copy's ticket is the one the next flush() returns.
+    bool upload_buffer(VkBuffer dst,
+		       VkDeviceSize dst_offset,
+		       const void* data,
+		       VkDeviceSize size,
+		       VkPipelineStageFlags dst_stage,
+		       VkAccessFlags dst_access);
+
+    // fn is recorded into the next flush()'s graphics command
+    // buffer, after the copies it makes visible
+    bool record_graphics(record_fn_t fn);
+
+    // submits everything queued since the last flush(), and returns
+    // the ticket for it; k_no_ticket if nothing was queued
+    ticket flush();
+
+    // retires the batches the GPU has finished
+    void poll();
+
+    bool complete(ticket t);
+
+    // blocks until t is complete
+    bool wait(ticket t);
+
+    const stats& get_stats() const {
+      return m_stats;
+    }
+  };
+}
@@ -10,11 +10,21 @@
 #include "common.hpp"
 #include "device_context.hpp"
 #include "geom.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_bake.hpp"
+#include "debug_draw.hpp"
+#include "parallel.hpp"
 
 #include "vk_common.hpp"
+#include "vk_memory.hpp"
 #include "vk_image.hpp"
 #include "vk_uniform_buffer.hpp"
 #include "vk_pipeline.hpp"
+#include "vk_pipeline_cache.hpp"
+#include "vk_reflect.hpp"
+#include "vk_timeline.hpp"
+#include "vk_upload.hpp"
+#include "vk_profiler.hpp"
 #include "vk_model.hpp"
 
 #include <optional>
@@ -25,6 +35,8 @@
 #include <iostream>
 #include <functional>
 #include <variant>
+#include <chrono>
+#include <memory>
 
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -50,6 +62,8 @@ namespace vulkan {
   struct queue_family_indices {
     std::optional<uint32_t> graphics_family{};
     std::optional<uint32_t> present_family{};
+    // a family that can transfer but not draw; not required
+    std::optional<uint32_t> transfer_family{};
 
     bool ok() const {
       bool r =
@@ -68,8 +82,8 @@ namespace vulkan {
 
   struct framebuffer_attachments {
     struct color_depth_pair {
-      image_pool::index_type color_attachment;
-      image_pool::index_type depth_attachment;
+      image_pool::index_type color_attachment{image_pool::k_unset};
+      image_pool::index_type depth_attachment{image_pool::k_unset};
     };
     
     darray<color_depth_pair> data{};
@@ -162,22 +176,70 @@ namespace vulkan {
     
   }
   
+  namespace storage_block {
+    // an element of tri_ubo.vert.glsl's instance buffer (std430)
+    struct instance {
+      mat4_t model_to_world{R(1.0)};
+      uint32_t material{0};
+      uint32_t padding[3]{};
+    };
+
+    static_assert(sizeof(instance) == 80, "instance must match its std430 layout");
+
+    static constexpr inline uint32_t k_binding_instances = 0;
+
+    //
+    // cull.comp.glsl's buffers (std430), for st_config's k_gpu_driven
+    //
+
+    // one per model, drawing all of its instances
+    struct cull_object {
+      vec4_t sphere{R(0)}; // world space center, radius
+      uint32_t index_count{0};
+      uint32_t first_index{0};
+      int32_t vertex_offset{0};
+      uint32_t first_instance{0};
+      uint32_t instance_count{0};
+      uint32_t flags{0};
+      uint32_t padding[2]{};
+    };
+
+    static_assert(sizeof(cull_object) == 48, "cull_object must match its std430 layout");
+
+    // written by the host before each submission, except for
+    // draw_count, which the GPU zeroes and then counts draws with
+    struct cull_frame {
+      vec4_t planes[4]{}; // normal, d; module_geom::frustum's side planes
+      uint32_t num_objects{0};
+      uint32_t draw_count{0};
+      uint32_t padding[2]{};
+    };
+
+    static_assert(sizeof(cull_frame) == 80, "cull_frame must match its std430 layout");
+
+    // the indirect stride is sizeof(cull_draw)
+    struct cull_draw {
+      VkDrawIndexedIndirectCommand command;
+      uint32_t object;
+    };
+
+    static_assert(sizeof(cull_draw) == 24, "cull_draw must match its std430 layout");
+
+    static constexpr inline uint32_t k_cull_object_never_cull = 1 << 0;
+
+    static constexpr inline uint32_t k_cull_group_size = 64; // local_size_x
+
+    static constexpr inline uint32_t k_binding_cull_objects = 0;
+    static constexpr inline uint32_t k_binding_cull_frame = 1;
+    static constexpr inline uint32_t k_binding_cull_draws = 2;
+  }
+  
   namespace push_constant {
     // NOTE:
-    // currently the basic_pbr and
-    // model push constants
-    // are used in the same program, just at different stages.
-    // the model is used in the vertex stage, and the
-    // standard surface in the fragment shage.
-    // despite being used at different stages,
-    // the push constants are viewed as one contiguous
-    // buffer for a given pipeline layout;
-    // thus, a byte offset for at least one of these
-    // must be specified. For now, the model
-    // offset is listed here at <k_model_offset> bytes.
-    // there is a hole in the middle between the two,
-    // but that's ok since basic_pbr will end
-    // up having more parameters as we move forward.
+    // basic_pbr is the only push constant block; it's read
+    // by the fragment stage. Model transforms used to be
+    // pushed per draw as well, but they live in the
+    // instance buffer now (see storage_block::instance).
     
     // autodesk - WIP
     struct basic_pbr {
@@ -188,44 +250,44 @@ namespace vulkan {
       float metallic;
       float roughness;
       float ao;
-      int sampler;
-    };
-
-    struct model {
-      mat4_t model_to_world{R(1.0)};
+      int padding2;
     };
-
-    static inline constexpr uint32_t k_model_offset = 64;
+    
+    // the fragment shader's block ends at ao; padding2
+    // only rounds the C++ struct up to 16 bytes
+    static constexpr inline uint32_t k_basic_pbr_size = offsetof(basic_pbr, padding2);
     
     template <class T, VkShaderStageFlags flags>
-    static inline VkPushConstantRange range(uint32_t offset = 0) {
+    static inline VkPushConstantRange range(uint32_t offset = 0, uint32_t size = sizeof(T)) {
       return
 	{
 	 flags,
 	 offset,
-	 sizeof(T)
+	 size
 	};
     }
 
     template <class T, VkShaderStageFlags flags>
-    static inline void upload(T* ptr, VkCommandBuffer cmd_buffer, VkPipelineLayout layout, uint32_t offset=0) {
+    static inline void upload(T* ptr,
+			      VkCommandBuffer cmd_buffer,
+			      VkPipelineLayout layout,
+			      uint32_t offset = 0,
+			      uint32_t size = sizeof(T)) {
       vkCmdPushConstants(cmd_buffer,
 			 layout,
 			 flags,
 			 offset,
-			 sizeof(T),
+			 size,
 			 ptr);
     }
 
+    // what the pipeline layout's range, which is reflected
+    // from tri_ubo.frag.spv, has to match
     static inline VkPushConstantRange basic_pbr_range() {
       return range<basic_pbr,
-		   VK_SHADER_STAGE_FRAGMENT_BIT>();
+		   VK_SHADER_STAGE_FRAGMENT_BIT>(0, k_basic_pbr_size);
     }
 
-    static inline VkPushConstantRange model_range() {
-      return range<model,
-		   VK_SHADER_STAGE_VERTEX_BIT>(k_model_offset);
-    }
 
     static inline void basic_pbr_upload(basic_pbr& pc,
 					       VkCommandBuffer cmd_buffer,
@@ -233,17 +295,9 @@ namespace vulkan {
       upload<basic_pbr,
 	     VK_SHADER_STAGE_FRAGMENT_BIT>(&pc,
 					   cmd_buffer,
-					   layout);
-    }
-
-    static inline void model_upload(model& pc,
-				    VkCommandBuffer cmd_buffer,
-				    VkPipelineLayout layout) {
-      upload<model,
-	     VK_SHADER_STAGE_VERTEX_BIT>(&pc,
-					 cmd_buffer,
-					 layout,
-					 k_model_offset);
+					   layout,
+					   0,
+					   k_basic_pbr_size);
     }
 
 
@@ -264,7 +318,7 @@ namespace vulkan {
 	 R(0.5),
 	 // ambient occlusion
 	 R(1),
-	 // sampler index
+	 // padding2
 	 0
 	};
     }
@@ -272,17 +326,17 @@ namespace vulkan {
 
   struct buffer_data {
     VkBuffer handle{VK_NULL_HANDLE};
-    VkDeviceMemory memory{VK_NULL_HANDLE};
+    device_allocation memory{};
 
     bool ok() const {
       return
 	c_assert(H_OK(handle)) &&
-	c_assert(H_OK(memory));
+	memory.ok();
     }
 
-    void free_mem(VkDevice device) {
+    void free_mem(VkDevice device, device_memory_pool& pool) {
       free_device_handle<VkBuffer, &vkDestroyBuffer>(device, handle);
-      free_device_handle<VkDeviceMemory, &vkFreeMemory>(device, memory);
+      pool.free(memory);
     }
 
     void bind_vertex(VkCommandBuffer cmd_buffer) {
@@ -293,6 +347,13 @@ namespace vulkan {
 			     &handle,
 			     &vertex_buffer_offset);
     }
+
+    void bind_index(VkCommandBuffer cmd_buffer) {
+      vkCmdBindIndexBuffer(cmd_buffer,
+			   handle,
+			   0, // offset
+			   VK_INDEX_TYPE_UINT32);
+    }
   };
   
   class renderer {       
@@ -312,9 +373,51 @@ namespace vulkan {
 
     darray<VkSemaphore> m_vk_sems_render_finished{};
 
-    darray<VkFence> m_vk_fences_in_flight{};
+    // signaled by every graphics queue submission
+    gpu_timeline m_timeline{};
 
-    darray<VkFence> m_vk_images_in_flight{};
+    // the timeline value of the last submission that used each
+    // frame in flight's semaphores, and each swapchain image's
+    // command buffer and uniform region
+    darray<uint64_t> m_frame_values{};
+    darray<uint64_t> m_image_values{};
+
+    uint64_t m_frames_submitted{0};
+
+    // a slot per swapchain image's command buffer
+    gpu_profiler m_gpu_profiler{};
+
+    // set when acquiring or presenting says the swapchain no longer
+    // matches the surface, or when the window's framebuffer is resized
+    // (some platforms, like Wayland, never report the former);
+    // render() recreates it first thing
+    bool m_swapchain_stale{false};
+
+    // set when a recreated swapchain's image count differs from
+    // the one everything per image was sized to
+    bool m_restart_required{false};
+
+  public:
+    struct headless_params {
+      VkExtent2D extent{};
+      uint32_t image_count{0};
+      // copy every frame back to host memory; see last_frame_pixels()
+      bool readback{false};
+    };
+
+  private:
+    // set before init_context() to render without a window;
+    // see set_headless()
+    std::optional<headless_params> m_headless{};
+
+    // headless: the images that stand in for the swapchain's,
+    // and where frames are copied back to, a region per image
+    darray<image_pool::index_type> m_offscreen_images{};
+    buffer_data m_readback_buffer{};
+    VkDeviceSize m_readback_size{0};
+
+    // frame times are measured from here
+    std::chrono::steady_clock::time_point m_start_time{std::chrono::steady_clock::now()};
 
     darray<double> m_frame_stimes{};
     darray<double> m_frame_dtimes{};
@@ -324,6 +427,9 @@ namespace vulkan {
     descriptors m_descriptors{};
     
     descriptor_set_pool m_descriptor_set_pool{};
+
+    // every buffer and image is placed in memory from here
+    device_memory_pool m_memory_pool{};
     
     image_pool m_image_pool{};
 
@@ -335,7 +441,18 @@ namespace vulkan {
 
     pipeline_pool m_pipeline_pool{};   
 
+    pipeline_cache m_pipeline_cache{};
+
     module_geom::frustum m_frustum{};
+
+    // model indices drawn by commands_draw_inner_objects()
+    darray<uint32_t> m_visible_models{};
+
+    struct record_time {
+      double total_us{0.0};
+      double max_us{0.0};
+      uint32_t count{0};
+    } m_record_time{};
     
     uniform_block_data<uniform_block::transform> m_transform_uniform_block{};
     uniform_block_data<uniform_block::surface> m_surface_uniform_block{};
@@ -353,23 +470,59 @@ namespace vulkan {
     static inline constexpr int32_t k_sampler_aqua = 1;       
     
     struct model_data {
-      darray<transform> transforms{};
+      struct instance {
+	transform model_to_world{};
+	uint32_t material{k_sampler_checkerboard};
+      };
+
+      // all of a model's instances are drawn with one call
+      darray<darray<instance>> instances{};
+
+      // where write_instances() put each model's instances
+      // for the command buffer being recorded, and how many fit
+      darray<uint32_t> first_instances{};
+      darray<uint32_t> instance_counts{};
+      
       darray<module_geom::bvol> bounds_vols{}; // only spheres right now
       darray<uint32_t> vb_offsets{};
       darray<uint32_t> vb_lengths{};
+      darray<uint32_t> ib_offsets{};
+      darray<uint32_t> ib_lengths{};
 
       std::unordered_map<std::string, uint32_t> indices{}; // into the above buffers
 
       size_t length() const {
-	return transforms.size();
+	return instances.size();
+      }
+
+      void push_instance(const transform& t, uint32_t material) {
+	instances.push_back({ { t, material } });
+	first_instances.push_back(0);
+	instance_counts.push_back(0);
       }
       
     } m_model_data{};
     
     vertex_list_t m_vertex_buffer_vertices{};
 
+    // indices are relative to the model's vb_offset
+    darray<uint32_t> m_vertex_buffer_indices{};
+
     VkCommandPool m_vk_command_pool{VK_NULL_HANDLE};
 
+    // one per swapchain image; only used when command
+    // buffers are recorded per frame
+    darray<VkCommandPool> m_vk_frame_command_pools{};
+
+    // with k_record_secondary_parallel, one pool and one secondary
+    // buffer per (swapchain image, chunk), at
+    // [image * m_num_record_chunks + chunk]
+    darray<VkCommandPool> m_vk_secondary_command_pools{};
+    darray<VkCommandBuffer> m_vk_secondary_command_buffers{};
+    uint32_t m_num_record_chunks{0};
+
+    std::unique_ptr<worker_pool> m_record_workers{};
+
     VkDescriptorPool m_vk_descriptor_pool{VK_NULL_HANDLE};   
 
     VkSurfaceFormatKHR m_vk_khr_swapchain_format;
@@ -386,11 +539,63 @@ namespace vulkan {
 
     VkQueue m_vk_graphics_queue{VK_NULL_HANDLE};
     VkQueue m_vk_present_queue{VK_NULL_HANDLE};
+    // the graphics queue, unless there's a transfer only family
+    VkQueue m_vk_transfer_queue{VK_NULL_HANDLE};
+    uint32_t m_transfer_family{UINT32_MAX};
 
     VkSurfaceKHR m_vk_khr_surface{VK_NULL_HANDLE};
     VkSwapchainKHR m_vk_khr_swapchain{VK_NULL_HANDLE};
 
     buffer_data m_vertex_buffer;
+    buffer_data m_index_buffer;
+
+    // staging buffer uploads go through here
+    buffer_data m_upload_ring{};
+    upload_manager m_upload_manager{};
+
+    //
+    // debug_draw.hpp's ring: one section per frame in flight,
+    // persistently mapped. Each command buffer draws it through its
+    // own VkDrawIndirectCommand, which render() fills in with the
+    // frame's section and vertex count right before the submit.
+    //
+    buffer_data m_debug_draw_vertices;
+    buffer_data m_debug_draw_indirect;
+    VkDrawIndirectCommand* m_debug_draw_commands{nullptr};
+
+    // storage_block::instance records, one region of
+    // k_max_instances per command buffer
+    buffer_data m_instance_buffer;
+    VkDeviceSize m_instance_region_size{0};
+
+    //
+    // k_gpu_driven's buffer, host visible so validation can read it:
+    // the storage_block::cull_object array, then one region per
+    // command buffer holding its cull_frame and its cull_draws.
+    // m_gpu_driven is set once the device is known to support it.
+    //
+    buffer_data m_cull_buffer;
+    VkDeviceSize m_cull_objects_size{0};
+    VkDeviceSize m_cull_frame_size{0};
+    VkDeviceSize m_cull_region_size{0};
+    bool m_gpu_driven{false};
+
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_vk_cmd_draw_indexed_indirect_count{nullptr};
+
+    // what module_geom::frustum made of the planes each
+    // region was last given, per object
+    enum cull_expectation : uint8_t
+      {
+       cull_expect_culled = 0,
+       cull_expect_drawn,
+       cull_expect_either
+      };
+    
+    struct cull_validation {
+      darray<darray<uint8_t>> expected{};
+      uint32_t frames{0};
+      uint32_t mismatched_frames{0};
+    } m_cull_validation{};
     
     darray<image_pool::index_type> m_test_image_indices =
       {
@@ -411,27 +616,53 @@ namespace vulkan {
     //    m_vk_descriptor_pool is used to allocate memory
     //    needed for these descriptor sets. When the pool is allocated,
     //    the amount of descriptor sets that are to be created is specified
-    //    _upfront_. So, it's important that the number of indices here
-    //    match the total count that's passed to vkCreateDescriptorPool's
-    //    create_info (see setup_descriptor_pool())
+    //    _upfront_. setup_descriptor_pool() works that out from
+    //    descriptor_set_sources() and descriptor_set_copies(), so
+    //    a set that's added here has to be added to both.
     //
     static constexpr inline int k_descriptor_set_samplers = 0;
     static constexpr inline int k_descriptor_set_uniform_blocks = 1; 
+    static constexpr inline int k_descriptor_set_instances = 2;
     static constexpr inline int k_descriptor_set_input_attachment = 3;
+    static constexpr inline int k_descriptor_set_cull = 4;
     
     darray<descriptor_set_pool::index_type> m_test_descriptor_set_indices =
       {
        descriptor_set_pool::k_unset,  // pipeline 0
        descriptor_set_pool::k_unset,  // pipeline 0, pipeline 1
-       descriptor_set_pool::k_unset,  // pipeline 1
-       descriptor_set_pool::k_unset
+       descriptor_set_pool::k_unset,  // pipeline 0
+       descriptor_set_pool::k_unset,
+       descriptor_set_pool::k_unset   // cull
       };   
+
+    //
+    // Where each of the sets above is declared: the shaders that
+    // read it and the set number they read it from. The sets'
+    // layouts are reflected from those shaders' SPIR-V.
+    //
+    struct descriptor_set_source {
+      darray<std::string> spv_files;
+      uint32_t set;
+
+      // uniform and storage buffers are bound with dynamic offsets
+      bool dynamic;
+
+      // bindings that are written, but that no shader reads yet
+      uint32_t min_bindings;
+    };
+
+    // reflected by setup_descriptor_pool(), indexed
+    // like m_test_descriptor_set_indices
+    darray<descriptor_set_gen_params> m_descriptor_set_params{};
     
     static constexpr inline int k_pass_texture2d = 0;
     static constexpr inline int k_pass_test_fbo = 1; // test FBO pass   
+    static constexpr inline int k_pass_debug_draw = 2;
+    static constexpr inline int k_pass_cull = 3; // compute, before the render pass
 
     darray<pipeline_layout_pool::index_type> m_pipeline_layout_indices =
       {
+       pipeline_layout_pool::k_unset,
        pipeline_layout_pool::k_unset,
        pipeline_layout_pool::k_unset,
        pipeline_layout_pool::k_unset
@@ -439,14 +670,22 @@ namespace vulkan {
 
     darray<pipeline_pool::index_type> m_pipeline_indices =
       {
+       pipeline_pool::k_unset,
        pipeline_pool::k_unset,
        pipeline_pool::k_unset,
        pipeline_pool::k_unset
       };
 
+    // graphics pipelines waiting on create_pending_pipelines()
+    struct pending_pipeline {
+      int render_phase_index;
+      pipeline_gen_params params;
+    };
+    
+    darray<pending_pipeline> m_pending_pipelines{};
+
     vec3_t m_camera_position{R(0)};
     
-    uint32_t m_instance_count{0};
     uint32_t m_current_frame{0};
     uint32_t m_swapchain_image_count{0};
     
@@ -481,6 +720,31 @@ namespace vulkan {
       VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
+    // enabled if the physical device supports them
+    static inline darray<const char*> s_optional_device_extensions = {
+#if defined(VK_KHR_maintenance4)
+      VK_KHR_MAINTENANCE_4_EXTENSION_NAME, // memory requirements without dummy objects
+#endif
+      VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME // k_gpu_driven
+    };
+
+    // everything m_vk_curr_ldevice was created with
+    darray<const char*> m_device_extensions{};
+
+    // every {create flags, usage} pair buffers are made with; the memory
+    // pool queries their requirements once, when it's initialized
+    static inline darray<device_memory_pool::buffer_usage> s_buffer_usages = {
+      { 0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+      { 0, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+      { 0, VK_BUFFER_USAGE_TRANSFER_SRC_BIT }, // staging ring
+      { 0, VK_BUFFER_USAGE_TRANSFER_DST_BIT }, // headless readback
+      { 0, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+      { 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT }, // instances
+      { 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT }, // k_gpu_driven
+      { 0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT }, // debug draw
+      { 0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT } // debug draw
+    };
+
     uint32_t max_frames_in_flight() const {
       // we may want to make this more dynamic at some point,
       // hence the method
@@ -588,9 +852,18 @@ namespace vulkan {
 
         uint32_t i = 0;
         while (i < queue_fam_count) {
-          if ((queue_props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) {
+          VkQueueFlags flags = queue_props[i].queueFlags;
+          
+          if ((flags & VK_QUEUE_GRAPHICS_BIT) != 0) {
             indices.graphics_family = i;
           }
+          else if ((flags & VK_QUEUE_TRANSFER_BIT) != 0) {
+            // a dedicated transfer (DMA) family beats an async compute one
+            if (!indices.transfer_family.has_value() ||
+                (flags & VK_QUEUE_COMPUTE_BIT) == 0) {
+              indices.transfer_family = i;
+            }
+          }
 
           if (surface != VK_NULL_HANDLE) {
             VkBool32 present_support = false;
@@ -601,6 +874,12 @@ namespace vulkan {
           }
           i++;
         }
+
+        // headless: nothing's presented, and the
+        // graphics queue stands in for the present queue
+        if (surface == VK_NULL_HANDLE) {
+          indices.present_family = indices.graphics_family;
+        }
       }
       
       return indices;
@@ -650,8 +929,11 @@ namespace vulkan {
       return buffer_info;
     }
 
-    // Create a frame buffer attachment
-    image_pool::index_type make_framebuffer_attachment(VkFormat format, VkImageUsageFlags usage)
+    // Create a frame buffer attachment, the size of the swapchain;
+    // in place of replace, if it's set
+    image_pool::index_type make_framebuffer_attachment(VkFormat format,
+						       VkImageUsageFlags usage,
+						       image_pool::index_type replace = image_pool::k_unset)
     {
       image_pool::index_type ret{image_pool::k_unset};
 
@@ -681,7 +963,8 @@ namespace vulkan {
       gen_image.usage_flags = usage;
 
       ret = m_image_pool.make_image(make_device_resource_properties(),
-				    gen_image);
+				    gen_image,
+				    replace);
 
       ASSERT(ret != image_pool::k_unset);
 
@@ -738,24 +1021,10 @@ namespace vulkan {
     }
 
 
-    std::optional<VkMemoryRequirements> query_vertex_buffer_memory_requirements(VkDeviceSize size) const {
+    std::optional<VkMemoryRequirements> query_vertex_buffer_memory_requirements(VkDeviceSize size) {
       std::optional<VkMemoryRequirements> ret{};
       if (ok_graphics_pipeline()) {
-	VkBufferCreateInfo buffer_info = make_vertex_buffer_create_info(size);
-	
-	VkBuffer dummy_buffer = 0;
-	VK_FN(vkCreateBuffer(m_vk_curr_ldevice, &buffer_info, nullptr, &dummy_buffer));
-
-	if (ok() && dummy_buffer != VK_NULL_HANDLE) {
-	  VkMemoryRequirements r = {};
-	  vkGetBufferMemoryRequirements(m_vk_curr_ldevice,
-					dummy_buffer,
-					&r);
-
-	  ret = r;
-	}
-	
-	free_vk_ldevice_handle<VkBuffer, &vkDestroyBuffer>(dummy_buffer);
+	ret = m_memory_pool.buffer_requirements(make_vertex_buffer_create_info(size));
       }
       return ret;
     }
@@ -806,8 +1075,8 @@ namespace vulkan {
              !details.present_modes.empty();
     }
 
-    bool check_device_extensions(VkPhysicalDevice device) {
-      bool r = false;
+    std::set<std::string> query_device_extensions(VkPhysicalDevice device) const {
+      std::set<std::string> ret{};
       if (ok()) {
         uint32_t extension_count;
         VK_FN(vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr));
@@ -821,20 +1090,94 @@ namespace vulkan {
 						     avail_ext.data()));
           
           if (ok()) {
-            std::set<std::string> required_ext(s_device_extensions.begin(), 
-                                               s_device_extensions.end());
-
             for (uint32_t i = 0; i < extension_count; ++i) {
-              required_ext.erase(avail_ext[i].extensionName);
+              ret.insert(avail_ext[i].extensionName);
             }
-
-            r = required_ext.empty();
           }
         }
       }
+      return ret;
+    }
+
+    // nothing's presented headless, so there's no need for a swapchain
+    darray<const char*> required_device_extensions() const {
+      return headless() ? darray<const char*>{} : s_device_extensions;
+    }
+
+    bool check_device_extensions(VkPhysicalDevice device) {
+      bool r = false;
+      if (ok()) {
+        std::set<std::string> avail_ext = query_device_extensions(device);
+        darray<const char*> required = required_device_extensions();
+
+        if (ok()) {
+          r = std::all_of(required.begin(),
+                          required.end(),
+                          [&avail_ext](const char* ext) {
+                            return avail_ext.count(ext) != 0;
+                          });
+        }
+      }
+      return r;
+    }
+
+    // timeline semaphores are core in 1.2, but still a feature
+    bool timeline_semaphores_supported(VkPhysicalDevice device) const {
+      VkPhysicalDeviceProperties properties = {};
+      vkGetPhysicalDeviceProperties(device, &properties);
+
+      bool r = properties.apiVersion >= VK_API_VERSION_1_2;
+
+      if (r) {
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+        timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timeline_features.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &timeline_features;
+
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        r = timeline_features.timelineSemaphore == VK_TRUE;
+      }
+
+      return r;
+    }
+
+    // tri_ubo.frag indexes its sampler array with the instance's material,
+    // which needs nonuniformEXT; optional in 1.2, but desktop drivers have it
+    bool nonuniform_sampler_indexing_supported(VkPhysicalDevice device) const {
+      VkPhysicalDeviceProperties properties = {};
+      vkGetPhysicalDeviceProperties(device, &properties);
+
+      bool r = properties.apiVersion >= VK_API_VERSION_1_2;
+
+      if (r) {
+        VkPhysicalDeviceDescriptorIndexingFeatures indexing_features = {};
+        indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        indexing_features.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &indexing_features;
+
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        r = indexing_features.shaderSampledImageArrayNonUniformIndexing == VK_TRUE;
+      }
+
       return r;
     }
 
+    bool device_extension_enabled(const char* name) const {
+      return std::any_of(m_device_extensions.begin(),
+                         m_device_extensions.end(),
+                         [name](const char* ext) {
+                           return strcmp(ext, name) == 0;
+                         });
+    }
+
     void setup_device_and_queues() {
       if (ok_pdev()) {
         queue_family_indices indices = 
@@ -844,14 +1187,29 @@ namespace vulkan {
 
         std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 
+        // uploads get their own queue when there's a transfer only
+        // family to take it from. That's kept to devices that present
+        // from the graphics family, so that buffers only ever change
+        // hands between two families.
+        m_transfer_family = indices.graphics_family.value();
+
+        STATIC_IF (st_config::c_upload::k_use_transfer_queue) {
+          if (indices.transfer_family.has_value() &&
+              indices.graphics_family.value() == indices.present_family.value()) {
+            m_transfer_family = indices.transfer_family.value();
+          }
+        }
+        
         std::set<uint32_t> unique_queue_indices = {
           indices.present_family.value(),
-          indices.graphics_family.value()
+          indices.graphics_family.value(),
+          m_transfer_family
         };
 
-        write_logf("present family queue: %" PRIu32 "; graphics family queue: %" PRIu32 "\n",
+        write_logf("present family queue: %" PRIu32 "; graphics family queue: %" PRIu32 "; transfer family queue: %" PRIu32 "\n",
                     indices.present_family.value(),
-                    indices.graphics_family.value());
+                    indices.graphics_family.value(),
+                    m_transfer_family);
 
         float priority = 1.0f;
 	
@@ -865,6 +1223,22 @@ namespace vulkan {
         }
 
         VkPhysicalDeviceFeatures dev_features = {};
+
+        bool use_gpu_driven = false;
+        
+        STATIC_IF (st_config::c_renderer::m_render::k_gpu_driven) {
+          VkPhysicalDeviceFeatures supported_features = {};
+          vkGetPhysicalDeviceFeatures(m_vk_curr_pdevice, &supported_features);
+
+          use_gpu_driven =
+            supported_features.multiDrawIndirect == VK_TRUE &&
+            supported_features.drawIndirectFirstInstance == VK_TRUE;
+
+          if (use_gpu_driven) {
+            dev_features.multiDrawIndirect = VK_TRUE;
+            dev_features.drawIndirectFirstInstance = VK_TRUE;
+          }
+        }
         
         VkDeviceCreateInfo dev_create_info = {};
         
@@ -882,8 +1256,53 @@ namespace vulkan {
                                         ? avail_layers.data()
                                         : nullptr;
 
-        dev_create_info.enabledExtensionCount = static_cast<uint32_t>(s_device_extensions.size());
-        dev_create_info.ppEnabledExtensionNames = s_device_extensions.data();
+        m_device_extensions = required_device_extensions();
+
+        {
+          std::set<std::string> avail_ext = query_device_extensions(m_vk_curr_pdevice);
+
+          for (const char* ext: s_optional_device_extensions) {
+            if (avail_ext.count(ext) != 0) {
+              m_device_extensions.push_back(ext);
+              write_logf("enabling optional device extension %s\n", ext);
+            }
+          }
+        }
+
+        dev_create_info.enabledExtensionCount = static_cast<uint32_t>(m_device_extensions.size());
+        dev_create_info.ppEnabledExtensionNames = m_device_extensions.data();
+
+        // is_device_suitable() checked for it
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+        timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timeline_features.pNext = nullptr;
+        timeline_features.timelineSemaphore = VK_TRUE;
+
+        // is_device_suitable() checked for this too
+        VkPhysicalDeviceDescriptorIndexingFeatures indexing_features = {};
+        indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        indexing_features.pNext = nullptr;
+        indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+        dev_create_info.pNext = &timeline_features;
+        timeline_features.pNext = &indexing_features;
+        
+        bool use_maintenance4 = false;
+
+#if defined(VK_KHR_maintenance4)
+        // the feature is required to be supported
+        // by anything that exposes the extension
+        VkPhysicalDeviceMaintenance4FeaturesKHR maintenance4_features = {};
+        maintenance4_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_4_FEATURES_KHR;
+        maintenance4_features.pNext = nullptr;
+        maintenance4_features.maintenance4 = VK_TRUE;
+
+        use_maintenance4 = device_extension_enabled(VK_KHR_MAINTENANCE_4_EXTENSION_NAME);
+
+        if (use_maintenance4) {
+          indexing_features.pNext = &maintenance4_features;
+        }
+#endif
 
         VK_FN(vkCreateDevice(m_vk_curr_pdevice, 
                               &dev_create_info, 
@@ -900,9 +1319,49 @@ namespace vulkan {
                           indices.present_family.value(),
                           0,
                           &m_vk_present_queue);
+
+          vkGetDeviceQueue(m_vk_curr_ldevice,
+                           m_transfer_family,
+                           0,
+                           &m_vk_transfer_queue);
+
+          c_assert(m_timeline.init(m_vk_curr_ldevice));
         }
 
         ASSERT(m_vk_graphics_queue != VK_NULL_HANDLE);
+
+        if (ok_ldev() &&
+            use_gpu_driven &&
+            device_extension_enabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+          m_vk_cmd_draw_indexed_indirect_count =
+            reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(m_vk_curr_ldevice,
+                                                                                       "vkCmdDrawIndexedIndirectCountKHR"));
+
+          m_gpu_driven = m_vk_cmd_draw_indexed_indirect_count != nullptr;
+        }
+
+        STATIC_IF (st_config::c_renderer::m_render::k_gpu_driven) {
+          write_logf("gpu driven culling and draws: %s\n",
+                     m_gpu_driven ? "enabled" : "unsupported, culling on the CPU");
+        }
+
+        if (ok_ldev() &&
+            m_memory_pool.init(m_vk_curr_pdevice,
+                               m_vk_curr_ldevice,
+                               use_maintenance4,
+                               s_buffer_usages)) {
+          m_image_pool.set_memory_pool(&m_memory_pool);
+          m_uniform_block_pool.set_memory_pool(&m_memory_pool);
+        }
+
+        STATIC_IF (st_config::c_pipeline_cache::k_enabled) {
+          if (ok_ldev()) {
+            // without a cache, pipelines are still created; just slower
+            c_assert(m_pipeline_cache.init(m_vk_curr_pdevice,
+                                           m_vk_curr_ldevice,
+                                           st_config::c_pipeline_cache::k_path));
+          }
+        }
       }
     }
 
@@ -951,7 +1410,9 @@ namespace vulkan {
       return present_mode;
     }
 
-    void setup_swapchain() {
+    // old_swapchain is the one being replaced, if any; it's
+    // retired by this, but still has to be destroyed
+    void setup_swapchain(VkSwapchainKHR old_swapchain = VK_NULL_HANDLE) {
       if (ok_ldev()) {
         if (swapchain_ok(m_vk_curr_pdevice)) {
           swapchain_support_details details = query_swapchain_support(m_vk_curr_pdevice);
@@ -992,6 +1453,10 @@ namespace vulkan {
             swap_extent = details.capabilities.currentExtent;
           }
 
+          // everything per image is sized to the current swapchain's count,
+          // so a recreated swapchain asks for the same one
+          uint32_t previous_image_count = m_swapchain_image_count;
+
           // Image count represents the amount of images on the swapchain.
           // We'll use a small image count for now. Simple semantics first;
           // we can optimize later as necessary.
@@ -1013,6 +1478,12 @@ namespace vulkan {
     ASSERT(details.capabilities.minImageCount <= m_swapchain_image_count &&
            m_swapchain_image_count <= details.capabilities.maxImageCount);
 
+	  if (old_swapchain != VK_NULL_HANDLE) {
+	    m_swapchain_image_count = std::clamp(previous_image_count,
+						 details.capabilities.minImageCount,
+						 details.capabilities.maxImageCount);
+	  }
+
 	  write_logf("selected swapchain image count = %" PRIu32 "\n"
 		     "min image count allowed = %" PRIu32 "\n"
 		     "max image count allowed = %" PRIu32,
@@ -1075,9 +1546,9 @@ namespace vulkan {
           // which is visible, but itself is currently _not_ visible).
           //
           // --
-          // On oldSwapChain: at the time of this writing, we keep this set to VK_NULL_HANDLE. This will need to be
-          // none-null once we support things like window resizing, or anything that requires
-          // re-initialization of the swapchain.
+          // On oldSwapChain: VK_NULL_HANDLE at setup. recreate_swapchain() passes the swapchain
+          // it's replacing, which lets the driver reuse its resources and hand over
+          // images that have been acquired but not yet presented.
           // 
           {
             VkSwapchainCreateInfoKHR create_info = {};
@@ -1120,7 +1591,7 @@ namespace vulkan {
             create_info.presentMode = present_mode;
             create_info.clipped = VK_FALSE;
 
-            create_info.oldSwapchain = VK_NULL_HANDLE;
+            create_info.oldSwapchain = old_swapchain;
 
             VK_FN(vkCreateSwapchainKHR(m_vk_curr_ldevice, &create_info, nullptr, &m_vk_khr_swapchain));
 
@@ -1131,7 +1602,15 @@ namespace vulkan {
 					    &count,
 					    nullptr));
 
-	      ASSERT(count == m_swapchain_image_count);
+	      // minImageCount is only a lower bound; the driver
+	      // may hand back more images than we asked for
+	      if (count != m_swapchain_image_count) {
+		write_logf("swapchain has %" PRIu32 " images; %" PRIu32 " were requested",
+			   count,
+			   m_swapchain_image_count);
+		
+		m_swapchain_image_count = count;
+	      }
 	      
               if (ok_swapchain()) {
                 m_vk_swapchain_images.resize(count);
@@ -1231,53 +1710,41 @@ namespace vulkan {
       auto properties = make_device_resource_properties();
 		
       if (c_assert(properties.ok())) {
-	  	  
-	std::optional<buffer_reqs> opt_buffreqs =
-	  get_buffer_requirements(properties,
-				  flags_create,
-				  flags_usage,
-				  flags_memory,
-				  buffer_size);
-
-	if (c_assert(opt_buffreqs.has_value())) {
-	  auto buffreqs = opt_buffreqs.value();
+	buffer_data ret{};
+
+	// the buffer comes first: its memory size
+	// is whatever the driver says it needs
+	ret.handle = make_buffer(properties,
+				 flags_create,
+				 flags_usage,
+				 buffer_size);
+
+	if (c_assert(H_OK(ret.handle))) {
+	  std::optional<buffer_reqs> opt_buffreqs =
+	    get_buffer_requirements(properties,
+				    m_memory_pool,
+				    flags_create,
+				    flags_usage,
+				    flags_memory,
+				    buffer_size,
+				    ret.handle);
+
+	  if (c_assert(opt_buffreqs.has_value())) {
+	    auto buffreqs = opt_buffreqs.value();
 	  
-	  if (c_assert(buffreqs.ok())) {
-	    buffer_data ret{};
-	    
-	    VkBufferCreateInfo buffer_info = {};
-	      
-	    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	    buffer_info.pNext = nullptr;
-
-	    buffer_info.flags = flags_create;
-	    buffer_info.size = buffreqs.required_size;
-	    buffer_info.usage = flags_usage;
-	      
-	    buffer_info.sharingMode = properties.queue_sharing_mode;
-	    buffer_info.queueFamilyIndexCount = properties.queue_family_indices.size();
-	    buffer_info.pQueueFamilyIndices = properties.queue_family_indices.data();
-
-	    VK_FN(vkCreateBuffer(m_vk_curr_ldevice, &buffer_info, nullptr, &ret.handle));
-
-	    if (c_assert(H_OK(ret.handle))) {
-	      VkMemoryAllocateInfo balloc_info = {};
+	    if (c_assert(buffreqs.ok())) {
+	      auto opt_memory = m_memory_pool.allocate(buffreqs.memory_property_index,
+						       buffreqs.required_size,
+						       buffreqs.alignment,
+						       resource_tiling::linear);
+
+	      if (c_assert(opt_memory.has_value())) {
+		ret.memory = opt_memory.value();
 		
-	      balloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	      balloc_info.pNext = nullptr;
-	      balloc_info.allocationSize = buffreqs.required_size;
-	      balloc_info.memoryTypeIndex = buffreqs.memory_property_index;
-	  
-	      VK_FN(vkAllocateMemory(m_vk_curr_ldevice,
-				     &balloc_info,
-				     nullptr,
-				     &ret.memory));
-
-	      if (c_assert(H_OK(ret.memory))) {		
 		VK_FN(vkBindBufferMemory(m_vk_curr_ldevice,
 					 ret.handle,
-					 ret.memory,
-					 0));
+					 ret.memory.memory,
+					 ret.memory.offset));
 
 		if (ok()) {
 		  opt_ret = ret;
@@ -1286,94 +1753,212 @@ namespace vulkan {
 	    }
 	  }
 	}
+
+	if (!opt_ret.has_value()) {
+	  ret.free_mem(m_vk_curr_ldevice, m_memory_pool);
+	}
       }
       return opt_ret;
     }
   
-    void setup_vertex_buffer() {
-      if (ok_graphics_pipeline()) {
-	const VkDeviceSize k_buffer_size =
-	  sizeof(m_vertex_buffer_vertices[0]) *
-	  m_vertex_buffer_vertices.size();
-	
-	auto make_and_fill =
-	  [this, k_buffer_size](VkBufferUsageFlags usage) -> buffer_data {
+    // Creates a buffer of the given usage and fills it with data;
+    // if use_staging is set, the buffer is device local and the data
+    // goes through m_upload_manager, so it's only there once the
+    // next flush() has been submitted.
+    buffer_data make_filled_buffer(VkBufferUsageFlags usage,
+				   const void* data,
+				   VkDeviceSize size,
+				   bool use_staging) {
+      auto make_and_fill =
+	[this, data, size](VkBufferUsageFlags usage) -> buffer_data {
       
-	    buffer_data buffer{};
+	  buffer_data buffer{};
 
-	    auto opt_ret = make_buffer_data(0, // create flags
-					    usage,
-					    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-					    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					    k_buffer_size);
+	  auto opt_ret = make_buffer_data(0, // create flags
+					  usage,
+					  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					  size);
 
-	    if (c_assert(opt_ret.has_value())) {
-	      if (c_assert(opt_ret.value().ok())) {
-		buffer = opt_ret.value();
+	  if (c_assert(opt_ret.has_value())) {
+	    if (c_assert(opt_ret.value().ok())) {
+	      buffer = opt_ret.value();
 	  
-		write_device_memory(m_vk_curr_ldevice,
-				    buffer.memory,
-				    static_cast<void*>(m_vertex_buffer_vertices.data()),
-				    k_buffer_size);	    
-	      }
+	      memcpy(buffer.memory.mapped, data, size);
 	    }
+	  }
 
-	    return buffer;
-	  };
+	  return buffer;
+	};
 
-	bool good = false;
-	
-	STATIC_IF (st_config::c_renderer::m_setup_vertex_buffer::k_use_staging) {		
-	  // create the staging buffer
-	  buffer_data staging = make_and_fill(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-	  // create vertex buffer
-	  auto opt_vertex_buffer = make_buffer_data(0, // create flags
-						    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-						    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-						    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-						    k_buffer_size);
-	  // make sure everything is ok,
-	  // and then copy from staging to vertex buffer
-	  good =
-	    c_assert(opt_vertex_buffer.has_value()) &&
-	    c_assert(opt_vertex_buffer.value().ok());
+      buffer_data ret{};
+      
+      if (use_staging) {
+	// create destination buffer
+	auto opt_buffer = make_buffer_data(0, // create flags
+					   VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+					   usage,
+					   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					   size);
+	bool good =
+	  c_assert(opt_buffer.has_value()) &&
+	  c_assert(opt_buffer.value().ok());
+	  
+	if (good) {	  
+	  ret = opt_buffer.value();
+
+	  // the copy is submitted by the next flush(); nothing
+	  // is drawn from the buffer before that
+	  VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	  VkAccessFlags dst_access = 0;
+
+	  if ((usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) != 0) {
+	    dst_access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	  }
 	  
-	  if (good) {	  
-	    m_vertex_buffer = opt_vertex_buffer.value();
-
-	    run_cmds(// success
-		     [this, k_buffer_size, &staging](VkCommandBuffer cmd_buf) {
-		       VkBufferCopy region{};
-
-		       region.srcOffset = 0;
-		       region.dstOffset = 0;
-		       region.size = k_buffer_size;
-		       
-		       vkCmdCopyBuffer(cmd_buf,
-				       staging.handle,
-				       m_vertex_buffer.handle,
-				       1,
-				       &region);
-		     },
-		     // error
-	             [this, &good](one_shot_command_error err) {
-		       good = false;
-	             });
-
-	    staging.free_mem(m_vk_curr_ldevice);
+	  if ((usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) != 0) {
+	    dst_access |= VK_ACCESS_INDEX_READ_BIT;
+	  }
+
+	  if (dst_access == 0) {
+	    dst_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	    dst_access = VK_ACCESS_MEMORY_READ_BIT;
+	  }
+
+	  bool queued = m_upload_manager.upload_buffer(ret.handle,
+						       0,
+						       data,
+						       size,
+						       dst_stage,
+						       dst_access);
+
+	  if (!c_assert(queued)) {
+	    ret.free_mem(m_vk_curr_ldevice, m_memory_pool);
+	    ret = buffer_data{};
 	  }
 	}
-	else {
-	  m_vertex_buffer =
-	    make_and_fill(VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-			  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+      }
+      else {
+	ret = make_and_fill(VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage);
+      }
+
+      return ret;
+    }
+  
+    // the staging ring, and the upload manager that copies out of it
+    bool setup_upload_manager() {
+      auto opt_ring =
+	make_buffer_data(0, // create flags
+			 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			 st_config::c_upload::k_ring_size);
+
+      bool good =
+	c_assert(opt_ring.has_value()) &&
+	c_assert(opt_ring.value().memory.mapped != nullptr);
+
+      if (good) {
+	m_upload_ring = opt_ring.value();
+
+	queue_family_indices indices =
+	  query_queue_families(m_vk_curr_pdevice, m_vk_khr_surface);
+
+	good =
+	  m_upload_manager.init(m_vk_curr_ldevice,
+				m_timeline,
+				{ m_transfer_family, m_vk_transfer_queue },
+				{ indices.graphics_family.value(), m_vk_graphics_queue },
+				m_upload_ring.handle,
+				m_upload_ring.memory.mapped,
+				st_config::c_upload::k_ring_size);
+      }
 
-	  good = m_vertex_buffer.ok();
+      return c_assert(good);
+    }
+    
+    void setup_vertex_buffer() {
+      if (ok_graphics_pipeline() && setup_upload_manager()) {
+	constexpr bool k_use_staging =
+	  st_config::c_renderer::m_setup_vertex_buffer::k_use_staging;
+	
+	m_vertex_buffer =
+	  make_filled_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			     m_vertex_buffer_vertices.data(),
+			     sizeof(m_vertex_buffer_vertices[0]) *
+			     m_vertex_buffer_vertices.size(),
+			     k_use_staging);
+
+	m_index_buffer =
+	  make_filled_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			     m_vertex_buffer_indices.data(),
+			     sizeof(m_vertex_buffer_indices[0]) *
+			     m_vertex_buffer_indices.size(),
+			     k_use_staging);
+
+	m_ok_vertex_buffer =
+	  m_vertex_buffer.ok() &&
+	  m_index_buffer.ok();
+
+	STATIC_IF (debug_draw::k_enabled) {
+	  m_ok_vertex_buffer =
+	    m_ok_vertex_buffer &&
+	    setup_debug_draw_buffers();
 	}
+      }
+    }
 
-	m_ok_vertex_buffer = good;
+    bool setup_debug_draw_buffers() {
+      constexpr VkMemoryPropertyFlags k_host_memory =
+	VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+      uint32_t num_commands = m_vk_swapchain_image_views.size();
+      
+      auto opt_vertices =
+	make_buffer_data(0, // create flags
+			 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			 k_host_memory,
+			 sizeof(debug_vertex) *
+			 debug_draw::k_max_vertices *
+			 max_frames_in_flight());
+
+      auto opt_commands =
+	make_buffer_data(0, // create flags
+			 VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			 k_host_memory,
+			 sizeof(VkDrawIndirectCommand) * num_commands);
+
+      bool good =
+	c_assert(opt_vertices.has_value()) &&
+	c_assert(opt_commands.has_value());
+
+      if (good) {
+	m_debug_draw_vertices = opt_vertices.value();
+	m_debug_draw_indirect = opt_commands.value();
+
+	// host visible pool memory stays mapped
+	void* ring = m_debug_draw_vertices.memory.mapped;
+	void* commands = m_debug_draw_indirect.memory.mapped;
+
+	good =
+	  c_assert(ring != nullptr) &&
+	  c_assert(commands != nullptr);
+
+	if (good) {
+	  m_debug_draw_commands = static_cast<VkDrawIndirectCommand*>(commands);
+
+	  for (uint32_t i = 0; i < num_commands; ++i) {
+	    m_debug_draw_commands[i] = { 0, 1, 0, 0 };
+	  }
+	  
+	  debug_draw::set_ring(static_cast<debug_vertex*>(ring),
+			       max_frames_in_flight());
+	  debug_draw::begin_frame(m_current_frame);
+	}
       }
+
+      return good;
     }
 
     void run_cmds(one_shot_command_fn_ok_t f,
@@ -1396,7 +1981,7 @@ namespace vulkan {
     }
     
     bool ok_surface() const {
-      bool r = ok() && m_vk_khr_surface != VK_NULL_HANDLE;
+      bool r = ok() && (headless() || m_vk_khr_surface != VK_NULL_HANDLE);
       ASSERT(r);
       return r;
     }
@@ -1413,8 +1998,13 @@ namespace vulkan {
       return r;
     }
 
+    // headless, the offscreen images are the swapchain
     bool ok_swapchain() const {
-      bool r = ok_ldev() && m_vk_khr_swapchain != VK_NULL_HANDLE;
+      bool r =
+	ok_ldev() &&
+	(headless()
+	 ? !m_vk_swapchain_images.empty()
+	 : m_vk_khr_swapchain != VK_NULL_HANDLE);
       ASSERT(r);
       return r;
     }
@@ -1511,9 +2101,11 @@ namespace vulkan {
       vkGetPhysicalDeviceProperties(device, &properties);
       vkGetPhysicalDeviceFeatures(device, &features);
 
+      // headless also runs on CPU implementations, like lavapipe
       bool type_ok = 
         properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ||
-        properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+        properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+        (headless() && properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU);
 
       queue_family_indices indices = query_queue_families(device, m_vk_khr_surface);
 
@@ -1522,7 +2114,9 @@ namespace vulkan {
       return type_ok && 
              indices.ok() && 
              extensions_supported && 
-             swapchain_ok(device);
+             timeline_semaphores_supported(device) &&
+             nonuniform_sampler_indexing_supported(device) &&
+             (headless() || swapchain_ok(device));
     }
 
     void set_physical_device(uint32_t device) {
@@ -1618,14 +2212,19 @@ namespace vulkan {
 
       app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
       app_info.pApplicationName = "Renderer";
-      app_info.apiVersion = VK_API_VERSION_1_1;
+      app_info.apiVersion = VK_API_VERSION_1_2; // timeline semaphores
       app_info.applicationVersion = 1;
 
       create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
       create_info.pApplicationInfo = &app_info;
 
       uint32_t ext_count = 0;
-      const char** extensions = glfwGetRequiredInstanceExtensions(&ext_count);
+      const char** extensions = nullptr;
+
+      // there's no surface headless, and no GLFW
+      if (!headless()) {
+        extensions = glfwGetRequiredInstanceExtensions(&ext_count);
+      }
 
       create_info.enabledExtensionCount = ext_count;
       create_info.ppEnabledExtensionNames = extensions;
@@ -1645,7 +2244,7 @@ namespace vulkan {
       VK_FN(vkCreateInstance(&create_info, nullptr, &m_vk_instance));
 
       if (ok()) {
-        if (setup_surface()) {
+        if (headless() || setup_surface()) {
           query_physical_devices();
         }
       }
@@ -1653,37 +2252,176 @@ namespace vulkan {
       return api_ok();
     }
 
-    void setup_presentation() {
-      setup_device_and_queues();
-      setup_swapchain();
-      setup_swapchain_image_views();
-      
-      if (ok_swapchain()) {
-	m_ok_present = true;
-      }
-    }
+    // headless: what the swapchain would have provided. The images
+    // come from the image pool; their views are made alongside a
+    // swapchain's, by setup_swapchain_image_views().
+    void setup_offscreen_images() {
+      if (ok_ldev()) {
+	m_vk_khr_swapchain_format.format = VK_FORMAT_R8G8B8A8_UNORM;
+	m_vk_khr_swapchain_format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	m_vk_swapchain_extent = m_headless->extent;
+	m_swapchain_image_count = m_headless->image_count;
 
-    void setup_command_pool() {
-      if (ok_present()) {
-	queue_family_indices indices = query_queue_families(m_vk_curr_pdevice, m_vk_khr_surface);
+	bool good = c_assert(m_swapchain_image_count > 0);
+	
+	for (uint32_t i = 0; i < m_swapchain_image_count && good; ++i) {
+	  image_pool::index_type image =
+	    make_framebuffer_attachment(m_vk_khr_swapchain_format.format,
+					VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+					VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 
-	VkCommandPoolCreateInfo pool_info = {};
-	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	pool_info.queueFamilyIndex = indices.graphics_family.value();
-	pool_info.flags = 0;
+	  good = image != image_pool::k_unset;
 
-	VK_FN(vkCreateCommandPool(m_vk_curr_ldevice, &pool_info, nullptr, &m_vk_command_pool));
+	  if (good) {
+	    m_offscreen_images.push_back(image);
+	    m_vk_swapchain_images.push_back(m_image_pool.image(image));
+	  }
+	}
 
-	m_ok_command_pool = true;	
-      }      
-    }
+	if (good && m_headless->readback) {
+	  m_readback_size =
+	    VkDeviceSize{m_vk_swapchain_extent.width} * m_vk_swapchain_extent.height * 4;
+	  
+	  auto opt_buffer =
+	    make_buffer_data(0, // create flags
+			     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			     m_readback_size * m_swapchain_image_count);
 
-    void setup_vertex_data() {
+	  good =
+	    c_assert(opt_buffer.has_value()) &&
+	    c_assert(opt_buffer.value().memory.mapped != nullptr);
+
+	  if (good) {
+	    m_readback_buffer = opt_buffer.value();
+	  }
+	}
+
+	if (!good) {
+	  m_vk_swapchain_images.clear();
+	}
+      }
+    }
+    
+    void setup_presentation() {
+      setup_device_and_queues();
+
+      if (headless()) {
+	setup_offscreen_images();
+      }
+      else {
+	setup_swapchain();
+      }
+      
+      setup_swapchain_image_views();
+      
+      if (ok_swapchain()) {
+	m_ok_present = true;
+      }
+    }
+
+    void setup_command_pool() {
+      if (ok_present()) {
+	queue_family_indices indices = query_queue_families(m_vk_curr_pdevice, m_vk_khr_surface);
+
+	VkCommandPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = indices.graphics_family.value();
+	pool_info.flags = 0;
+
+	VK_FN(vkCreateCommandPool(m_vk_curr_ldevice, &pool_info, nullptr, &m_vk_command_pool));
+
+	STATIC_IF (st_config::c_renderer::m_render::k_record_command_buffers_per_frame) {
+	  // everything in a frame's pool is thrown away together,
+	  // so the buffers don't need to be individually resettable
+	  pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	  m_vk_frame_command_pools.resize(m_vk_swapchain_images.size(), VK_NULL_HANDLE);
+
+	  for (VkCommandPool& pool: m_vk_frame_command_pools) {
+	    VK_FN(vkCreateCommandPool(m_vk_curr_ldevice, &pool_info, nullptr, &pool));
+	  }
+	}
+
+	STATIC_IF (st_config::c_renderer::m_render::k_record_secondary_parallel) {
+	  m_record_workers =
+	    std::make_unique<worker_pool>(st_config::c_renderer::m_render::k_record_threads);
+
+	  m_num_record_chunks = m_record_workers->num_threads();
+
+	  m_vk_secondary_command_pools.resize(m_vk_swapchain_images.size() * m_num_record_chunks,
+					      VK_NULL_HANDLE);
+
+	  for (VkCommandPool& pool: m_vk_secondary_command_pools) {
+	    VK_FN(vkCreateCommandPool(m_vk_curr_ldevice, &pool_info, nullptr, &pool));
+	  }
+	}
+
+	m_ok_command_pool = ok();	
+      }      
+    }
+
+    // Appends every mesh of a baked file (see mesh_bake.hpp) as a model
+    // named "<prefix>/<mesh name>". The file's blobs are already in
+    // vertex_data layout with model relative indices, so this is one bulk
+    // copy per blob straight out of the mapping; nothing is processed
+    // per vertex.
+    bool add_baked_meshes(const std::string& prefix,
+			  const mesh_bake::baked_file& file,
+			  const transform& t) {
+      static_assert(sizeof(vertex_data) == mesh_bake::k_vulkan_vertex_stride);
+
+      bool ok =
+	c_assert(file.ok()) &&
+	c_assert(file.info().vertex_layout == mesh_bake::layout_vulkan);
+
+      if (ok) {
+	const size_t vb_base = m_vertex_buffer_vertices.size();
+	const size_t ib_base = m_vertex_buffer_indices.size();
+
+	m_vertex_buffer_vertices.resize(vb_base + file.num_vertex_bytes() / sizeof(vertex_data));
+	m_vertex_buffer_indices.resize(ib_base + file.num_indices());
+
+	memcpy(m_vertex_buffer_vertices.data() + vb_base,
+	       file.vertex_bytes(),
+	       file.num_vertex_bytes());
+
+	memcpy(m_vertex_buffer_indices.data() + ib_base,
+	       file.indices(),
+	       file.num_indices() * sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < file.num_meshes(); ++i) {
+	  const mesh_bake::mesh_record& m = file.mesh(i);
+	  const mesh_bake::lod_record& lod0 = file.lod(m, 0);
+
+	  module_geom::bvol bvol{};
+
+	  bvol.radius = m.sphere[3];
+	  bvol.center = vec3_t{t() * R4v(m.sphere[0], m.sphere[1], m.sphere[2], 1)};
+	  bvol.type = module_geom::bvol::type_sphere;
+
+	  m_model_data.indices[prefix + "/" + m.name] = m_model_data.length();
+
+	  m_model_data.bounds_vols.push_back(bvol);
+	  m_model_data.vb_offsets.push_back(vb_base + m.first_vertex);
+	  m_model_data.vb_lengths.push_back(m.num_vertices);
+	  m_model_data.ib_offsets.push_back(ib_base + lod0.first_index);
+	  m_model_data.ib_lengths.push_back(lod0.num_indices);
+	  m_model_data.push_instance(t, k_sampler_checkerboard);
+	}
+      }
+
+      return ok;
+    }
+
+    void setup_vertex_data() {
       if (ok_command_pool()) {
 	auto add_verts =
 	  [this](const std::string& name,
 		 mesh_builder& mb,
-		 real_t bounds_radius) {
+		 real_t bounds_radius,
+		 uint32_t material = k_sampler_checkerboard) {
 	    
 	    m_model_data.indices[name] = m_model_data.length();
 
@@ -1693,15 +2431,33 @@ namespace vulkan {
 	    bvol.center = mb.taccum()[3];
 	    bvol.type = module_geom::bvol::type_sphere;
 	    
+	    mesh_optimize::indexed_mesh<vertex_data> mesh{};
+
+	    STATIC_IF (st_config::c_renderer::m_setup_vertex_data::k_optimize_meshes) {
+	      mesh_optimize::report report{};
+	      
+	      mesh = mesh_optimize::optimize(mb.vertices, &report);
+
+	      STATIC_IF (st_config::c_renderer::m_setup_vertex_data::k_log_optimize_report) {
+		write_logf("%s", report.to_string(name).c_str());
+	      }
+	    }
+	    else {
+	      mesh = mesh_optimize::make_indexed(mb.vertices);
+	    }
+	    
 	    m_model_data.bounds_vols.push_back(bvol);
 	    m_model_data.vb_offsets.push_back(m_vertex_buffer_vertices.size());
-	    m_model_data.vb_lengths.push_back(mb.vertices.size());
-	    m_model_data.transforms.push_back(mb.taccum);	   	    
-	    
-	    m_instance_count += mb.vertices.size() / 3;
+	    m_model_data.vb_lengths.push_back(mesh.vertices.size());
+	    m_model_data.ib_offsets.push_back(m_vertex_buffer_indices.size());
+	    m_model_data.ib_lengths.push_back(mesh.indices.size());
+	    m_model_data.push_instance(mb.taccum, material);
 	    
 	    m_vertex_buffer_vertices =
-	      m_vertex_buffer_vertices + mb.vertices;
+	      m_vertex_buffer_vertices + mesh.vertices;
+
+	    m_vertex_buffer_indices =
+	      m_vertex_buffer_indices + mesh.indices;
 
 	    // erase previous state,
 	    // so we can add a new model
@@ -1755,49 +2511,245 @@ namespace vulkan {
 	    .cube()
 	    .with_scale(k_room_cube_size);
 
-	  add_verts("outer-cube", mb, k_room_cube_size[0]);
+	  add_verts("outer-cube", mb, k_room_cube_size[0], k_sampler_aqua);
+	}
+
+	{
+	  const fs::path baked_path{st_config::c_renderer::m_setup_vertex_data::k_baked_mesh_path};
+
+	  if (fs::is_directory(baked_path)) {
+	    for (const auto& entry: fs::directory_iterator(baked_path)) {
+	      if (entry.path().extension() == ".bmesh") {
+		mesh_bake::baked_file file{};
+
+		if (file.open(entry.path().string())) {
+		  add_baked_meshes(entry.path().stem().string(), file, transform());
+		}
+	      }
+	    }
+	  }
 	}
 	
 	m_ok_vertex_data = true;
       }
     }
     
-    void setup_descriptor_pool() {
-      if (ok_vertex_data()) {       
-        darray<VkDescriptorPoolSize> pool_sizes =
+    darray<descriptor_set_source> descriptor_set_sources() const {
+      return
+	{
+	 // k_descriptor_set_samplers
+	 { { realpath_spv("tri_ubo.frag.spv") }, 0, false, 0 },
+	 // k_descriptor_set_uniform_blocks: the surface block
+	 // is binding 1
+	 {
 	  {
-	   // type, descriptorCount
-	   { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
-	   { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
-	   { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 2 }
-	  };
+	   realpath_spv("tri_ubo.vert.spv"),
+	   realpath_spv("debug_lines.vert.spv")
+	  },
+	  1, true, 2
+	 },
+	 // k_descriptor_set_instances
+	 { { realpath_spv("tri_ubo.vert.spv") }, 2, true, 0 },
+	 // k_descriptor_set_input_attachment
+	 { { realpath_spv("attachment_read.frag.spv") }, 0, false, 0 },
+	 // k_descriptor_set_cull
+	 { { realpath_spv("cull.comp.spv") }, 0, true, 0 }
+	};
+    }
+
+    // how many of each set are allocated from the pool
+    uint32_t descriptor_set_copies(int set) const {
+      uint32_t copies = 1;
+      
+      switch (set) {
+      case k_descriptor_set_input_attachment:
+	// one per framebuffer, and only when there's a second subpass
+	// to read them; see setup_attachment_read_descriptors()
+	copies = st_config::c_renderer::m_setup::k_use_single_pass
+	  ? 0
+	  : static_cast<uint32_t>(m_vk_swapchain_images.size());
+	break;
+      case k_descriptor_set_cull:
+	copies = m_gpu_driven ? 1 : 0;
+	break;
+      }
+
+      return copies;
+    }
+
+    //
+    // Reflects each set's layout from the shaders that declare it,
+    // then makes a pool that holds exactly the sets that setup()
+    // goes on to allocate.
+    //
+    void setup_descriptor_pool() {
+      if (ok_vertex_data()) {
+	darray<descriptor_set_source> sources = descriptor_set_sources();
+
+	ASSERT(sources.size() == m_test_descriptor_set_indices.size());
+	
+	darray<VkDescriptorPoolSize> pool_sizes{};
+	uint32_t max_sets = 0;
 
-	uint32_t max_sets = sum<uint32_t,
-				VkDescriptorPoolSize>(pool_sizes,
-						      [](const VkDescriptorPoolSize& x) -> uint32_t
-						      { return x.descriptorCount; });
+	bool good = true;
+
+	m_descriptor_set_params.assign(sources.size(), {});
 	
-	VkDescriptorPoolCreateInfo create_info = {};
-	create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	create_info.pNext = nullptr;
-	create_info.flags = 0;
-	create_info.maxSets = max_sets;
-	create_info.poolSizeCount = pool_sizes.size();
-	create_info.pPoolSizes = pool_sizes.data();
-
-	VK_FN(vkCreateDescriptorPool(m_vk_curr_ldevice,
-				     &create_info,
-				     nullptr,
-				     &m_vk_descriptor_pool));
+	for (size_t i = 0; i < sources.size() && good; ++i) {
+	  uint32_t copies = descriptor_set_copies(static_cast<int>(i));
+
+	  if (copies > 0) {
+	    auto reflection = reflect_spv_files(sources[i].spv_files);
+
+	    std::optional<descriptor_set_gen_params> params{};
+	    
+	    if (c_assert(reflection.has_value())) {
+	      params = reflection.value().set_params(sources[i].set,
+						     sources[i].dynamic,
+						     sources[i].min_bindings);
+	    }
+
+	    good = c_assert(params.has_value());
+	    
+	    if (good) {
+	      m_descriptor_set_params[i] = params.value();
+	      
+	      for (uint32_t count: params.value().descriptor_counts) {
+		auto it = std::find_if(pool_sizes.begin(), pool_sizes.end(),
+				       [&params](const VkDescriptorPoolSize& x) {
+					 return x.type == params.value().type;
+				       });
+	      
+		if (it == pool_sizes.end()) {
+		  pool_sizes.push_back({ params.value().type, 0 });
+		  it = pool_sizes.end() - 1;
+		}
+
+		it->descriptorCount += count * copies;
+	      }
+
+	      max_sets += copies;
+	    }
+	  }
+	}
+
+	if (good) {
+	  for (const VkDescriptorPoolSize& size: pool_sizes) {
+	    write_logf("descriptor pool: %" PRIu32 " of type %" PRIu32,
+		       size.descriptorCount,
+		       static_cast<uint32_t>(size.type));
+	  }
+
+	  write_logf("descriptor pool: %" PRIu32 " sets", max_sets);
+	  
+	  VkDescriptorPoolCreateInfo create_info = {};
+	  create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	  create_info.pNext = nullptr;
+	  create_info.flags = 0;
+	  create_info.maxSets = max_sets;
+	  create_info.poolSizeCount = pool_sizes.size();
+	  create_info.pPoolSizes = pool_sizes.data();
+
+	  VK_FN(vkCreateDescriptorPool(m_vk_curr_ldevice,
+				       &create_info,
+				       nullptr,
+				       &m_vk_descriptor_pool));
+	}
 	
-	m_ok_descriptor_pool = api_ok() && m_vk_descriptor_pool != VK_NULL_HANDLE;
+	m_ok_descriptor_pool = good && api_ok() && m_vk_descriptor_pool != VK_NULL_HANDLE;
       }
     }
 
+    // The push constant ranges the shaders in spv_files declare; a
+    // pipeline layout that's shared by several pipelines takes the
+    // ranges of the one that pushes constants.
+    darray<VkPushConstantRange> reflect_push_constant_ranges(const darray<std::string>& spv_files) const {
+      auto reflection = reflect_spv_files(spv_files);
+
+      return
+	c_assert(reflection.has_value())
+	? reflection.value().push_constant_ranges
+	: darray<VkPushConstantRange>{};
+    }
+
     uint32_t current_frame() const {
       return m_current_frame;
     }
 
+    // GPU time per scope, read back a few frames after it's spent;
+    // empty without timestamp support
+    const gpu_profiler::stats& gpu_timings() const {
+      return m_gpu_profiler.get_stats();
+    }
+
+    // Before init_context(): render into params.image_count offscreen
+    // images of params.extent instead of a swapchain. No window or
+    // surface is needed, so neither is GLFW, and CPU devices are
+    // accepted. render() uses the images in turn and presents nothing.
+    void set_headless(const headless_params& params) {
+      ASSERT(m_vk_instance == VK_NULL_HANDLE);
+      m_headless = params;
+    }
+
+    bool headless() const {
+      return m_headless.has_value();
+    }
+
+    // Headless with readback: the last frame render() submitted,
+    // RGBA8 with tightly packed rows; waits for it if it's not done.
+    // nullptr otherwise, or if nothing's been submitted.
+    const uint8_t* last_frame_pixels() {
+      const uint8_t* pixels = nullptr;
+      
+      if (m_readback_buffer.handle != VK_NULL_HANDLE && m_frames_submitted > 0) {
+	uint32_t image_index = static_cast<uint32_t>((m_frames_submitted - 1) % m_vk_swapchain_images.size());
+
+	if (m_timeline.wait(m_image_values.at(image_index))) {
+	  pixels =
+	    static_cast<const uint8_t*>(m_readback_buffer.memory.mapped) +
+	    m_readback_size * image_index;
+	}
+      }
+
+      return pixels;
+    }
+
+    // changes when the swapchain is recreated
+    VkExtent2D swapchain_extent() const {
+      return m_vk_swapchain_extent;
+    }
+
+    // called from the window's framebuffer size callback;
+    // the swapchain is recreated by the next render()
+    void framebuffer_resized() {
+      m_swapchain_stale = true;
+    }
+
+    // the owner should free this renderer and set up a new one;
+    // render() is a no-op until then
+    bool restart_required() const {
+      return m_restart_required;
+    }
+
+    // frames are numbered from 1, in the order they're submitted
+    uint64_t frames_submitted() const {
+      return m_frames_submitted;
+    }
+
+    // whether the GPU has finished the nth frame (and everything
+    // submitted before it); doesn't block
+    bool gpu_completed_frame(uint64_t n) {
+      bool r = n <= m_frames_submitted;
+
+      // a frame's slot is only reused once its
+      // submission has been waited on
+      if (r && n > 0 && m_frames_submitted - n < max_frames_in_flight()) {
+	r = m_timeline.reached(m_frame_values.at((n - 1) % max_frames_in_flight()));
+      }
+
+      return r;
+    }
+
     double frame_delta_seconds(uint32_t frame_index) const {
       return m_frame_dtimes.at(frame_index);
     }
@@ -1820,6 +2772,51 @@ namespace vulkan {
        dual_via_input_attachment
       };
     
+    pass_type m_pass_type{pass_type::single};
+
+    // Generates the framebuffer attachments for m_pass_type, one set
+    // per swapchain image. The two pass path creates color and depth
+    // images which are meant to be used for multipass rendering (via
+    // VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT); the single pass path only
+    // needs depth, so data[i].color_attachment is left alone.
+    //
+    // They're the size of the swapchain, so recreate_swapchain()
+    // calls this again, which remakes them at the same indices.
+    bool make_swapchain_attachments() {
+      const VkFormat color_format = VK_FORMAT_R8G8B8A8_UNORM;
+      const VkFormat depth_format = depthbuffer_info::query_format();
+
+      bool good = true;
+      
+      for (framebuffer_attachments::color_depth_pair& pair: m_framebuffer_attachments.data) {
+	switch (m_pass_type) {
+	case pass_type::dual_via_input_attachment:
+	  pair.color_attachment =
+	    make_framebuffer_attachment(color_format,
+					VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+					pair.color_attachment);
+
+	  pair.depth_attachment =
+	    make_framebuffer_attachment(depth_format,
+					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+					pair.depth_attachment);
+
+	  good = good && pair.color_attachment != image_pool::k_unset;
+	  break;
+	case pass_type::single:
+	  pair.depth_attachment =
+	    make_framebuffer_attachment(depth_format,
+					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+					pair.depth_attachment);
+	  break;
+	}
+
+	good = good && pair.depth_attachment != image_pool::k_unset;
+      }
+
+      return good;
+    }
+    
     void setup_render_pass(pass_type type = pass_type::single) {
       if (ok_descriptor_pool()) {
 	ASSERT(!m_vk_swapchain_images.empty());	
@@ -1877,31 +2874,14 @@ namespace vulkan {
 
 	darray<VkSubpassDependency> subpass_dependencies{};
 
+	m_pass_type = type;
+	
 	m_framebuffer_attachments.data.resize(m_vk_swapchain_images.size());
+
+	make_swapchain_attachments();
 	
 	switch (type) {
 	case pass_type::dual_via_input_attachment:
-	  // generate the framebuffer attachments;
-	  // these create image views which are meant to be used
-	  // for multipass rendering (via VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
-	  {
-	    const VkFormat color_format = VK_FORMAT_R8G8B8A8_UNORM;
-	    const VkFormat depth_format = depthbuffer_info::query_format();       
-	
-	    for (size_t i{0}; i < m_framebuffer_attachments.data.size(); i++) {
-
-	      m_framebuffer_attachments.data[i].color_attachment =
-		make_framebuffer_attachment(color_format,
-					    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT);
-
-	      m_framebuffer_attachments.data[i].depth_attachment =
-		make_framebuffer_attachment(depth_format,
-					    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT);
-	  
-	  
-	    }
-	  }
-	  
 	  // Input attachments
 	  // These will be written in the first subpass, transitioned to input attachments 
 	  // and then read in the secod subpass
@@ -2013,25 +2993,9 @@ namespace vulkan {
 	  
 	  break;
 	case pass_type::single:
-	  // generate the depth framebuffer attachment;
-	  // we leave data[i].color_attachment alone (i.e., we don't generate it),
-	  // since it isn't needed.
-	  {
-	    const VkFormat depth_format = depthbuffer_info::query_format();	    
-
-	    for (size_t i{0}; i < m_framebuffer_attachments.data.size(); i++) {
-
-	      m_framebuffer_attachments.data[i].depth_attachment =
-		make_framebuffer_attachment(depth_format,
-					    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
-	  
-	  
-	    }
-	  }
-	  
 	  // depth attachment; we still need a depth buffer,
 	  // and this describes how we wish to use the image view
-	  // (which we create in the loop right above this line)
+	  // (which make_swapchain_attachments() created)
 	  attachments.push_back(make_attachment_description(attachment_kind::depth));
 
 	  // we've already passed the addresses of these to the first
@@ -2126,8 +3090,11 @@ namespace vulkan {
 	   VK_ATTACHMENT_STORE_OP_DONT_CARE,
 	   // initialLayout
 	   VK_IMAGE_LAYOUT_UNDEFINED,
-	   // finalLayout
-	   VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+	   // finalLayout: headless, commands_readback() takes
+	   // it from here when the frame is read back
+	   headless()
+	   ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	   : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
 	  };
       case attachment_kind::input_color:
 	return
@@ -2217,31 +3184,64 @@ namespace vulkan {
        complete				       
       };
     
+    // points attachment read set i at image i's color and depth
+    // attachments; again whenever they're remade
+    void write_attachment_read_descriptors() {
+      for (size_t i{0}; i < m_descriptors.attachment_read.size(); ++i) {
+	VkImageView color = m_framebuffer_attachments.color_image_view(i);	      	       
+	VkImageView depth = m_framebuffer_attachments.depth_image_view(i);
+	    
+	darray<VkDescriptorImageInfo> descriptor_image_infos =
+	  {
+	   // sampler,          imageView,  imageLayout
+	   { VK_NULL_HANDLE,    color,      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+	   { VK_NULL_HANDLE,    depth,      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+	  };
+
+	VkDescriptorSet descset = m_descriptor_set_pool.descriptor_set(m_descriptors.attachment_read.at(i));
+	    
+	darray<VkWriteDescriptorSet> write_descriptor_sets =
+	  {
+	   // color input attachment
+	   make_write_descriptor_set(descset,
+				     // corresponding image info
+				     descriptor_image_infos.data(),
+				     // binding
+				     0,
+				     // type
+				     VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+				     // descriptor count
+				     1),
+	   // depth input attachment
+	   make_write_descriptor_set(descset,
+				     // corresponding image info
+				     descriptor_image_infos.data() + 1,
+				     // binding
+				     1,
+				     // type
+				     VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+				     // descriptor count
+				     1)
+	  };
+	    
+	vkUpdateDescriptorSets(m_vk_curr_ldevice,
+			       static_cast<uint32_t>(write_descriptor_sets.size()),
+			       write_descriptor_sets.data(),
+			       0,
+			       nullptr);
+      }
+    }
+    
     void setup_attachment_read_descriptors(attachment_read_descriptor_type type = attachment_read_descriptor_type::none) {
       if (ok_render_pass()) {
 
 	bool good = true;
 
 	if (type == attachment_read_descriptor_type::complete) {
-	  descriptor_set_gen_params attachment_read_params =
-	    {
-	     // stages
-	     {
-	      // binding 0: color attachment input
-	      VK_SHADER_STAGE_FRAGMENT_BIT,
-	      // binding 1: depth attachment input
-	      VK_SHADER_STAGE_FRAGMENT_BIT
-	     },
-	     // descriptor counts
-	     {
-	      // binding 0: color attachment input
-	      1,
-	      // binding 1: depth attachment input
-	      1
-	     },
-	     // type for this set
-	     VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT
-	    };
+	  // binding 0: color attachment input
+	  // binding 1: depth attachment input
+	  const descriptor_set_gen_params& attachment_read_params =
+	    m_descriptor_set_params.at(k_descriptor_set_input_attachment);
 
 	  m_descriptors
 	    .attachment_read
@@ -2257,55 +3257,14 @@ namespace vulkan {
 	      .make_descriptor_set(make_device_resource_properties(),
 				   attachment_read_params);
 
-	    good = m_descriptor_set_pool.ok_descriptor_set(m_descriptors.attachment_read.at(i));
-
-	    if (c_assert(good)) {
-	    
-	      VkImageView color = m_framebuffer_attachments.color_image_view(i);	      	       
-	      VkImageView depth = m_framebuffer_attachments.depth_image_view(i);
-	    
-	      darray<VkDescriptorImageInfo> descriptor_image_infos =
-		{
-		 // sampler,          imageView,  imageLayout
-		 { VK_NULL_HANDLE,    color,      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
-		 { VK_NULL_HANDLE,    depth,      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
-		};
-
-	      VkDescriptorSet descset = m_descriptor_set_pool.descriptor_set(m_descriptors.attachment_read.at(i));
-	    
-	      darray<VkWriteDescriptorSet> write_descriptor_sets =
-		{
-		 // color input attachment
-		 make_write_descriptor_set(descset,
-					   // corresponding image info
-					   descriptor_image_infos.data(),
-					   // binding
-					   0,
-					   // type
-					   VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-					   // descriptor count
-					   1),
-		 // depth input attachment
-		 make_write_descriptor_set(descset,
-					   // corresponding image info
-					   descriptor_image_infos.data() + 1,
-					   // binding
-					   1,
-					   // type
-					   VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-					   // descriptor count
-					   1)
-		};
-	    
-	      vkUpdateDescriptorSets(m_vk_curr_ldevice,
-				     static_cast<uint32_t>(write_descriptor_sets.size()),
-				     write_descriptor_sets.data(),
-				     0,
-				     nullptr);
-	    }
+	    good = c_assert(m_descriptor_set_pool.ok_descriptor_set(m_descriptors.attachment_read.at(i)));
 
 	    i++;
 	  }
+
+	  if (good) {
+	    write_attachment_read_descriptors();
+	  }
 	}
 
 	m_ok_attachment_read_descriptors = good;
@@ -2315,30 +3274,26 @@ namespace vulkan {
     void setup_uniform_block_data() {
       if (ok_attachment_read_descriptors()) {
 	// setup descriptor set for all uniform blocks
-	{
-	  descriptor_set_gen_params uniform_block_desc_set_params =
-	    {
-	     {
-	      VK_SHADER_STAGE_VERTEX_BIT, // binding 0: transform block
-	      VK_SHADER_STAGE_VERTEX_BIT // binding 1: surface block
-	     },
-	     // descriptor counts for each binding
-	     {
-	      1, // binding 0
-	      1 // binding 1
-	     },
-	     VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
-	    };
-
-	  m_test_descriptor_set_indices[k_descriptor_set_uniform_blocks] =
-	    m_descriptor_set_pool.make_descriptor_set(make_device_resource_properties(),
-						      uniform_block_desc_set_params);
-	}
+	//
+	// binding 0: transform block
+	// binding 1: surface block
+	//
+	// the region of the uniform ring that's read
+	// is chosen when the set is bound
+	m_test_descriptor_set_indices[k_descriptor_set_uniform_blocks] =
+	  m_descriptor_set_pool.make_descriptor_set(make_device_resource_properties(),
+						    m_descriptor_set_params.at(k_descriptor_set_uniform_blocks));
 
 	// the pool will forward descriptor set info when
 	// creating a uniform block
 	m_uniform_block_pool.set_descriptor_set_pool(&m_descriptor_set_pool);
 
+	// one region per command buffer, so that a block can be updated
+	// for the next submission while earlier ones are still reading it
+	bool ring_made =
+	  m_uniform_block_pool.make_ring(make_device_resource_properties(),
+					 static_cast<uint32_t>(m_vk_swapchain_images.size()));
+
 	//
 	// generate the uniform blocks.
 	//
@@ -2353,79 +3308,398 @@ namespace vulkan {
 	  };
 
 	m_ok_uniform_block_data =
+	  ring_made &&
 	  gen.make<uniform_block::transform>(m_transform_uniform_block, uniform_block::k_binding_transform) &&
-	  gen.make<uniform_block::surface>(m_surface_uniform_block, uniform_block::k_binding_surface);
+	  gen.make<uniform_block::surface>(m_surface_uniform_block, uniform_block::k_binding_surface) &&
+	  setup_instance_buffer() &&
+	  setup_cull_buffer();
       }
     }
-    
-    void setup_texture_data() {
-      if (ok_uniform_block_data()) {
-	m_texture_pool.set_image_pool(&m_image_pool);
-	m_texture_pool.set_descriptor_set_pool(&m_descriptor_set_pool);
 
-	//
-	// create our descriptor set that's used
-	// for the 2d samplers
-	//
-	{
-	  descriptor_set_gen_params descriptor_set_params =
-	    {
-	     // stages
-	     {
-	      VK_SHADER_STAGE_FRAGMENT_BIT
-	     },
-	     // descriptor_counts
-	     {
-	      2
-	     },
-	     // type
-	     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
-	    };
-
-	  m_test_descriptor_set_indices[k_descriptor_set_samplers] =
-	    m_descriptor_set_pool.make_descriptor_set(make_device_resource_properties(),
-						      descriptor_set_params);
-	}
+    // host visible, like the uniform ring, and bound with a dynamic
+    // offset that picks the recording command buffer's region
+    bool setup_instance_buffer() {
+      constexpr VkMemoryPropertyFlags k_host_memory =
+	VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-	//
-	// make first image/texture
-	//
+      // binding 0: instances
+      m_test_descriptor_set_indices[k_descriptor_set_instances] =
+	m_descriptor_set_pool.make_descriptor_set(make_device_resource_properties(),
+						  m_descriptor_set_params.at(k_descriptor_set_instances));
 
-	// reuse these 4 variables for both images
-	uint32_t image_w = 256;
-	uint32_t image_h = 256;
+      VkDeviceSize alignment =
+	std::max(m_memory_pool.limits().minStorageBufferOffsetAlignment, VkDeviceSize{1});
 
-	uint32_t bpp = 4;
+      VkDeviceSize region_size =
+	sizeof(storage_block::instance) *
+	st_config::c_renderer::m_setup_instance_buffer::k_max_instances;
+      
+      m_instance_region_size = ((region_size + alignment - 1) / alignment) * alignment;
+
+      auto opt_buffer =
+	make_buffer_data(0, // create flags
+			 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			 k_host_memory,
+			 m_instance_region_size * m_vk_swapchain_images.size());
+
+      bool good =
+	c_assert(opt_buffer.has_value()) &&
+	c_assert(opt_buffer.value().memory.mapped != nullptr);
+
+      if (good) {
+	m_instance_buffer = opt_buffer.value();
+
+	good =
+	  m_descriptor_set_pool.write_buffer(m_test_descriptor_set_indices.at(k_descriptor_set_instances),
+					     m_vk_curr_ldevice,
+					     m_instance_buffer.handle,
+					     0,
+					     region_size,
+					     storage_block::k_binding_instances,
+					     0);
+      }
 
-	darray<uint8_t> buffer(image_w * image_h * bpp, 0);
+      return c_assert(good);
+    }
 
-	// this creates a checkerboard pattern
-	{
-	  uint8_t rgb = 0;
+    // Lays out the instances of every visible model, then the room's,
+    // in region i of the instance buffer, and records where each
+    // model's run starts for commands_draw_model(). The GPU has to be
+    // done with command buffer i's last submission.
+    void write_instances(uint32_t i) {
+      auto* region =
+	reinterpret_cast<storage_block::instance*>(static_cast<uint8_t*>(m_instance_buffer.memory.mapped) +
+						   i * m_instance_region_size);
+
+      uint32_t count = 0;
+      uint32_t dropped = 0;
+      
+      auto write = [this, region, &count, &dropped](uint32_t model) {
+	const auto& instances = m_model_data.instances.at(model);
 
-	  uint32_t mask = 7;
+	uint32_t n = std::min(static_cast<uint32_t>(instances.size()),
+			      st_config::c_renderer::m_setup_instance_buffer::k_max_instances - count);
 
-	  uint32_t y = 0;
-	  while (y < image_h) {
-	    uint32_t x = 0;
-	    while (x < image_w) {
-	      uint32_t offset = (y * image_w + x) * bpp;
-	    
-	      buffer[offset + 0] = 255 & rgb;
-	      buffer[offset + 1] = 255 & rgb;
-	      buffer[offset + 2] = 255 & rgb;
-	      buffer[offset + 3] = 255;
-	    
-	      x++;
+	m_model_data.first_instances[model] = count;
+	m_model_data.instance_counts[model] = n;
 
-	      if (((x + 1) & mask) == 0) {
-		rgb = ~rgb;
-	      }
-	    }
+	for (uint32_t k = 0; k < n; ++k) {
+	  region[count + k].model_to_world = instances[k].model_to_world();
+	  region[count + k].material = instances[k].material;
+	}
 
-	    y++;
+	count += n;
+	dropped += static_cast<uint32_t>(instances.size()) - n;
+      };
 
-	    if (((y + 1) & mask) == 0) {
+      for (uint32_t model: m_visible_models) {
+	write(model);
+      }
+
+      write(m_model_data.indices.at("outer-cube"));
+
+      ASSERT(dropped == 0);
+    }
+
+    // does nothing unless m_gpu_driven. The objects are written by
+    // write_cull_objects(), once the instance layout is known.
+    bool setup_cull_buffer() {
+      bool good = true;
+      
+      if (m_gpu_driven) {
+	constexpr VkMemoryPropertyFlags k_host_memory =
+	  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	// binding 0: objects
+	// binding 1: frame
+	// binding 2: draws
+	//
+	// the objects are bound with a dynamic offset of 0,
+	// the frame and draws with their region's
+	m_test_descriptor_set_indices[k_descriptor_set_cull] =
+	  m_descriptor_set_pool.make_descriptor_set(make_device_resource_properties(),
+						    m_descriptor_set_params.at(k_descriptor_set_cull));
+
+	VkDeviceSize alignment =
+	  std::max(m_memory_pool.limits().minStorageBufferOffsetAlignment, VkDeviceSize{1});
+
+	auto align = [alignment](VkDeviceSize size) -> VkDeviceSize {
+	  return ((size + alignment - 1) / alignment) * alignment;
+	};
+
+	VkDeviceSize objects_size = sizeof(storage_block::cull_object) * m_model_data.length();
+	VkDeviceSize draws_size = sizeof(storage_block::cull_draw) * m_model_data.length();
+	
+	m_cull_objects_size = align(objects_size);
+	m_cull_frame_size = align(sizeof(storage_block::cull_frame));
+	m_cull_region_size = align(m_cull_frame_size + draws_size);
+
+	auto opt_buffer =
+	  make_buffer_data(0, // create flags
+			   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+			   VK_BUFFER_USAGE_TRANSFER_DST_BIT, // draw_count is zeroed with vkCmdFillBuffer
+			   k_host_memory,
+			   m_cull_objects_size + m_cull_region_size * m_vk_swapchain_images.size());
+
+	good =
+	  c_assert(opt_buffer.has_value()) &&
+	  c_assert(opt_buffer.value().memory.mapped != nullptr);
+
+	if (good) {
+	  m_cull_buffer = opt_buffer.value();
+
+	  auto set = m_test_descriptor_set_indices.at(k_descriptor_set_cull);
+	  
+	  good =
+	    m_descriptor_set_pool.write_buffer(set,
+					       m_vk_curr_ldevice,
+					       m_cull_buffer.handle,
+					       0,
+					       objects_size,
+					       storage_block::k_binding_cull_objects,
+					       0) &&
+	    m_descriptor_set_pool.write_buffer(set,
+					       m_vk_curr_ldevice,
+					       m_cull_buffer.handle,
+					       m_cull_objects_size,
+					       sizeof(storage_block::cull_frame),
+					       storage_block::k_binding_cull_frame,
+					       0) &&
+	    m_descriptor_set_pool.write_buffer(set,
+					       m_vk_curr_ldevice,
+					       m_cull_buffer.handle,
+					       m_cull_objects_size + m_cull_frame_size,
+					       draws_size,
+					       storage_block::k_binding_cull_draws,
+					       0);
+	}
+
+	m_cull_validation.expected.resize(m_vk_swapchain_images.size());
+      }
+
+      return c_assert(good);
+    }
+
+    VkDeviceSize cull_region_offset(uint32_t i) const {
+      return m_cull_objects_size + i * m_cull_region_size;
+    }
+
+    storage_block::cull_object* cull_objects() const {
+      return reinterpret_cast<storage_block::cull_object*>(m_cull_buffer.memory.mapped);
+    }
+
+    storage_block::cull_frame* cull_frame(uint32_t i) const {
+      return reinterpret_cast<storage_block::cull_frame*>(static_cast<uint8_t*>(m_cull_buffer.memory.mapped) +
+							  cull_region_offset(i));
+    }
+
+    const storage_block::cull_draw* cull_draws(uint32_t i) const {
+      return reinterpret_cast<const storage_block::cull_draw*>(static_cast<uint8_t*>(m_cull_buffer.memory.mapped) +
+							       cull_region_offset(i) +
+							       m_cull_frame_size);
+    }
+
+    // Object i draws model i's instances from wherever write_instances()
+    // put them. With every model visible the layout is the same in each
+    // region of the instance buffer, so this is only done once.
+    // The room and models with more than one instance are never
+    // culled, as in update_visible_models().
+    void write_cull_objects() {
+      storage_block::cull_object* objects = cull_objects();
+
+      uint32_t room = m_model_data.indices.at("outer-cube");
+      
+      for (uint32_t i = 0; i < m_model_data.length(); ++i) {
+	const module_geom::bvol& bounds = m_model_data.bounds_vols.at(i);
+
+	storage_block::cull_object o{};
+	
+	o.sphere = vec4_t{bounds.center, bounds.radius};
+	o.index_count = m_model_data.ib_lengths.at(i);
+	o.first_index = m_model_data.ib_offsets.at(i);
+	o.vertex_offset = static_cast<int32_t>(m_model_data.vb_offsets.at(i));
+	o.first_instance = m_model_data.first_instances.at(i);
+	o.instance_count = m_model_data.instance_counts.at(i);
+
+	if (i == room || m_model_data.instances.at(i).size() > 1) {
+	  o.flags |= storage_block::k_cull_object_never_cull;
+	}
+
+	objects[i] = o;
+      }
+    }
+
+    // Hands region i the current frustum. The GPU has to be done
+    // with command buffer i's last submission. When validating, the
+    // CPU's answer for the same planes is kept until the draws
+    // can be read back.
+    void write_cull_frame(uint32_t i) {
+      storage_block::cull_frame* frame = cull_frame(i);
+
+      const auto& planes = m_frustum.planes();
+      
+      for (uint32_t p = 0; p < 4; ++p) {
+	frame->planes[p] = vec4_t{planes[p].normal, planes[p].d};
+      }
+
+      frame->num_objects = static_cast<uint32_t>(m_model_data.length());
+
+      STATIC_IF (st_config::c_renderer::m_render::k_validate_gpu_culling) {
+	const storage_block::cull_object* objects = cull_objects();
+	
+	darray<uint8_t>& expected = m_cull_validation.expected.at(i);
+
+	expected.resize(m_model_data.length());
+	
+	for (uint32_t o = 0; o < m_model_data.length(); ++o) {
+	  const module_geom::bvol& bounds = m_model_data.bounds_vols.at(o);
+	  
+	  if ((objects[o].flags & storage_block::k_cull_object_never_cull) != 0) {
+	    expected[o] = cull_expect_drawn;
+	  }
+	  else {
+	    expected[o] =
+	      m_frustum.intersects_sphere(bounds)
+	      ? cull_expect_drawn
+	      : cull_expect_culled;
+
+	    real_t epsilon =
+	      st_config::c_renderer::m_render::k_cull_validation_epsilon *
+	      std::max(bounds.radius, R(1));
+	    
+	    for (uint32_t p = 0; p < 4; ++p) {
+	      real_t dist =
+		glm::abs(glm::dot(bounds.center, planes[p].normal) - planes[p].d) /
+		glm::length(planes[p].normal);
+
+	      if (glm::abs(dist - bounds.radius) <= epsilon) {
+		expected[o] = cull_expect_either;
+	      }
+	    }
+	  }
+	}
+      }
+    }
+
+    // Compares the draws command buffer i produced on its last
+    // submission with what the CPU expected for the same planes. The
+    // GPU has to be done with that submission; regions that haven't
+    // been submitted yet are skipped.
+    void check_gpu_culling(uint32_t i) {
+      darray<uint8_t>& expected = m_cull_validation.expected.at(i);
+      
+      if (!expected.empty()) {
+	const storage_block::cull_frame* frame = cull_frame(i);
+	const storage_block::cull_draw* draws = cull_draws(i);
+
+	uint32_t num_objects = static_cast<uint32_t>(expected.size());
+	uint32_t num_draws = std::min(frame->draw_count, num_objects);
+	
+	darray<uint8_t> drawn(num_objects, 0);
+
+	uint32_t mismatches = frame->draw_count - num_draws;
+	
+	for (uint32_t d = 0; d < num_draws; ++d) {
+	  uint32_t o = draws[d].object;
+
+	  if (o < num_objects && drawn[o] == 0) {
+	    drawn[o] = 1;
+	  }
+	  else {
+	    write_logf("gpu culling: draw %" PRIu32 " has a bad or repeated object %" PRIu32, d, o);
+	    mismatches++;
+	  }
+	}
+
+	for (uint32_t o = 0; o < num_objects; ++o) {
+	  if (expected[o] != cull_expect_either &&
+	      (expected[o] == cull_expect_drawn) != (drawn[o] == 1)) {
+	    auto it = std::find_if(m_model_data.indices.begin(),
+				   m_model_data.indices.end(),
+				   [o](const auto& kv) { return kv.second == o; });
+
+	    write_logf("gpu culling: %s is %s on the GPU but %s on the CPU",
+		       it != m_model_data.indices.end() ? it->first.c_str() : "?",
+		       drawn[o] == 1 ? "drawn" : "culled",
+		       drawn[o] == 1 ? "culled" : "drawn");
+	    mismatches++;
+	  }
+	}
+
+	m_cull_validation.frames++;
+
+	if (mismatches > 0) {
+	  m_cull_validation.mismatched_frames++;
+	}
+
+	if (m_cull_validation.frames == st_config::c_renderer::m_render::k_record_log_period) {
+	  write_logf("gpu culling: %" PRIu32 " of %" PRIu32 " frames disagreed with the CPU frustum",
+		     m_cull_validation.mismatched_frames,
+		     m_cull_validation.frames);
+
+	  m_cull_validation.frames = 0;
+	  m_cull_validation.mismatched_frames = 0;
+	}
+	
+	expected.clear();
+      }
+    }
+    
+    void setup_texture_data() {
+      if (ok_uniform_block_data()) {
+	m_texture_pool.set_image_pool(&m_image_pool);
+	m_texture_pool.set_descriptor_set_pool(&m_descriptor_set_pool);
+
+	//
+	// create our descriptor set that's used
+	// for the 2d samplers
+	//
+	m_test_descriptor_set_indices[k_descriptor_set_samplers] =
+	  m_descriptor_set_pool.make_descriptor_set(make_device_resource_properties(),
+						    m_descriptor_set_params.at(k_descriptor_set_samplers));
+
+	//
+	// make first image/texture
+	//
+
+	// reuse these 4 variables for both images
+	uint32_t image_w = 256;
+	uint32_t image_h = 256;
+
+	uint32_t bpp = 4;
+
+	darray<uint8_t> buffer(image_w * image_h * bpp, 0);
+
+	// this creates a checkerboard pattern
+	{
+	  uint8_t rgb = 0;
+
+	  uint32_t mask = 7;
+
+	  uint32_t y = 0;
+	  while (y < image_h) {
+	    uint32_t x = 0;
+	    while (x < image_w) {
+	      uint32_t offset = (y * image_w + x) * bpp;
+	    
+	      buffer[offset + 0] = 255 & rgb;
+	      buffer[offset + 1] = 255 & rgb;
+	      buffer[offset + 2] = 255 & rgb;
+	      buffer[offset + 3] = 255;
+	    
+	      x++;
+
+	      if (((x + 1) & mask) == 0) {
+		rgb = ~rgb;
+	      }
+	    }
+
+	    y++;
+
+	    if (((y + 1) & mask) == 0) {
 	      rgb = ~rgb;
 	    }
 	  }
@@ -2540,11 +3814,33 @@ namespace vulkan {
     }
 
 
+    // Checks the shaders against the layout and vertex attributes
+    // they're given, then makes the pass's layout right away; the
+    // pipeline itself is created by create_pending_pipelines()
     bool setup_pipeline(int render_phase_index,
 			int subpass_index,
 			pipeline_layout_gen_params layout_params,
 			pipeline_gen_params params) {
-      bool success = false;
+      auto reflection = reflect_spv_files({ params.vert_spv_path, params.frag_spv_path });
+
+      bool success = c_assert(reflection.has_value());
+
+      if (success) {
+	const auto& attributes =
+	  params.vertex_attributes.empty()
+	  ? pipeline_pool::vertex_data_attributes()
+	  : params.vertex_attributes;
+
+	success = c_assert(reflection.value().accepts_vertex_attributes(attributes));
+
+	for (const shader_reflection::binding& b: reflection.value().bindings) {
+	  success = success && c_assert(b.set < layout_params.descriptor_set_layouts.size());
+	}
+      }
+
+      if (!success) {
+	return false;
+      }
       
       m_pipeline_layout_indices[render_phase_index] =
 	m_pipeline_layout_pool.make_pipeline_layout(make_device_resource_properties(),
@@ -2553,18 +3849,91 @@ namespace vulkan {
       params.subpass_index = subpass_index;
       params.pipeline_layout_index = m_pipeline_layout_indices.at(render_phase_index);
       
-      if (m_pipeline_layout_pool.ok_pipeline_layout(m_pipeline_layout_indices[0])) {
-		  
-	m_pipeline_indices[render_phase_index] =
-	  m_pipeline_pool.make_pipeline(make_device_resource_properties(),
-				        params);
+      if (m_pipeline_layout_pool.ok_pipeline_layout(m_pipeline_layout_indices[render_phase_index])) {
+	m_pending_pipelines.push_back({ render_phase_index, params });
+	
+	success = true;
+      }
+
+      return success;
+    }
+
+    // Creates every pipeline setup_pipeline() has queued, as parallel
+    // jobs when c_pipeline_pool::k_parallel_create is set, and returns
+    // once they've all been made. Nothing can be recorded with them
+    // before that, so this is the barrier between pipeline creation
+    // and command recording.
+    bool create_pending_pipelines() {
+      darray<pipeline_gen_params> params{};
+
+      for (const pending_pipeline& p: m_pending_pipelines) {
+	params.push_back(p.params);
+      }
+
+      std::unique_ptr<worker_pool> workers{};
+
+      STATIC_IF (st_config::c_pipeline_pool::k_parallel_create) {
+	uint32_t num_threads = st_config::c_pipeline_pool::k_threads == 0
+	  ? parallel_default_thread_count()
+	  : st_config::c_pipeline_pool::k_threads;
+
+	// no more threads than jobs
+	num_threads = std::clamp<uint32_t>(static_cast<uint32_t>(params.size()), 1, num_threads);
+	
+	workers = std::make_unique<worker_pool>(num_threads);
+      }
+
+      write_logf("creating %" PRIu32 " pipelines on %" PRIu32 " threads",
+		 static_cast<uint32_t>(params.size()),
+		 workers ? workers->num_threads() : 1u);
+      
+      darray<pipeline_pool::index_type> indices =
+	m_pipeline_pool.make_pipelines(make_device_resource_properties(),
+				       params,
+				       workers.get());
+
+      bool success = true;
+      
+      for (size_t i = 0; i < m_pending_pipelines.size(); ++i) {
+	int pass = m_pending_pipelines[i].render_phase_index;
+	
+	m_pipeline_indices[pass] = indices.at(i);
 
-	success = m_pipeline_pool.ok_pipeline(m_pipeline_indices[render_phase_index]);
+	success = success && m_pipeline_pool.ok_pipeline(m_pipeline_indices[pass]);
       }
 
+      m_pending_pipelines.clear();
+      
       return success;
     }
         
+    //
+    // push constant ranges are taken from these, for
+    // texture2d and the passes that share its layout
+    //
+    darray<std::string> texture2d_spv_files() const {
+      return
+	{
+	 realpath_spv("tri_ubo.vert.spv"),
+	 realpath_spv("tri_ubo.frag.spv")
+	};
+    }
+
+    darray<VkPushConstantRange> texture2d_push_constant_ranges() const {
+      darray<VkPushConstantRange> ranges =
+	reflect_push_constant_ranges(texture2d_spv_files());
+
+      // has to match what commands_draw_main() uploads
+      VkPushConstantRange expected = push_constant::basic_pbr_range();
+
+      c_assert(ranges.size() == 1 &&
+	       ranges[0].stageFlags == expected.stageFlags &&
+	       ranges[0].offset == expected.offset &&
+	       ranges[0].size == expected.size);
+
+      return ranges;
+    }
+    
     bool setup_pipeline_texture2d() {
       return setup_pipeline(k_pass_texture2d,
 			    // subpass index
@@ -2574,24 +3943,20 @@ namespace vulkan {
 			     // descriptor set layouts
 			     {
 			      descriptor_set_layout(k_descriptor_set_samplers),			      
-			      descriptor_set_layout(k_descriptor_set_uniform_blocks)
+			      descriptor_set_layout(k_descriptor_set_uniform_blocks),
+			      descriptor_set_layout(k_descriptor_set_instances)
 			     },
 			     // push constant ranges
-			     {
-			      push_constant::basic_pbr_range(),
-			      push_constant::model_range()
-			     }
+			     texture2d_push_constant_ranges()
 			    },
 			    // pipeline
 			    {
 			     // render pass
 			     m_vk_render_pass,
-			     // viewport extent
-			     m_vk_swapchain_extent,	   
 			     // vert spv path
-			     realpath_spv("tri_ubo.vert.spv"),
+			     texture2d_spv_files().at(0),
 			     // frag spv path
-			     realpath_spv("tri_ubo.frag.spv")
+			     texture2d_spv_files().at(1)
 
 			    });
     }
@@ -2604,15 +3969,15 @@ namespace vulkan {
 			    {
 			     m_descriptor_set_pool.descriptor_set_layouts(m_descriptors.attachment_read),
 			     // push constant ranges
-			     {
-			     }
+			     reflect_push_constant_ranges({
+				 realpath_spv("attachment_read.vert.spv"),
+				 realpath_spv("attachment_read.frag.spv")
+			       })
 			    },
 			    // pipeline
 			    {
 			     // render pass
 			     m_vk_render_pass,
-			     // viewport extent
-			     m_vk_swapchain_extent,	   
 			     // vert spv path
 			     realpath_spv("attachment_read.vert.spv"),
 			     // frag spv path
@@ -2620,6 +3985,76 @@ namespace vulkan {
 			    });
     }
 
+    //
+    // shares texture2d's pipeline layout, so the descriptor
+    // sets bound for the main draw stay valid
+    //
+    bool setup_pipeline_debug_draw() {
+      pipeline_gen_params params{
+	// render pass
+	m_vk_render_pass,
+	// vert spv path
+	realpath_spv("debug_lines.vert.spv"),
+	// frag spv path
+	realpath_spv("debug_lines.frag.spv")
+      };
+
+      params.vertex_attributes =
+	{
+	 { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(debug_vertex, position) },
+	 { 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(debug_vertex, color) }
+	};
+      
+      params.vertex_stride = sizeof(debug_vertex);
+      params.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+      params.depth_write = false;
+      
+      return setup_pipeline(k_pass_debug_draw,
+			    // subpass index
+			    0,
+			    // pipeline layout
+			    {
+			     // descriptor set layouts
+			     {
+			      descriptor_set_layout(k_descriptor_set_samplers),			      
+			      descriptor_set_layout(k_descriptor_set_uniform_blocks),
+			      descriptor_set_layout(k_descriptor_set_instances)
+			     },
+			     // push constant ranges
+			     texture2d_push_constant_ranges()
+			    },
+			    params);
+    }
+
+    bool setup_pipeline_cull() {
+      bool success = false;
+      
+      m_pipeline_layout_indices[k_pass_cull] =
+	m_pipeline_layout_pool.make_pipeline_layout(make_device_resource_properties(),
+						    {
+						     // descriptor set layouts
+						     {
+						      descriptor_set_layout(k_descriptor_set_cull)
+						     },
+						     // push constant ranges
+						     reflect_push_constant_ranges({ realpath_spv("cull.comp.spv") })
+						    });
+
+      if (m_pipeline_layout_pool.ok_pipeline_layout(m_pipeline_layout_indices[k_pass_cull])) {
+	m_pipeline_indices[k_pass_cull] =
+	  m_pipeline_pool.make_compute_pipeline(make_device_resource_properties(),
+						{
+						 // comp spv path
+						 realpath_spv("cull.comp.spv"),
+						 m_pipeline_layout_indices.at(k_pass_cull)
+						});
+
+	success = m_pipeline_pool.ok_pipeline(m_pipeline_indices[k_pass_cull]);
+      }
+
+      return success;
+    }
+
     //
     // texture2d is used in both pipeline types,
     // and thus is purely independent.
@@ -2632,7 +4067,10 @@ namespace vulkan {
     
     void setup_graphics_pipeline(pipeline_type type=pipeline_type::pbr_basic_single) {      
       if (ok_texture_data()) {
+	auto start = std::chrono::steady_clock::now();
+	
 	m_pipeline_pool.set_pipeline_layout_pool(&m_pipeline_layout_pool);
+	m_pipeline_pool.set_pipeline_cache(m_pipeline_cache.handle());
 
 	switch (type) {
 	case pipeline_type::pbr_basic_single:
@@ -2647,7 +4085,34 @@ namespace vulkan {
 	default:
 	  __FATAL__("Unrecognized pipeline_type: 0x%" PRIx32, type);
 	  break;
-	}	
+	}
+
+	STATIC_IF (debug_draw::k_enabled) {
+	  m_ok_graphics_pipeline =
+	    m_ok_graphics_pipeline &&
+	    setup_pipeline_debug_draw();
+	}
+
+	m_ok_graphics_pipeline =
+	  m_ok_graphics_pipeline &&
+	  create_pending_pipelines();
+
+	if (m_gpu_driven) {
+	  m_ok_graphics_pipeline =
+	    m_ok_graphics_pipeline &&
+	    setup_pipeline_cull();
+	}
+
+	STATIC_IF (st_config::c_pipeline_cache::k_log_timing) {
+	  std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+
+	  const auto& stats = m_pipeline_cache.get_stats();
+	  
+	  write_logf("pipelines created in %f ms; pipeline cache %s (%" PRIu64 " bytes loaded)",
+		     d.count(),
+		     stats.warm ? "warm" : "cold",
+		     static_cast<uint64_t>(stats.loaded_bytes));
+	}
       }
     }
 
@@ -2739,6 +4204,9 @@ namespace vulkan {
        single_pass
       };
     
+    // kept for recreate_swapchain()
+    framebuffer_attach_flags_t m_framebuffer_attach_flags{0};
+    
     void setup_framebuffers(framebuffer_setup_method fbmethod = framebuffer_setup_method::single_pass) {
       if (ok_vertex_buffer()) {
 	framebuffer_attach_flags_t flags = 0;
@@ -2754,6 +4222,8 @@ namespace vulkan {
 	    framebuffer_attach_depth_output;
 	  break;
 	}
+
+	m_framebuffer_attach_flags = flags;
 	
 	m_vk_swapchain_framebuffers =
 	  make_framebuffer_list(m_vk_render_pass,
@@ -2764,11 +4234,36 @@ namespace vulkan {
       }
     }
 
+    // bound by both of the first subpass's pipelines
+    darray<VkDescriptorSet> frame_descriptor_sets() const {
+      return
+	{
+	 descriptor_set(k_descriptor_set_samplers),
+	 descriptor_set(k_descriptor_set_uniform_blocks),
+	 descriptor_set(k_descriptor_set_instances)
+	};
+    }
+
+    // command buffer i reads region i of the uniform ring
+    // and of the instance buffer; the offsets are in the
+    // same order as frame_descriptor_sets()
+    darray<uint32_t> frame_dynamic_offsets(uint32_t command_index) const {
+      auto set = m_test_descriptor_set_indices.at(k_descriptor_set_uniform_blocks);
+      
+      darray<uint32_t> offsets(m_descriptor_set_pool.dynamic_offset_count(set),
+			       m_uniform_block_pool.dynamic_offset(command_index));
+
+      offsets.push_back(static_cast<uint32_t>(command_index * m_instance_region_size));
+      
+      return offsets;
+    }
+
     void commands_begin_pipeline(VkCommandBuffer cmd_buffer,
 				 VkPipeline pipeline,
 				 VkPipelineLayout pipeline_layout,
 				 bool with_vertex_buffer,
-				 const darray<VkDescriptorSet>& descriptor_sets) {
+				 const darray<VkDescriptorSet>& descriptor_sets,
+				 const darray<uint32_t>& dynamic_offsets = {}) {
       
       vkCmdBindPipeline(cmd_buffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -2776,6 +4271,7 @@ namespace vulkan {
 
       if (with_vertex_buffer) {
 	m_vertex_buffer.bind_vertex(cmd_buffer);
+	m_index_buffer.bind_index(cmd_buffer);
       }
 
       vkCmdBindDescriptorSets(cmd_buffer,
@@ -2784,13 +4280,30 @@ namespace vulkan {
 			      0,
 			      descriptor_sets.size(),
 			      descriptor_sets.data(),
-			      0,
-			      nullptr);
+			      dynamic_offsets.size(),
+			      dynamic_offsets.data());
     }
 
+    // every pipeline's viewport and scissor are dynamic, so that
+    // they survive swapchain recreation; this covers the swapchain.
+    // Secondary buffers don't inherit them.
+    void commands_set_viewport(VkCommandBuffer cmd_buffer) const {
+      VkViewport viewport = make_viewport(R2(0), m_vk_swapchain_extent, 0.0f, 1.0f);
+      
+      VkRect2D scissor = {};
+      scissor.offset = { 0, 0 };
+      scissor.extent = m_vk_swapchain_extent;
+
+      vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+      vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+    }
+    
+    // if secondaries isn't empty the first subpass
+    // consists of executing them, in order
     void commands_start_render_pass(VkCommandBuffer cmd_buffer,
 				    VkFramebuffer framebuffer,
-				    VkRenderPass render_pass) {
+				    VkRenderPass render_pass,
+				    const darray<VkCommandBuffer>& secondaries = {}) {
       VkRenderPassBeginInfo render_pass_info = {};
       
       render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -2823,7 +4336,76 @@ namespace vulkan {
 	    	    
       vkCmdBeginRenderPass(cmd_buffer,
 			   &render_pass_info,
-			   VK_SUBPASS_CONTENTS_INLINE);      
+			   secondaries.empty()
+			   ? VK_SUBPASS_CONTENTS_INLINE
+			   : VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+      if (!secondaries.empty()) {
+	vkCmdExecuteCommands(cmd_buffer,
+			     static_cast<uint32_t>(secondaries.size()),
+			     secondaries.data());
+      }
+      else {
+	commands_set_viewport(cmd_buffer);
+      }
+    }
+
+    // headless: copies offscreen image i into its region
+    // of m_readback_buffer, once the render pass is done with it
+    void commands_readback(VkCommandBuffer cmd_buffer, uint32_t i) const {
+      VkImageMemoryBarrier barrier = {};
+      barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+      barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+      barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.image = m_vk_swapchain_images.at(i);
+      barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      barrier.subresourceRange.baseMipLevel = 0;
+      barrier.subresourceRange.levelCount = 1;
+      barrier.subresourceRange.baseArrayLayer = 0;
+      barrier.subresourceRange.layerCount = 1;
+
+      vkCmdPipelineBarrier(cmd_buffer,
+			   VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			   VK_PIPELINE_STAGE_TRANSFER_BIT,
+			   0,
+			   0, nullptr,
+			   0, nullptr,
+			   1, &barrier);
+
+      VkBufferImageCopy region = {};
+      region.bufferOffset = m_readback_size * i;
+      region.bufferRowLength = 0; // tightly packed
+      region.bufferImageHeight = 0;
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.mipLevel = 0;
+      region.imageSubresource.baseArrayLayer = 0;
+      region.imageSubresource.layerCount = 1;
+      region.imageOffset = { 0, 0, 0 };
+      region.imageExtent = { m_vk_swapchain_extent.width, m_vk_swapchain_extent.height, 1 };
+
+      vkCmdCopyImageToBuffer(cmd_buffer,
+			     m_vk_swapchain_images.at(i),
+			     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			     m_readback_buffer.handle,
+			     1,
+			     &region);
+
+      VkMemoryBarrier host_barrier = {};
+      host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+      vkCmdPipelineBarrier(cmd_buffer,
+			   VK_PIPELINE_STAGE_TRANSFER_BIT,
+			   VK_PIPELINE_STAGE_HOST_BIT,
+			   0,
+			   1, &host_barrier,
+			   0, nullptr,
+			   0, nullptr);
     }
 
     bool commands_begin_buffer(VkCommandBuffer cmd_buffer) {
@@ -2862,20 +4444,38 @@ namespace vulkan {
 		     &copy_region);		     
     }
 
-    void commands_draw_inner_objects(VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout) const {
+    // everything but the room, which is always drawn. The frustum
+    // has to have been updated this frame if cull is set. Bounds
+    // only cover a model's first instance, so models with
+    // more than one are never culled here.
+    void update_visible_models(bool cull) {
+      m_visible_models.clear();
+
       for (auto const& [name, index]: m_model_data.indices) {
-	if (name != "outer-cube") {	   
-	  commands_draw_model(index,
-			      cmd_buffer,
-			      pipeline_layout);	  
+	if (name != "outer-cube" &&
+	    (!cull ||
+	     m_model_data.instances.at(index).size() > 1 ||
+	     m_frustum.intersects_sphere(m_model_data.bounds_vols.at(index)))) {
+	  m_visible_models.push_back(index);
 	}
       }
     }
 
-    void commands_draw_room(VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout) const {
+    // m_visible_models[first, last)
+    void commands_draw_inner_objects(VkCommandBuffer cmd_buffer,
+				     size_t first = 0,
+				     size_t last = SIZE_MAX) const {
+      last = std::min(last, m_visible_models.size());
+      
+      for (size_t i = first; i < last; ++i) {
+	commands_draw_model(m_visible_models[i],
+			    cmd_buffer);	  
+      }
+    }
+
+    void commands_draw_room(VkCommandBuffer cmd_buffer) const {
       commands_draw_model("outer-cube",
-			  cmd_buffer,
-			  pipeline_layout);
+			  cmd_buffer);
     }
 
     void commands_draw_quad_no_vb(VkCommandBuffer cmd_buffer) const {
@@ -2885,63 +4485,173 @@ namespace vulkan {
 		0,
 		0);
     }
-    
-    void commands_draw_model(uint32_t model,
-			     VkCommandBuffer cmd_buffer,
-			     VkPipelineLayout pipeline_layout) const {
-
-      push_constant::model pc_m{};
-      
-      pc_m.model_to_world = m_model_data.transforms.at(model)();
-      push_constant::model_upload(pc_m, cmd_buffer, pipeline_layout);
-      
-      vkCmdDraw(cmd_buffer,
-		m_model_data.vb_lengths.at(model), // num vertices
-	        m_model_data.vb_lengths.at(model) / 3, // num instances
-		m_model_data.vb_offsets.at(model), // first vertex
-		m_model_data.vb_offsets.at(model) / 3); // first instance
 
+    // one draw for all of the model's instances that
+    // write_instances() placed in the instance buffer
+    void commands_draw_model(uint32_t model,
+			     VkCommandBuffer cmd_buffer) const {
+      uint32_t num_instances = m_model_data.instance_counts.at(model);
+
+      if (num_instances > 0) {
+	vkCmdDrawIndexed(cmd_buffer,
+			 m_model_data.ib_lengths.at(model), // num indices
+			 num_instances, // num instances
+			 m_model_data.ib_offsets.at(model), // first index
+			 m_model_data.vb_offsets.at(model), // vertex offset
+			 m_model_data.first_instances.at(model)); // first instance
+      }
     }
 
     void commands_draw_model(const std::string& name,
-			     VkCommandBuffer cmd_buffer,
-			     VkPipelineLayout pipeline_layout) const {
+			     VkCommandBuffer cmd_buffer) const {
       commands_draw_model(m_model_data.indices.at(name),
-			  cmd_buffer,
-			  pipeline_layout);
+			  cmd_buffer);
     }
     
     void commands_draw_main(VkCommandBuffer cmd_buffer,
-			    VkPipelineLayout pipeline_layout) const {
+			    VkPipelineLayout pipeline_layout,
+			    size_t first = 0,
+			    size_t last = SIZE_MAX,
+			    bool with_room = true) const {
       
       push_constant::basic_pbr pc_bp{push_constant::basic_pbr_default()};
 
       pc_bp.camera_position = m_camera_position;
-      pc_bp.sampler = 0;
       push_constant::basic_pbr_upload(pc_bp, cmd_buffer, pipeline_layout);
       
-      commands_draw_inner_objects(cmd_buffer, pipeline_layout);
+      commands_draw_inner_objects(cmd_buffer, first, last);
+
+      if (with_room) {
+	commands_draw_room(cmd_buffer);
+      }
+    }     
+
+    // Zeroes region i's draw count and has the GPU fill in its
+    // draws; recorded outside of the render pass.
+    void commands_cull(VkCommandBuffer cmd_buffer, uint32_t i) const {
+      VkDeviceSize region_offset = cull_region_offset(i);
+      
+      vkCmdFillBuffer(cmd_buffer,
+		      m_cull_buffer.handle,
+		      region_offset + offsetof(storage_block::cull_frame, draw_count),
+		      sizeof(uint32_t),
+		      0);
+
+      VkMemoryBarrier barrier = {};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+      vkCmdPipelineBarrier(cmd_buffer,
+			   VK_PIPELINE_STAGE_TRANSFER_BIT,
+			   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			   0,
+			   1, &barrier,
+			   0, nullptr,
+			   0, nullptr);
+
+      vkCmdBindPipeline(cmd_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipeline(k_pass_cull));
+
+      VkDescriptorSet set = descriptor_set(k_descriptor_set_cull);
+
+      // objects, frame, draws
+      std::array<uint32_t, 3> dynamic_offsets =
+	{
+	 0,
+	 static_cast<uint32_t>(i * m_cull_region_size),
+	 static_cast<uint32_t>(i * m_cull_region_size)
+	};
+      
+      vkCmdBindDescriptorSets(cmd_buffer,
+			      VK_PIPELINE_BIND_POINT_COMPUTE,
+			      pipeline_layout(k_pass_cull),
+			      0,
+			      1,
+			      &set,
+			      dynamic_offsets.size(),
+			      dynamic_offsets.data());
+
+      uint32_t num_objects = static_cast<uint32_t>(m_model_data.length());
       
-      pc_bp.sampler = 1;
+      vkCmdDispatch(cmd_buffer,
+		    (num_objects + storage_block::k_cull_group_size - 1) / storage_block::k_cull_group_size,
+		    1,
+		    1);
+
+      // validation reads the draws back on the host
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+      vkCmdPipelineBarrier(cmd_buffer,
+			   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			   VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			   0,
+			   1, &barrier,
+			   0, nullptr,
+			   0, nullptr);
+    }
+
+    // commands_draw_main()'s counterpart for m_gpu_driven:
+    // whatever commands_cull() left in region i, room included
+    void commands_draw_main_indirect(VkCommandBuffer cmd_buffer,
+				     VkPipelineLayout pipeline_layout,
+				     uint32_t i) const {
+      push_constant::basic_pbr pc_bp{push_constant::basic_pbr_default()};
+
+      pc_bp.camera_position = m_camera_position;
       push_constant::basic_pbr_upload(pc_bp, cmd_buffer, pipeline_layout);
+
+      VkDeviceSize region_offset = cull_region_offset(i);
       
-      commands_draw_room(cmd_buffer, pipeline_layout);
-    }     
+      m_vk_cmd_draw_indexed_indirect_count(cmd_buffer,
+					   m_cull_buffer.handle,
+					   region_offset + m_cull_frame_size,
+					   m_cull_buffer.handle,
+					   region_offset + offsetof(storage_block::cull_frame, draw_count),
+					   static_cast<uint32_t>(m_model_data.length()),
+					   sizeof(storage_block::cull_draw));
+    }
+
+    void commands_draw_debug(VkCommandBuffer cmd_buffer, uint32_t command_index) {
+      commands_begin_pipeline(cmd_buffer,
+			      pipeline(k_pass_debug_draw),
+			      pipeline_layout(k_pass_debug_draw),
+			      false, // do not bind the model vertex buffer
+			      frame_descriptor_sets(),
+			      frame_dynamic_offsets(command_index));
+
+      m_debug_draw_vertices.bind_vertex(cmd_buffer);
+
+      vkCmdDrawIndirect(cmd_buffer,
+			m_debug_draw_indirect.handle,
+			sizeof(VkDrawIndirectCommand) * command_index,
+			1,
+			sizeof(VkDrawIndirectCommand));
+    }
     
     //
     // we always use the command pool here to allocate command buffer memory
     //
     bool make_command_buffers(darray<VkCommandBuffer>& command_buffers) const {
+      return make_command_buffers(command_buffers, m_vk_command_pool);
+    }
+
+    bool make_command_buffers(darray<VkCommandBuffer>& command_buffers,
+			      VkCommandPool pool,
+			      VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const {
       bool ret =
 	c_assert(!command_buffers.empty()) &&
-	c_assert(ok_command_pool());
+	c_assert(ok_command_pool()) &&
+	c_assert(pool != VK_NULL_HANDLE);
       
       if (ret) {
 	VkCommandBufferAllocateInfo alloc_info = {};
 
 	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	alloc_info.commandPool = m_vk_command_pool;
-	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandPool = pool;
+	alloc_info.level = level;
 	alloc_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
 
 	VK_FN(vkAllocateCommandBuffers(m_vk_curr_ldevice, &alloc_info, command_buffers.data()));
@@ -2986,6 +4696,272 @@ namespace vulkan {
        two_pass
       };
     
+    command_buffer_type m_command_buffer_type{command_buffer_type::two_pass};
+
+    // Records this frame's share of the first subpass into image i's
+    // secondary buffers, one contiguous range of m_visible_models per
+    // buffer, and returns the buffers in the order they must execute.
+    // Chunk c always records from pool c, so no pool is used by two
+    // threads at once, whichever worker picks up the chunk.
+    darray<VkCommandBuffer> record_secondary_command_buffers(uint32_t i) {
+      size_t num_visible = m_visible_models.size();
+      size_t per_chunk = st_config::c_renderer::m_render::k_min_draws_per_chunk;
+      
+      size_t num_chunks = std::clamp<size_t>((num_visible + per_chunk - 1) / per_chunk,
+					     1,
+					     m_num_record_chunks);
+
+      size_t base = static_cast<size_t>(i) * m_num_record_chunks;
+
+      // VK_FN isn't thread safe; results are checked once every chunk is done
+      darray<VkResult> results(num_chunks, VK_SUCCESS);
+
+      m_record_workers->run(num_chunks, [this, i, base, num_chunks, num_visible, &results](size_t c) {
+	VkCommandBuffer cmd_buffer = m_vk_secondary_command_buffers[base + c];
+	
+	VkResult result = vkResetCommandPool(m_vk_curr_ldevice,
+					     m_vk_secondary_command_pools[base + c],
+					     0);
+	
+	if (result == VK_SUCCESS) {
+	  VkCommandBufferInheritanceInfo inheritance_info = {};
+	  inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	  inheritance_info.renderPass = m_vk_render_pass;
+	  inheritance_info.subpass = 0;
+	  inheritance_info.framebuffer = m_vk_swapchain_framebuffers.at(i);
+	  
+	  VkCommandBufferBeginInfo begin_info = {};
+	  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	  begin_info.flags =
+	    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+	    VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	  begin_info.pInheritanceInfo = &inheritance_info;
+
+	  result = vkBeginCommandBuffer(cmd_buffer, &begin_info);
+	}
+
+	if (result == VK_SUCCESS) {
+	  bool last_chunk = c + 1 == num_chunks;
+
+	  // nothing is inherited from the primary
+	  // buffer besides the render pass
+	  commands_set_viewport(cmd_buffer);
+	  
+	  commands_begin_pipeline(cmd_buffer,
+				  pipeline(k_pass_texture2d),
+				  pipeline_layout(k_pass_texture2d),
+				  true, // bind vertex buffer
+				  frame_descriptor_sets(),
+				  frame_dynamic_offsets(i));
+
+	  commands_draw_main(cmd_buffer,
+			     pipeline_layout(k_pass_texture2d),
+			     (c * num_visible) / num_chunks,
+			     ((c + 1) * num_visible) / num_chunks,
+			     last_chunk);
+
+	  STATIC_IF (debug_draw::k_enabled) {
+	    if (last_chunk) {
+	      commands_draw_debug(cmd_buffer, i);
+	    }
+	  }
+	  
+	  result = vkEndCommandBuffer(cmd_buffer);
+	}
+
+	results[c] = result;
+      });
+
+      for (VkResult result: results) {
+	VK_FN(result);
+      }
+
+      darray<VkCommandBuffer> ret{};
+      
+      if (ok()) {
+	ret.assign(m_vk_secondary_command_buffers.begin() + base,
+		   m_vk_secondary_command_buffers.begin() + base + num_chunks);
+      }
+
+      return ret;
+    }
+
+    // draws m_visible_models into swapchain image i's framebuffer
+    bool record_command_buffer(uint32_t i) {
+      VkCommandBuffer cmd_buff = m_vk_command_buffers.at(i);
+
+      darray<VkCommandBuffer> secondaries{};
+      
+      bool good = true;
+
+      STATIC_IF (st_config::c_renderer::m_render::k_record_secondary_parallel) {
+	secondaries = record_secondary_command_buffers(i);
+	good = c_assert(!secondaries.empty());
+      }
+      
+      good = good && c_assert(commands_begin_buffer(cmd_buff));
+	      
+      if (good) {
+	m_gpu_profiler.commands_reset(cmd_buff, i);
+	
+	if (m_gpu_driven) {
+	  uint32_t cull_begin = m_gpu_profiler.commands_timestamp(cmd_buff, i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	  
+	  commands_cull(cmd_buff, i);
+
+	  uint32_t cull_end = m_gpu_profiler.commands_timestamp(cmd_buff, i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	  
+	  m_gpu_profiler.scope(i, "cull", cull_begin, cull_end);
+	}
+
+	// the first subpass can hold secondaries, which rules out
+	// timestamps inside it; it's timed from outside the render pass
+	uint32_t pass_begin = m_gpu_profiler.commands_timestamp(cmd_buff, i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	uint32_t subpass_1_begin = gpu_profiler::k_no_query;
+	
+	//
+	// we obviously have two render passes,
+	// and the code corresponding to each pass
+	// is labeled in inner scope blocks as follows
+	//
+	commands_start_render_pass(cmd_buff,
+				   m_vk_swapchain_framebuffers.at(i),
+				   m_vk_render_pass,
+				   secondaries);
+	//
+	// subpass 1: fill depth and color attachments
+	//
+	if (secondaries.empty()) {
+	  commands_begin_pipeline(cmd_buff,
+				  pipeline(k_pass_texture2d),
+				  pipeline_layout(k_pass_texture2d),
+				  true, // bind vertex buffer
+				  frame_descriptor_sets(),
+				  frame_dynamic_offsets(i));
+
+	  if (m_gpu_driven) {
+	    commands_draw_main_indirect(cmd_buff,
+					pipeline_layout(k_pass_texture2d),
+					i);
+	  }
+	  else {
+	    commands_draw_main(cmd_buff,
+			       pipeline_layout(k_pass_texture2d));
+	  }
+
+	  STATIC_IF (debug_draw::k_enabled) {
+	    commands_draw_debug(cmd_buff, i);
+	  }
+	}
+
+	if (m_command_buffer_type == command_buffer_type::two_pass) {
+	  //
+	  // subpass 2: read depth and color attachments
+	  //
+		  
+	  vkCmdNextSubpass(cmd_buff, VK_SUBPASS_CONTENTS_INLINE);
+
+	  subpass_1_begin = m_gpu_profiler.commands_timestamp(cmd_buff, i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+	  // executing secondaries leaves it undefined
+	  commands_set_viewport(cmd_buff);
+
+	  commands_begin_pipeline(cmd_buff,
+				  pipeline(k_pass_test_fbo),
+				  pipeline_layout(k_pass_test_fbo),
+				  false, // do not bind vertex buffer
+				  m_descriptor_set_pool.descriptor_sets(m_descriptors.attachment_read));		
+		
+	  commands_draw_quad_no_vb(cmd_buff);
+	}
+		
+	vkCmdEndRenderPass(cmd_buff);
+
+	uint32_t pass_end = m_gpu_profiler.commands_timestamp(cmd_buff, i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+	if (m_readback_buffer.handle != VK_NULL_HANDLE) {
+	  commands_readback(cmd_buff, i);
+	}
+
+	m_gpu_profiler.scope(i, "render pass", pass_begin, pass_end);
+
+	if (subpass_1_begin != gpu_profiler::k_no_query) {
+	  m_gpu_profiler.scope(i, "subpass 0", pass_begin, subpass_1_begin);
+	  m_gpu_profiler.scope(i, "subpass 1", subpass_1_begin, pass_end);
+	}
+		
+	good = c_assert(commands_end_buffer(cmd_buff));		
+      }
+
+      return good;
+    }
+
+    // resets image i's pool and records its command buffer
+    // from this frame's visible set. The caller has to
+    // know that the buffer's last submission is done.
+    bool record_frame_command_buffer(uint32_t i) {
+      auto start = std::chrono::steady_clock::now();
+      
+      update_visible_models(st_config::c_renderer::m_render::k_use_frustum_culling);
+
+      write_instances(i);
+
+      VK_FN(vkResetCommandPool(m_vk_curr_ldevice,
+			       m_vk_frame_command_pools.at(i),
+			       0));
+
+      bool good = ok() && record_command_buffer(i);
+
+      STATIC_IF (st_config::c_renderer::m_render::k_log_record_time) {
+	std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+
+	m_record_time.total_us += d.count();
+	m_record_time.max_us = std::max(m_record_time.max_us, d.count());
+	m_record_time.count++;
+
+	if (m_record_time.count == st_config::c_renderer::m_render::k_record_log_period) {
+	  write_logf("per frame command buffers: %f us average, %f us worst over %" PRIu32 " frames; %" PRIu32 " objects visible",
+		     m_record_time.total_us / static_cast<double>(m_record_time.count),
+		     m_record_time.max_us,
+		     m_record_time.count,
+		     static_cast<uint32_t>(m_visible_models.size()));
+	  
+	  m_record_time = record_time{};
+	}
+      }
+
+      return good;
+    }
+    
+    // records every swapchain image's command buffer once, drawing
+    // everything; at setup, and again after recreate_swapchain()
+    bool record_static_command_buffers() {
+      update_visible_models(false);
+
+      auto start = std::chrono::steady_clock::now();
+	    
+      bool good = true;
+      
+      uint32_t i{0};	      
+      while (i < m_vk_command_buffers.size() &&
+	     c_assert(good)) {
+	write_instances(i);
+	good = c_assert(record_command_buffer(i));
+	i++;
+      }
+
+      STATIC_IF (st_config::c_renderer::m_render::k_log_record_time) {
+	std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+	      
+	write_logf("static command buffers: %" PRIu32 " recorded in %f us (%f us each)",
+		   i,
+		   d.count(),
+		   d.count() / static_cast<double>(std::max(i, 1u)));
+      }
+
+      return good;
+    }
+    
     void setup_command_buffers(command_buffer_type cmd_type = command_buffer_type::two_pass) {
       m_image_pool.print_images_info();
       if (ok_framebuffers()) {
@@ -3002,93 +4978,77 @@ namespace vulkan {
 							   std::move(tex_indices)))) {
 	  //
 	  // perform the image layout transition for
-	  // test_image_indices[i]
+	  // test_image_indices[i]. They're submitted along with
+	  // the vertex and index buffer copies, ahead of
+	  // any frame; nothing waits for them.
 	  //
-	  run_cmds([this](VkCommandBuffer cmd_buf) {
-		     puts("image_layout_transition");		     
-		     m_ok_scene =
-		       m_image_pool.make_layout_transitions(cmd_buf,
-							    m_test_image_indices);
-		   },
-	    [this](one_shot_command_error err) {
-	      puts("run_cmds ERROR");
-	      ASSERT(false);
-	      m_ok_scene = false;
-	    });
+	  m_upload_manager.record_graphics([this](VkCommandBuffer cmd_buf) {
+					     puts("image_layout_transition");
+					     m_ok_scene =
+					       m_image_pool.make_layout_transitions(cmd_buf,
+										    m_test_image_indices);
+					   });
+
+	  c_assert(m_upload_manager.flush() != upload_manager::k_no_ticket);
 
 	  //
 	  // update the descriptor sets here to include the input attachment
 	  // for the shader
 	  //
 	  
+	  m_command_buffer_type = cmd_type;
+	  
 	  m_vk_command_buffers.resize(m_vk_swapchain_image_views.size());
 
-	  bool good = c_assert(make_command_buffers(m_vk_command_buffers));
-	    
-	  if (good) {
-	    
-	    //
-	    // begin the command buffer series;
-	    // we obviously have two render passes,
-	    // and the code corresponding to each pass
-	    // is labeled in inner scope blocks as follows
-	    //
-	    size_t i{0};	      
-	    while (i < m_vk_command_buffers.size() &&
-		   c_assert(good)) {			        
-
-	      VkCommandBuffer cmd_buff = m_vk_command_buffers.at(i);
-
-	      good = c_assert(commands_begin_buffer(cmd_buff));
+	  STATIC_IF (st_config::c_gpu_profiler::k_enabled) {
+	    // without timestamp support nothing's timed; that's all
+	    queue_family_indices indices = query_queue_families(m_vk_curr_pdevice, m_vk_khr_surface);
+
+	    m_gpu_profiler.init(m_vk_curr_pdevice,
+				m_vk_curr_ldevice,
+				indices.graphics_family.value(),
+				static_cast<uint32_t>(m_vk_command_buffers.size()),
+				st_config::c_gpu_profiler::k_max_queries);
+	  }
+
+	  bool good = true;
+
+	  STATIC_IF (st_config::c_renderer::m_render::k_record_command_buffers_per_frame) {
+	    // recorded in render(), once the frame's
+	    // visible set and pool are ready
+	    for (size_t i{0}; i < m_vk_command_buffers.size() && good; ++i) {
+	      darray<VkCommandBuffer> buffer(1, VK_NULL_HANDLE);
 	      
-	      if (good) {
-		commands_start_render_pass(cmd_buff,
-					   m_vk_swapchain_framebuffers.at(i),
-					   m_vk_render_pass);
-		//
-		// subpass 1: fill depth and color attachments
-		//
-
-		commands_begin_pipeline(cmd_buff,
-					pipeline(k_pass_texture2d),
-					pipeline_layout(k_pass_texture2d),
-					true, // bind vertex buffer
-					{
-					 descriptor_set(k_descriptor_set_samplers),
-					 descriptor_set(k_descriptor_set_uniform_blocks)
-					});
-
-		commands_draw_main(cmd_buff,
-				   pipeline_layout(k_pass_texture2d));
-		
+	      good = c_assert(make_command_buffers(buffer, m_vk_frame_command_pools.at(i)));
 
-		if (cmd_type == command_buffer_type::two_pass) {
-		  //
-		  // subpass 2: read depth and color attachments
-		  //
-		  
-		  vkCmdNextSubpass(cmd_buff, VK_SUBPASS_CONTENTS_INLINE);
-		
+	      m_vk_command_buffers[i] = buffer[0];
+	    }
 
-		  commands_begin_pipeline(cmd_buff,
-					  pipeline(k_pass_test_fbo),
-					  pipeline_layout(k_pass_test_fbo),
-					  false, // do not bind vertex buffer
-					  m_descriptor_set_pool.descriptor_sets(m_descriptors.attachment_read));		
-		
-		  commands_draw_quad_no_vb(cmd_buff);
-		}
-		
-		vkCmdEndRenderPass(cmd_buff);
-		
-		good = c_assert(commands_end_buffer(cmd_buff));		
-	      }
-	      	      
-	      i++;
+	    m_vk_secondary_command_buffers.resize(m_vk_secondary_command_pools.size(), VK_NULL_HANDLE);
+
+	    for (size_t i{0}; i < m_vk_secondary_command_buffers.size() && good; ++i) {
+	      darray<VkCommandBuffer> buffer(1, VK_NULL_HANDLE);
+	      
+	      good = c_assert(make_command_buffers(buffer,
+						   m_vk_secondary_command_pools.at(i),
+						   VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+
+	      m_vk_secondary_command_buffers[i] = buffer[0];
+	    }
+	  }
+	  else {
+	    good =
+	      c_assert(make_command_buffers(m_vk_command_buffers)) &&
+	      record_static_command_buffers();
+
+	    // the culling is left to the GPU, so it sees every
+	    // model, laid out the same way in each region
+	    if (good && m_gpu_driven) {
+	      write_cull_objects();
 	    }
+	  }
 
-	    m_ok_command_buffers = good;	      
-	  }	    	  
+	  m_ok_command_buffers = good;	      
 	}
       }
     }
@@ -3100,28 +5060,17 @@ namespace vulkan {
 	semaphore_info.pNext = nullptr;
 	semaphore_info.flags = 0;
 	
-	VkFenceCreateInfo fence_info = {};
-	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fence_info.pNext = nullptr;
-	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 	m_vk_sems_image_available.resize(max_frames_in_flight());
 	m_vk_sems_render_finished.resize(max_frames_in_flight());
-	m_vk_fences_in_flight.resize(max_frames_in_flight());
 
-	STATIC_IF (st_config::c_renderer::m_render::k_allow_more_frames_than_fences) {
-	  m_vk_images_in_flight.resize(m_vk_swapchain_images.size(), VK_NULL_HANDLE);
-	}
+	// 0 is reached before anything's submitted
+	m_frame_values.resize(max_frames_in_flight(), 0);
+	m_image_values.resize(m_vk_swapchain_images.size(), 0);
 
 	m_frame_stimes.resize(max_frames_in_flight(), 0.0);
 	m_frame_dtimes.resize(max_frames_in_flight(), 0.0);
 	
 	for (uint32_t i = 0; i < max_frames_in_flight(); ++i) {
-	  VK_FN(vkCreateFence(m_vk_curr_ldevice,
-			      &fence_info,
-			      nullptr,
-			      &m_vk_fences_in_flight[i]));
-	  
 	  VK_FN(vkCreateSemaphore(m_vk_curr_ldevice,
 				  &semaphore_info,
 				  nullptr,
@@ -3133,15 +5082,130 @@ namespace vulkan {
 				  &m_vk_sems_render_finished[i]));
 	}
 	
-	if (ok()) {
+	if (ok() && c_assert(m_timeline.ok())) {
 	  m_ok_sync_objects = true;
 	}
       }
     }
 
+    // Swaps the swapchain for one that matches the surface's current
+    // extent and remakes only what's sized to it: the image views, the
+    // attachments, the attachment read descriptors that point at them
+    // and the framebuffers. Pipelines set their viewport and scissor
+    // dynamically, so they're kept; static command buffers are
+    // re-recorded. Everything per image is kept too, so the old image
+    // count is requested again; if the driver still hands back a
+    // different count, the renderer is marked as needing a full
+    // setup (see restart_required()) and draws nothing until then.
+    //
+    // Returns false while the surface has no area (e.g. the window
+    // is minimized), in which case nothing is changed.
+    bool recreate_swapchain() {
+      bool good = ok_scene();
+
+      if (good) {
+	swapchain_support_details details = query_swapchain_support(m_vk_curr_pdevice);
+
+	good =
+	  details.capabilities.currentExtent.width != 0 &&
+	  details.capabilities.currentExtent.height != 0;
+      }
+
+      if (good) {
+	auto start = std::chrono::steady_clock::now();
+	
+	// everything that used the old images is done
+	device_wait();
+
+	free_vk_ldevice_handles<VkFramebuffer, &vkDestroyFramebuffer>(m_vk_swapchain_framebuffers);
+	free_vk_ldevice_handles<VkImageView, &vkDestroyImageView>(m_vk_swapchain_image_views);
+
+	size_t image_count = m_vk_swapchain_images.size();
+	
+	VkSwapchainKHR old_swapchain = m_vk_khr_swapchain;
+	m_vk_khr_swapchain = VK_NULL_HANDLE;
+	
+	setup_swapchain(old_swapchain);
+
+	vkDestroySwapchainKHR(m_vk_curr_ldevice, old_swapchain, nullptr);
+
+	good = ok_swapchain();
+
+	if (good && m_vk_swapchain_images.size() != image_count) {
+	  write_logf("swapchain image count changed from %zu to %zu; "
+		     "the renderer needs a full setup",
+		     image_count,
+		     m_vk_swapchain_images.size());
+	  
+	  m_restart_required = true;
+	  good = false;
+	}
+
+	if (good) {
+	  setup_swapchain_image_views();
+
+	  good = c_assert(make_swapchain_attachments());
+	}
+
+	if (good) {
+	  if (!m_descriptors.attachment_read.empty()) {
+	    write_attachment_read_descriptors();
+	  }
+
+	  m_vk_swapchain_framebuffers =
+	    make_framebuffer_list(m_vk_render_pass,
+				  m_vk_swapchain_image_views,
+				  m_framebuffer_attach_flags);
+
+	  good = !m_vk_swapchain_framebuffers.empty();
+	}
+
+	STATIC_IF (!st_config::c_renderer::m_render::k_record_command_buffers_per_frame) {
+	  if (good) {
+	    // the device is idle, so every buffer in
+	    // the pool can go back to the initial state
+	    VK_FN(vkResetCommandPool(m_vk_curr_ldevice, m_vk_command_pool, 0));
+
+	    good = ok() && record_static_command_buffers();
+	  }
+	}
+
+	m_ok_scene = good;
+	m_swapchain_stale = false;
+
+	std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+
+	write_logf("swapchain recreated at %" PRIu32 "x%" PRIu32 " in %f ms",
+		   m_vk_swapchain_extent.width,
+		   m_vk_swapchain_extent.height,
+		   d.count());
+      }
+
+      return good;
+    }
+
+    // out of date and suboptimal swapchains are recreated
+    // by the next render() rather than treated as errors
+    void check_swapchain_result(VkResult result) {
+      if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+	m_swapchain_stale = true;
+      }
+      else if (api_ok()) {
+	g_vk_result = result;
+      }
+    }
+
     void setup_scene() {
       if (ok_sync_objects()) {	
 	m_ok_scene = true;
+
+	// every pipeline exists by now; free_mem() saves again
+	// in case anything is added later
+	m_pipeline_cache.save();
+
+	STATIC_IF (st_config::c_device_memory_pool::k_log_stats) {
+	  m_memory_pool.print_stats();
+	}
       }
     }
 
@@ -3183,6 +5247,31 @@ namespace vulkan {
       setup_scene();
     }
 
+    // Adds another copy of a model, drawn by the same draw call as the
+    // rest of its instances. Static command buffers only see instances
+    // that exist at setup; per frame recording picks them up on the
+    // next frame.
+    bool add_model_instance(const std::string& name,
+			    const transform& model_to_world,
+			    uint32_t material = k_sampler_checkerboard) {
+      auto it = m_model_data.indices.find(name);
+
+      bool ret = c_assert(it != m_model_data.indices.end());
+
+      if (ret) {
+	m_model_data.instances.at(it->second).push_back({ model_to_world, material });
+      }
+
+      return ret;
+    }
+
+    // world space bounding spheres of every model
+    void debug_draw_bounds() const {
+      for (const module_geom::bvol& b: m_model_data.bounds_vols) {
+	debug_draw::bounds(b);
+      }
+    }
+
     void set_world_to_view_transform(const mat4_t& w2v) {
       m_transform_uniform_block.data.world_to_view = w2v;
       m_camera_position = -vec3_t{w2v[3]};
@@ -3193,61 +5282,97 @@ namespace vulkan {
     }
 
     void render() {
+      if (m_restart_required) {
+	return;
+      }
+      
+      // nothing can be drawn until the surface has an area again
+      if (m_swapchain_stale && !recreate_swapchain()) {
+	return;
+      }
+      
       if (ok_scene()) {
-	m_uniform_block_pool.update_block(m_transform_uniform_block.index,
-					  m_vk_curr_ldevice);
-	
 	constexpr uint64_t k_timeout_ns = 16 * 1000000 + 6000000 * 100; // 100 * 16.6 milliseconds
-	
-	VK_FN(vkWaitForFences(m_vk_curr_ldevice,
-			      1,
-			      &m_vk_fences_in_flight[m_current_frame],
-			      VK_TRUE,
-			      k_timeout_ns));
+
+	// the last submission to use this frame's semaphores
+	m_timeline.wait(m_frame_values.at(m_current_frame), k_timeout_ns);
 	{
-	  double time = glfwGetTime();
-	  m_frame_dtimes[m_current_frame] = time - m_frame_stimes.at(m_current_frame);
-	  m_frame_stimes[m_current_frame] = time; // stimes = start times
+	  std::chrono::duration<double> time = std::chrono::steady_clock::now() - m_start_time;
+	  m_frame_dtimes[m_current_frame] = time.count() - m_frame_stimes.at(m_current_frame);
+	  m_frame_stimes[m_current_frame] = time.count(); // stimes = start times
 
-	  STATIC_IF (st_config::c_renderer::m_render::k_use_frustum_culling) {
+	  if (st_config::c_renderer::m_render::k_use_frustum_culling || m_gpu_driven) {
 	    m_frustum.update();
 	  }
 	}
 	
 	uint32_t image_index = UINT32_MAX;
-	
-	VK_FN(vkAcquireNextImageKHR(m_vk_curr_ldevice,
-				    m_vk_khr_swapchain,
-				    k_timeout_ns,
-				    m_vk_sems_image_available.at(m_current_frame),
-				    VK_NULL_HANDLE,
-				    &image_index));
-	
-	STATIC_IF (st_config::c_renderer::m_render::k_allow_more_frames_than_fences) {
-	  if (m_vk_images_in_flight.at(image_index) != VK_NULL_HANDLE) {
-	    VK_FN(vkWaitForFences(m_vk_curr_ldevice,
-				  1,
-				  &m_vk_images_in_flight[image_index],
-				  VK_TRUE,
-				  k_timeout_ns));
-	  }
-	  
-	  m_vk_images_in_flight[image_index] = m_vk_fences_in_flight.at(m_current_frame);
+
+	if (headless()) {
+	  // the images are drawn to in turn; waiting for
+	  // an image's last frame below is all the pacing
+	  image_index = static_cast<uint32_t>(m_frames_submitted % m_vk_swapchain_images.size());
 	}
 	else {
-	  // m_vk_images_in_flight makes sense if and only if we're submitting more frames than
-	  // we have fences. Otherwise, the image index should directly
-	  // map to the current frame.
-	  ASSERT(image_index == m_current_frame);
+	  VkResult acquire_result = vkAcquireNextImageKHR(m_vk_curr_ldevice,
+							  m_vk_khr_swapchain,
+							  k_timeout_ns,
+							  m_vk_sems_image_available.at(m_current_frame),
+							  VK_NULL_HANDLE,
+							  &image_index);
+
+	  check_swapchain_result(acquire_result);
+
+	  // nothing was acquired, so the semaphore won't be signaled and
+	  // the frame is dropped. A suboptimal image can still be drawn
+	  // to and presented before the swapchain is recreated.
+	  if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+	    return;
+	  }
 	}
 	
 	if (ok()) {	  
 	  ASSERT(m_vk_command_buffers.size() == m_vk_swapchain_images.size());
 	  ASSERT(image_index < m_vk_command_buffers.size());
 
-	  VK_FN(vkResetFences(m_vk_curr_ldevice,
-			      1,
-			      &m_vk_fences_in_flight[m_current_frame]));			
+	  // the last submission that drew to this image. When there are
+	  // as many frames in flight as images, it's the one the wait
+	  // above was for, and this doesn't call into the driver.
+	  m_timeline.wait(m_image_values.at(image_index), k_timeout_ns);
+
+	  // its timestamps are in, so this doesn't wait either; it has
+	  // to come before the buffer is recorded again below
+	  m_gpu_profiler.collect(image_index);
+	  
+	  // which was also the last submission of this
+	  // command buffer, so it's done with its region
+	  m_uniform_block_pool.update_block(m_transform_uniform_block.index,
+					    image_index);
+
+	  if (m_gpu_driven) {
+	    STATIC_IF (st_config::c_renderer::m_render::k_validate_gpu_culling) {
+	      check_gpu_culling(image_index);
+	    }
+	    
+	    write_cull_frame(image_index);
+	  }
+
+	  STATIC_IF (st_config::c_renderer::m_render::k_record_command_buffers_per_frame) {
+	    record_frame_command_buffer(image_index);
+	  }
+
+	  STATIC_IF (debug_draw::k_enabled) {
+	    VkDrawIndirectCommand& draw = m_debug_draw_commands[image_index];
+	    draw.vertexCount = debug_draw::frame_vertex_count();
+	    draw.firstVertex = m_current_frame * debug_draw::k_max_vertices;
+	  }
+
+	  // uploads queued since the last frame go ahead of it on the
+	  // graphics queue; finished ones give their ring space back
+	  m_upload_manager.flush();
+	  m_upload_manager.poll();
+
+	  uint64_t frame_value = m_timeline.next_signal();
 	  
 	  VkSubmitInfo submit_info = {};
 	  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -3256,38 +5381,84 @@ namespace vulkan {
 	  
 	  VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };	  	  
 	  
-	  submit_info.waitSemaphoreCount = 1;
+	  // headless, nothing's acquired or presented: there are no
+	  // binary semaphores, and only the timeline is signaled
+	  submit_info.waitSemaphoreCount = headless() ? 0 : 1;
 	  submit_info.pWaitSemaphores = wait_semaphores;
 	  submit_info.pWaitDstStageMask = wait_stages;
 
 	  submit_info.commandBufferCount = 1;
 	  submit_info.pCommandBuffers = &m_vk_command_buffers[image_index];
 
-	  VkSemaphore signal_semaphores[] = { m_vk_sems_render_finished.at(m_current_frame) };
-	  submit_info.signalSemaphoreCount = 1;
-	  submit_info.pSignalSemaphores = signal_semaphores;
+	  // presentation only takes binary semaphores, so the
+	  // timeline is signaled alongside render_finished
+	  VkSemaphore signal_semaphores[] = { m_vk_sems_render_finished.at(m_current_frame),
+					      m_timeline.semaphore() };
+	  submit_info.signalSemaphoreCount = headless() ? 1 : 2;
+	  submit_info.pSignalSemaphores = headless() ? &signal_semaphores[1] : signal_semaphores;
 
+	  // the binary semaphores' values are ignored
+	  uint64_t wait_values[] = { 0 };
+	  uint64_t signal_values[] = { 0, frame_value };
+	  
+	  VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	  timeline_info.pNext = nullptr;
+	  timeline_info.waitSemaphoreValueCount = submit_info.waitSemaphoreCount;
+	  timeline_info.pWaitSemaphoreValues = wait_values;
+	  timeline_info.signalSemaphoreValueCount = submit_info.signalSemaphoreCount;
+	  timeline_info.pSignalSemaphoreValues = headless() ? &signal_values[1] : signal_values;
+
+	  submit_info.pNext = &timeline_info;
+	  
 	  VK_FN(vkQueueSubmit(m_vk_graphics_queue,
 			      1,
 			      &submit_info,
-			      m_vk_fences_in_flight.at(m_current_frame)));
+			      VK_NULL_HANDLE));
+
+	  m_frame_values[m_current_frame] = frame_value;
+	  m_image_values[image_index] = frame_value;
+	  m_frames_submitted++;
+
+	  m_gpu_profiler.submitted(image_index);
 
-	  VkPresentInfoKHR present_info = {};
-	  present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	  present_info.waitSemaphoreCount = 1;
-	  present_info.pWaitSemaphores = signal_semaphores;
+	  STATIC_IF (st_config::c_gpu_profiler::k_log_period > 0) {
+	    constexpr uint64_t k_period = std::max(st_config::c_gpu_profiler::k_log_period, 1u);
+	    
+	    if (m_frames_submitted % k_period == 0 &&
+		m_gpu_profiler.ok()) {
+	      m_gpu_profiler.print_stats();
+	      m_gpu_profiler.reset_stats();
+	    }
+	  }
+
+	  if (!headless()) {
+	    VkPresentInfoKHR present_info = {};
+	    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	    present_info.waitSemaphoreCount = 1;
+	    present_info.pWaitSemaphores = signal_semaphores;
 
-	  VkSwapchainKHR swap_chains[] = { m_vk_khr_swapchain };
+	    VkSwapchainKHR swap_chains[] = { m_vk_khr_swapchain };
 
-	  present_info.swapchainCount = 1;
-	  present_info.pSwapchains = swap_chains;
-	  present_info.pImageIndices =  &image_index;
+	    present_info.swapchainCount = 1;
+	    present_info.pSwapchains = swap_chains;
+	    present_info.pImageIndices =  &image_index;
 
-	  present_info.pResults = nullptr;
+	    present_info.pResults = nullptr;
 
-	  VK_FN(vkQueuePresentKHR(m_vk_present_queue, &present_info));
+	    check_swapchain_result(vkQueuePresentKHR(m_vk_present_queue, &present_info));
+	  }
 
 	  m_current_frame = (m_current_frame + 1) % max_frames_in_flight();
+
+	  STATIC_IF (debug_draw::k_enabled) {
+	    // lines for the next frame are written as soon as this
+	    // returns, so the submit that last read its section
+	    // has to be done
+	    m_timeline.wait(m_frame_values.at(m_current_frame), k_timeout_ns);
+	    
+	    debug_draw::begin_frame(m_current_frame);
+	  }
 	}
       }
     }
@@ -3350,17 +5521,39 @@ namespace vulkan {
     void free_mem() {
       device_wait();
 
-      m_vertex_buffer.free_mem(m_vk_curr_ldevice);
+      m_upload_manager.free_mem();
+      m_upload_ring.free_mem(m_vk_curr_ldevice, m_memory_pool);
+
+      m_gpu_profiler.free_mem();
+
+      m_readback_buffer.free_mem(m_vk_curr_ldevice, m_memory_pool);
+      
+      m_vertex_buffer.free_mem(m_vk_curr_ldevice, m_memory_pool);
+      m_index_buffer.free_mem(m_vk_curr_ldevice, m_memory_pool);
+
+      debug_draw::set_ring(nullptr, 0);
+      m_debug_draw_commands = nullptr;
+      m_debug_draw_vertices.free_mem(m_vk_curr_ldevice, m_memory_pool);
+      m_debug_draw_indirect.free_mem(m_vk_curr_ldevice, m_memory_pool);
+
+      m_instance_buffer.free_mem(m_vk_curr_ldevice, m_memory_pool);
+      m_cull_buffer.free_mem(m_vk_curr_ldevice, m_memory_pool);
       
       free_vk_ldevice_handles<VkSemaphore, &vkDestroySemaphore>(m_vk_sems_image_available);
       free_vk_ldevice_handles<VkSemaphore, &vkDestroySemaphore>(m_vk_sems_render_finished);
-      free_vk_ldevice_handles<VkFence, &vkDestroyFence>(m_vk_fences_in_flight);
+      m_timeline.free_mem();
       
       free_vk_ldevice_handle<VkCommandPool, &vkDestroyCommandPool>(m_vk_command_pool);
+      free_vk_ldevice_handles<VkCommandPool, &vkDestroyCommandPool>(m_vk_frame_command_pools);
+      free_vk_ldevice_handles<VkCommandPool, &vkDestroyCommandPool>(m_vk_secondary_command_pools);
+      m_vk_secondary_command_buffers.clear();
+      m_record_workers.reset();
       
       free_vk_ldevice_handles<VkFramebuffer, &vkDestroyFramebuffer>(m_vk_swapchain_framebuffers);
       
       m_pipeline_pool.free_mem(m_vk_curr_ldevice);
+
+      m_pipeline_cache.free_mem();
       
       m_pipeline_layout_pool.free_mem(m_vk_curr_ldevice);
 
@@ -3373,6 +5566,10 @@ namespace vulkan {
 
       m_uniform_block_pool.free_mem(m_vk_curr_ldevice);
 
+      // everything allocated from the pool
+      // has to be released before this
+      m_memory_pool.free_mem();
+
       // UBO descriptor set will eventually be moved over
       // to this pool. In fact, the actual VkDescriptorPool
       // should be moved to this class as well.
@@ -154,6 +154,12 @@ struct vertex {
   vec2_t uv;
 };
 
+// color is RGBA8, red in the lowest byte
+struct debug_vertex {
+  vec3_t position;
+  uint32_t color;
+};
+
 struct type_module;
 struct framebuffer_ops;
 struct module_programs;
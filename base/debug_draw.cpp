@@ -0,0 +1,305 @@
+#include "debug_draw.hpp"
+
+#if BASE_ENABLE_DEBUG_DRAW == 1
+
+#include "gapi.hpp"
+#include "programs.hpp"
+
+#include <array>
+
+namespace debug_draw {
+  static struct {
+    debug_vertex* ring{nullptr};
+    debug_vertex* frame{nullptr};
+    uint32_t num_frames{0};
+    uint32_t capacity{0}; // vertices; 0 while detached
+    uint32_t count{0};
+    uint32_t dropped_lines{0};
+  } g_ring{};
+
+  // corner i has x, y and z set from bits 0, 1 and 2
+  static constexpr std::array<uint8_t, 24> k_cube_edges = {
+    0, 1,  2, 3,  4, 5,  6, 7,
+    0, 2,  1, 3,  4, 6,  5, 7,
+    0, 4,  1, 5,  2, 6,  3, 7
+  };
+
+  using circle_table = std::array<vec2_t, k_circle_segments + 1>;
+
+  static const circle_table& unit_circle() {
+    static const circle_table table = []() -> circle_table {
+      circle_table t{};
+
+      for (uint32_t i = 0; i <= k_circle_segments; ++i) {
+        real_t theta = R(2) * glm::pi<real_t>() * R(i) / R(k_circle_segments);
+        t[i] = R2v(glm::cos(theta), glm::sin(theta));
+      }
+
+      return t;
+    }();
+
+    return table;
+  }
+
+  static void cube_lines(const std::array<vec3_t, 8>& corners, uint32_t color) {
+    for (size_t i = 0; i < k_cube_edges.size(); i += 2) {
+      line(corners[k_cube_edges[i]], corners[k_cube_edges[i + 1]], color);
+    }
+  }
+
+  // transforms the [-1, 1] cube; w is divided out so
+  // this works for inverse projections too
+  static void cube_lines(const mat4_t& transform, uint32_t color) {
+    std::array<vec3_t, 8> corners{};
+
+    for (uint32_t i = 0; i < 8; ++i) {
+      vec4_t c = transform * R4v((i & 1) ? 1 : -1,
+                                 (i & 2) ? 1 : -1,
+                                 (i & 4) ? 1 : -1,
+                                 1);
+      corners[i] = vec3_t{c} / c.w;
+    }
+
+    cube_lines(corners, color);
+  }
+
+  static void circle_lines(const vec3_t& center,
+                           const vec3_t& u,
+                           const vec3_t& v,
+                           uint32_t color) {
+    const circle_table& t = unit_circle();
+
+    for (uint32_t i = 0; i < k_circle_segments; ++i) {
+      line(center + u * t[i].x + v * t[i].y,
+           center + u * t[i + 1].x + v * t[i + 1].y,
+           color);
+    }
+  }
+
+  void set_ring(debug_vertex* ring, uint32_t num_frames) {
+    g_ring.ring = ring;
+    g_ring.num_frames = ring != nullptr ? num_frames : 0;
+    g_ring.frame = nullptr;
+    g_ring.capacity = 0;
+    g_ring.count = 0;
+    g_ring.dropped_lines = 0;
+  }
+
+  void begin_frame(uint32_t frame) {
+    if (g_ring.ring != nullptr && c_assert(frame < g_ring.num_frames)) {
+      g_ring.frame = g_ring.ring + static_cast<size_t>(frame) * k_max_vertices;
+      g_ring.capacity = k_max_vertices;
+      g_ring.count = 0;
+      g_ring.dropped_lines = 0;
+    }
+  }
+
+  uint32_t frame_vertex_count() {
+    return g_ring.count;
+  }
+
+  const debug_vertex* frame_vertices() {
+    return g_ring.frame;
+  }
+
+  stats frame_stats() {
+    return { g_ring.count / 2, g_ring.dropped_lines };
+  }
+
+  void line(const vec3_t& a, const vec3_t& b, uint32_t color) {
+    if (g_ring.count + 2 <= g_ring.capacity) {
+      debug_vertex* v = g_ring.frame + g_ring.count;
+      v[0] = { a, color };
+      v[1] = { b, color };
+      g_ring.count += 2;
+    }
+    else {
+      g_ring.dropped_lines++;
+    }
+  }
+
+  void ray(const module_geom::ray& r, real_t length, uint32_t color) {
+    line(r.orig, r.orig + r.dir * length, color);
+  }
+
+  void box(const vec3_t& min, const vec3_t& max, uint32_t color) {
+    std::array<vec3_t, 8> corners{};
+
+    for (uint32_t i = 0; i < 8; ++i) {
+      corners[i] = R3v((i & 1) ? max.x : min.x,
+                       (i & 2) ? max.y : min.y,
+                       (i & 4) ? max.z : min.z);
+    }
+
+    cube_lines(corners, color);
+  }
+
+  void box(const mat4_t& transform, uint32_t color) {
+    cube_lines(transform, color);
+  }
+
+  void sphere(const vec3_t& center, real_t radius, uint32_t color) {
+    vec3_t x{radius, 0, 0};
+    vec3_t y{0, radius, 0};
+    vec3_t z{0, 0, radius};
+
+    circle_lines(center, x, y, color);
+    circle_lines(center, y, z, color);
+    circle_lines(center, z, x, color);
+  }
+
+  void circle(const vec3_t& center, const vec3_t& normal, real_t radius, uint32_t color) {
+    vec3_t n = glm::normalize(normal);
+
+    // any vector that isn't parallel to n will do
+    vec3_t ref = glm::abs(n.y) < R(0.99) ? R3v(0, 1, 0) : R3v(1, 0, 0);
+
+    vec3_t u = glm::normalize(glm::cross(ref, n));
+    vec3_t v = glm::cross(n, u);
+
+    circle_lines(center, u * radius, v * radius, color);
+  }
+
+  void frustum(const mat4_t& world_to_clip, uint32_t color) {
+    cube_lines(glm::inverse(world_to_clip), color);
+  }
+
+  void bounds(const module_geom::bvol& b, uint32_t color) {
+    switch (b.type) {
+    case module_geom::bvol::type_sphere:
+      sphere(b.center, b.radius, color);
+      break;
+    case module_geom::bvol::type_aabb:
+      box(b.center - b.extents, b.center + b.extents, color);
+      break;
+    }
+  }
+
+  void axes(const mat4_t& transform, real_t size) {
+    vec3_t origin{transform[3]};
+
+    line(origin, MAT4V3(transform, R3v(size, 0, 0)), k_red);
+    line(origin, MAT4V3(transform, R3v(0, size, 0)), k_green);
+    line(origin, MAT4V3(transform, R3v(0, 0, size)), k_blue);
+  }
+
+  namespace gl {
+    static constexpr uint32_t k_num_frames = 3;
+
+    static struct {
+      gapi::buffer_object_handle vbo{};
+
+      // used in place of a persistent mapping when ARB_buffer_storage
+      // isn't available; it holds a single frame, which is uploaded
+      // right before the draw
+      darray<debug_vertex> fallback{};
+
+      darray<gapi::fence_object_handle> fences = darray<gapi::fence_object_handle>(k_num_frames);
+
+      uint32_t frame{0};
+    } g_gl{};
+
+    static gapi::bytesize_t bytes(size_t num_vertices) {
+      return static_cast<gapi::bytesize_t>(sizeof(debug_vertex) * num_vertices);
+    }
+
+    static gapi::state draw_state() {
+      gapi::state s{};
+      s.depth.mask = false;
+      return s;
+    }
+
+    void init() {
+      const auto target = gapi::buffer_object_target::vertex;
+
+      g_gl.vbo = g_m.gpu->buffer_object_new();
+      g_m.gpu->buffer_object_bind(target, g_gl.vbo);
+
+      auto* ring =
+        static_cast<debug_vertex*>(g_m.gpu->buffer_object_set_storage_mapped(target,
+                                                                             bytes(k_num_frames * k_max_vertices)));
+
+      if (ring != nullptr) {
+        set_ring(ring, k_num_frames);
+      }
+      else {
+        g_m.gpu->buffer_object_set_data(target,
+                                        bytes(k_max_vertices),
+                                        nullptr,
+                                        gapi::buffer_object_usage::dynamic_draw);
+
+        g_gl.fallback.resize(k_max_vertices);
+        set_ring(g_gl.fallback.data(), 1);
+      }
+
+      g_m.gpu->buffer_object_unbind(target);
+
+      g_gl.frame = 0;
+      begin_frame(g_gl.frame);
+    }
+
+    void render(const mat4_t& world_to_view, const mat4_t& view_to_clip) {
+      const auto target = gapi::buffer_object_target::vertex;
+      const bool persistent = g_gl.fallback.empty();
+
+      uint32_t count = frame_vertex_count();
+
+      if (count != 0) {
+        g_m.gpu->buffer_object_bind(target, g_gl.vbo);
+
+        if (!persistent) {
+          g_m.gpu->buffer_object_set_sub_data(target, 0, bytes(count), frame_vertices());
+        }
+
+        {
+          use_program u(g_m.programs->debug_lines);
+
+          g_m.programs->up_mat4x4("unif_ModelView", world_to_view);
+          g_m.programs->up_mat4x4("unif_Projection", view_to_clip);
+          g_m.programs->up_vec4("unif_ModelColor", R4v(1, 1, 1, 1));
+
+          g_m.gpu->apply_state(draw_state());
+          g_m.gpu->buffer_object_draw_vertices(gapi::raster_method::lines,
+                                               g_gl.frame * k_max_vertices,
+                                               count);
+        }
+
+        g_m.gpu->buffer_object_unbind(target);
+      }
+
+      if (persistent) {
+        // the next section is written to as soon as begin_frame()
+        // returns, so the draw that last read it has to be finished
+        g_gl.fences[g_gl.frame] = g_m.gpu->fence_object_insert();
+        g_gl.frame = (g_gl.frame + 1) % k_num_frames;
+        g_m.gpu->fence_object_wait(g_gl.fences[g_gl.frame]);
+      }
+
+      begin_frame(g_gl.frame);
+    }
+
+    void free() {
+      const auto target = gapi::buffer_object_target::vertex;
+
+      set_ring(nullptr, 0);
+
+      for (auto& fence: g_gl.fences) {
+        g_m.gpu->fence_object_wait(fence);
+      }
+
+      if (!g_gl.vbo.is_null()) {
+        if (g_gl.fallback.empty()) {
+          g_m.gpu->buffer_object_bind(target, g_gl.vbo);
+          g_m.gpu->buffer_object_unmap(target);
+          g_m.gpu->buffer_object_unbind(target);
+        }
+
+        g_m.gpu->buffer_object_delete(g_gl.vbo);
+      }
+
+      g_gl.fallback.clear();
+    }
+  }
+}
+
+#endif // BASE_ENABLE_DEBUG_DRAW == 1
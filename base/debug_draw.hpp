@@ -0,0 +1,145 @@
+#pragma once
+
+#include "common.hpp"
+#include "geom.hpp"
+
+//
+// Immediate mode debug geometry: lines, boxes, spheres, frusta and axis
+// gizmos can be submitted from anywhere during a frame and are drawn after
+// the scene with a single line list draw.
+//
+// Everything is expanded into lines on submission and written straight into
+// a ring of vertices owned by the active backend; the ring has one section
+// per frame in flight, and is normally persistently mapped GPU memory.
+// Submitting is a bounds check and two vertex writes - nothing is allocated
+// per frame, and lines beyond k_max_lines are dropped (and counted).
+//
+// The backend calls begin_frame() once it knows the GPU is done with the
+// section it's about to hand out, and reads frame_vertex_count() when it
+// issues the draw.
+//
+// Compiled in with BASE_ENABLE_DEBUG_DRAW=1, which is the default for
+// debug builds. Otherwise every function here is an empty inline and
+// the backends skip their debug draw resources entirely.
+//
+
+#if !defined(BASE_ENABLE_DEBUG_DRAW)
+#if defined(BASE_DEBUG)
+#define BASE_ENABLE_DEBUG_DRAW 1
+#else
+#define BASE_ENABLE_DEBUG_DRAW 0
+#endif
+#endif
+
+namespace debug_draw {
+  static constexpr bool k_enabled = BASE_ENABLE_DEBUG_DRAW == 1;
+
+  static constexpr uint32_t k_max_lines = 1 << 17; // per frame
+  static constexpr uint32_t k_max_vertices = k_max_lines * 2;
+
+  static constexpr uint32_t k_circle_segments = 32;
+
+  static constexpr uint32_t pack_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+    return
+      static_cast<uint32_t>(r) |
+      (static_cast<uint32_t>(g) << 8) |
+      (static_cast<uint32_t>(b) << 16) |
+      (static_cast<uint32_t>(a) << 24);
+  }
+
+  static inline uint32_t pack_color(const vec4_t& c) {
+    auto to_u8 = [](real_t x) -> uint8_t {
+      return static_cast<uint8_t>(glm::clamp(x, R(0), R(1)) * R(255) + R(0.5));
+    };
+
+    return pack_color(to_u8(c.x), to_u8(c.y), to_u8(c.z), to_u8(c.w));
+  }
+
+  static constexpr uint32_t k_white = pack_color(255, 255, 255);
+  static constexpr uint32_t k_red = pack_color(255, 0, 0);
+  static constexpr uint32_t k_green = pack_color(0, 255, 0);
+  static constexpr uint32_t k_blue = pack_color(0, 0, 255);
+  static constexpr uint32_t k_yellow = pack_color(255, 255, 0);
+  static constexpr uint32_t k_cyan = pack_color(0, 255, 255);
+  static constexpr uint32_t k_magenta = pack_color(255, 0, 255);
+
+  struct stats {
+    uint32_t lines{0};
+    uint32_t dropped_lines{0};
+  };
+
+#if BASE_ENABLE_DEBUG_DRAW == 1
+  // ring must hold num_frames * k_max_vertices vertices;
+  // nullptr detaches it, after which submissions are dropped
+  void set_ring(debug_vertex* ring, uint32_t num_frames);
+
+  void begin_frame(uint32_t frame);
+
+  // the current frame's vertices start at
+  // frame * k_max_vertices in the ring
+  uint32_t frame_vertex_count();
+
+  const debug_vertex* frame_vertices();
+
+  // for the frame in progress
+  stats frame_stats();
+
+  void line(const vec3_t& a, const vec3_t& b, uint32_t color = k_white);
+
+  void ray(const module_geom::ray& r, real_t length, uint32_t color = k_yellow);
+
+  void box(const vec3_t& min, const vec3_t& max, uint32_t color = k_white);
+
+  // the [-1, 1] cube, transformed
+  void box(const mat4_t& transform, uint32_t color = k_white);
+
+  // three great circles
+  void sphere(const vec3_t& center, real_t radius, uint32_t color = k_white);
+
+  void circle(const vec3_t& center, const vec3_t& normal, real_t radius, uint32_t color = k_white);
+
+  // view_to_clip * world_to_view for a GL style [-1, 1] clip volume
+  void frustum(const mat4_t& world_to_clip, uint32_t color = k_magenta);
+
+  void bounds(const module_geom::bvol& b, uint32_t color = k_green);
+
+  // x, y and z in red, green and blue
+  void axes(const mat4_t& transform, real_t size = R(1));
+#else
+  static inline void set_ring(debug_vertex*, uint32_t) {}
+  static inline void begin_frame(uint32_t) {}
+  static inline uint32_t frame_vertex_count() { return 0; }
+  static inline const debug_vertex* frame_vertices() { return nullptr; }
+  static inline stats frame_stats() { return {}; }
+  static inline void line(const vec3_t&, const vec3_t&, uint32_t = k_white) {}
+  static inline void ray(const module_geom::ray&, real_t, uint32_t = k_yellow) {}
+  static inline void box(const vec3_t&, const vec3_t&, uint32_t = k_white) {}
+  static inline void box(const mat4_t&, uint32_t = k_white) {}
+  static inline void sphere(const vec3_t&, real_t, uint32_t = k_white) {}
+  static inline void circle(const vec3_t&, const vec3_t&, real_t, uint32_t = k_white) {}
+  static inline void frustum(const mat4_t&, uint32_t = k_magenta) {}
+  static inline void bounds(const module_geom::bvol&, uint32_t = k_green) {}
+  static inline void axes(const mat4_t&, real_t = R(1)) {}
+#endif
+
+  //
+  // OpenGL backend; owns the ring's buffer object and draws it
+  // with the "debug_lines" program. Only valid when the GL device
+  // is in use. The Vulkan renderer manages its own ring.
+  //
+  namespace gl {
+#if BASE_ENABLE_DEBUG_DRAW == 1
+    void init();
+
+    // draws the frame's lines into whatever framebuffer is bound,
+    // then moves the ring on to the next frame
+    void render(const mat4_t& world_to_view, const mat4_t& view_to_clip);
+
+    void free();
+#else
+    static inline void init() {}
+    static inline void render(const mat4_t&, const mat4_t&) {}
+    static inline void free() {}
+#endif
+  }
+}
@@ -7,6 +7,7 @@ extern void error_callback(int error, const char* description);
 extern void cursor_position_callback(GLFWwindow* window, double xpos, double ypos);
 extern void mouse_button_callback(GLFWwindow* window, int button, int action, int mmods);
 extern void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+extern void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
 class device_context {
 private:
@@ -66,7 +67,9 @@ public:
         break;
     }
 
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    // the Vulkan renderer recreates its swapchain on resize
+    glfwWindowHint(GLFW_RESIZABLE,
+                   g_conf.api_backend == gapi::backend::vulkan ? GL_TRUE : GL_FALSE);
     glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
     glfwWindowHint(GLFW_DOUBLEBUFFER, GL_TRUE);
 
@@ -123,6 +126,7 @@ public:
           glfwSetKeyCallback(glfw_window, key_callback);
           glfwSetCursorPosCallback(glfw_window, cursor_position_callback);
           glfwSetMouseButtonCallback(glfw_window, mouse_button_callback);
+          glfwSetFramebufferSizeCallback(glfw_window, framebuffer_size_callback);
         }
       } 
       else {
@@ -16,6 +16,8 @@ namespace gapi {
   const framebuffer_object_handle k_framebuffer_object_none{k_none_value};
   const buffer_object_handle k_buffer_object_none{k_none_value};
   const vertex_array_object_handle k_vertex_array_object_none{k_none_value};
+  const fence_object_handle k_fence_object_none{k_none_value};
+  const query_object_handle k_query_object_none{k_none_value};
 
   static void state_set_backbuffer(bool fbo) {
     if (fbo) {
@@ -741,6 +743,86 @@ namespace gapi {
     }
   }
 
+  void device::buffer_object_set_sub_data(buffer_object_target target, bytesize_t offset, bytesize_t size, const void* data) {
+    if (buffer_object_bound_enforced(target)) {
+      GL_FN(glBufferSubData(gl_buffer_target_to_enum(target),
+                            static_cast<GLintptr>(offset),
+                            static_cast<GLsizeiptr>(size),
+                            static_cast<const GLvoid*>(data)));
+    }
+  }
+
+  void device::buffer_object_get_sub_data(buffer_object_target target, bytesize_t offset, bytesize_t size, void* data) {
+    if (buffer_object_bound_enforced(target)) {
+      GL_FN(glGetBufferSubData(gl_buffer_target_to_enum(target),
+                               static_cast<GLintptr>(offset),
+                               static_cast<GLsizeiptr>(size),
+                               static_cast<GLvoid*>(data)));
+    }
+  }
+
+  // The copy targets exist so this doesn't disturb any of the
+  // tracked bindings.
+  void device::buffer_object_copy(buffer_object_ref src,
+                                  buffer_object_ref dst,
+                                  bytesize_t src_offset,
+                                  bytesize_t dst_offset,
+                                  bytesize_t size) {
+    if (c_assert(!src.is_null()) && c_assert(!dst.is_null())) {
+      GL_FN(glBindBuffer(GL_COPY_READ_BUFFER, src.value_as<GLuint>()));
+      GL_FN(glBindBuffer(GL_COPY_WRITE_BUFFER, dst.value_as<GLuint>()));
+
+      GL_FN(glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                GL_COPY_WRITE_BUFFER,
+                                static_cast<GLintptr>(src_offset),
+                                static_cast<GLintptr>(dst_offset),
+                                static_cast<GLsizeiptr>(size)));
+
+      GL_FN(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+      GL_FN(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    }
+  }
+
+  void device::buffer_object_delete(buffer_object_mut_ref object) {
+    if (object) {
+      for (auto target: enum_type<buffer_object_target>()) {
+        ASSERT(m_curr_buffer_object.at(target) != object);
+      }
+
+      GLuint handle = object.value_as<GLuint>();
+      GL_FN(glDeleteBuffers(1, &handle));
+      object.set_null();
+    }
+  }
+
+  void* device::buffer_object_set_storage_mapped(buffer_object_target target, bytesize_t size) {
+    void* ret = nullptr;
+
+    if (buffer_object_bound_enforced(target)) {
+      if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        GL_FN(glBufferStorage(gl_buffer_target_to_enum(target),
+                              static_cast<GLsizeiptr>(size),
+                              nullptr,
+                              flags));
+
+        GL_FN(ret = glMapBufferRange(gl_buffer_target_to_enum(target),
+                                     0,
+                                     static_cast<GLsizeiptr>(size),
+                                     flags));
+      }
+    }
+
+    return ret;
+  }
+
+  void device::buffer_object_unmap(buffer_object_target target) {
+    if (buffer_object_bound_enforced(target)) {
+      GL_FN(glUnmapBuffer(gl_buffer_target_to_enum(target)));
+    }
+  }
+
   void device::buffer_object_draw_vertices(raster_method method, offset_t offset, count_t count) {
     if (buffer_object_bound_enforced(buffer_object_target::vertex)) {
       GL_FN(glDrawArrays(gl_raster_method_to_enum(method),
@@ -749,6 +831,70 @@ namespace gapi {
     }
   }
 
+  //-------------------------------
+  // fence_object_handle
+  //-------------------------------
+
+  fence_object_handle device::fence_object_insert() {
+    GLsync sync{};
+    GL_FN(sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    return fence_object_handle{static_cast<handle_int_t>(reinterpret_cast<intptr_t>(sync))};
+  }
+
+  void device::fence_object_wait(fence_object_mut_ref fence) {
+    if (!fence.is_null()) {
+      GLsync sync = reinterpret_cast<GLsync>(static_cast<intptr_t>(fence.value()));
+      GLenum result = GL_TIMEOUT_EXPIRED;
+
+      // the first wait flushes, so the fence is guaranteed to signal eventually
+      GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+      
+      while (result == GL_TIMEOUT_EXPIRED) {
+        GL_FN(result = glClientWaitSync(sync, flags, 1000000000));
+        flags = 0;
+      }
+
+      ASSERT(result != GL_WAIT_FAILED);
+
+      GL_FN(glDeleteSync(sync));
+      fence.set_null();
+    }
+  }
+
+  //-------------------------------
+  // query_object_handle
+  //-------------------------------
+
+  query_object_handle device::query_object_new() {
+    query_object_handle ret{};
+    glew_gen_handle<query_object_handle, &glGenQueries>(ret);
+    return ret;
+  }
+
+  void device::query_object_delete(query_object_mut_ref query) {
+    if (query) {
+      GLuint handle = query.value_as<GLuint>();
+      GL_FN(glDeleteQueries(1, &handle));
+      query.set_null();
+    }
+  }
+
+  void device::query_object_timestamp(query_object_ref query) {
+    GL_FN(glQueryCounter(query.value_as<GLuint>(), GL_TIMESTAMP));
+  }
+
+  bool device::query_object_available(query_object_ref query) {
+    GLint available = GL_FALSE;
+    GL_FN(glGetQueryObjectiv(query.value_as<GLuint>(), GL_QUERY_RESULT_AVAILABLE, &available));
+    return available == GL_TRUE;
+  }
+
+  uint64_t device::query_object_result(query_object_ref query) {
+    GLuint64 result = 0;
+    GL_FN(glGetQueryObjectui64v(query.value_as<GLuint>(), GL_QUERY_RESULT, &result));
+    return static_cast<uint64_t>(result);
+  }
+
   //-------------------------------
   // viewport
   //-------------------------------
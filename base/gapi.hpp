@@ -95,7 +95,9 @@ enum class handle_type {
   vertex_array_object,
   buffer_object,
   framebuffer_object,
-  texture_object
+  texture_object,
+  fence_object,
+  query_object
 };
 
 enum class buffer_object_target {
@@ -474,6 +476,8 @@ DEF_HANDLE_TYPES(vertex_array_object)
 DEF_HANDLE_TYPES(buffer_object)
 DEF_HANDLE_TYPES(framebuffer_object)
 DEF_HANDLE_TYPES(texture_object)
+DEF_HANDLE_TYPES(fence_object)
+DEF_HANDLE_TYPES(query_object)
 
 DEF_TRAITED_HANDLE_TYPES(program_unit, program_unit_traits)
 
@@ -538,6 +542,10 @@ struct constants {
   static constexpr uint8_t k_vertex_layout_color = 1;
   static constexpr uint8_t k_vertex_layout_normal = 2;
 
+  // debug_vertex; see debug_draw.hpp
+  static constexpr uint8_t k_vertex_layout_debug_position = 3;
+  static constexpr uint8_t k_vertex_layout_debug_color = 4;
+
   static constexpr primitive_type k_real_type = primitive_type::floating_point;
 };
 
@@ -589,40 +597,54 @@ private:
     darray<int16_t> locations { 
       constants::k_vertex_layout_position, 
       constants::k_vertex_layout_color,
-      constants::k_vertex_layout_normal
+      constants::k_vertex_layout_normal,
+      constants::k_vertex_layout_position,
+      constants::k_vertex_layout_color
     };
 
     darray<uint16_t> strides {
       sizeof(vertex),
       sizeof(vertex),
-      sizeof(vertex)
+      sizeof(vertex),
+      sizeof(debug_vertex),
+      sizeof(debug_vertex)
     };
 
     darray<void*> offsets {
       (void*)offsetof(vertex, position),
       (void*)offsetof(vertex, color),
-      (void*)offsetof(vertex, normal)
+      (void*)offsetof(vertex, normal),
+      (void*)offsetof(debug_vertex, position),
+      (void*)offsetof(debug_vertex, color)
     };
 
     darray<primitive_type> types {
       constants::k_real_type,
       constants::k_real_type,
-      constants::k_real_type
+      constants::k_real_type,
+      constants::k_real_type,
+      primitive_type::unsigned_byte
     };
 
     darray<uint8_t> tuple_sizes {
       3,
       4,
-      3
+      3,
+      3,
+      4
     };
 
     darray<bool> normalized {
       false,
       false,
-      false
+      false,
+      false,
+      true
     };
 
     darray<bool> enabled {
+      false,
+      false,
       false,
       false,
       false
@@ -762,8 +784,52 @@ public:
 
   void buffer_object_set_data(buffer_object_target target, bytesize_t size, const void* data, buffer_object_usage usage);
 
+  // the range has to be within the store set by buffer_object_set_data
+  void buffer_object_set_sub_data(buffer_object_target target, bytesize_t offset, bytesize_t size, const void* data);
+
+  void buffer_object_get_sub_data(buffer_object_target target, bytesize_t offset, bytesize_t size, void* data);
+
+  // GPU side copy; neither buffer needs to be bound
+  void buffer_object_copy(buffer_object_ref src,
+                          buffer_object_ref dst,
+                          bytesize_t src_offset,
+                          bytesize_t dst_offset,
+                          bytesize_t size);
+
+  void buffer_object_delete(buffer_object_mut_ref object);
+
+  // Allocates an immutable store and maps all of it once for writing, 
+  // persistently and coherently, so the returned pointer stays valid until
+  // buffer_object_unmap(). Returns nullptr without allocating anything
+  // when ARB_buffer_storage isn't available.
+  void* buffer_object_set_storage_mapped(buffer_object_target target, bytesize_t size);
+
+  void buffer_object_unmap(buffer_object_target target);
+
   void buffer_object_draw_vertices(raster_method method, offset_t offset, count_t count);
 
+  // fences
+
+  fence_object_handle fence_object_insert();
+
+  // blocks until the GPU has passed the fence, then deletes it
+  void fence_object_wait(fence_object_mut_ref fence);
+
+  // queries
+
+  query_object_handle query_object_new();
+
+  void query_object_delete(query_object_mut_ref query);
+
+  // records the GPU's clock, in nanoseconds, once
+  // everything issued before it has completed
+  void query_object_timestamp(query_object_ref query);
+
+  // true once the result can be read without blocking
+  bool query_object_available(query_object_ref query);
+
+  uint64_t query_object_result(query_object_ref query);
+
   // viewport
 
   void viewport_set(dimension_t x, dimension_t y, dimension_t width, dimension_t height);
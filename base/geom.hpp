@@ -192,5 +192,9 @@ struct module_geom {
   public:
     void update();
     bool intersects_sphere(const bvol& s) const;
+
+    // top, bottom, right, left, near, far; intersects_sphere()
+    // only tests the first four
+    const std::array<plane, 6>& planes() const { return m_planes; }
   };
 };
@@ -0,0 +1,864 @@
+#include "glb_import.hpp"
+#include "parallel.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cmath>
+
+using json = nlohmann::json;
+
+namespace glb_import {
+  using clock_type = std::chrono::steady_clock;
+
+  static real_t elapsed_ms(clock_type::time_point start) {
+    std::chrono::duration<double, std::milli> d = clock_type::now() - start;
+    return R(d.count());
+  }
+
+  static constexpr uint32_t k_magic = 0x46546C67; // "glTF"
+  static constexpr uint32_t k_version = 2;
+  static constexpr uint32_t k_chunk_json = 0x4E4F534A; // "JSON"
+  static constexpr uint32_t k_chunk_bin = 0x004E4942; // "BIN\0"
+  static constexpr size_t k_header_size = 12;
+  static constexpr size_t k_chunk_header_size = 8;
+
+  static uint32_t read_u32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  //
+  // accessor
+  //
+
+  uint32_t accessor::component_size() const {
+    uint32_t ret = 0;
+    switch (component) {
+    case component_s8:
+    case component_u8:
+      ret = 1;
+      break;
+    case component_s16:
+    case component_u16:
+      ret = 2;
+      break;
+    case component_u32:
+    case component_f32:
+      ret = 4;
+      break;
+    }
+    return ret;
+  }
+
+  template <class T>
+  static T read_component(const uint8_t* p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  void accessor::read(size_t i, real_t* out, uint32_t n) const {
+    n = std::min(n, num_components);
+
+    if (data == nullptr) {
+      for (uint32_t c = 0; c < n; ++c) {
+        out[c] = R(0);
+      }
+    }
+    else {
+      const uint8_t* p = data + i * stride;
+
+      switch (component) {
+      case component_f32:
+        memcpy(out, p, n * sizeof(real_t));
+        break;
+
+        // normalization rules are from the spec's "Animations" section
+#define READ_COMPONENTS(type, scale)                                    \
+        for (uint32_t c = 0; c < n; ++c) {                              \
+          real_t v = R(read_component<type>(p + c * sizeof(type)));     \
+          out[c] = normalized ? std::max(v / R(scale), R(-1)) : v;      \
+        }                                                               \
+        break
+
+      case component_s8: READ_COMPONENTS(int8_t, 127);
+      case component_u8: READ_COMPONENTS(uint8_t, 255);
+      case component_s16: READ_COMPONENTS(int16_t, 32767);
+      case component_u16: READ_COMPONENTS(uint16_t, 65535);
+      case component_u32: READ_COMPONENTS(uint32_t, 4294967295.0);
+
+#undef READ_COMPONENTS
+      }
+    }
+  }
+
+  uint32_t accessor::read_index(size_t i) const {
+    uint32_t ret = 0;
+
+    if (data != nullptr) {
+      const uint8_t* p = data + i * stride;
+
+      switch (component) {
+      case component_u8:
+        ret = read_component<uint8_t>(p);
+        break;
+      case component_u16:
+        ret = read_component<uint16_t>(p);
+        break;
+      case component_u32:
+        ret = read_component<uint32_t>(p);
+        break;
+      default:
+        break;
+      }
+    }
+
+    return ret;
+  }
+
+  //
+  // json
+  //
+
+  // nlohmann's accessors throw on a type mismatch, so
+  // everything read from the document goes through these.
+
+  static int32_t get_index(const json& j, const char* key, int32_t fallback = -1) {
+    auto it = j.find(key);
+    return it != j.end() && it->is_number_integer()
+      ? it->get<int32_t>()
+      : fallback;
+  }
+
+  static size_t get_size(const json& j, const char* key, size_t fallback = 0) {
+    auto it = j.find(key);
+    return it != j.end() && it->is_number_unsigned()
+      ? it->get<size_t>()
+      : fallback;
+  }
+
+  static bool get_bool(const json& j, const char* key, bool fallback) {
+    auto it = j.find(key);
+    return it != j.end() && it->is_boolean()
+      ? it->get<bool>()
+      : fallback;
+  }
+
+  static real_t get_real(const json& j, const char* key, real_t fallback) {
+    auto it = j.find(key);
+    return it != j.end() && it->is_number()
+      ? it->get<real_t>()
+      : fallback;
+  }
+
+  static std::string get_string(const json& j, const char* key) {
+    auto it = j.find(key);
+    return it != j.end() && it->is_string()
+      ? it->get<std::string>()
+      : std::string{};
+  }
+
+  // fills out from a numeric array of exactly n elements
+  static bool get_reals(const json& j, const char* key, real_t* out, size_t n) {
+    auto it = j.find(key);
+
+    bool ret =
+      it != j.end() &&
+      it->is_array() &&
+      it->size() == n;
+
+    for (size_t i = 0; ret && i < n; ++i) {
+      ret = (*it)[i].is_number();
+      if (ret) {
+        out[i] = (*it)[i].get<real_t>();
+      }
+    }
+
+    return ret;
+  }
+
+  static const json& get_array(const json& j, const char* key) {
+    static const json k_empty = json::array();
+    auto it = j.find(key);
+    return it != j.end() && it->is_array() ? *it : k_empty;
+  }
+
+  static uint32_t num_components_of(const std::string& type) {
+    uint32_t ret = 0;
+    if (type == "SCALAR") ret = 1;
+    else if (type == "VEC2") ret = 2;
+    else if (type == "VEC3") ret = 3;
+    else if (type == "VEC4") ret = 4;
+    else if (type == "MAT2") ret = 4;
+    else if (type == "MAT3") ret = 9;
+    else if (type == "MAT4") ret = 16;
+    return ret;
+  }
+
+  static bool load_accessors(const json& root,
+                             const uint8_t* bin,
+                             size_t bin_size,
+                             darray<accessor>& out) {
+    bool ok = true;
+
+    const json& views = get_array(root, "bufferViews");
+    const json& buffers = get_array(root, "buffers");
+
+    for (const json& ja: get_array(root, "accessors")) {
+      accessor a{};
+
+      a.count = get_size(ja, "count");
+      a.component = static_cast<component_type>(get_index(ja, "componentType", component_f32));
+      a.num_components = num_components_of(get_string(ja, "type"));
+      a.normalized = get_bool(ja, "normalized", false);
+      a.stride = a.element_size();
+
+      ok =
+        c_assert(a.component_size() != 0) &&
+        c_assert(a.num_components != 0) &&
+        c_assert(ja.find("sparse") == ja.end());
+
+      int32_t view_index = get_index(ja, "bufferView");
+
+      if (ok && view_index != -1) {
+        ok = c_assert(view_index >= 0 && static_cast<size_t>(view_index) < views.size());
+
+        if (ok) {
+          const json& jv = views[view_index];
+
+          int32_t buffer = get_index(jv, "buffer");
+
+          // only the GLB-stored buffer (the first one, without a uri) is supported
+          ok =
+            c_assert(buffer == 0 && !buffers.empty()) &&
+            c_assert(buffers[0].find("uri") == buffers[0].end());
+
+          if (ok) {
+            size_t view_offset = get_size(jv, "byteOffset");
+            size_t view_length = get_size(jv, "byteLength");
+            size_t offset = get_size(ja, "byteOffset");
+
+            a.stride = static_cast<uint32_t>(get_size(jv, "byteStride", a.stride));
+
+            size_t span = a.count == 0
+              ? 0
+              : a.stride * (a.count - 1) + a.element_size();
+
+            ok =
+              c_assert(view_offset + view_length <= bin_size) &&
+              c_assert(offset + span <= view_length) &&
+              c_assert(a.stride >= a.element_size());
+
+            if (ok) {
+              a.data = bin + view_offset + offset;
+            }
+          }
+        }
+      }
+
+      if (!ok) {
+        break;
+      }
+
+      out.push_back(a);
+    }
+
+    return ok;
+  }
+
+  static bool load_meshes(const json& root, size_t num_accessors, darray<mesh>& out) {
+    bool ok = true;
+
+    auto valid = [num_accessors](int32_t i) {
+      return i == primitive::k_absent ||
+        (i >= 0 && static_cast<size_t>(i) < num_accessors);
+    };
+
+    for (const json& jm: get_array(root, "meshes")) {
+      mesh m{};
+
+      m.name = get_string(jm, "name");
+
+      for (const json& jp: get_array(jm, "primitives")) {
+        primitive p{};
+
+        auto attribs = jp.find("attributes");
+
+        if (attribs != jp.end() && attribs->is_object()) {
+          p.position = get_index(*attribs, "POSITION");
+          p.normal = get_index(*attribs, "NORMAL");
+          p.uv = get_index(*attribs, "TEXCOORD_0");
+          p.color = get_index(*attribs, "COLOR_0");
+        }
+
+        p.indices = get_index(jp, "indices");
+        p.material = get_index(jp, "material");
+        p.mode = static_cast<primitive::mode_type>(get_index(jp, "mode", primitive::mode_triangles));
+
+        ok =
+          c_assert(valid(p.position)) &&
+          c_assert(valid(p.normal)) &&
+          c_assert(valid(p.uv)) &&
+          c_assert(valid(p.color)) &&
+          c_assert(valid(p.indices));
+
+        if (!ok) {
+          break;
+        }
+
+        m.primitives.push_back(p);
+      }
+
+      if (!ok) {
+        break;
+      }
+
+      out.push_back(std::move(m));
+    }
+
+    return ok;
+  }
+
+  static void load_materials(const json& root, darray<material>& out) {
+    for (const json& jm: get_array(root, "materials")) {
+      material m{};
+
+      m.name = get_string(jm, "name");
+      m.double_sided = get_bool(jm, "doubleSided", false);
+
+      auto pbr = jm.find("pbrMetallicRoughness");
+
+      if (pbr != jm.end() && pbr->is_object()) {
+        get_reals(*pbr, "baseColorFactor", &m.base_color[0], 4);
+        m.metallic = get_real(*pbr, "metallicFactor", m.metallic);
+        m.roughness = get_real(*pbr, "roughnessFactor", m.roughness);
+      }
+
+      out.push_back(m);
+    }
+  }
+
+  // Splits a column major TRS matrix back into its parts.
+  // Shear can't be represented and is lost.
+  static void decompose(const real_t* m, node& n) {
+    vec3_t axes[3] = {
+      R3v(m[0], m[1], m[2]),
+      R3v(m[4], m[5], m[6]),
+      R3v(m[8], m[9], m[10])
+    };
+
+    n.translation = R3v(m[12], m[13], m[14]);
+
+    n.scale = R3v(glm::length(axes[0]),
+                  glm::length(axes[1]),
+                  glm::length(axes[2]));
+
+    // a mirroring matrix; flip one axis so the rest is a rotation
+    if (glm::dot(glm::cross(axes[0], axes[1]), axes[2]) < R(0)) {
+      n.scale.x = -n.scale.x;
+    }
+
+    real_t r[3][3]; // r[column][row]
+
+    for (int c = 0; c < 3; ++c) {
+      vec3_t axis = n.scale[c] != R(0) ? axes[c] / n.scale[c] : vec3_t{R(0)};
+      r[c][0] = axis.x;
+      r[c][1] = axis.y;
+      r[c][2] = axis.z;
+    }
+
+    // rotation matrix to quaternion (Shepperd's method)
+    real_t trace = r[0][0] + r[1][1] + r[2][2];
+    vec4_t q{};
+
+    if (trace > R(0)) {
+      real_t s = std::sqrt(trace + R(1)) * R(2);
+      q = R4v((r[1][2] - r[2][1]) / s,
+              (r[2][0] - r[0][2]) / s,
+              (r[0][1] - r[1][0]) / s,
+              R(0.25) * s);
+    }
+    else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+      real_t s = std::sqrt(R(1) + r[0][0] - r[1][1] - r[2][2]) * R(2);
+      q = R4v(R(0.25) * s,
+              (r[1][0] + r[0][1]) / s,
+              (r[2][0] + r[0][2]) / s,
+              (r[1][2] - r[2][1]) / s);
+    }
+    else if (r[1][1] > r[2][2]) {
+      real_t s = std::sqrt(R(1) + r[1][1] - r[0][0] - r[2][2]) * R(2);
+      q = R4v((r[1][0] + r[0][1]) / s,
+              R(0.25) * s,
+              (r[2][1] + r[1][2]) / s,
+              (r[2][0] - r[0][2]) / s);
+    }
+    else {
+      real_t s = std::sqrt(R(1) + r[2][2] - r[0][0] - r[1][1]) * R(2);
+      q = R4v((r[2][0] + r[0][2]) / s,
+              (r[2][1] + r[1][2]) / s,
+              R(0.25) * s,
+              (r[0][1] - r[1][0]) / s);
+    }
+
+    n.rotation = q;
+  }
+
+  static bool load_nodes(const json& root, size_t num_meshes, darray<node>& out) {
+    bool ok = true;
+
+    const json& jnodes = get_array(root, "nodes");
+
+    for (const json& jn: jnodes) {
+      node n{};
+
+      n.name = get_string(jn, "name");
+      n.mesh = get_index(jn, "mesh");
+
+      for (const json& jc: get_array(jn, "children")) {
+        ok = c_assert(jc.is_number_integer());
+
+        if (ok) {
+          int32_t c = jc.get<int32_t>();
+          ok = c_assert(c >= 0 && static_cast<size_t>(c) < jnodes.size());
+          n.children.push_back(c);
+        }
+
+        if (!ok) {
+          break;
+        }
+      }
+
+      ok = ok && c_assert(n.mesh == node::k_absent ||
+                          (n.mesh >= 0 && static_cast<size_t>(n.mesh) < num_meshes));
+
+      if (!ok) {
+        break;
+      }
+
+      real_t matrix[16];
+
+      if (get_reals(jn, "matrix", matrix, 16)) {
+        decompose(matrix, n);
+      }
+      else {
+        get_reals(jn, "translation", &n.translation[0], 3);
+        get_reals(jn, "rotation", &n.rotation[0], 4);
+        get_reals(jn, "scale", &n.scale[0], 3);
+      }
+
+      out.push_back(std::move(n));
+    }
+
+    return ok;
+  }
+
+  static void load_root_nodes(const json& root, size_t num_nodes, darray<int32_t>& out) {
+    const json& scenes = get_array(root, "scenes");
+
+    int32_t scene = get_index(root, "scene", 0);
+
+    if (scene >= 0 && static_cast<size_t>(scene) < scenes.size()) {
+      for (const json& jn: get_array(scenes[scene], "nodes")) {
+        if (jn.is_number_integer()) {
+          int32_t n = jn.get<int32_t>();
+
+          if (c_assert(n >= 0 && static_cast<size_t>(n) < num_nodes)) {
+            out.push_back(n);
+          }
+        }
+      }
+    }
+    else {
+      // no scene: every node which isn't a child is a root
+      darray<bool> is_child(num_nodes, false);
+
+      for (const json& jn: get_array(root, "nodes")) {
+        for (const json& jc: get_array(jn, "children")) {
+          is_child[jc.get<int32_t>()] = true;
+        }
+      }
+
+      for (size_t i = 0; i < num_nodes; ++i) {
+        if (!is_child[i]) {
+          out.push_back(static_cast<int32_t>(i));
+        }
+      }
+    }
+  }
+
+  std::optional<asset> load(const std::string& path, stats* out_stats) {
+    std::optional<asset> ret{};
+
+    stats st{};
+
+    auto t0 = clock_type::now();
+
+    asset a{};
+
+    // accessors are followed in whatever order the document lists them
+    bool ok = a.file.open(path, mapped_file::access_hint::random);
+
+    st.map_ms = elapsed_ms(t0);
+
+    const uint8_t* json_data = nullptr;
+    const uint8_t* bin_data = nullptr;
+
+    if (ok) {
+      const uint8_t* p = a.file.data();
+      const size_t size = a.file.size();
+
+      st.num_bytes = size;
+
+      ok =
+        c_assert(size >= k_header_size) &&
+        c_assert(read_u32(p + 0) == k_magic) &&
+        c_assert(read_u32(p + 4) == k_version) &&
+        c_assert(read_u32(p + 8) <= size);
+
+      size_t offset = k_header_size;
+
+      // chunks: JSON is always first, BIN is optional,
+      // and unknown chunk types are skipped.
+      while (ok && offset + k_chunk_header_size <= size) {
+        size_t length = read_u32(p + offset);
+        uint32_t type = read_u32(p + offset + 4);
+
+        offset += k_chunk_header_size;
+
+        ok = c_assert(offset + length <= size);
+
+        if (ok) {
+          if (type == k_chunk_json && json_data == nullptr) {
+            json_data = p + offset;
+            st.num_json_bytes = length;
+          }
+          else if (type == k_chunk_bin && bin_data == nullptr) {
+            bin_data = p + offset;
+            st.num_bin_bytes = length;
+          }
+
+          offset += length;
+        }
+      }
+
+      ok = ok && c_assert(json_data != nullptr);
+    }
+
+    if (ok) {
+      t0 = clock_type::now();
+
+      json root = json::parse(json_data,
+                              json_data + st.num_json_bytes,
+                              nullptr,
+                              false);
+
+      ok =
+        c_assert(!root.is_discarded()) &&
+        c_assert(root.is_object()) &&
+        load_accessors(root, bin_data, st.num_bin_bytes, a.accessors) &&
+        load_meshes(root, a.accessors.size(), a.meshes) &&
+        load_nodes(root, a.meshes.size(), a.nodes);
+
+      if (ok) {
+        load_materials(root, a.materials);
+        load_root_nodes(root, a.nodes.size(), a.root_nodes);
+      }
+
+      st.json_ms = elapsed_ms(t0);
+      st.num_meshes = static_cast<uint32_t>(a.meshes.size());
+      st.num_nodes = static_cast<uint32_t>(a.nodes.size());
+    }
+
+    if (ok) {
+      ret = std::move(a);
+    }
+    else {
+      write_logf("could not load glTF binary %s", path.c_str());
+    }
+
+    if (out_stats != nullptr) {
+      *out_stats = st;
+    }
+
+    return ret;
+  }
+
+  //
+  // conversion
+  //
+
+  bool to_imported_mesh(const asset& a,
+                        const primitive& p,
+                        imported_mesh& out) {
+    bool ok =
+      p.position != primitive::k_absent &&
+      (p.mode == primitive::mode_triangles ||
+       p.mode == primitive::mode_triangle_strip ||
+       p.mode == primitive::mode_triangle_fan);
+
+    if (ok) {
+      const accessor& positions = a.accessors[p.position];
+
+      auto& mesh = out.mesh;
+
+      mesh.vertices.resize(positions.count);
+
+      for (size_t i = 0; i < positions.count; ++i) {
+        vertex& v = mesh.vertices[i];
+
+        v.position = vec3_t{R(0)};
+        v.color = vec4_t{R(1)};
+        v.normal = vec3_t{R(0)};
+        v.uv = vec2_t{R(0)};
+
+        positions.read(i, &v.position[0], 3);
+      }
+
+      auto read_attrib = [&a, &mesh](int32_t index, auto member, uint32_t n) {
+        bool ret = index != primitive::k_absent;
+
+        if (ret) {
+          const accessor& acc = a.accessors[index];
+
+          ret = c_assert(acc.count == mesh.vertices.size());
+
+          for (size_t i = 0; ret && i < acc.count; ++i) {
+            acc.read(i, &(mesh.vertices[i].*member)[0], n);
+          }
+        }
+
+        return ret;
+      };
+
+      bool has_normals = read_attrib(p.normal, &vertex::normal, 3);
+
+      read_attrib(p.uv, &vertex::uv, 2);
+      read_attrib(p.color, &vertex::color, 4); // alpha stays 1 for VEC3 colors
+
+      // the vertex list of a triangle, strip or fan
+      mesh_optimize::index_list_t list{};
+
+      if (p.indices != primitive::k_absent) {
+        const accessor& indices = a.accessors[p.indices];
+
+        list.resize(indices.count);
+
+        if (indices.component == component_u32 && indices.packed() && indices.data != nullptr) {
+          memcpy(list.data(), indices.data, indices.count * sizeof(uint32_t));
+        }
+        else {
+          for (size_t i = 0; i < indices.count; ++i) {
+            list[i] = indices.read_index(i);
+          }
+        }
+      }
+      else {
+        list.resize(mesh.vertices.size());
+
+        for (size_t i = 0; i < list.size(); ++i) {
+          list[i] = static_cast<mesh_optimize::index_t>(i);
+        }
+      }
+
+      for (mesh_optimize::index_t i: list) {
+        ok = ok && c_assert(i < mesh.vertices.size());
+      }
+
+      if (ok) {
+        switch (p.mode) {
+        case primitive::mode_triangle_strip:
+          for (size_t i = 2; i < list.size(); ++i) {
+            // every other triangle is wound the other way
+            bool odd = (i & 1) == 1;
+            mesh.indices.push_back(list[i - 2]);
+            mesh.indices.push_back(list[odd ? i : i - 1]);
+            mesh.indices.push_back(list[odd ? i - 1 : i]);
+          }
+          break;
+
+        case primitive::mode_triangle_fan:
+          for (size_t i = 2; i < list.size(); ++i) {
+            mesh.indices.push_back(list[0]);
+            mesh.indices.push_back(list[i - 1]);
+            mesh.indices.push_back(list[i]);
+          }
+          break;
+
+        default:
+          list.resize(list.size() - list.size() % 3);
+          mesh.indices = std::move(list);
+          break;
+        }
+
+        if (!has_normals) {
+          imported_mesh_make_normals(mesh);
+        }
+
+        if (p.material != primitive::k_absent &&
+            static_cast<size_t>(p.material) < a.materials.size()) {
+          out.material = a.materials[p.material].name;
+        }
+      }
+    }
+
+    if (!ok) {
+      out.mesh = mesh_optimize::indexed_mesh<vertex>{};
+    }
+
+    return ok;
+  }
+
+  darray<imported_mesh> to_imported_meshes(const asset& a, uint32_t num_threads) {
+    struct item {
+      const mesh* m;
+      const primitive* p;
+    };
+
+    darray<item> items{};
+
+    for (const mesh& m: a.meshes) {
+      for (const primitive& p: m.primitives) {
+        items.push_back({ &m, &p });
+      }
+    }
+
+    darray<imported_mesh> ret(items.size());
+
+    parallel_for(items.size(),
+                 [&a, &items, &ret](size_t i) {
+                   ret[i].name = items[i].m->name;
+
+                   if (!to_imported_mesh(a, *items[i].p, ret[i])) {
+                     write_logf("glTF mesh %s has an unsupported primitive",
+                                items[i].m->name.c_str());
+                   }
+                 },
+                 num_threads);
+
+    return ret;
+  }
+
+  //
+  // scene graph
+  //
+
+  // The scene graph applies rotations about x, then y, then z,
+  // so the quaternion is converted to those angles.
+  static vec3_t euler_xyz(const vec4_t& q) {
+    real_t x = q.x, y = q.y, z = q.z, w = q.w;
+
+    // the rotation matrix entries the angles depend on (row, column)
+    real_t r00 = R(1) - R(2) * (y * y + z * z);
+    real_t r10 = R(2) * (x * y + z * w);
+    real_t r20 = R(2) * (x * z - y * w);
+    real_t r21 = R(2) * (y * z + x * w);
+    real_t r22 = R(1) - R(2) * (x * x + y * y);
+
+    return R3v(std::atan2(r21, r22),
+               std::asin(std::clamp(-r20, R(-1), R(1))),
+               std::atan2(r10, r00));
+  }
+
+  darray<scene_graph::index_type> instantiate(const asset& a,
+                                              module_models& models,
+                                              scene_graph& graph,
+                                              scene_graph::index_type parent) {
+    darray<scene_graph::index_type> ret(a.nodes.size(), unset<scene_graph::index_type>());
+
+    // one model per primitive
+    darray<imported_mesh> meshes{to_imported_meshes(a)};
+    darray<module_models::index_list_type> mesh_models(a.meshes.size());
+
+    {
+      size_t k = 0;
+
+      for (size_t m = 0; m < a.meshes.size(); ++m) {
+        for (const primitive& p: a.meshes[m].primitives) {
+          if (!meshes[k].mesh.indices.empty()) {
+            material mat{};
+
+            if (p.material != primitive::k_absent &&
+                static_cast<size_t>(p.material) < a.materials.size()) {
+              mat = a.materials[p.material];
+            }
+
+            module_models::index_type id = models.add_mesh(meshes[k].mesh, mat.base_color);
+
+            // roughness -> Blinn-Phong exponent, via the GGX alpha
+            real_t alpha = std::max(mat.roughness * mat.roughness, R(0.01));
+            models.material_info[id].smooth = R(2) / (alpha * alpha) - R(2);
+
+            mesh_models[m].push_back(id);
+          }
+          k++;
+        }
+      }
+
+      g_m.vertex_buffer->reset();
+    }
+
+    // parents are always created before their children
+    struct pending {
+      int32_t node;
+      scene_graph::index_type parent;
+    };
+
+    darray<pending> stack{};
+
+    for (auto it = a.root_nodes.rbegin(); it != a.root_nodes.rend(); ++it) {
+      stack.push_back({ *it, parent });
+    }
+
+    while (!stack.empty()) {
+      pending n = stack.back();
+      stack.pop_back();
+
+      // a node listed twice would make the hierarchy a DAG
+      if (!c_assert(ret[n.node] == unset<scene_graph::index_type>())) {
+        continue;
+      }
+
+      const node& src = a.nodes[n.node];
+
+      const module_models::index_list_type* ids =
+        src.mesh != node::k_absent ? &mesh_models[src.mesh] : nullptr;
+
+      scene_graph::init_info info{};
+
+      info.position = src.translation;
+      info.angle = euler_xyz(src.rotation);
+      info.scale = src.scale;
+      info.accum = boolvec3_t{true}; // glTF children inherit the full transform
+      info.parent = n.parent;
+      info.draw = ids != nullptr && !ids->empty();
+
+      if (info.draw) {
+        info.model = ids->at(0);
+      }
+
+      scene_graph::index_type index = graph.new_node(info);
+
+      ret[n.node] = index;
+
+      if (ids != nullptr) {
+        for (size_t i = 1; i < ids->size(); ++i) {
+          scene_graph::init_info extra{};
+
+          extra.accum = boolvec3_t{true};
+          extra.parent = index;
+          extra.model = ids->at(i);
+
+          graph.new_node(extra);
+        }
+      }
+
+      for (auto it = src.children.rbegin(); it != src.children.rend(); ++it) {
+        stack.push_back({ *it, index });
+      }
+    }
+
+    return ret;
+  }
+}
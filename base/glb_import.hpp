@@ -0,0 +1,179 @@
+#pragma once
+
+#include "common.hpp"
+#include "mapped_file.hpp"
+#include "mesh_import.hpp"
+#include "scene_graph.hpp"
+
+#include <optional>
+
+//
+// glTF 2.0 binary (.glb) importer.
+//
+// The file is memory mapped and only the JSON chunk is parsed. Accessors
+// are resolved to strided views that point straight into the mapped BIN
+// chunk: nothing is copied at load time, so for large scenes the cost of
+// load() is the JSON plus whatever pages get touched afterward.
+//
+// Data is converted to the engine's vertex format only when it's asked for
+// (to_imported_meshes()), and only where the layouts differ: uint32 index
+// data is bulk copied, float attributes are copied per element,
+// and everything else (normalized integers, u8/u16 indices) is converted.
+//
+// Supported: meshes (triangles, strips and fans), POSITION, NORMAL,
+// TEXCOORD_0 and COLOR_0, the node hierarchy (TRS or matrix) and
+// the pbrMetallicRoughness factors of materials.
+// Not supported: external/data URI buffers, sparse accessors, textures,
+// skins, morph targets and animations.
+//
+// See https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html
+//
+
+namespace glb_import {
+  enum component_type : uint32_t {
+    component_s8 = 5120,
+    component_u8 = 5121,
+    component_s16 = 5122,
+    component_u16 = 5123,
+    component_u32 = 5125,
+    component_f32 = 5126
+  };
+
+  // A typed, strided view into the BIN chunk.
+  // data == nullptr means the accessor has no buffer view,
+  // in which case every element reads as zero.
+  struct accessor {
+    const uint8_t* data{nullptr};
+    size_t count{0};
+    uint32_t stride{0};
+    component_type component{component_f32};
+    uint32_t num_components{0};
+    bool normalized{false};
+
+    uint32_t component_size() const;
+
+    uint32_t element_size() const {
+      return component_size() * num_components;
+    }
+
+    // elements are adjacent, so the range can be used (or uploaded) as is
+    bool packed() const {
+      return stride == element_size();
+    }
+
+    // Reads up to n components of element i as floats,
+    // applying normalization if the accessor asks for it.
+    // Components the accessor doesn't have are left untouched.
+    void read(size_t i, real_t* out, uint32_t n) const;
+
+    uint32_t read_index(size_t i) const;
+  };
+
+  struct primitive {
+    enum mode_type : uint32_t {
+      mode_points = 0,
+      mode_lines,
+      mode_line_loop,
+      mode_line_strip,
+      mode_triangles,
+      mode_triangle_strip,
+      mode_triangle_fan
+    };
+
+    static constexpr inline int32_t k_absent = -1;
+
+    // indices into asset::accessors
+    int32_t position{k_absent};
+    int32_t normal{k_absent};
+    int32_t uv{k_absent};
+    int32_t color{k_absent};
+    int32_t indices{k_absent};
+
+    int32_t material{k_absent};
+    mode_type mode{mode_triangles};
+  };
+
+  struct mesh {
+    std::string name{};
+    darray<primitive> primitives{};
+  };
+
+  struct material {
+    std::string name{};
+    vec4_t base_color{R(1)};
+    real_t metallic{R(1)};
+    real_t roughness{R(1)};
+    bool double_sided{false};
+  };
+
+  struct node {
+    static constexpr inline int32_t k_absent = -1;
+
+    std::string name{};
+    int32_t mesh{k_absent};
+    darray<int32_t> children{};
+
+    // matrix nodes are decomposed on load
+    vec3_t translation{R(0)};
+    vec4_t rotation{R(0), R(0), R(0), R(1)}; // quaternion, xyzw
+    vec3_t scale{R(1)};
+  };
+
+  struct stats {
+    size_t num_bytes{0};
+    size_t num_json_bytes{0};
+    size_t num_bin_bytes{0};
+    uint32_t num_meshes{0};
+    uint32_t num_nodes{0};
+    real_t map_ms{R(0)};
+    real_t json_ms{R(0)};
+
+    std::string to_string(const std::string& prefix = "glb_import::stats") const {
+      std::stringstream ss;
+      ss << prefix << ": { "
+         << AS_STRING_SS(num_bytes) SEP_SS
+        AS_STRING_SS(num_json_bytes) SEP_SS
+        AS_STRING_SS(num_bin_bytes) SEP_SS
+        AS_STRING_SS(num_meshes) SEP_SS
+        AS_STRING_SS(num_nodes) SEP_SS
+        AS_STRING_SS(map_ms) SEP_SS
+        AS_STRING_SS(json_ms) << " }";
+      return ss.str();
+    }
+  };
+
+  // Owns the mapping; every accessor points into it,
+  // so an asset must outlive anything that reads through them.
+  struct asset {
+    mapped_file file{};
+
+    darray<accessor> accessors{};
+    darray<mesh> meshes{};
+    darray<material> materials{};
+    darray<node> nodes{};
+    darray<int32_t> root_nodes{}; // of the default scene
+  };
+
+  std::optional<asset> load(const std::string& path, stats* out_stats = nullptr);
+
+  // Converts one primitive; false if it isn't a triangle primitive
+  // or references data out of range.
+  bool to_imported_mesh(const asset& a,
+                        const primitive& p,
+                        imported_mesh& out);
+
+  // Every primitive of every mesh, in order (mesh 0's primitives first),
+  // converted across num_threads workers (0 means every hardware thread).
+  // Primitives which can't be converted produce an empty mesh.
+  darray<imported_mesh> to_imported_meshes(const asset& a, uint32_t num_threads = 0);
+
+  // Registers every primitive as a model and recreates the default scene's
+  // node hierarchy under parent. A node whose mesh has several primitives
+  // gets one child node per extra primitive. Model colors come from
+  // the base color factor of each primitive's material.
+  // Returns the scene graph node for each glTF node (or unset if unused).
+  darray<scene_graph::index_type> instantiate(const asset& a,
+                                              module_models& models,
+                                              scene_graph& graph,
+                                              scene_graph::index_type parent = scene_graph::k_root);
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <memory>
 #include <functional>
@@ -12,6 +13,7 @@
 #include <unordered_map>
 #include <map>
 #include <limits>
+#include <chrono>
 
 #include "textures.hpp"
 #include "util.hpp"
@@ -32,6 +34,9 @@
 #include "render_loop.hpp"
 
 #include "settings.hpp"
+#include "mesh_bake.hpp"
+#include "debug_draw.hpp"
+#include "stb_image_write.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -46,11 +51,15 @@
 const real_t PI_OVER_6 = (PI_OVER_2 / R(6));
 
 struct render_loop_triangle : public render_loop {
-  vulkan::renderer m_renderer;
+  // remade from scratch when it asks for a restart
+  std::unique_ptr<vulkan::renderer> m_renderer{std::make_unique<vulkan::renderer>()};
 
+  void setup_renderer();
+  
   void init();
   void update();
   void render();
+  void framebuffer_resized(int width, int height);
 };
 
 struct render_loop_complete : public render_loop {
@@ -100,6 +109,9 @@ void modules::free() {
     
     switch (g_conf.api_backend) {
     case gapi::backend::opengl:{
+      debug_draw::gl::free();
+      g_pass_timings.free_mem();
+
       delete view;
       delete framebuffer;
       delete uniform_store;
@@ -131,6 +143,8 @@ module_textures::index_type g_checkerboard_cubemap {module_textures::k_uninit};
 
 static bool g_unif_gamma_correct = true;
 
+static bool g_debug_draw_bounds = false;
+
 gapi::vertex_array_object_handle g_vao{};
 
 static move_state  g_cam_move_state = {
@@ -683,9 +697,18 @@ static void init_api_data() {
   g_vao = g_m.gpu->vertex_array_object_new();
   g_m.gpu->vertex_array_object_bind(g_vao);
 
+  debug_draw::gl::init();
+
   g_m.models->modind_sphere = g_m.models->new_sphere();
   g_m.models->modind_area_sphere = g_m.models->new_sphere();
 
+  g_m.models->build_lods({ g_m.models->modind_sphere,
+                           g_m.models->modind_area_sphere });
+
+  // the room sphere is seen from inside, which the
+  // meshlets' cone test would take for back faces
+  g_m.models->build_meshlets({ g_m.models->modind_sphere });
+
   frame_model fmod {};
   fmod.render_cube_id = g_m.framebuffer->add_render_cube(TEST_SPHERE_POS,
                                                          TEST_SPHERE_RADIUS);
@@ -697,6 +720,10 @@ static void init_api_data() {
                                                            256,
                                                            module_textures::cubemap_preset_test_room_0));
 
+  // the LODs and meshlets above were built from the CPU copy; from
+  // here on uploaded vertices are dropped from it, and anything
+  // built later reads them back from the GPU (read_vertices())
+  g_m.vertex_buffer->keep_cpu_copy = false;
   g_m.vertex_buffer->reset();
 
   {
@@ -1016,6 +1043,12 @@ void error_callback(int error, const char* description) {
   fputs(description, stdout);
 }
 
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+  if (g_m.loop != nullptr) {
+    g_m.loop->framebuffer_resized(width, height);
+  }
+}
+
 // this callback is a slew of macros to make changes and adaptations easier
 // to materialize: much of this is likely to be altered as new needs are met,
 // and there are many situations that call for redundant expressions that may
@@ -1072,6 +1105,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
       KEY_BLOCK(GLFW_KEY_R,
                 g_obj_manip->reset_select_model_state());
 
+      KEY_BLOCK(GLFW_KEY_B,
+                g_debug_draw_bounds = !g_debug_draw_bounds);
+
       MAP_MOVE_STATE_TRUE(GLFW_KEY_W, front);
       MAP_MOVE_STATE_TRUE(GLFW_KEY_S, back);
       MAP_MOVE_STATE_TRUE(GLFW_KEY_A, left);
@@ -1241,17 +1277,21 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mmods
   }
 }
 
-void render_loop_triangle::init() {
-  if (m_renderer.init_context()) {
-    for (uint32_t i = 0; i < m_renderer.num_devices(); ++i) {
-      m_renderer.print_device_info(i);
+void render_loop_triangle::setup_renderer() {
+  if (m_renderer->init_context()) {
+    for (uint32_t i = 0; i < m_renderer->num_devices(); ++i) {
+      m_renderer->print_device_info(i);
     }
 
-    m_renderer.set_physical_device(0);
-    m_renderer.setup();
+    m_renderer->set_physical_device(0);
+    m_renderer->setup();
   }
+}
+
+void render_loop_triangle::init() {
+  setup_renderer();
     
-  if (m_renderer.ok_sync_objects()) {
+  if (m_renderer->ok_sync_objects()) {
     // moves the camera backward 5 units on the z axis - right handed system
     g_m.view->position = R3v(0, 0, 5);
     g_m.view->reset_proj();
@@ -1261,19 +1301,46 @@ void render_loop_triangle::init() {
 
 void render_loop_triangle::update() {
   render_loop::update();
-  m_frame_index = m_renderer.current_frame();
+  m_frame_index = m_renderer->current_frame();
   
   glfwPollEvents();
   
+  // keep the aspect ratio in step with a recreated swapchain
+  VkExtent2D extent = m_renderer->swapchain_extent();
+
+  if (extent.width != 0 &&
+      (extent.width != g_m.view->view_width || extent.height != g_m.view->view_height)) {
+    g_m.view->view_width = static_cast<uint16_t>(extent.width);
+    g_m.view->view_height = static_cast<uint16_t>(extent.height);
+    g_m.view->reset_proj();
+  }
+  
   g_m.view->update(g_cam_move_state);
 
-  m_renderer.set_world_to_view_transform(g_m.view->view());
-  m_renderer.set_view_to_clip_transform(g_m.view->proj);
+  if (g_debug_draw_bounds) {
+    m_renderer->debug_draw_bounds();
+  }
+
+  m_renderer->set_world_to_view_transform(g_m.view->view());
+  m_renderer->set_view_to_clip_transform(g_m.view->proj);
+}
+
+void render_loop_triangle::framebuffer_resized(int width, int height) {
+  m_renderer->framebuffer_resized();
 }
 
 void render_loop_triangle::render() {
-  m_renderer.render();
-  m_dtime = m_renderer.frame_delta_seconds(m_frame_index);
+  // the swapchain came back with a different image count;
+  // the old renderer has to release the surface first
+  if (m_renderer->restart_required()) {
+    m_renderer.reset();
+    m_renderer = std::make_unique<vulkan::renderer>();
+    setup_renderer();
+    m_frame_index = m_renderer->current_frame();
+  }
+  
+  m_renderer->render();
+  m_dtime = m_renderer->frame_delta_seconds(m_frame_index);
   post_update();
 }
 
@@ -1291,6 +1358,15 @@ void render_loop_complete::update() {
   if (g_obj_manip->has_select_model_state()) {
     g_obj_manip->update_select_model_state();
   }
+
+  if (g_debug_draw_bounds) {
+    // 0 is the root
+    for (size_t i = 1; i < g_m.graph->bound_volumes.size(); ++i) {
+      debug_draw::bounds(g_m.graph->bound_volumes[i]);
+    }
+
+    debug_draw::axes(m4i(), R(5));
+  }
 }
 
 void render_loop_complete::render() {
@@ -1317,11 +1393,141 @@ void render_loop_complete::render() {
     } break;
   }
 
+  debug_draw::gl::render(g_m.view->view(), g_m.view->proj);
+
+  g_pass_timings.end_frame();
+
   glfwSwapBuffers(g_m.device_ctx->window());
 }
 
 
-int main(void) {
+// renderer --bake <src.obj|src.glb> <dst.bmesh> [engine|vulkan]
+// Runs before any window or device is created, so it works headless.
+static int bake_main(int argc, char** argv) {
+  mesh_bake::params p{};
+
+  if (argc > 4) {
+    p.layout = strcmp(argv[4], "engine") == 0
+      ? mesh_bake::layout_engine
+      : mesh_bake::layout_vulkan;
+  }
+
+  return argc > 3 && mesh_bake::bake_file(argv[2], argv[3], p) ? 0 : 1;
+}
+
+// renderer --meshlet-bench [src.obj|src.glb]
+// uses the source's largest mesh, or a dense sphere without one
+static int meshlet_bench_main(int argc, char** argv) {
+  mesh_optimize::indexed_mesh<vertex> mesh{};
+
+  if (argc > 2) {
+    auto meshes = mesh_bake::import_file(argv[2]);
+
+    if (!meshes || meshes->empty()) {
+      return 1;
+    }
+
+    for (imported_mesh& m: meshes.value()) {
+      if (m.mesh.indices.size() > mesh.indices.size()) {
+        mesh = std::move(m.mesh);
+      }
+    }
+  }
+
+  meshlets::run_benchmark(mesh);
+
+  return 0;
+}
+
+// renderer --headless [frames] [device] [out.png]
+// Draws a fixed number of frames into offscreen images and reports how
+// long they took, without a window, a surface or GLFW; CPU devices like
+// lavapipe are accepted. With out.png the last frame is read back and
+// written there.
+static int headless_main(int argc, char** argv) {
+  uint32_t frames = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 600;
+  uint32_t device = argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 0;
+  const char* out_path = argc > 4 ? argv[4] : nullptr;
+
+  vulkan::renderer::headless_params params{};
+  params.extent = { SCREEN_WIDTH, SCREEN_HEIGHT };
+  params.image_count = 3;
+  params.readback = out_path != nullptr;
+
+  vulkan::renderer renderer{};
+  renderer.set_headless(params);
+
+  bool good = renderer.init_context() && device < renderer.num_devices();
+
+  if (good) {
+    renderer.print_device_info(device);
+    renderer.set_physical_device(device);
+    renderer.setup();
+
+    good = renderer.ok_sync_objects();
+  }
+
+  if (good) {
+    view_data view(SCREEN_WIDTH, SCREEN_HEIGHT);
+    view.position = R3v(0, 0, 5);
+    view.reset_proj();
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < frames && good; ++i) {
+      renderer.set_world_to_view_transform(view.view());
+      renderer.set_view_to_clip_transform(view.proj);
+      renderer.render();
+
+      good = vulkan::api_ok();
+    }
+
+    // the timing includes the GPU finishing the last frame
+    renderer.device_wait();
+
+    std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+
+    write_logf("headless: %" PRIu32 " frames in %f ms, %f ms per frame",
+               frames,
+               d.count(),
+               d.count() / static_cast<double>(std::max(frames, 1u)));
+
+    for (const auto& t: renderer.gpu_timings().scopes) {
+      write_logf("headless: gpu %s: %f ms average",
+                 t.name,
+                 t.samples > 0 ? t.total_ms / static_cast<double>(t.samples) : 0.0);
+    }
+
+    if (good && out_path != nullptr) {
+      const uint8_t* pixels = renderer.last_frame_pixels();
+
+      good =
+        pixels != nullptr &&
+        stbi_write_png(out_path,
+                       SCREEN_WIDTH,
+                       SCREEN_HEIGHT,
+                       4,
+                       pixels,
+                       SCREEN_WIDTH * 4) != 0;
+    }
+  }
+
+  return good ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+    return headless_main(argc, argv);
+  }
+
+  if (argc > 1 && strcmp(argv[1], "--bake") == 0) {
+    return bake_main(argc, argv);
+  }
+
+  if (argc > 1 && strcmp(argv[1], "--meshlet-bench") == 0) {
+    return meshlet_bench_main(argc, argv);
+  }
+
   g_key_states.fill(false);
 
   if (g_m.init()) {
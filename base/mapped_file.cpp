@@ -0,0 +1,123 @@
+#include "mapped_file.hpp"
+
+#if defined(OS_LINUX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file(mapped_file&& f) {
+  *this = std::move(f);
+}
+
+mapped_file& mapped_file::operator = (mapped_file&& f) {
+  if (this != &f) {
+    close();
+
+    m_data = f.m_data;
+    m_size = f.m_size;
+
+#if defined(OS_LINUX)
+    m_fd = f.m_fd;
+    f.m_fd = -1;
+#else
+    m_fallback = std::move(f.m_fallback);
+#endif
+
+    f.m_data = nullptr;
+    f.m_size = 0;
+  }
+  return *this;
+}
+
+#if defined(OS_LINUX)
+
+bool mapped_file::open(const std::string& path, access_hint hint) {
+  close();
+
+  bool ret = false;
+
+  m_fd = ::open(path.c_str(), O_RDONLY);
+
+  if (m_fd != -1) {
+    struct stat st{};
+
+    if (fstat(m_fd, &st) == 0) {
+      m_size = static_cast<size_t>(st.st_size);
+
+      if (m_size == 0) {
+        ret = true;
+      }
+      else {
+        void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+        if (p != MAP_FAILED) {
+          m_data = static_cast<const uint8_t*>(p);
+
+          switch (hint) {
+          case access_hint::sequential:
+            madvise(p, m_size, MADV_SEQUENTIAL);
+            madvise(p, m_size, MADV_WILLNEED);
+            break;
+          case access_hint::random:
+            madvise(p, m_size, MADV_RANDOM);
+            break;
+          default:
+            break;
+          }
+
+          ret = true;
+        }
+      }
+    }
+  }
+
+  if (!ret) {
+    write_logf("could not map %s", path.c_str());
+    close();
+  }
+
+  return ret;
+}
+
+void mapped_file::close() {
+  if (m_data != nullptr) {
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+  }
+
+  if (m_fd != -1) {
+    ::close(m_fd);
+  }
+
+  m_data = nullptr;
+  m_size = 0;
+  m_fd = -1;
+}
+
+#else
+
+bool mapped_file::open(const std::string& path, access_hint hint) {
+  close();
+
+  bool ret = fs::exists(path);
+
+  if (ret) {
+    m_fallback = read_file(path);
+    m_data = m_fallback.empty() ? nullptr : m_fallback.data();
+    m_size = m_fallback.size();
+  }
+  else {
+    write_logf("could not map %s", path.c_str());
+  }
+
+  return ret;
+}
+
+void mapped_file::close() {
+  m_fallback.clear();
+  m_data = nullptr;
+  m_size = 0;
+}
+
+#endif
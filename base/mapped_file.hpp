@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common.hpp"
+
+//
+// Read-only, memory mapped view of a file.
+//
+// On Linux the file is mmap'd, so pages are only faulted in as they're
+// touched and nothing is copied. Elsewhere this falls back to read_file(),
+// which keeps callers portable at the cost of one copy.
+//
+// The mapping lives as long as the mapped_file does; pointers
+// into data() must not outlive it.
+//
+class mapped_file {
+public:
+  enum class access_hint {
+    normal,
+    sequential, // e.g. a text parser walking the file front to back
+    random      // e.g. following offsets in a binary container
+  };
+
+private:
+  const uint8_t* m_data{nullptr};
+  size_t m_size{0};
+
+#if defined(OS_LINUX)
+  int m_fd{-1};
+#else
+  darray<uint8_t> m_fallback{};
+#endif
+
+public:
+  mapped_file() = default;
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator = (const mapped_file&) = delete;
+
+  mapped_file(mapped_file&& f);
+  mapped_file& operator = (mapped_file&& f);
+
+  ~mapped_file() {
+    close();
+  }
+
+  bool open(const std::string& path, access_hint hint = access_hint::normal);
+
+  void close();
+
+  const uint8_t* data() const { return m_data; }
+
+  size_t size() const { return m_size; }
+
+  // an empty file is still a valid mapping
+  bool ok() const {
+    return m_data != nullptr || m_size == 0;
+  }
+
+  const char* begin_chars() const { return reinterpret_cast<const char*>(m_data); }
+  const char* end_chars() const { return reinterpret_cast<const char*>(m_data) + m_size; }
+};
@@ -0,0 +1,379 @@
+#include "mesh_bake.hpp"
+#include "obj_import.hpp"
+#include "glb_import.hpp"
+#include "parallel.hpp"
+
+#include <fstream>
+
+namespace mesh_bake {
+  static uint64_t align_up(uint64_t x) {
+    return (x + k_alignment - 1) & ~(k_alignment - 1);
+  }
+
+  static void copy_name(char (&dst)[k_max_name], const std::string& src) {
+    memset(dst, 0, k_max_name);
+    memcpy(dst, src.data(), std::min(src.size(), k_max_name - 1));
+  }
+
+  static uint32_t vertex_stride(vertex_layout layout) {
+    return layout == layout_engine
+      ? k_engine_vertex_stride
+      : k_vulkan_vertex_stride;
+  }
+
+  static void write_vertices(vertex_layout layout,
+                             const darray<vertex>& vertices,
+                             uint8_t* out) {
+    if (layout == layout_engine) {
+      memcpy(out, vertices.data(), vertices.size() * sizeof(vertex));
+    }
+    else {
+      for (const vertex& v: vertices) {
+        const float f[11] = {
+          v.position.x, v.position.y, v.position.z,
+          v.uv.x, v.uv.y,
+          v.color.x, v.color.y, v.color.z,
+          v.normal.x, v.normal.y, v.normal.z
+        };
+        memcpy(out, f, sizeof(f));
+        out += sizeof(f);
+      }
+    }
+  }
+
+  // everything about one mesh that isn't file layout
+  struct baked_mesh {
+    mesh_optimize::indexed_mesh<vertex> mesh{};
+    darray<mesh_simplify::lod> lods{};
+    meshlets::meshlet_set meshlets{};
+    vec3_t bounds_min{R(0)};
+    vec3_t bounds_max{R(0)};
+    vec4_t sphere{R(0)};
+  };
+
+  static void bake_mesh(const imported_mesh& src, const params& p, baked_mesh& out) {
+    out.mesh = src.mesh;
+
+    if (p.optimize) {
+      mesh_optimize::optimize(out.mesh);
+    }
+
+    if (p.make_meshlets) {
+      out.meshlets = meshlets::build(out.mesh);
+    }
+
+    if (p.make_lods) {
+      out.lods = mesh_simplify::make_lod_chain(out.mesh, p.lod_params);
+    }
+
+    if (!out.mesh.vertices.empty()) {
+      out.bounds_min = out.bounds_max = out.mesh.vertices[0].position;
+
+      for (const vertex& v: out.mesh.vertices) {
+        out.bounds_min = glm::min(out.bounds_min, v.position);
+        out.bounds_max = glm::max(out.bounds_max, v.position);
+      }
+
+      vec3_t center{(out.bounds_min + out.bounds_max) * R(0.5)};
+      real_t radius = R(0);
+
+      for (const vertex& v: out.mesh.vertices) {
+        radius = std::max(radius, glm::length(v.position - center));
+      }
+
+      out.sphere = vec4_t{center, radius};
+    }
+  }
+
+  darray<uint8_t> bake(const darray<imported_mesh>& meshes, const params& p) {
+    darray<baked_mesh> baked(meshes.size());
+
+    parallel_for(meshes.size(),
+                 [&meshes, &baked, &p](size_t i) {
+                   bake_mesh(meshes[i], p, baked[i]);
+                 });
+
+    const uint32_t stride = vertex_stride(p.layout);
+
+    header h{};
+
+    h.magic = k_magic;
+    h.version = k_version;
+    h.vertex_layout = p.layout;
+    h.vertex_stride = stride;
+    h.num_meshes = static_cast<uint32_t>(meshes.size());
+
+    size_t num_vertices = 0;
+    size_t num_indices = 0;
+    size_t num_lods = 0;
+    size_t num_meshlets = 0;
+    size_t num_meshlet_vertices = 0;
+
+    for (const baked_mesh& b: baked) {
+      num_vertices += b.mesh.vertices.size();
+      num_indices += b.mesh.indices.size();
+      num_lods += 1 + b.lods.size();
+      num_meshlets += b.meshlets.meshlets.size();
+      num_meshlet_vertices += b.meshlets.vertices.size();
+
+      for (const mesh_simplify::lod& l: b.lods) {
+        num_indices += l.indices.size();
+      }
+    }
+
+    const uint64_t section_sizes[section_count] = {
+      sizeof(mesh_record) * meshes.size(),
+      sizeof(lod_record) * num_lods,
+      uint64_t{stride} * num_vertices,
+      sizeof(uint32_t) * num_indices,
+      sizeof(meshlet_record) * num_meshlets,
+      sizeof(uint32_t) * num_meshlet_vertices
+    };
+
+    uint64_t offset = align_up(sizeof(header));
+
+    for (uint32_t s = 0; s < section_count; ++s) {
+      h.sections[s] = { offset, section_sizes[s] };
+      offset = align_up(offset + section_sizes[s]);
+    }
+
+    h.file_size = offset;
+
+    darray<uint8_t> bytes(h.file_size, 0);
+
+    auto* records = reinterpret_cast<mesh_record*>(bytes.data() + h.sections[section_meshes].offset);
+    auto* lods = reinterpret_cast<lod_record*>(bytes.data() + h.sections[section_lods].offset);
+    uint8_t* vertices = bytes.data() + h.sections[section_vertices].offset;
+    auto* indices = reinterpret_cast<uint32_t*>(bytes.data() + h.sections[section_indices].offset);
+    auto* meshlet_records = reinterpret_cast<meshlet_record*>(bytes.data() + h.sections[section_meshlets].offset);
+    auto* meshlet_vertices = reinterpret_cast<uint32_t*>(bytes.data() + h.sections[section_meshlet_vertices].offset);
+
+    uint32_t first_vertex = 0;
+    uint32_t first_index = 0;
+    uint32_t first_lod = 0;
+    uint32_t first_meshlet = 0;
+    uint32_t first_meshlet_vertex = 0;
+
+    vec3_t file_min{R(0)};
+    vec3_t file_max{R(0)};
+
+    for (size_t i = 0; i < baked.size(); ++i) {
+      const baked_mesh& b = baked[i];
+
+      mesh_record& r = records[i];
+
+      copy_name(r.name, meshes[i].name);
+      copy_name(r.material, meshes[i].material);
+
+      r.first_vertex = first_vertex;
+      r.num_vertices = static_cast<uint32_t>(b.mesh.vertices.size());
+      r.first_lod = first_lod;
+      r.num_lods = static_cast<uint32_t>(1 + b.lods.size());
+      r.first_meshlet = first_meshlet;
+      r.num_meshlets = static_cast<uint32_t>(b.meshlets.meshlets.size());
+
+      for (int k = 0; k < 3; ++k) {
+        r.bounds_min[k] = b.bounds_min[k];
+        r.bounds_max[k] = b.bounds_max[k];
+      }
+
+      for (int k = 0; k < 4; ++k) {
+        r.sphere[k] = b.sphere[k];
+      }
+
+      if (i == 0) {
+        file_min = b.bounds_min;
+        file_max = b.bounds_max;
+      }
+      else {
+        file_min = glm::min(file_min, b.bounds_min);
+        file_max = glm::max(file_max, b.bounds_max);
+      }
+
+      write_vertices(p.layout, b.mesh.vertices, vertices + uint64_t{first_vertex} * stride);
+
+      first_vertex += r.num_vertices;
+
+      auto add_lod = [&](const mesh_optimize::index_list_t& l, real_t error) {
+        lods[first_lod++] = { first_index, static_cast<uint32_t>(l.size()), error, 0 };
+
+        memcpy(indices + first_index, l.data(), l.size() * sizeof(uint32_t));
+        first_index += static_cast<uint32_t>(l.size());
+      };
+
+      // meshlet index ranges are into lod 0, which is added next
+      for (const meshlets::meshlet& m: b.meshlets.meshlets) {
+        meshlet_records[first_meshlet++] = {
+          first_index + m.first_index,
+          m.triangle_count,
+          first_meshlet_vertex + m.first_vertex,
+          m.vertex_count,
+          { m.center.x, m.center.y, m.center.z },
+          m.radius,
+          { m.cone_axis.x, m.cone_axis.y, m.cone_axis.z },
+          m.cone_cutoff
+        };
+      }
+
+      memcpy(meshlet_vertices + first_meshlet_vertex,
+             b.meshlets.vertices.data(),
+             b.meshlets.vertices.size() * sizeof(uint32_t));
+
+      first_meshlet_vertex += static_cast<uint32_t>(b.meshlets.vertices.size());
+
+      add_lod(b.mesh.indices, R(0));
+
+      for (const mesh_simplify::lod& l: b.lods) {
+        add_lod(l.indices, l.error);
+      }
+    }
+
+    for (int k = 0; k < 3; ++k) {
+      h.bounds_min[k] = file_min[k];
+      h.bounds_max[k] = file_max[k];
+    }
+
+    memcpy(bytes.data(), &h, sizeof(h));
+
+    return bytes;
+  }
+
+  static bool has_extension(const std::string& path, const std::string& ext) {
+    return path.size() >= ext.size() &&
+      path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+  }
+
+  std::optional<darray<imported_mesh>> import_file(const std::string& src) {
+    std::optional<darray<imported_mesh>> meshes{};
+
+    if (has_extension(src, ".obj")) {
+      meshes = obj_import::load(src);
+    }
+    else if (has_extension(src, ".glb")) {
+      auto a = glb_import::load(src);
+
+      if (a) {
+        meshes = darray<imported_mesh>{};
+
+        for (imported_mesh& m: glb_import::to_imported_meshes(a.value())) {
+          if (!m.mesh.indices.empty()) {
+            meshes->push_back(std::move(m));
+          }
+        }
+      }
+    }
+    else {
+      write_logf("don't know how to import %s", src.c_str());
+    }
+
+    return meshes;
+  }
+
+  bool bake_file(const std::string& src, const std::string& dst, const params& p) {
+    std::optional<darray<imported_mesh>> meshes{import_file(src)};
+
+    bool ok = meshes.has_value();
+
+    if (ok) {
+      darray<uint8_t> bytes{bake(meshes.value(), p)};
+
+      std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+
+      out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+      ok = static_cast<bool>(out);
+
+      if (ok) {
+        write_logf("baked %s -> %s (%zu meshes, %zu bytes)",
+                   src.c_str(),
+                   dst.c_str(),
+                   meshes->size(),
+                   bytes.size());
+      }
+      else {
+        write_logf("could not write %s", dst.c_str());
+      }
+    }
+
+    return ok;
+  }
+
+  //
+  // runtime
+  //
+
+  // Only the structure is validated: every record and range has to be
+  // in bounds, so a truncated or stale file is rejected up front. Index
+  // values themselves aren't checked, since that would mean touching
+  // every page of the index blob at load time.
+  bool baked_file::open(const std::string& path) {
+    m_header = nullptr;
+
+    bool ok =
+      m_file.open(path, mapped_file::access_hint::random) &&
+      c_assert(m_file.size() >= sizeof(header));
+
+    const header* h = ok ? reinterpret_cast<const header*>(m_file.data()) : nullptr;
+
+    ok = ok &&
+      c_assert(h->magic == k_magic) &&
+      c_assert(h->version == k_version) &&
+      c_assert(h->file_size == m_file.size()) &&
+      c_assert(h->vertex_layout == layout_engine || h->vertex_layout == layout_vulkan) &&
+      c_assert(h->vertex_stride == vertex_stride(static_cast<vertex_layout>(h->vertex_layout)));
+
+    for (uint32_t s = 0; ok && s < section_count; ++s) {
+      ok =
+        c_assert(h->sections[s].offset % k_alignment == 0) &&
+        c_assert(h->sections[s].offset <= h->file_size) &&
+        c_assert(h->sections[s].size <= h->file_size - h->sections[s].offset);
+    }
+
+    ok = ok &&
+      c_assert(h->sections[section_meshes].size == sizeof(mesh_record) * uint64_t{h->num_meshes}) &&
+      c_assert(h->sections[section_lods].size % sizeof(lod_record) == 0) &&
+      c_assert(h->sections[section_vertices].size % h->vertex_stride == 0) &&
+      c_assert(h->sections[section_indices].size % sizeof(uint32_t) == 0) &&
+      c_assert(h->sections[section_meshlets].size % sizeof(meshlet_record) == 0) &&
+      c_assert(h->sections[section_meshlet_vertices].size % sizeof(uint32_t) == 0);
+
+    if (ok) {
+      m_header = h;
+
+      const uint64_t num_lods = h->sections[section_lods].size / sizeof(lod_record);
+      const uint64_t num_vertices = h->sections[section_vertices].size / h->vertex_stride;
+      const uint64_t num_meshlets = h->sections[section_meshlets].size / sizeof(meshlet_record);
+      const uint64_t num_meshlet_vertices = h->sections[section_meshlet_vertices].size / sizeof(uint32_t);
+
+      for (uint32_t i = 0; ok && i < num_meshes(); ++i) {
+        const mesh_record& m = mesh(i);
+
+        ok =
+          c_assert(m.num_lods > 0) &&
+          c_assert(uint64_t{m.first_lod} + m.num_lods <= num_lods) &&
+          c_assert(uint64_t{m.first_vertex} + m.num_vertices <= num_vertices) &&
+          c_assert(uint64_t{m.first_meshlet} + m.num_meshlets <= num_meshlets);
+
+        for (uint32_t l = 0; ok && l < m.num_lods; ++l) {
+          ok = c_assert(uint64_t{lod(m, l).first_index} + lod(m, l).num_indices <= num_indices());
+        }
+
+        for (uint32_t k = 0; ok && k < m.num_meshlets; ++k) {
+          const meshlet_record& ml = meshlet(m, k);
+
+          ok =
+            c_assert(uint64_t{ml.first_index} + uint64_t{ml.triangle_count} * 3 <= num_indices()) &&
+            c_assert(uint64_t{ml.first_vertex} + ml.vertex_count <= num_meshlet_vertices);
+        }
+      }
+    }
+
+    if (!ok) {
+      write_logf("%s is not a valid baked mesh (expected version %u)", path.c_str(), k_version);
+      m_header = nullptr;
+      m_file.close();
+    }
+
+    return ok;
+  }
+}
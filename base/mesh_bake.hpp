@@ -0,0 +1,194 @@
+#pragma once
+
+#include "common.hpp"
+#include "mapped_file.hpp"
+#include "mesh_import.hpp"
+#include "mesh_simplify.hpp"
+#include "meshlets.hpp"
+
+#include <optional>
+
+//
+// Baked runtime mesh container (.bmesh).
+//
+// Source assets (OBJ, glTF) are converted offline by `make bake`, which
+// runs `renderer --bake <src> <dst>`. Baking does everything that would
+// otherwise be per vertex work at load time: welding, vertex cache/overdraw/
+// fetch optimization, LOD generation, meshlet building and conversion to the
+// renderer's vertex layout. At runtime the file is memory mapped and its vertex and index
+// blobs are handed to the GPU upload path as they are.
+//
+// Layout (all offsets are from the start of the file, and every
+// section starts on a k_alignment boundary):
+//
+//   header
+//   sections[section_meshes]    mesh_record[num_meshes]
+//   sections[section_lods]      lod_record[...]
+//   sections[section_vertices]  vertex blob, in header.vertex_layout
+//   sections[section_indices]   uint32 indices, relative to each mesh's first_vertex
+//   sections[section_meshlets]  meshlet_record[...], over each mesh's lod 0
+//   sections[section_meshlet_vertices]
+//                               uint32 vertices of each meshlet, relative to
+//                               each mesh's first_vertex (see meshlets.hpp)
+//
+// Everything is little endian. A file is only ever read by the version
+// that wrote it: any change to the records bumps k_version.
+//
+
+namespace mesh_bake {
+  static constexpr inline uint32_t k_magic = 0x48534D42; // "BMSH"
+  static constexpr inline uint32_t k_version = 2;
+  static constexpr inline uint64_t k_alignment = 64;
+  static constexpr inline size_t k_max_name = 64;
+
+  enum vertex_layout : uint32_t {
+    // ::vertex (module_vertex_buffer, the OpenGL path)
+    layout_engine = 0,
+    // position, st, rgb color, normal (vulkan::vertex_data)
+    layout_vulkan
+  };
+
+  static constexpr inline uint32_t k_engine_vertex_stride = 48;
+  static constexpr inline uint32_t k_vulkan_vertex_stride = 44;
+
+  static_assert(sizeof(vertex) == k_engine_vertex_stride);
+
+  enum section_type : uint32_t {
+    section_meshes = 0,
+    section_lods,
+    section_vertices,
+    section_indices,
+    section_meshlets,
+    section_meshlet_vertices,
+    section_count
+  };
+
+  struct section {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  struct header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+
+    uint32_t vertex_layout;
+    uint32_t vertex_stride;
+    uint32_t num_meshes;
+    uint32_t reserved;
+
+    float bounds_min[3];
+    float bounds_max[3];
+
+    section sections[section_count];
+  };
+
+  struct mesh_record {
+    char name[k_max_name];
+    char material[k_max_name];
+
+    uint32_t first_vertex;
+    uint32_t num_vertices;
+
+    // lod 0 is the full mesh
+    uint32_t first_lod;
+    uint32_t num_lods;
+
+    uint32_t first_meshlet;
+    uint32_t num_meshlets;
+
+    float bounds_min[3];
+    float bounds_max[3];
+    float sphere[4]; // center, radius
+  };
+
+  struct lod_record {
+    uint32_t first_index; // into the index section
+    uint32_t num_indices;
+    float error; // relative to the mesh extent, see mesh_simplify.hpp
+    uint32_t reserved;
+  };
+
+  struct meshlet_record {
+    uint32_t first_index; // into the index section
+    uint32_t triangle_count;
+    uint32_t first_vertex; // into the meshlet vertex section
+    uint32_t vertex_count;
+
+    float center[3];
+    float radius;
+
+    float cone_axis[3];
+    float cone_cutoff;
+  };
+
+  static_assert(sizeof(header) == 152);
+  static_assert(sizeof(mesh_record) == 192);
+  static_assert(sizeof(lod_record) == 16);
+  static_assert(sizeof(meshlet_record) == 48);
+
+  struct params {
+    vertex_layout layout{layout_vulkan};
+    bool optimize{true};
+    bool make_lods{true};
+    bool make_meshlets{true};
+    mesh_simplify::lod_chain_params lod_params{};
+  };
+
+  // Returns the file's bytes.
+  darray<uint8_t> bake(const darray<imported_mesh>& meshes, const params& p = params{});
+
+  // Imports src (.obj or .glb, by extension); glTF primitives
+  // without triangles are dropped.
+  std::optional<darray<imported_mesh>> import_file(const std::string& src);
+
+  // Imports src, bakes it and writes dst.
+  bool bake_file(const std::string& src, const std::string& dst, const params& p = params{});
+
+  //
+  // runtime
+  //
+
+  // A validated, read-only view of a mapped .bmesh;
+  // every pointer it returns is into the mapping.
+  class baked_file {
+    mapped_file m_file{};
+    const header* m_header{nullptr};
+
+    template <class T>
+    const T* section_data(section_type s) const {
+      return reinterpret_cast<const T*>(m_file.data() + m_header->sections[s].offset);
+    }
+
+  public:
+    bool open(const std::string& path);
+
+    bool ok() const { return m_header != nullptr; }
+
+    const header& info() const { return *m_header; }
+
+    uint32_t num_meshes() const { return m_header->num_meshes; }
+
+    const mesh_record& mesh(uint32_t i) const {
+      return section_data<mesh_record>(section_meshes)[i];
+    }
+
+    const lod_record& lod(const mesh_record& m, uint32_t level) const {
+      return section_data<lod_record>(section_lods)[m.first_lod + level];
+    }
+
+    const meshlet_record& meshlet(const mesh_record& m, uint32_t i) const {
+      return section_data<meshlet_record>(section_meshlets)[m.first_meshlet + i];
+    }
+
+    const uint32_t* meshlet_vertices() const { return section_data<uint32_t>(section_meshlet_vertices); }
+
+    // suitable for a straight memcpy into a vertex/index buffer
+    const uint8_t* vertex_bytes() const { return section_data<uint8_t>(section_vertices); }
+    size_t num_vertex_bytes() const { return m_header->sections[section_vertices].size; }
+
+    const uint32_t* indices() const { return section_data<uint32_t>(section_indices); }
+    size_t num_indices() const { return m_header->sections[section_indices].size / sizeof(uint32_t); }
+  };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "common.hpp"
+#include "mesh_optimize.hpp"
+
+//
+// Common output of the asset importers (see obj_import.hpp).
+//
+// Meshes are indexed and use the engine vertex format;
+// vertex colors are white unless the source provides them,
+// since per model color is a material parameter.
+//
+struct imported_mesh {
+  std::string name{};
+  std::string material{};
+
+  mesh_optimize::indexed_mesh<vertex> mesh{};
+};
+
+// Smooth, area weighted normals per vertex;
+// used when a source doesn't provide its own.
+static inline void imported_mesh_make_normals(mesh_optimize::indexed_mesh<vertex>& mesh) {
+  for (vertex& v: mesh.vertices) {
+    v.normal = vec3_t{R(0)};
+  }
+
+  for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+    vertex& a = mesh.vertices[mesh.indices[t + 0]];
+    vertex& b = mesh.vertices[mesh.indices[t + 1]];
+    vertex& c = mesh.vertices[mesh.indices[t + 2]];
+
+    // unnormalized, so larger triangles weigh more
+    vec3_t n{glm::cross(b.position - a.position, c.position - a.position)};
+
+    a.normal += n;
+    b.normal += n;
+    c.normal += n;
+  }
+
+  for (vertex& v: mesh.vertices) {
+    real_t len = glm::length(v.normal);
+    v.normal = len > R(0) ? v.normal / len : V3_UP;
+  }
+}
@@ -0,0 +1,522 @@
+#include "mesh_optimize.hpp"
+
+#include <cmath>
+
+namespace mesh_optimize {
+  //
+  // cache simulation
+  //
+
+  // Tracks which vertices are resident in a simulated
+  // post-transform cache. FIFO is implemented with timestamps
+  // (a vertex is resident if fewer than cache_size misses
+  // have occurred since it was last inserted), which keeps
+  // a lookup O(1). LRU uses a small array, since cache sizes are tiny.
+  struct cache_sim {
+    cache_model model;
+    uint32_t cache_size;
+
+    darray<uint32_t> timestamps;
+    uint32_t time;
+
+    darray<index_t> lru;
+
+    cache_sim(size_t num_vertices, uint32_t cache_size, cache_model model)
+      : model{model},
+        cache_size{cache_size},
+        timestamps(num_vertices, 0),
+        time{cache_size + 1},
+        lru{} {
+      lru.reserve(cache_size + 1);
+    }
+
+    void reset() {
+      // moving time far enough forward
+      // invalidates every timestamp at once
+      time += cache_size + 1;
+      lru.clear();
+    }
+
+    // returns true on a miss
+    bool access(index_t v) {
+      bool miss = false;
+
+      if (model == cache_model::fifo) {
+        if (time - timestamps[v] > cache_size) {
+          timestamps[v] = time++;
+          miss = true;
+        }
+      }
+      else {
+        auto it = std::find(lru.begin(), lru.end(), v);
+
+        if (it != lru.end()) {
+          lru.erase(it);
+        }
+        else {
+          miss = true;
+        }
+
+        lru.insert(lru.begin(), v);
+
+        if (lru.size() > cache_size) {
+          lru.pop_back();
+        }
+      }
+
+      return miss;
+    }
+  };
+
+  cache_stats simulate_vertex_cache(const index_list_t& indices,
+                                    size_t num_vertices,
+                                    uint32_t cache_size,
+                                    cache_model model) {
+    cache_stats stats{};
+
+    if (c_assert(indices.size() % 3 == 0) &&
+        c_assert(cache_size > 0)) {
+      cache_sim cache(num_vertices, cache_size, model);
+
+      darray<bool> referenced(num_vertices, false);
+
+      for (index_t i: indices) {
+        if (c_assert(i < num_vertices)) {
+          if (cache.access(i)) {
+            stats.num_misses++;
+          }
+
+          if (!referenced[i]) {
+            referenced[i] = true;
+            stats.num_vertices++;
+          }
+        }
+      }
+
+      stats.num_triangles = static_cast<uint32_t>(indices.size() / 3);
+    }
+
+    return stats;
+  }
+
+  //
+  // vertex cache optimization
+  //
+  // See Tom Forsyth, "Linear-Speed Vertex Cache Optimisation" (2006).
+  // Scores favor vertices that are in the cache (but not the ones
+  // just used by the last triangle), and vertices with few remaining
+  // triangles, so that stragglers are finished off early.
+  //
+
+  static constexpr real_t k_cache_decay_power = R(1.5);
+  static constexpr real_t k_last_tri_score = R(0.75);
+  static constexpr real_t k_valence_boost_scale = R(2.0);
+  static constexpr real_t k_valence_boost_power = R(0.5);
+
+  static constexpr int32_t k_not_cached = -1;
+
+  static real_t forsyth_vertex_score(int32_t cache_position, uint32_t remaining_tris) {
+    real_t score = R(-1);
+
+    if (remaining_tris > 0) {
+      score = R(0);
+
+      if (cache_position >= 0) {
+        if (cache_position < 3) {
+          score = k_last_tri_score;
+        }
+        else {
+          ASSERT(cache_position < I(k_forsyth_cache_size));
+
+          const real_t scaler = R(1) / R(k_forsyth_cache_size - 3);
+
+          score = R(1) - R(cache_position - 3) * scaler;
+          score = std::pow(score, k_cache_decay_power);
+        }
+      }
+
+      score += k_valence_boost_scale *
+        std::pow(R(remaining_tris), -k_valence_boost_power);
+    }
+
+    return score;
+  }
+
+  index_list_t optimize_vertex_cache(const index_list_t& indices,
+                                     size_t num_vertices) {
+    if (!c_assert(indices.size() % 3 == 0) || indices.empty()) {
+      return indices;
+    }
+
+    const size_t num_tris = indices.size() / 3;
+
+    // vertex -> triangle adjacency, stored contiguously
+    darray<uint32_t> remaining(num_vertices, 0);
+
+    for (index_t i: indices) {
+      ASSERT(i < num_vertices);
+      remaining[i]++;
+    }
+
+    darray<uint32_t> adj_offsets(num_vertices + 1, 0);
+
+    for (size_t v = 0; v < num_vertices; ++v) {
+      adj_offsets[v + 1] = adj_offsets[v] + remaining[v];
+    }
+
+    darray<uint32_t> adj_tris(indices.size(), 0);
+
+    {
+      darray<uint32_t> fill(adj_offsets.begin(), adj_offsets.end() - 1);
+
+      for (size_t t = 0; t < num_tris; ++t) {
+        for (size_t k = 0; k < 3; ++k) {
+          adj_tris[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+      }
+    }
+
+    darray<int32_t> cache_positions(num_vertices, k_not_cached);
+    darray<real_t> vertex_scores(num_vertices, R(0));
+
+    for (size_t v = 0; v < num_vertices; ++v) {
+      vertex_scores[v] = forsyth_vertex_score(k_not_cached, remaining[v]);
+    }
+
+    darray<real_t> tri_scores(num_tris, R(0));
+    darray<bool> emitted(num_tris, false);
+
+    for (size_t t = 0; t < num_tris; ++t) {
+      tri_scores[t] =
+        vertex_scores[indices[t * 3 + 0]] +
+        vertex_scores[indices[t * 3 + 1]] +
+        vertex_scores[indices[t * 3 + 2]];
+    }
+
+    auto best_linear = [&](size_t start) -> size_t {
+      size_t best = num_tris;
+      real_t best_score = R(-1);
+      for (size_t t = start; t < num_tris; ++t) {
+        if (!emitted[t] && tri_scores[t] > best_score) {
+          best_score = tri_scores[t];
+          best = t;
+        }
+      }
+      return best;
+    };
+
+    index_list_t ret{};
+    ret.reserve(indices.size());
+
+    // + 3, since the newest triangle is pushed
+    // onto the front before the tail is trimmed
+    darray<index_t> cache{};
+    darray<index_t> next_cache{};
+    cache.reserve(k_forsyth_cache_size + 3);
+    next_cache.reserve(k_forsyth_cache_size + 3);
+
+    size_t linear_cursor = 0;
+    size_t best_tri = best_linear(0);
+
+    while (best_tri != num_tris) {
+      emitted[best_tri] = true;
+
+      const index_t* tri = &indices[best_tri * 3];
+
+      for (size_t k = 0; k < 3; ++k) {
+        index_t v = tri[k];
+
+        ret.push_back(v);
+
+        // remove the triangle from v's live adjacency range
+        uint32_t* begin = &adj_tris[adj_offsets[v]];
+        uint32_t* end = begin + remaining[v];
+        uint32_t* it = std::find(begin, end, static_cast<uint32_t>(best_tri));
+
+        ASSERT(it != end);
+
+        std::swap(*it, *(end - 1));
+        remaining[v]--;
+      }
+
+      // rebuild the cache with this triangle's
+      // vertices at the front
+      next_cache.clear();
+      next_cache.insert(next_cache.end(), tri, tri + 3);
+
+      for (index_t v: cache) {
+        if (v != tri[0] && v != tri[1] && v != tri[2]) {
+          next_cache.push_back(v);
+        }
+      }
+
+      for (size_t i = 0; i < next_cache.size(); ++i) {
+        index_t v = next_cache[i];
+
+        cache_positions[v] =
+          i < k_forsyth_cache_size
+          ? static_cast<int32_t>(i)
+          : k_not_cached;
+
+        vertex_scores[v] = forsyth_vertex_score(cache_positions[v], remaining[v]);
+      }
+
+      // rescore every triangle touching the (old and new) cache,
+      // and pick the best of them for the next iteration
+      best_tri = num_tris;
+      real_t best_score = R(-1);
+
+      for (index_t v: next_cache) {
+        for (uint32_t a = 0; a < remaining[v]; ++a) {
+          uint32_t t = adj_tris[adj_offsets[v] + a];
+
+          tri_scores[t] =
+            vertex_scores[indices[t * 3 + 0]] +
+            vertex_scores[indices[t * 3 + 1]] +
+            vertex_scores[indices[t * 3 + 2]];
+
+          if (tri_scores[t] > best_score) {
+            best_score = tri_scores[t];
+            best_tri = t;
+          }
+        }
+      }
+
+      if (next_cache.size() > k_forsyth_cache_size) {
+        next_cache.resize(k_forsyth_cache_size);
+      }
+
+      std::swap(cache, next_cache);
+
+      // nothing adjacent to the cache is left,
+      // so continue on from wherever the mesh still has triangles.
+      if (best_tri == num_tris) {
+        while (linear_cursor < num_tris && emitted[linear_cursor]) {
+          linear_cursor++;
+        }
+
+        best_tri = best_linear(linear_cursor);
+      }
+    }
+
+    ASSERT(ret.size() == indices.size());
+
+    return ret;
+  }
+
+  //
+  // overdraw optimization
+  //
+  // Based on Sander, Nehab and Barczak, "Fast Triangle Reordering for
+  // Vertex Locality and Reduced Overdraw" (2007).
+  //
+  // Hard boundaries are triangles that miss on all three vertices:
+  // splitting there costs nothing in cache efficiency. Each hard cluster
+  // is then split again wherever the running ACMR dips below the cluster's
+  // ACMR scaled by threshold. Clusters are finally sorted by how much they
+  // face away from the mesh's centroid, so outer surfaces get drawn first
+  // and occlude what's behind them.
+  //
+
+  static darray<uint32_t> overdraw_hard_boundaries(const index_list_t& indices,
+                                                   size_t num_vertices) {
+    darray<uint32_t> boundaries{};
+
+    cache_sim cache(num_vertices, k_sim_cache_size, cache_model::fifo);
+
+    const size_t num_tris = indices.size() / 3;
+
+    for (size_t t = 0; t < num_tris; ++t) {
+      uint32_t misses = 0;
+
+      for (size_t k = 0; k < 3; ++k) {
+        misses += cache.access(indices[t * 3 + k]) ? 1 : 0;
+      }
+
+      if (t == 0 || misses == 3) {
+        boundaries.push_back(static_cast<uint32_t>(t));
+      }
+    }
+
+    boundaries.push_back(static_cast<uint32_t>(num_tris));
+
+    return boundaries;
+  }
+
+  static darray<uint32_t> overdraw_soft_boundaries(const index_list_t& indices,
+                                                   size_t num_vertices,
+                                                   const darray<uint32_t>& hard,
+                                                   real_t threshold) {
+    darray<uint32_t> boundaries{};
+
+    cache_sim cache(num_vertices, k_sim_cache_size, cache_model::fifo);
+
+    auto tri_misses = [&cache, &indices](size_t t) -> uint32_t {
+      uint32_t misses = 0;
+      for (size_t k = 0; k < 3; ++k) {
+        misses += cache.access(indices[t * 3 + k]) ? 1 : 0;
+      }
+      return misses;
+    };
+
+    for (size_t c = 0; c + 1 < hard.size(); ++c) {
+      const uint32_t start = hard[c];
+      const uint32_t end = hard[c + 1];
+
+      cache.reset();
+
+      uint32_t cluster_misses = 0;
+
+      for (uint32_t t = start; t < end; ++t) {
+        cluster_misses += tri_misses(t);
+      }
+
+      const real_t cluster_threshold =
+        threshold * R(cluster_misses) / R(end - start);
+
+      cache.reset();
+
+      boundaries.push_back(start);
+
+      uint32_t running_misses = 0;
+      uint32_t running_tris = 0;
+
+      for (uint32_t t = start; t < end; ++t) {
+        running_misses += tri_misses(t);
+        running_tris++;
+
+        if (t + 1 < end &&
+            R(running_misses) / R(running_tris) <= cluster_threshold) {
+          boundaries.push_back(t + 1);
+
+          cache.reset();
+
+          running_misses = 0;
+          running_tris = 0;
+        }
+      }
+    }
+
+    boundaries.push_back(hard.back());
+
+    return boundaries;
+  }
+
+  index_list_t optimize_overdraw(const index_list_t& indices,
+                                 const darray<vec3_t>& positions,
+                                 real_t threshold,
+                                 uint32_t* out_num_clusters) {
+    if (!c_assert(indices.size() % 3 == 0) || indices.empty()) {
+      return indices;
+    }
+
+    const size_t num_vertices = positions.size();
+
+    darray<uint32_t> clusters =
+      overdraw_soft_boundaries(indices,
+                               num_vertices,
+                               overdraw_hard_boundaries(indices, num_vertices),
+                               threshold);
+
+    const size_t num_clusters = clusters.size() - 1;
+
+    if (out_num_clusters != nullptr) {
+      *out_num_clusters = static_cast<uint32_t>(num_clusters);
+    }
+
+    // area weighted centroid for the whole mesh
+    // and area weighted centroids/normals per cluster
+    vec3_t mesh_centroid{R(0)};
+    real_t mesh_area = R(0);
+
+    darray<vec3_t> cluster_centroids(num_clusters, vec3_t{R(0)});
+    darray<vec3_t> cluster_normals(num_clusters, vec3_t{R(0)});
+
+    for (size_t c = 0; c < num_clusters; ++c) {
+      real_t cluster_area = R(0);
+
+      for (uint32_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+        const vec3_t& a = positions.at(indices[t * 3 + 0]);
+        const vec3_t& b = positions.at(indices[t * 3 + 1]);
+        const vec3_t& p = positions.at(indices[t * 3 + 2]);
+
+        vec3_t n{glm::cross(b - a, p - a)};
+        real_t area = glm::length(n);
+
+        vec3_t centroid{(a + b + p) / R(3)};
+
+        cluster_centroids[c] += centroid * area;
+        cluster_normals[c] += n;
+        cluster_area += area;
+
+        mesh_centroid += centroid * area;
+        mesh_area += area;
+      }
+
+      if (cluster_area > R(0)) {
+        cluster_centroids[c] /= cluster_area;
+      }
+
+      real_t nlen = glm::length(cluster_normals[c]);
+
+      if (nlen > R(0)) {
+        cluster_normals[c] /= nlen;
+      }
+    }
+
+    if (mesh_area > R(0)) {
+      mesh_centroid /= mesh_area;
+    }
+
+    darray<real_t> sort_keys(num_clusters, R(0));
+    darray<uint32_t> order(num_clusters, 0);
+
+    for (size_t c = 0; c < num_clusters; ++c) {
+      sort_keys[c] = glm::dot(cluster_centroids[c] - mesh_centroid, cluster_normals[c]);
+      order[c] = static_cast<uint32_t>(c);
+    }
+
+    // stable, so equal keys keep their
+    // cache-optimized order and results are deterministic
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&sort_keys](uint32_t a, uint32_t b) {
+                       return sort_keys[a] > sort_keys[b];
+                     });
+
+    index_list_t ret{};
+    ret.reserve(indices.size());
+
+    for (uint32_t c: order) {
+      ret.insert(ret.end(),
+                 indices.begin() + clusters[c] * 3,
+                 indices.begin() + clusters[c + 1] * 3);
+    }
+
+    return ret;
+  }
+
+  //
+  // vertex fetch optimization
+  //
+
+  uint32_t make_vertex_fetch_remap(index_list_t& indices,
+                                   size_t num_vertices,
+                                   index_list_t& remap) {
+    remap.assign(num_vertices, unset<index_t>());
+
+    uint32_t next = 0;
+
+    for (index_t& i: indices) {
+      ASSERT(i < num_vertices);
+
+      if (remap[i] == unset<index_t>()) {
+        remap[i] = next++;
+      }
+
+      i = remap[i];
+    }
+
+    return next;
+  }
+}
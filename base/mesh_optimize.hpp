@@ -0,0 +1,273 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <string.h>
+#include <unordered_map>
+#include <string>
+
+//
+// Offline mesh optimization.
+//
+// Everything in here is meant to run when a mesh is built or baked,
+// never per frame. The usual order of operations is:
+//
+// 1) make_indexed(): weld a triangle soup (which is what mesh_builder
+//    and module_models produce) into a unique vertex list plus indices.
+//
+// 2) optimize_vertex_cache(): reorder triangles so that the post-transform
+//    vertex cache gets as many hits as possible (Forsyth's linear-speed
+//    algorithm).
+//
+// 3) optimize_overdraw(): split the cache-optimized triangle list into
+//    clusters along cache boundaries and sort the clusters so that
+//    outward facing ones are drawn first. Triangle order within each
+//    cluster is left alone, so the cache gains from 2) mostly survive.
+//
+// 4) optimize_vertex_fetch(): reorder the vertex list itself in order of
+//    first use, which improves locality for the vertex fetch/pre-transform
+//    cache and drops unreferenced vertices.
+//
+// simulate_vertex_cache() is a CPU-side model of the post-transform cache,
+// so the above can be measured without a GPU. ACMR is cache misses per
+// triangle (0.5 is the theoretical best for a large regular grid, 3 is the worst);
+// ATVR is cache misses per unique vertex (1.0 is the best possible).
+//
+
+namespace mesh_optimize {
+  using index_t = uint32_t;
+  using index_list_t = darray<index_t>;
+
+  enum class cache_model {
+    fifo,
+    lru
+  };
+
+  // Most desktop hardware behaves roughly like a FIFO
+  // with somewhere between 16 and 32 entries.
+  static inline constexpr uint32_t k_sim_cache_size = 16;
+
+  static inline constexpr uint32_t k_forsyth_cache_size = 32;
+
+  // Clusters whose ACMR is within this factor of the
+  // unsplit ACMR are allowed to be split off for overdraw sorting.
+  static inline constexpr real_t k_overdraw_threshold = R(1.05);
+
+  struct cache_stats {
+    uint32_t num_triangles{0};
+    uint32_t num_vertices{0};
+    uint32_t num_misses{0};
+
+    real_t acmr() const {
+      return num_triangles != 0 ? R(num_misses) / R(num_triangles) : R(0);
+    }
+
+    real_t atvr() const {
+      return num_vertices != 0 ? R(num_misses) / R(num_vertices) : R(0);
+    }
+
+    std::string to_string(const std::string& prefix = "cache_stats") const {
+      std::stringstream ss;
+      ss << prefix << ": { "
+         << AS_STRING_SS(num_triangles) SEP_SS
+        AS_STRING_SS(num_vertices) SEP_SS
+        AS_STRING_SS(num_misses) SEP_SS
+        "acmr: " << acmr() SEP_SS
+        "atvr: " << atvr() << " }";
+      return ss.str();
+    }
+  };
+
+  // before/after numbers for a full optimize() run
+  struct report {
+    cache_stats before{};
+    cache_stats after{};
+
+    uint32_t num_soup_vertices{0};
+    uint32_t num_clusters{0};
+
+    std::string to_string(const std::string& prefix = "mesh_optimize::report") const {
+      std::stringstream ss;
+      ss << prefix << ": { "
+         << AS_STRING_SS(num_soup_vertices) SEP_SS
+        AS_STRING_SS(num_clusters) SEP_SS
+        before.to_string("before") SEP_SS
+        after.to_string("after") << " }";
+      return ss.str();
+    }
+  };
+
+  template <class vertexType>
+  struct indexed_mesh {
+    darray<vertexType> vertices{};
+    index_list_t indices{};
+
+    uint32_t num_triangles() const {
+      return static_cast<uint32_t>(indices.size() / 3);
+    }
+  };
+
+  //
+  // Vertices are compared bitwise, so this only
+  // welds vertices whose attributes are exactly equal;
+  // seams (differing normals or uvs) are preserved.
+  //
+  template <class vertexType>
+  struct vertex_bits_hash {
+    static_assert(std::is_trivially_copyable<vertexType>::value,
+                  "vertices must be trivially copyable to be hashed bitwise");
+
+    size_t operator()(const vertexType& v) const {
+      // FNV-1a
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&v);
+      uint64_t h = 14695981039346656037ull;
+      for (size_t i = 0; i < sizeof(vertexType); ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+      }
+      return static_cast<size_t>(h);
+    }
+  };
+
+  template <class vertexType>
+  struct vertex_bits_equal {
+    bool operator()(const vertexType& a, const vertexType& b) const {
+      return memcmp(&a, &b, sizeof(vertexType)) == 0;
+    }
+  };
+
+  template <class vertexType>
+  indexed_mesh<vertexType> make_indexed(const darray<vertexType>& soup) {
+    indexed_mesh<vertexType> ret{};
+
+    ASSERT(soup.size() % 3 == 0);
+
+    std::unordered_map<vertexType,
+                       index_t,
+                       vertex_bits_hash<vertexType>,
+                       vertex_bits_equal<vertexType>> unique{};
+
+    unique.reserve(soup.size());
+    ret.indices.reserve(soup.size());
+
+    for (const vertexType& v: soup) {
+      auto [it, inserted] = unique.try_emplace(v, static_cast<index_t>(ret.vertices.size()));
+      if (inserted) {
+        ret.vertices.push_back(v);
+      }
+      ret.indices.push_back(it->second);
+    }
+
+    return ret;
+  }
+
+  // inverse of make_indexed
+  template <class vertexType>
+  darray<vertexType> make_soup(const indexed_mesh<vertexType>& mesh) {
+    darray<vertexType> ret{};
+    ret.reserve(mesh.indices.size());
+    for (index_t i: mesh.indices) {
+      ret.push_back(mesh.vertices.at(i));
+    }
+    return ret;
+  }
+
+  cache_stats simulate_vertex_cache(const index_list_t& indices,
+                                    size_t num_vertices,
+                                    uint32_t cache_size = k_sim_cache_size,
+                                    cache_model model = cache_model::fifo);
+
+  index_list_t optimize_vertex_cache(const index_list_t& indices,
+                                     size_t num_vertices);
+
+  // positions are indexed by the values in indices.
+  // out_num_clusters is optional.
+  index_list_t optimize_overdraw(const index_list_t& indices,
+                                 const darray<vec3_t>& positions,
+                                 real_t threshold = k_overdraw_threshold,
+                                 uint32_t* out_num_clusters = nullptr);
+
+  // Produces a remap table, where remap[old_vertex] = new_vertex,
+  // and rewrites indices in place. Unreferenced vertices are mapped to
+  // unset<index_t>(). Returns the number of referenced vertices.
+  uint32_t make_vertex_fetch_remap(index_list_t& indices,
+                                   size_t num_vertices,
+                                   index_list_t& remap);
+
+  template <class vertexType>
+  void optimize_vertex_fetch(indexed_mesh<vertexType>& mesh) {
+    index_list_t remap{};
+
+    uint32_t count = make_vertex_fetch_remap(mesh.indices,
+                                             mesh.vertices.size(),
+                                             remap);
+
+    darray<vertexType> vertices(count);
+
+    for (size_t i = 0; i < remap.size(); ++i) {
+      if (remap[i] != unset<index_t>()) {
+        vertices[remap[i]] = mesh.vertices[i];
+      }
+    }
+
+    mesh.vertices = std::move(vertices);
+  }
+
+  template <class vertexType>
+  darray<vec3_t> positions_of(const darray<vertexType>& vertices) {
+    darray<vec3_t> ret{};
+    ret.reserve(vertices.size());
+    for (const vertexType& v: vertices) {
+      ret.push_back(v.position);
+    }
+    return ret;
+  }
+
+  template <class vertexType>
+  cache_stats simulate_vertex_cache(const indexed_mesh<vertexType>& mesh,
+                                    uint32_t cache_size = k_sim_cache_size,
+                                    cache_model model = cache_model::fifo) {
+    return simulate_vertex_cache(mesh.indices,
+                                 mesh.vertices.size(),
+                                 cache_size,
+                                 model);
+  }
+
+  // runs every pass, in the order given at the top of this file.
+  template <class vertexType>
+  report optimize(indexed_mesh<vertexType>& mesh) {
+    report r{};
+
+    r.before = simulate_vertex_cache(mesh);
+
+    mesh.indices = optimize_vertex_cache(mesh.indices,
+                                         mesh.vertices.size());
+
+    mesh.indices = optimize_overdraw(mesh.indices,
+                                     positions_of(mesh.vertices),
+                                     k_overdraw_threshold,
+                                     &r.num_clusters);
+
+    optimize_vertex_fetch(mesh);
+
+    r.after = simulate_vertex_cache(mesh);
+
+    return r;
+  }
+
+  // convenience for triangle soups, e.g. mesh_builder::vertices
+  template <class vertexType>
+  indexed_mesh<vertexType> optimize(const darray<vertexType>& soup,
+                                    report* out_report = nullptr) {
+    indexed_mesh<vertexType> mesh{make_indexed(soup)};
+
+    report r{optimize(mesh)};
+    r.num_soup_vertices = static_cast<uint32_t>(soup.size());
+
+    if (out_report != nullptr) {
+      *out_report = r;
+    }
+
+    return mesh;
+  }
+}
@@ -0,0 +1,449 @@
+#include "mesh_simplify.hpp"
+
+#include <cmath>
+
+namespace mesh_simplify {
+  //
+  // Symmetric 4x4 quadric, stored as the upper 3x3 (a),
+  // the linear term (b), the constant term (c) and the
+  // accumulated weight (w). Error for a point p is
+  // p^T a p + 2 b.p + c, divided by w so that it's an area
+  // weighted mean squared distance.
+  //
+  struct quadric {
+    double a00{0}, a11{0}, a22{0};
+    double a01{0}, a02{0}, a12{0};
+    double b0{0}, b1{0}, b2{0};
+    double c{0};
+    double w{0};
+
+    quadric& operator += (const quadric& q) {
+      a00 += q.a00; a11 += q.a11; a22 += q.a22;
+      a01 += q.a01; a02 += q.a02; a12 += q.a12;
+      b0 += q.b0; b1 += q.b1; b2 += q.b2;
+      c += q.c;
+      w += q.w;
+      return *this;
+    }
+
+    // plane: dot(n, p) + d = 0
+    static quadric from_plane(double nx, double ny, double nz, double d, double weight) {
+      quadric q{};
+      q.a00 = weight * nx * nx;
+      q.a11 = weight * ny * ny;
+      q.a22 = weight * nz * nz;
+      q.a01 = weight * nx * ny;
+      q.a02 = weight * nx * nz;
+      q.a12 = weight * ny * nz;
+      q.b0 = weight * nx * d;
+      q.b1 = weight * ny * d;
+      q.b2 = weight * nz * d;
+      q.c = weight * d * d;
+      q.w = weight;
+      return q;
+    }
+
+    double error(const vec3_t& p) const {
+      double x = p.x, y = p.y, z = p.z;
+
+      double r =
+        a00 * x * x + a11 * y * y + a22 * z * z +
+        2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+        2.0 * (b0 * x + b1 * y + b2 * z) +
+        c;
+
+      return std::abs(r) / (w > 0.0 ? w : 1.0);
+    }
+  };
+
+  static inline quadric operator + (quadric a, const quadric& b) {
+    a += b;
+    return a;
+  }
+
+  static inline uint64_t edge_key(index_t a, index_t b) {
+    if (a > b) {
+      std::swap(a, b);
+    }
+    return (static_cast<uint64_t>(a) << 32) | static_cast<uint64_t>(b);
+  }
+
+  struct collapse {
+    index_t from;
+    index_t to;
+    double error;
+
+    bool operator < (const collapse& c) const {
+      // ties are broken by index, so the order is total
+      // and the result never depends on sort stability
+      if (error != c.error) return error < c.error;
+      if (from != c.from) return from < c.from;
+      return to < c.to;
+    }
+  };
+
+  //
+  // position welding:
+  // pos_ids[v] is the first vertex with v's exact position.
+  // Vertices in the same position group but with differing
+  // attributes form a seam.
+  //
+
+  static darray<index_t> make_position_ids(const darray<vec3_t>& positions) {
+    struct hash {
+      size_t operator()(const vec3_t& v) const {
+        return mesh_optimize::vertex_bits_hash<vec3_t>{}(v);
+      }
+    };
+
+    std::unordered_map<vec3_t,
+                       index_t,
+                       hash,
+                       mesh_optimize::vertex_bits_equal<vec3_t>> first{};
+
+    first.reserve(positions.size());
+
+    darray<index_t> ids(positions.size(), 0);
+
+    for (size_t i = 0; i < positions.size(); ++i) {
+      auto [it, inserted] = first.try_emplace(positions[i], static_cast<index_t>(i));
+      ids[i] = it->second;
+    }
+
+    return ids;
+  }
+
+  real_t mesh_extent(const darray<vec3_t>& positions) {
+    real_t extent = R(0);
+
+    if (!positions.empty()) {
+      vec3_t lo{positions[0]};
+      vec3_t hi{positions[0]};
+
+      for (const vec3_t& p: positions) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+      }
+
+      vec3_t d{hi - lo};
+
+      extent = std::max(d.x, std::max(d.y, d.z));
+    }
+
+    return extent;
+  }
+
+  static bool triangle_flips(const vec3_t& a, const vec3_t& b, const vec3_t& c,
+                             const vec3_t& new_a) {
+    vec3_t n0{glm::cross(b - a, c - a)};
+    vec3_t n1{glm::cross(b - new_a, c - new_a)};
+
+    // also rejects triangles which become degenerate
+    return glm::dot(n0, n1) <= R(1e-2) * glm::length(n0) * glm::length(n1);
+  }
+
+  index_list_t simplify(const index_list_t& indices,
+                        const darray<vec3_t>& positions,
+                        const params& p,
+                        real_t* out_error) {
+    index_list_t result{indices};
+
+    real_t result_error = R(0);
+
+    const size_t num_vertices = positions.size();
+
+    const real_t extent = mesh_extent(positions);
+
+    if (c_assert(indices.size() % 3 == 0) &&
+        !indices.empty() &&
+        extent > R(0)) {
+      const darray<index_t> pos_ids{make_position_ids(positions)};
+
+      // quadrics are accumulated per position group
+      darray<quadric> quadrics(num_vertices);
+
+      darray<uint32_t> group_sizes(num_vertices, 0);
+
+      for (size_t v = 0; v < num_vertices; ++v) {
+        group_sizes[pos_ids[v]]++;
+      }
+
+      std::unordered_map<uint64_t, uint32_t> edge_counts{};
+
+      for (size_t t = 0; t < indices.size(); t += 3) {
+        index_t pa = pos_ids[indices[t + 0]];
+        index_t pb = pos_ids[indices[t + 1]];
+        index_t pc = pos_ids[indices[t + 2]];
+
+        const vec3_t& a = positions[pa];
+        const vec3_t& b = positions[pb];
+        const vec3_t& c = positions[pc];
+
+        vec3_t n{glm::cross(b - a, c - a)};
+        real_t len = glm::length(n);
+
+        if (len > R(0)) {
+          n /= len;
+
+          quadric q{quadric::from_plane(n.x, n.y, n.z,
+                                        -glm::dot(n, a),
+                                        R(0.5) * len)};
+
+          quadrics[pa] += q;
+          quadrics[pb] += q;
+          quadrics[pc] += q;
+        }
+
+        edge_counts[edge_key(pa, pb)]++;
+        edge_counts[edge_key(pb, pc)]++;
+        edge_counts[edge_key(pc, pa)]++;
+      }
+
+      // seams and open borders are never moved
+      darray<bool> locked(num_vertices, false);
+
+      for (size_t v = 0; v < num_vertices; ++v) {
+        locked[v] = group_sizes[pos_ids[v]] > 1;
+      }
+
+      for (const auto& [key, count]: edge_counts) {
+        if (count != 2) {
+          locked[static_cast<index_t>(key >> 32)] = true;
+          locked[static_cast<index_t>(key & 0xFFFFFFFF)] = true;
+        }
+      }
+
+      for (size_t v = 0; v < num_vertices; ++v) {
+        if (locked[pos_ids[v]]) {
+          locked[v] = true;
+        }
+      }
+
+      // errors are compared squared, relative to the extent
+      const double max_error_sq =
+        static_cast<double>(p.max_error) * static_cast<double>(p.max_error) *
+        static_cast<double>(extent) * static_cast<double>(extent);
+
+      double worst_error_sq = 0.0;
+
+      darray<collapse> candidates{};
+      darray<uint64_t> edges{};
+      darray<uint32_t> adj_offsets{};
+      darray<uint32_t> adj_tris{};
+      darray<bool> touched(num_vertices, false);
+      darray<index_t> remap(num_vertices, 0);
+
+      bool progress = true;
+
+      while (progress && result.size() / 3 > p.target_triangles) {
+        progress = false;
+
+        const size_t num_tris = result.size() / 3;
+
+        // vertex -> triangle adjacency for the current indices
+        adj_offsets.assign(num_vertices + 1, 0);
+
+        for (index_t i: result) {
+          adj_offsets[i + 1]++;
+        }
+
+        for (size_t v = 0; v < num_vertices; ++v) {
+          adj_offsets[v + 1] += adj_offsets[v];
+        }
+
+        adj_tris.assign(result.size(), 0);
+
+        {
+          darray<uint32_t> fill(adj_offsets.begin(), adj_offsets.end() - 1);
+
+          for (size_t t = 0; t < num_tris; ++t) {
+            for (size_t k = 0; k < 3; ++k) {
+              adj_tris[fill[result[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+          }
+        }
+
+        // unique edges, in both directions
+        edges.clear();
+
+        for (size_t t = 0; t < result.size(); t += 3) {
+          for (size_t k = 0; k < 3; ++k) {
+            index_t a = result[t + k];
+            index_t b = result[t + ((k + 1) % 3)];
+
+            if (pos_ids[a] != pos_ids[b]) {
+              edges.push_back(edge_key(a, b));
+            }
+          }
+        }
+
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        candidates.clear();
+
+        for (uint64_t e: edges) {
+          index_t a = static_cast<index_t>(e >> 32);
+          index_t b = static_cast<index_t>(e & 0xFFFFFFFF);
+
+          quadric q{quadrics[pos_ids[a]] + quadrics[pos_ids[b]]};
+
+          if (!locked[a]) {
+            candidates.push_back({a, b, q.error(positions[b])});
+          }
+
+          if (!locked[b]) {
+            candidates.push_back({b, a, q.error(positions[a])});
+          }
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+
+        // each collapse removes (roughly) two triangles
+        const size_t budget = (num_tris - p.target_triangles + 1) / 2;
+
+        size_t applied = 0;
+
+        std::fill(touched.begin(), touched.end(), false);
+
+        for (size_t v = 0; v < num_vertices; ++v) {
+          remap[v] = static_cast<index_t>(v);
+        }
+
+        for (const collapse& c: candidates) {
+          if (applied >= budget || c.error > max_error_sq) {
+            break;
+          }
+
+          if (touched[c.from] || touched[c.to]) {
+            continue;
+          }
+
+          bool flips = false;
+
+          for (uint32_t i = adj_offsets[c.from]; i < adj_offsets[c.from + 1] && !flips; ++i) {
+            const index_t* tri = &result[adj_tris[i] * 3];
+
+            bool collapses =
+              pos_ids[tri[0]] == pos_ids[c.to] ||
+              pos_ids[tri[1]] == pos_ids[c.to] ||
+              pos_ids[tri[2]] == pos_ids[c.to];
+
+            if (!collapses) {
+              // rotate so that c.from is first
+              size_t k = tri[0] == c.from ? 0 : (tri[1] == c.from ? 1 : 2);
+
+              flips = triangle_flips(positions[tri[k]],
+                                     positions[tri[(k + 1) % 3]],
+                                     positions[tri[(k + 2) % 3]],
+                                     positions[c.to]);
+            }
+          }
+
+          if (!flips) {
+            remap[c.from] = c.to;
+
+            quadrics[pos_ids[c.to]] += quadrics[pos_ids[c.from]];
+
+            // everything sharing a triangle with c.from
+            // is off limits for the rest of this pass, so that
+            // no triangle has two of its vertices moved at once.
+            for (uint32_t i = adj_offsets[c.from]; i < adj_offsets[c.from + 1]; ++i) {
+              const index_t* tri = &result[adj_tris[i] * 3];
+              touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+
+            touched[c.to] = true;
+
+            worst_error_sq = std::max(worst_error_sq, c.error);
+
+            applied++;
+          }
+        }
+
+        if (applied > 0) {
+          progress = true;
+
+          size_t write = 0;
+
+          for (size_t t = 0; t < result.size(); t += 3) {
+            index_t a = remap[result[t + 0]];
+            index_t b = remap[result[t + 1]];
+            index_t c = remap[result[t + 2]];
+
+            bool degenerate =
+              pos_ids[a] == pos_ids[b] ||
+              pos_ids[b] == pos_ids[c] ||
+              pos_ids[c] == pos_ids[a];
+
+            if (!degenerate) {
+              result[write + 0] = a;
+              result[write + 1] = b;
+              result[write + 2] = c;
+              write += 3;
+            }
+          }
+
+          result.resize(write);
+        }
+      }
+
+      result_error = R(std::sqrt(worst_error_sq)) / extent;
+    }
+
+    if (out_error != nullptr) {
+      *out_error = result_error;
+    }
+
+    return result;
+  }
+
+  darray<lod> make_lod_chain(const index_list_t& indices,
+                             const darray<vec3_t>& positions,
+                             const lod_chain_params& p) {
+    darray<lod> chain{};
+
+    const index_list_t* prev = &indices;
+
+    for (uint32_t level = 0; level < p.max_levels; ++level) {
+      const uint32_t prev_tris = static_cast<uint32_t>(prev->size() / 3);
+
+      params sp{};
+      sp.target_triangles = static_cast<uint32_t>(R(prev_tris) * p.ratio_per_level);
+      sp.max_error = p.max_error;
+
+      if (sp.target_triangles < p.min_triangles) {
+        break;
+      }
+
+      lod l{};
+      l.indices = simplify(*prev, positions, sp, &l.error);
+
+      // errors accumulate across levels, since each
+      // level is simplified from the one before it
+      if (!chain.empty()) {
+        l.error += chain.back().error;
+      }
+
+      // stop once the simplifier can't make meaningful progress,
+      // e.g. when everything that's left is a seam or border
+      const uint32_t tris = l.num_triangles();
+
+      if (tris < p.min_triangles ||
+          R(tris) > R(prev_tris) * R(0.95) ||
+          l.error > p.max_error) {
+        break;
+      }
+
+      if (p.optimize_vertex_cache) {
+        l.indices = mesh_optimize::optimize_vertex_cache(l.indices, positions.size());
+      }
+
+      chain.push_back(std::move(l));
+
+      prev = &chain.back().indices;
+    }
+
+    return chain;
+  }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "common.hpp"
+#include "mesh_optimize.hpp"
+#include "parallel.hpp"
+
+//
+// Quadric error metric mesh simplification.
+//
+// See Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics" (1997).
+//
+// This variant only ever collapses an edge onto one of its existing
+// endpoints, so no new vertices are produced: a simplified mesh is just
+// a new index list over the original vertex list. That has a few nice
+// consequences:
+//
+// - every LOD of a mesh can share one vertex range;
+// - vertex attributes never need to be interpolated;
+// - UV and normal seams (vertices which share a position but not
+//   other attributes) and open borders are preserved exactly, since vertices
+//   on either are never moved. Other vertices may still collapse onto them.
+//
+// Errors are reported relative to the mesh's extent, i.e. an error of 0.01
+// means the surface moved roughly 1% of the mesh's largest AABB dimension.
+//
+// Everything here is deterministic: the same input always produces the same output,
+// regardless of how many threads are used in make_lod_chains().
+//
+
+namespace mesh_simplify {
+  using mesh_optimize::index_t;
+  using mesh_optimize::index_list_t;
+
+  struct params {
+    // stop once the triangle count is at or below this
+    uint32_t target_triangles{0};
+    // never perform a collapse which exceeds this error
+    real_t max_error{R(0.01)};
+  };
+
+  struct lod_chain_params {
+    // not including the base mesh
+    uint32_t max_levels{3};
+    // each level aims for this fraction of the previous level's triangles
+    real_t ratio_per_level{R(0.5)};
+    // no level may exceed this error (relative to the base mesh)
+    real_t max_error{R(0.05)};
+    // levels with fewer triangles than this aren't generated
+    uint32_t min_triangles{8};
+    // run the vertex cache optimizer over each level's indices
+    bool optimize_vertex_cache{true};
+  };
+
+  struct lod {
+    index_list_t indices{};
+    real_t error{R(0)};
+
+    uint32_t num_triangles() const {
+      return static_cast<uint32_t>(indices.size() / 3);
+    }
+  };
+
+  // The largest dimension of the positions' AABB; errors are fractions of this.
+  real_t mesh_extent(const darray<vec3_t>& positions);
+
+  // Returns the simplified index list; out_error (optional) receives
+  // the largest error of any collapse performed.
+  index_list_t simplify(const index_list_t& indices,
+                        const darray<vec3_t>& positions,
+                        const params& p,
+                        real_t* out_error = nullptr);
+
+  // Level 0 is not included; each returned level is derived from the previous one.
+  darray<lod> make_lod_chain(const index_list_t& indices,
+                             const darray<vec3_t>& positions,
+                             const lod_chain_params& p);
+
+  template <class vertexType>
+  darray<lod> make_lod_chain(const mesh_optimize::indexed_mesh<vertexType>& mesh,
+                             const lod_chain_params& p = lod_chain_params{}) {
+    return make_lod_chain(mesh.indices,
+                          mesh_optimize::positions_of(mesh.vertices),
+                          p);
+  }
+
+  // One chain per mesh, computed across num_threads workers
+  // (0 means use every hardware thread).
+  template <class vertexType>
+  darray<darray<lod>> make_lod_chains(const darray<mesh_optimize::indexed_mesh<vertexType>>& meshes,
+                                      const lod_chain_params& p = lod_chain_params{},
+                                      uint32_t num_threads = 0) {
+    darray<darray<lod>> chains(meshes.size());
+
+    parallel_for(meshes.size(),
+                 [&chains, &meshes, &p](size_t i) {
+                   chains[i] = make_lod_chain(meshes[i], p);
+                 },
+                 num_threads);
+
+    return chains;
+  }
+}
@@ -0,0 +1,361 @@
+#include "meshlets.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+
+namespace meshlets {
+  using clock_type = std::chrono::steady_clock;
+
+  static real_t elapsed_ms(clock_type::time_point start) {
+    std::chrono::duration<double, std::milli> d = clock_type::now() - start;
+    return R(d.count());
+  }
+
+  // Normal cones wider than this (dot of the axis with the
+  // furthest normal) can't cull anything useful.
+  static constexpr real_t k_min_cone_dot = R(0.1);
+
+  static void compute_bounds(meshlet& m,
+                             const index_list_t& indices,
+                             const darray<index_t>& vertices,
+                             const darray<vec3_t>& positions) {
+    vec3_t bmin{positions[vertices[m.first_vertex]]};
+    vec3_t bmax{bmin};
+
+    for (uint32_t i = 0; i < m.vertex_count; ++i) {
+      const vec3_t& p = positions[vertices[m.first_vertex + i]];
+      bmin = glm::min(bmin, p);
+      bmax = glm::max(bmax, p);
+    }
+
+    m.center = (bmin + bmax) * R(0.5);
+    m.radius = R(0);
+
+    for (uint32_t i = 0; i < m.vertex_count; ++i) {
+      m.radius = std::max(m.radius, glm::length(positions[vertices[m.first_vertex + i]] - m.center));
+    }
+
+    darray<vec3_t> normals{};
+    normals.reserve(m.triangle_count);
+
+    vec3_t sum{R(0)};
+
+    for (uint32_t t = 0; t < m.triangle_count; ++t) {
+      const index_t* tri = indices.data() + m.first_index + t * 3;
+
+      vec3_t n{glm::cross(positions[tri[1]] - positions[tri[0]],
+                          positions[tri[2]] - positions[tri[0]])};
+
+      real_t len = glm::length(n);
+
+      // degenerate triangles don't face anywhere
+      if (len > R(0)) {
+        n = n / len;
+        normals.push_back(n);
+        sum += n;
+      }
+    }
+
+    real_t sum_len = glm::length(sum);
+
+    m.cone_axis = sum_len > R(0) ? sum / sum_len : V3_UP;
+    m.cone_cutoff = R(1);
+
+    if (sum_len > R(0)) {
+      real_t min_dot = R(1);
+
+      for (const vec3_t& n: normals) {
+        min_dot = std::min(min_dot, glm::dot(n, m.cone_axis));
+      }
+
+      if (min_dot > k_min_cone_dot) {
+        m.cone_cutoff = std::sqrt(R(1) - min_dot * min_dot);
+      }
+    }
+  }
+
+  meshlet_set build(const index_list_t& indices,
+                    const darray<vec3_t>& positions,
+                    uint32_t max_vertices,
+                    uint32_t max_triangles) {
+    meshlet_set ret{};
+
+    ASSERT(max_vertices >= 3);
+    ASSERT(max_triangles >= 1);
+
+    // stamp[v] == current meshlet's number means v is already in it
+    darray<uint32_t> stamp(positions.size(), num_max<uint32_t>());
+
+    meshlet current{};
+    uint32_t current_number = 0;
+
+    auto flush = [&]() {
+      if (current.triangle_count > 0) {
+        compute_bounds(current, indices, ret.vertices, positions);
+        ret.meshlets.push_back(current);
+      }
+
+      current_number++;
+
+      current = meshlet{};
+      current.first_vertex = static_cast<uint32_t>(ret.vertices.size());
+    };
+
+    flush();
+
+    const size_t num_triangles = indices.size() / 3;
+
+    for (size_t t = 0; t < num_triangles; ++t) {
+      const index_t* tri = indices.data() + t * 3;
+
+      auto is_new = [&](uint32_t k) {
+        return stamp[tri[k]] != current_number &&
+          (k < 1 || tri[k] != tri[0]) &&
+          (k < 2 || tri[k] != tri[1]);
+      };
+
+      uint32_t num_new = (is_new(0) ? 1 : 0) + (is_new(1) ? 1 : 0) + (is_new(2) ? 1 : 0);
+
+      if (current.vertex_count + num_new > max_vertices ||
+          current.triangle_count == max_triangles) {
+        flush();
+      }
+
+      if (current.triangle_count == 0) {
+        current.first_index = static_cast<uint32_t>(t * 3);
+      }
+
+      for (uint32_t k = 0; k < 3; ++k) {
+        if (stamp[tri[k]] != current_number) {
+          stamp[tri[k]] = current_number;
+          ret.vertices.push_back(tri[k]);
+          current.vertex_count++;
+        }
+      }
+
+      current.triangle_count++;
+    }
+
+    flush();
+
+    return ret;
+  }
+
+  cull_view cull_view::make(const mat4_t& mvp, const vec3_t& eye) {
+    cull_view v{};
+
+    // Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes
+    // from the World-View-Projection Matrix". The near plane assumes
+    // OpenGL's [-w, w] depth range, which is conservative for Vulkan's [0, w].
+    auto row = [&mvp](int r) {
+      return R4v(mvp[0][r], mvp[1][r], mvp[2][r], mvp[3][r]);
+    };
+
+    v.planes = {
+      row(3) + row(0), // left
+      row(3) - row(0), // right
+      row(3) + row(1), // bottom
+      row(3) - row(1), // top
+      row(3) + row(2), // near
+      row(3) - row(2)  // far
+    };
+
+    for (vec4_t& p: v.planes) {
+      real_t len = glm::length(vec3_t{p});
+      p = len > R(0) ? p / len : p;
+    }
+
+    v.eye = eye;
+
+    return v;
+  }
+
+  bool backfacing(const meshlet& m, const vec3_t& eye) {
+    vec3_t v{m.center - eye};
+
+    return m.cone_cutoff < R(1) &&
+      glm::dot(v, m.cone_axis) >= m.cone_cutoff * glm::length(v) + m.radius;
+  }
+
+  bool outside(const meshlet& m, const cull_view& view) {
+    bool ret = false;
+
+    for (size_t i = 0; i < view.planes.size() && !ret; ++i) {
+      const vec4_t& p = view.planes[i];
+      ret = glm::dot(vec3_t{p}, m.center) + p.w < -m.radius;
+    }
+
+    return ret;
+  }
+
+  void cull(const meshlet_set& set,
+            const cull_view& view,
+            darray<draw_range>& out,
+            cull_stats* stats) {
+    cull_stats s{};
+
+    const size_t first_range = out.size();
+
+    for (const meshlet& m: set.meshlets) {
+      s.num_meshlets++;
+      s.num_triangles += m.triangle_count;
+
+      bool culled = true;
+
+      if (outside(m, view)) {
+        s.num_culled_frustum++;
+      }
+      else if (backfacing(m, view.eye)) {
+        s.num_culled_backface++;
+      }
+      else {
+        culled = false;
+      }
+
+      if (culled) {
+        s.num_triangles_culled += m.triangle_count;
+      }
+      else if (out.size() > first_range &&
+               out.back().first_index + out.back().num_indices == m.first_index) {
+        out.back().num_indices += m.triangle_count * 3;
+      }
+      else {
+        out.push_back({ m.first_index, m.triangle_count * 3 });
+      }
+    }
+
+    s.num_ranges = static_cast<uint32_t>(out.size() - first_range);
+
+    if (stats != nullptr) {
+      stats->add(s);
+    }
+  }
+
+  //
+  // benchmark
+  //
+
+  // indexed, so unlike module_models::gen_sphere it
+  // doesn't need a vertex buffer (or a GL context)
+  static mesh_optimize::indexed_mesh<vertex> make_dense_sphere(uint32_t stacks, uint32_t slices) {
+    mesh_optimize::indexed_mesh<vertex> mesh{};
+
+    for (uint32_t i = 0; i <= stacks; ++i) {
+      real_t phi = -glm::half_pi<real_t>() + glm::pi<real_t>() * R(i) / R(stacks);
+
+      for (uint32_t j = 0; j <= slices; ++j) {
+        real_t theta = glm::two_pi<real_t>() * R(j) / R(slices);
+
+        vertex v{};
+        v.position = R3v(glm::cos(theta) * glm::cos(phi),
+                         glm::sin(phi),
+                         glm::sin(theta) * glm::cos(phi));
+        v.normal = v.position;
+        v.color = vec4_t{R(1)};
+        v.uv = R2v(R(j) / R(slices), R(i) / R(stacks));
+
+        mesh.vertices.push_back(v);
+      }
+    }
+
+    // same winding as module_models::gen_sphere (counter clockwise, seen from outside)
+    for (uint32_t i = 0; i < stacks; ++i) {
+      for (uint32_t j = 0; j < slices; ++j) {
+        index_t a = i * (slices + 1) + j;
+        index_t b = a + 1;
+        index_t d = a + slices + 1;
+        index_t c = d + 1;
+
+        mesh.indices.insert(mesh.indices.end(), { a, d, c, c, b, a });
+      }
+    }
+
+    return mesh;
+  }
+
+  void run_benchmark(const mesh_optimize::indexed_mesh<vertex>& source, uint32_t num_views) {
+    mesh_optimize::indexed_mesh<vertex> mesh{
+      source.indices.empty()
+        ? make_dense_sphere(512, 1024)
+        : source
+    };
+
+    auto t0 = clock_type::now();
+
+    mesh.indices = mesh_optimize::optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+
+    real_t optimize_ms = elapsed_ms(t0);
+
+    darray<vec3_t> positions{mesh_optimize::positions_of(mesh.vertices)};
+
+    t0 = clock_type::now();
+
+    meshlet_set set{build(mesh.indices, positions)};
+
+    real_t build_ms = elapsed_ms(t0);
+
+    vec3_t bmin{positions[0]};
+    vec3_t bmax{positions[0]};
+
+    for (const vec3_t& p: positions) {
+      bmin = glm::min(bmin, p);
+      bmax = glm::max(bmax, p);
+    }
+
+    const vec3_t center{(bmin + bmax) * R(0.5)};
+    const real_t extent = glm::length(bmax - bmin) * R(0.5);
+
+    const mat4_t proj = glm::perspective(glm::radians(R(60)), R(16) / R(9), R(0.01), extent * R(100));
+
+    cull_stats total{};
+    darray<draw_range> ranges{};
+    real_t cull_ms = R(0);
+
+    // A ring of cameras around the mesh at 3x its extent; every other
+    // one looks off to the side, so the mesh straddles the frustum edge.
+    for (uint32_t k = 0; k < num_views; ++k) {
+      real_t angle = glm::two_pi<real_t>() * R(k) / R(num_views);
+
+      vec3_t eye{center + R3v(glm::cos(angle), R(0.3), glm::sin(angle)) * (extent * R(3))};
+      vec3_t side{R3v(-glm::sin(angle), R(0), glm::cos(angle)) * extent};
+      vec3_t target{(k & 1) == 1 ? center + side * R(4) : center};
+
+      mat4_t mvp = proj * glm::lookAt(eye, target, V3_UP);
+
+      ranges.clear();
+
+      t0 = clock_type::now();
+
+      cull(set, cull_view::make(mvp, eye), ranges, &total);
+
+      cull_ms += elapsed_ms(t0);
+    }
+
+    real_t avg_vertices = R(set.vertices.size()) / R(std::max<size_t>(set.meshlets.size(), 1));
+    real_t avg_triangles = R(mesh.indices.size() / 3) / R(std::max<size_t>(set.meshlets.size(), 1));
+
+    write_logf("meshlet benchmark: %zu triangles, %zu meshlets "
+               "(%.1f vertices, %.1f triangles each), "
+               "vertex cache optimize %.2f ms, build %.2f ms",
+               mesh.indices.size() / 3,
+               set.meshlets.size(),
+               avg_vertices,
+               avg_triangles,
+               optimize_ms,
+               build_ms);
+
+    write_logf("%s", total.to_string().c_str());
+
+    write_logf("over %u views: %.1f%% of triangles culled "
+               "(%.1f%% of meshlets backfacing, %.1f%% outside), "
+               "%.1f draw ranges and %.3f ms per cull",
+               num_views,
+               total.fraction_culled() * R(100),
+               R(100) * R(total.num_culled_backface) / R(std::max(total.num_meshlets, 1u)),
+               R(100) * R(total.num_culled_frustum) / R(std::max(total.num_meshlets, 1u)),
+               R(total.num_ranges) / R(num_views),
+               cull_ms / R(num_views));
+  }
+}
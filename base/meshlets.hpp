@@ -0,0 +1,140 @@
+#pragma once
+
+#include "common.hpp"
+#include "mesh_optimize.hpp"
+
+#include <array>
+
+//
+// Meshlets: small clusters of triangles with their own bounds, so
+// large meshes can be culled at a finer grain than the whole object.
+//
+// Each meshlet has a bounding sphere (for frustum culling) and a cone
+// which contains every triangle normal in it (for backface culling).
+// See Arseny Kapoulkine's meshoptimizer, which the cone test is taken from.
+//
+// Meshlets are built by scanning the index list in order, so the
+// triangles of a meshlet are always a contiguous index range and the
+// index list itself is never changed. Run the vertex cache optimizer
+// (which keeps neighboring triangles together) first; the meshlets
+// are then spatially compact without needing their own reordering,
+// and a culled mesh can still be drawn as a handful of index ranges.
+//
+// Backface culling assumes counter clockwise front faces and
+// one-sided surfaces, so only build meshlets for closed meshes
+// (or meshes which are never seen from behind).
+//
+
+namespace meshlets {
+  using mesh_optimize::index_t;
+  using mesh_optimize::index_list_t;
+
+  // Limits used by NVIDIA's mesh shading samples: 64 vertices
+  // keeps per-cluster attributes in shared memory, 124 triangles
+  // keeps the local index list (3 bytes a triangle) under 384 bytes.
+  static constexpr inline uint32_t k_max_vertices = 64;
+  static constexpr inline uint32_t k_max_triangles = 124;
+
+  struct meshlet {
+    // into the mesh's index list
+    uint32_t first_index;
+    uint32_t triangle_count;
+
+    // into meshlet_set::vertices
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+
+    vec3_t center;
+    real_t radius;
+
+    vec3_t cone_axis;
+    // sine of the cone's half angle; 1 means
+    // the normals are too spread out to ever cull
+    real_t cone_cutoff;
+  };
+
+  struct meshlet_set {
+    darray<meshlet> meshlets{};
+    // each meshlet's unique vertices, back to back
+    darray<index_t> vertices{};
+
+    bool empty() const { return meshlets.empty(); }
+  };
+
+  meshlet_set build(const index_list_t& indices,
+                    const darray<vec3_t>& positions,
+                    uint32_t max_vertices = k_max_vertices,
+                    uint32_t max_triangles = k_max_triangles);
+
+  template <class vertexType>
+  meshlet_set build(const mesh_optimize::indexed_mesh<vertexType>& mesh) {
+    return build(mesh.indices, mesh_optimize::positions_of(mesh.vertices));
+  }
+
+  // Everything is in the mesh's own (object) space: planes come
+  // from the full model-view-projection matrix, and eye is the camera
+  // position transformed by the inverse model-view matrix.
+  struct cull_view {
+    std::array<vec4_t, 6> planes{}; // normalized, pointing inward
+    vec3_t eye{R(0)};
+
+    static cull_view make(const mat4_t& mvp, const vec3_t& eye);
+  };
+
+  struct cull_stats {
+    uint32_t num_meshlets{0};
+    uint32_t num_triangles{0};
+    uint32_t num_culled_backface{0}; // meshlets
+    uint32_t num_culled_frustum{0}; // meshlets
+    uint32_t num_triangles_culled{0};
+    uint32_t num_ranges{0};
+
+    real_t fraction_culled() const {
+      return num_triangles != 0 ? R(num_triangles_culled) / R(num_triangles) : R(0);
+    }
+
+    void add(const cull_stats& s) {
+      num_meshlets += s.num_meshlets;
+      num_triangles += s.num_triangles;
+      num_culled_backface += s.num_culled_backface;
+      num_culled_frustum += s.num_culled_frustum;
+      num_triangles_culled += s.num_triangles_culled;
+      num_ranges += s.num_ranges;
+    }
+
+    std::string to_string(const std::string& prefix = "meshlets::cull_stats") const {
+      std::stringstream ss;
+      ss << prefix << ": { "
+         << AS_STRING_SS(num_meshlets) SEP_SS
+        AS_STRING_SS(num_triangles) SEP_SS
+        AS_STRING_SS(num_culled_backface) SEP_SS
+        AS_STRING_SS(num_culled_frustum) SEP_SS
+        AS_STRING_SS(num_triangles_culled) SEP_SS
+        AS_STRING_SS(num_ranges) SEP_SS
+        "fraction_culled: " << fraction_culled() << " }";
+      return ss.str();
+    }
+  };
+
+  // adjacent visible meshlets are merged into one range
+  struct draw_range {
+    uint32_t first_index;
+    uint32_t num_indices;
+  };
+
+  bool backfacing(const meshlet& m, const vec3_t& eye);
+
+  bool outside(const meshlet& m, const cull_view& view);
+
+  // Appends a range for every run of visible meshlets to out.
+  void cull(const meshlet_set& set,
+            const cull_view& view,
+            darray<draw_range>& out,
+            cull_stats* stats = nullptr);
+
+  // CPU only: builds meshlets for a dense unit sphere (or the given
+  // mesh, if it isn't empty), then culls it from a ring of cameras
+  // and logs the fraction of triangles culled and the cost per cull.
+  void run_benchmark(const mesh_optimize::indexed_mesh<vertex>& mesh = {},
+                     uint32_t num_views = 64);
+}
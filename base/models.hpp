@@ -4,11 +4,17 @@
 #include "vertex_buffer.hpp"
 #include "programs.hpp"
 #include "view_data.hpp"
+#include "mesh_simplify.hpp"
+#include "meshlets.hpp"
+#include "primitives.hpp"
 
 #include <functional>
+#include <map>
+#include <tuple>
 
 struct model_material {
   float smooth; // for phong, range is (0, inf)
+  vec4_t color {R(1.0)}; // multiplied with the vertex color (unif_ModelColor)
 };
 
 struct module_models {
@@ -17,7 +23,8 @@ struct module_models {
     model_tri,
     model_sphere,
     model_cube,
-    model_quad
+    model_quad,
+    model_mesh
   };
 
   enum wall_type {
@@ -41,6 +48,25 @@ struct module_models {
   darray<index_type> vertex_counts;
   darray<model_material> material_info;
 
+  // Level of detail ranges, per model.
+  // Entry 0 always mirrors vertex_offsets/vertex_counts (the base mesh);
+  // every further entry is a coarser version produced by build_lods().
+  darray<index_list_type> lod_vertex_offsets;
+  darray<index_list_type> lod_vertex_counts;
+  darray<darray<real_t>> lod_errors;
+  // lod_errors are fractions of this (see mesh_simplify.hpp):
+  // the base mesh's largest AABB dimension, in model space
+  darray<real_t> lod_extents;
+
+  // Per model meshlets over the base mesh (see build_meshlets());
+  // empty for models which don't have any.
+  darray<meshlets::meshlet_set> model_meshlets;
+
+  // cull meshlets against the view when drawing lod 0
+  bool use_meshlet_culling {true};
+
+  mutable darray<meshlets::draw_range> meshlet_draw_ranges;
+
   vec3_t model_select_reset_pos {glm::zero<vec3_t>()};
 
   index_type model_count = 0;
@@ -53,13 +79,35 @@ struct module_models {
 
   mutable bool framebuffer_pinned = false;
 
-  // It's assumed that vertices
-  // have been already added to the vertex
-  // buffer when this function is caglled,
-  // so we explicitly reallocate the needed
-  // VBO memory every time we add new
-  // model data with this function.
-  auto new_model(
+  static constexpr inline real_t k_sphere_step = primitives::k_engine_sphere_step;
+
+  // Generated primitives are cached by their generator parameters.
+  // Asking for a primitive that's already been generated produces a new
+  // model which shares the first one's vertex range, so it costs
+  // no tessellation, vertex memory or upload.
+  //
+  // Primitives are always generated in white;
+  // per model color lives in model_material::color.
+  struct primitive_key {
+    model_type type;
+    int32_t variant; // e.g., the wall_type for quads
+    real_t step; // tessellation step, if applicable
+
+    bool operator < (const primitive_key& k) const {
+      return std::tie(type, variant, step) < std::tie(k.type, k.variant, k.step);
+    }
+  };
+
+  struct primitive_range {
+    index_type vbo_offset;
+    index_type num_vertices;
+  };
+
+  std::map<primitive_key, primitive_range> primitive_cache;
+
+  // Same as new_model(), but doesn't touch the VBO.
+  // Use this when the vertex range is already uploaded.
+  auto add_model(
     model_type mt,
     index_type vbo_offset = 0,
     index_type num_vertices = 0,
@@ -72,21 +120,140 @@ struct module_models {
     vertex_offsets.push_back(vbo_offset);
     vertex_counts.push_back(num_vertices);
 
+    lod_vertex_offsets.push_back({ vbo_offset });
+    lod_vertex_counts.push_back({ num_vertices });
+    lod_errors.push_back({ R(0) });
+    lod_extents.push_back(R(0));
+
+    model_meshlets.push_back({});
+
     material_info.push_back(m);
 
     model_count++;
 
+    return id;
+  }
+
+  // It's assumed that vertices
+  // have been already added to the vertex
+  // buffer when this function is caglled,
+  // so we explicitly reallocate the needed
+  // VBO memory every time we add new
+  // model data with this function.
+  auto new_model(
+    model_type mt,
+    index_type vbo_offset = 0,
+    index_type num_vertices = 0,
+    model_material m = model_material {}) {
+
+    index_type id = add_model(mt, vbo_offset, num_vertices, m);
+
     g_m.vertex_buffer->reset();
 
     return id;
   }
 
-  auto new_sphere(vec4_t color = vec4_t {R(1.0)}) {
+  // generate is only invoked on a cache miss, and
+  // must push the primitive's vertices to the vertex buffer.
+  index_type new_primitive(const primitive_key& key,
+                           const vec4_t& color,
+                           const std::function<void()>& generate) {
+    model_material m {};
+    m.color = color;
+
+    index_type id = k_uninit;
+
+    auto it = primitive_cache.find(key);
+
+    if (it != primitive_cache.end()) {
+      id = add_model(key.type,
+                     it->second.vbo_offset,
+                     it->second.num_vertices,
+                     m);
+    }
+    else {
+      auto offset = g_m.vertex_buffer->num_vertices();
+
+      generate();
+
+      auto count = g_m.vertex_buffer->num_vertices() - offset;
+
+      primitive_cache[key] = { offset, count };
+
+      id = new_model(key.type, offset, count, m);
+    }
+
+    return id;
+  }
+
+  auto new_sphere(vec4_t color = vec4_t {R(1.0)}, real_t step = k_sphere_step) {
+    return new_primitive({ model_sphere, 0, step }, color, [step]() {
+      gen_sphere(step);
+    });
+  }
+
+  auto new_wall(
+    wall_type type,
+    const vec4_t& color = R4(1.0)) {
+    return new_primitive({ model_quad, type, R(0) }, color, [type]() {
+      gen_wall(type);
+    });
+  }
+
+  // For imported meshes (see mesh_import.hpp).
+  // The vertex buffer draws unindexed, so the mesh is expanded back
+  // into a triangle list here.
+  // Like add_model(), this doesn't upload; call
+  // g_m.vertex_buffer->reset() once the last mesh is added.
+  auto add_mesh(const mesh_optimize::indexed_mesh<vertex>& mesh,
+                const vec4_t& color = R4(1.0)) {
+    model_material m {};
+    m.color = color;
+
     auto offset = g_m.vertex_buffer->num_vertices();
 
-    real_t step = 0.05f;
+    for (mesh_optimize::index_t i: mesh.indices) {
+      g_m.vertex_buffer->push(mesh.vertices[i]);
+    }
 
-    auto count = 0;
+    return add_model(model_mesh,
+                     offset,
+                     static_cast<index_type>(mesh.indices.size()),
+                     m);
+  }
+
+  auto new_mesh(const mesh_optimize::indexed_mesh<vertex>& mesh,
+                const vec4_t& color = R4(1.0)) {
+    index_type id = add_mesh(mesh, color);
+
+    g_m.vertex_buffer->reset();
+
+    return id;
+  }
+
+  auto new_cube(const vec4_t& color = vec4_t(1.0f)) {
+    return new_primitive({ model_cube, 0, R(0) }, color, []() {
+      gen_cube();
+    });
+  }
+
+  template <size_t N>
+  static void push_table(const primitives::table<primitives::engine_vertex, N>& t,
+                         size_t first = 0,
+                         size_t count = N) {
+    ASSERT(first + count <= N);
+    g_m.vertex_buffer->push(t.data() + first, count);
+  }
+
+  // Spheres with the default step come from a
+  // compile time table; other steps are generated here.
+  static void gen_sphere(real_t step) {
+    if (step == primitives::k_engine_sphere_step) {
+      push_table(primitives::k_engine_sphere);
+      return;
+    }
+
+    const vec4_t color {R(1.0)};
 
     auto cart = [](real_t phi, real_t theta) {
       vec3_t ret;
@@ -110,195 +277,189 @@ struct module_models {
         g_m.vertex_buffer->add_triangle(c, color, c,
                                         a, color, a,
                                         b, color, b);
-
-        count += 6;
       }
     }
+  }
 
-    return new_model(model_sphere, offset, count);
+  static void gen_wall(wall_type type) {
+    push_table(primitives::k_engine_walls, type * 6, 6);
   }
 
-  auto new_wall(
-    wall_type type,
-    const vec4_t& color = R4(1.0)) {
+  static void gen_cube() {
+    push_table(primitives::k_engine_cube);
+  }
 
-    std::array<vec3_t, 6> normals = {
-      R3v(0, 0, -1), // front
-      R3v(-1, 0, 0), // left
-      R3v(1, 0, 0),  // right
-      R3v(0, 0, 1),  // back
-      R3v(0, 1, 0),  // top
-      R3v(0, -1, 0)  // bottom
-    };
+  // Simplifies each of the given models and appends the resulting
+  // LODs to the vertex buffer. Models are simplified in parallel;
+  // the results are appended in the order given, so the vertex buffer
+  // layout doesn't depend on thread scheduling.
+  void build_lods(const index_list_type& models,
+                  const mesh_simplify::lod_chain_params& params = mesh_simplify::lod_chain_params{}) {
+    darray<mesh_optimize::indexed_mesh<vertex>> meshes{};
 
-    // TODO:
-    // rewrite this so that the API
-    // takes planes XY, XZ, and YZ
-    // instead of wall types,
-    // since the scaling that's used
-    // is going to offset the faces
-    // in directions (in terms of translation)
-    // which we don't want them to be offset
-    // in.
-    std::array<real_t, 36 * 3> vertices = {
-      // positions
-      // front
-      -1.0f, 1.0f, 0.0f,
-      -1.0f, -1.0f, 0.0f,
-      1.0f, -1.0f, 0.0f,
-      1.0f, -1.0f, 0.0f,
-      1.0f, 1.0f, 0.0f,
-      -1.0f, 1.0f, 0.0f,
-
-      // left
-      0.0f, -1.0f, 1.0f,
-      0.0f, -1.0f, -1.0f,
-      0.0f, 1.0f, -1.0f,
-      0.0f, 1.0f, -1.0f,
-      0.0f, 1.0f, 1.0f,
-      0.0f, -1.0f, 1.0f,
-
-      // right
-      0.0f, -1.0f, -1.0f,
-      0.0f, -1.0f, 1.0f,
-      0.0f, 1.0f, 1.0f,
-      0.0f, 1.0f, 1.0f,
-      0.0f, 1.0f, -1.0f,
-      0.0f, -1.0f, -1.0f,
-
-      // back
-      -1.0f, -1.0f, 0.0f,
-      -1.0f, 1.0f, 0.0f,
-      1.0f, 1.0f, 0.0f,
-      1.0f, 1.0f, 0.0f,
-      1.0f, -1.0f, 0.0f,
-      -1.0f, -1.0f, 0.0f,
-
-      // top
-      -1.0f, 0.0f, -1.0f,
-      1.0f, 0.0f, -1.0f,
-      1.0f, 0.0f, 1.0f,
-      1.0f, 0.0f, 1.0f,
-      -1.0f, 0.0f, 1.0f,
-      -1.0f, 0.0f, -1.0f,
-
-      // bottom
-      -1.0f, 0.0f, -1.0f,
-      -1.0f, 0.0f, 1.0f,
-      1.0f, 0.0f, -1.0f,
-      1.0f, 0.0f, -1.0f,
-      -1.0f, 0.0f, 1.0f,
-      1.0f, 0.0f, 1.0f
-    };
+    // models which share a vertex range (see primitive_cache)
+    // share their LODs as well, so each range is only simplified once.
+    std::map<index_type, size_t> range_to_mesh{};
+
+    index_list_type mesh_models{};
 
-    auto vbo_offset = g_m.vertex_buffer->num_vertices();
+    for (index_type model: models) {
+      ASSERT(model != k_uninit && model < model_count);
 
-    real_t* offset = &vertices[type * 18];
+      if (range_to_mesh.count(vertex_offsets[model]) == 0) {
+        range_to_mesh[vertex_offsets[model]] = meshes.size();
 
-    vec3_t normal = normals[type];
+        darray<vertex> soup{g_m.vertex_buffer->read_vertices(vertex_offsets[model],
+                                                             vertex_counts[model])};
 
-    vec3_t a(offset[0], offset[1], offset[2]);
-    vec3_t b(offset[3], offset[4], offset[5]);
-    vec3_t c(offset[6], offset[7], offset[8]);
+        meshes.push_back(mesh_optimize::make_indexed(soup));
+        mesh_models.push_back(model);
+      }
+    }
 
-    g_m.vertex_buffer->add_triangle(a, color, normal,
-                                 b, color, normal,
-                                 c, color, normal);
+    auto chains = mesh_simplify::make_lod_chains(meshes, params);
 
-    vec3_t d(offset[9], offset[10], offset[11]);
-    vec3_t e(offset[12], offset[13], offset[14]);
-    vec3_t f(offset[15], offset[16], offset[17]);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      index_type model = mesh_models[i];
 
-    g_m.vertex_buffer->add_triangle(d, color, normal,
-                            e, color, normal,
-                            f, color, normal);
+      // drop any previous LODs; the base mesh stays
+      lod_vertex_offsets[model].resize(1);
+      lod_vertex_counts[model].resize(1);
+      lod_errors[model].resize(1);
+      lod_extents[model] = mesh_simplify::mesh_extent(mesh_optimize::positions_of(meshes[i].vertices));
+
+      for (const mesh_simplify::lod& l: chains[i]) {
+        lod_vertex_offsets[model].push_back(g_m.vertex_buffer->num_vertices());
+        lod_vertex_counts[model].push_back(static_cast<index_type>(l.indices.size()));
+        lod_errors[model].push_back(l.error);
+
+        for (mesh_optimize::index_t v: l.indices) {
+          g_m.vertex_buffer->push(meshes[i].vertices[v]);
+        }
+      }
+    }
+
+    for (index_type model: models) {
+      index_type owner = mesh_models[range_to_mesh.at(vertex_offsets[model])];
+
+      lod_vertex_offsets[model] = lod_vertex_offsets[owner];
+      lod_vertex_counts[model] = lod_vertex_counts[owner];
+      lod_errors[model] = lod_errors[owner];
+      lod_extents[model] = lod_extents[owner];
+    }
 
-    return new_model(model_quad,
-                     vbo_offset,
-                     6 // vertex count 
-    );
+    g_m.vertex_buffer->reset();
   }
 
-  auto new_cube(const vec4_t& color = vec4_t(1.0f)) {
-    std::array<real_t, 36 * 3> vertices = {
-      // positions          
-      -1.0f, 1.0f, -1.0f,
-      -1.0f, -1.0f, -1.0f,
-      1.0f, -1.0f, -1.0f,
-      1.0f, -1.0f, -1.0f,
-      1.0f, 1.0f, -1.0f,
-      -1.0f, 1.0f, -1.0f,
-
-      -1.0f, -1.0f, 1.0f,
-      -1.0f, -1.0f, -1.0f,
-      -1.0f, 1.0f, -1.0f,
-      -1.0f, 1.0f, -1.0f,
-      -1.0f, 1.0f, 1.0f,
-      -1.0f, -1.0f, 1.0f,
-
-      1.0f, -1.0f, -1.0f,
-      1.0f, -1.0f, 1.0f,
-      1.0f, 1.0f, 1.0f,
-      1.0f, 1.0f, 1.0f,
-      1.0f, 1.0f, -1.0f,
-      1.0f, -1.0f, -1.0f,
-
-      -1.0f, -1.0f, 1.0f,
-      -1.0f, 1.0f, 1.0f,
-      1.0f, 1.0f, 1.0f,
-      1.0f, 1.0f, 1.0f,
-      1.0f, -1.0f, 1.0f,
-      -1.0f, -1.0f, 1.0f,
-
-      -1.0f, 1.0f, -1.0f,
-      1.0f, 1.0f, -1.0f,
-      1.0f, 1.0f, 1.0f,
-      1.0f, 1.0f, 1.0f,
-      -1.0f, 1.0f, 1.0f,
-      -1.0f, 1.0f, -1.0f,
-
-      -1.0f, -1.0f, -1.0f,
-      -1.0f, -1.0f, 1.0f,
-      1.0f, -1.0f, -1.0f,
-      1.0f, -1.0f, -1.0f,
-      -1.0f, -1.0f, 1.0f,
-      1.0f, -1.0f, 1.0f
-    };
+  // Splits each model's base mesh into meshlets. The base mesh's
+  // triangles are put in vertex cache order first (see meshlets.hpp),
+  // and its soup in the vertex buffer is rewritten in that order, so
+  // a meshlet's index range is also its vertex range.
+  // Models which share a vertex range share their meshlets too.
+  // Meshlet culling drops faces pointing away from the camera, so
+  // meshes that are seen from inside (the room, the skybox) mustn't
+  // be passed here.
+  void build_meshlets(const index_list_type& models) {
+    std::map<index_type, index_type> range_to_model{};
 
-    auto offset = g_m.vertex_buffer->num_vertices();
+    for (index_type model: models) {
+      ASSERT(model != k_uninit && model < model_count);
+
+      auto it = range_to_model.find(vertex_offsets[model]);
+
+      if (it != range_to_model.end()) {
+        model_meshlets[model] = model_meshlets[it->second];
+      }
+      else {
+        range_to_model[vertex_offsets[model]] = model;
+
+        darray<vertex> soup{g_m.vertex_buffer->read_vertices(vertex_offsets[model],
+                                                             vertex_counts[model])};
 
-    for (size_t i = 0; i < vertices.size(); i += 9) {
-      vec3_t a(vertices[i + 0], vertices[i + 1], vertices[i + 2]);
-      vec3_t b(vertices[i + 3], vertices[i + 4], vertices[i + 5]);
-      vec3_t c(vertices[i + 6], vertices[i + 7], vertices[i + 8]);
+        mesh_optimize::indexed_mesh<vertex> mesh{mesh_optimize::make_indexed(soup)};
 
-      g_m.vertex_buffer->add_triangle(a, color,
-                                       b, color,
-                                       c, color);
+        mesh.indices = mesh_optimize::optimize_vertex_cache(mesh.indices,
+                                                            mesh.vertices.size());
+
+        // render() draws meshlets as ranges of the soup
+        g_m.vertex_buffer->write_vertices(vertex_offsets[model],
+                                          mesh_optimize::make_soup(mesh));
+
+        model_meshlets[model] = meshlets::build(mesh);
+      }
     }
+  }
 
-    return new_model(model_cube, offset, 36);
+  index_type lod_count(index_type model) const {
+    return static_cast<index_type>(lod_vertex_offsets[model].size());
   }
 
-  void render(index_type model, const mat4_t& world) const {
+  // Picks the coarsest LOD whose error stays under max_screen_error
+  // radians, seen from distance world units away. world_scale is the
+  // largest scale of the model's world transform; errors are turned
+  // into world units with it and lod_extents.
+  index_type select_lod(index_type model,
+                        real_t distance,
+                        real_t world_scale,
+                        real_t max_screen_error = R(0.002)) const {
+    index_type lod = 0;
+
+    real_t world_extent = lod_extents[model] * world_scale;
+
+    for (index_type l = 1; l < lod_count(model); ++l) {
+      if (lod_errors[model][l] * world_extent / std::max(distance, R(1e-3)) <= max_screen_error) {
+        lod = l;
+      }
+    }
+
+    return lod;
+  }
+
+  void render(index_type model, const mat4_t& world, index_type lod = 0) const {
     mat4_t mv = g_m.view->view() * world;
 
     if (g_m.programs->uniform("unif_Model") != gapi::k_program_uniform_none) {
       g_m.programs->up_mat4x4("unif_Model", world);
     }
 
-    g_m.programs->up_mat4x4("unif_ModelView", mv);
-    g_m.programs->up_mat4x4("unif_Projection",
+    if (g_m.programs->uniform("unif_ModelColor") != gapi::k_program_uniform_none) {
+      g_m.programs->up_vec4("unif_ModelColor", material_info[model].color);
+    }
+
+    const mat4_t& proj =
       (model == modind_skybox
        ? g_m.view->skyproj
        : (framebuffer_pinned
           ? g_m.view->cubeproj
-          : g_m.view->proj)));
+          : g_m.view->proj));
+
+    g_m.programs->up_mat4x4("unif_ModelView", mv);
+    g_m.programs->up_mat4x4("unif_Projection", proj);
 
-    auto ofs = static_cast<gapi::offset_t>(vertex_offsets[model]);
-    auto count = static_cast<gapi::count_t>(vertex_counts[model]);
+    ASSERT(lod < lod_count(model));
 
-    g_m.gpu->buffer_object_draw_vertices(gapi::raster_method::triangles, ofs, count);
+    auto ofs = static_cast<gapi::offset_t>(lod_vertex_offsets[model][lod]);
+    auto count = static_cast<gapi::count_t>(lod_vertex_counts[model][lod]);
+
+    if (lod == 0 && use_meshlet_culling && !model_meshlets[model].empty()) {
+      // culling happens in model space
+      vec3_t eye {glm::inverse(mv)[3]};
+
+      meshlet_draw_ranges.clear();
+
+      meshlets::cull(model_meshlets[model],
+                     meshlets::cull_view::make(proj * mv, eye),
+                     meshlet_draw_ranges);
+
+      for (const meshlets::draw_range& r: meshlet_draw_ranges) {
+        g_m.gpu->buffer_object_draw_vertices(gapi::raster_method::triangles,
+                                             ofs + static_cast<gapi::offset_t>(r.first_index),
+                                             static_cast<gapi::count_t>(r.num_indices));
+      }
+    }
+    else {
+      g_m.gpu->buffer_object_draw_vertices(gapi::raster_method::triangles, ofs, count);
+    }
   }
 
   model_type type(index_type i) const {
@@ -0,0 +1,786 @@
+#include "obj_import.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+
+namespace obj_import {
+  using clock_type = std::chrono::steady_clock;
+
+  static real_t elapsed_ms(clock_type::time_point start) {
+    std::chrono::duration<double, std::milli> d = clock_type::now() - start;
+    return R(d.count());
+  }
+
+  //
+  // number parsing
+  //
+
+  static constexpr double k_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22
+  };
+
+  static constexpr int k_max_exact_pow10 = 22;
+
+  static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  static inline void skip_space(const char*& p, const char* end) {
+    while (p < end && is_space(*p)) {
+      ++p;
+    }
+  }
+
+  static inline const char* line_end(const char* p, const char* end) {
+    const void* nl = memchr(p, '\n', end - p);
+    return nl != nullptr ? static_cast<const char*>(nl) : end;
+  }
+
+  static bool parse_float_slow(const char*& p, const char* end, real_t& out) {
+    char buf[64] = {};
+
+    size_t len = std::min(static_cast<size_t>(end - p), sizeof(buf) - 1);
+    memcpy(buf, p, len);
+
+    char* stop = nullptr;
+    out = strtof(buf, &stop);
+
+    bool ret = stop != buf;
+    p += stop - buf;
+
+    return ret;
+  }
+
+  bool parse_float(const char*& p, const char* end, real_t& out) {
+    const char* s = p;
+
+    bool neg = false;
+
+    if (s < end && (*s == '-' || *s == '+')) {
+      neg = *s == '-';
+      ++s;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0; // significant digits in mantissa
+    int exp10 = 0;
+    bool any = false;
+
+    while (s < end && is_digit(*s)) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+        digits += mantissa != 0 ? 1 : 0;
+      }
+      else {
+        exp10++;
+      }
+      any = true;
+      ++s;
+    }
+
+    if (s < end && *s == '.') {
+      ++s;
+
+      while (s < end && is_digit(*s)) {
+        if (digits < 19) {
+          mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+          digits += mantissa != 0 ? 1 : 0;
+          exp10--;
+        }
+        any = true;
+        ++s;
+      }
+    }
+
+    if (!any) {
+      // inf, nan, or garbage
+      return parse_float_slow(p, end, out);
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+      const char* e = s + 1;
+
+      bool eneg = false;
+
+      if (e < end && (*e == '-' || *e == '+')) {
+        eneg = *e == '-';
+        ++e;
+      }
+
+      if (e < end && is_digit(*e)) {
+        int ev = 0;
+
+        while (e < end && is_digit(*e)) {
+          ev = std::min(ev * 10 + (*e - '0'), 9999);
+          ++e;
+        }
+
+        exp10 += eneg ? -ev : ev;
+        s = e;
+      }
+    }
+
+    double v = static_cast<double>(mantissa);
+
+    if (v != 0.0) {
+      if (exp10 < 0) {
+        v = -exp10 <= k_max_exact_pow10
+          ? v / k_pow10[-exp10]
+          : v * std::pow(10.0, exp10);
+      }
+      else if (exp10 > 0) {
+        v = exp10 <= k_max_exact_pow10
+          ? v * k_pow10[exp10]
+          : v * std::pow(10.0, exp10);
+      }
+    }
+
+    out = static_cast<real_t>(neg ? -v : v);
+    p = s;
+
+    return true;
+  }
+
+  static bool parse_int(const char*& p, const char* end, int64_t& out) {
+    const char* s = p;
+
+    bool neg = false;
+
+    if (s < end && (*s == '-' || *s == '+')) {
+      neg = *s == '-';
+      ++s;
+    }
+
+    int64_t v = 0;
+    bool any = false;
+
+    while (s < end && is_digit(*s)) {
+      v = v * 10 + (*s - '0');
+      any = true;
+      ++s;
+    }
+
+    if (any) {
+      out = neg ? -v : v;
+      p = s;
+    }
+
+    return any;
+  }
+
+  //
+  // chunk parsing
+  //
+
+  static constexpr int32_t k_absent = num_max<int32_t>();
+
+  // Indices are either global and 0-based, or (for negative OBJ indices)
+  // relative to the chunk's own attribute count, in which case
+  // the matching local_* bit is set and the chunk's base is added at merge.
+  struct corner {
+    enum : uint8_t {
+      local_v = 1 << 0,
+      local_t = 1 << 1,
+      local_n = 1 << 2
+    };
+
+    int32_t v;
+    int32_t t;
+    int32_t n;
+    uint8_t local;
+  };
+
+  struct group_change {
+    bool has_object;
+    bool has_material;
+    std::string object;
+    std::string material;
+    size_t first_corner; // chunk local until merged
+  };
+
+  struct chunk {
+    const char* begin;
+    const char* end;
+
+    darray<vec3_t> positions{};
+    darray<vec2_t> uvs{};
+    darray<vec3_t> normals{};
+    darray<corner> corners{};
+    darray<group_change> groups{};
+
+    bool ok{true};
+    std::string error{};
+  };
+
+  static std::string rest_of_line(const char* p, const char* end) {
+    skip_space(p, end);
+
+    const char* e = end;
+
+    while (e > p && is_space(*(e - 1))) {
+      --e;
+    }
+
+    return std::string(p, e);
+  }
+
+  static bool parse_face_index(const char*& p, const char* end, int64_t count, int32_t& out, bool& local) {
+    int64_t i = 0;
+
+    bool ret = parse_int(p, end, i);
+
+    if (ret) {
+      if (i > 0) {
+        out = static_cast<int32_t>(i - 1);
+        local = false;
+      }
+      else if (i < 0) {
+        out = static_cast<int32_t>(count + i);
+        local = true;
+      }
+      else {
+        ret = false;
+      }
+    }
+
+    return ret;
+  }
+
+  static void parse_chunk(chunk& c) {
+    const char* p = c.begin;
+
+    while (p < c.end && c.ok) {
+      const char* eol = line_end(p, c.end);
+
+      skip_space(p, eol);
+
+      if (p < eol) {
+        switch (*p) {
+        case 'v': {
+          const char* q = p + 1;
+
+          if (q < eol && is_space(*q)) {
+            vec3_t v{R(0)};
+            for (int k = 0; k < 3 && c.ok; ++k) {
+              skip_space(q, eol);
+              c.ok = parse_float(q, eol, v[k]);
+            }
+            c.positions.push_back(v);
+          }
+          else if (q < eol && *q == 't') {
+            ++q;
+            vec2_t v{R(0)};
+            for (int k = 0; k < 2 && c.ok; ++k) {
+              skip_space(q, eol);
+              // some exporters write a single coordinate
+              if (k == 0 || q < eol) {
+                c.ok = parse_float(q, eol, v[k]);
+              }
+            }
+            c.uvs.push_back(v);
+          }
+          else if (q < eol && *q == 'n') {
+            ++q;
+            vec3_t v{R(0)};
+            for (int k = 0; k < 3 && c.ok; ++k) {
+              skip_space(q, eol);
+              c.ok = parse_float(q, eol, v[k]);
+            }
+            c.normals.push_back(v);
+          }
+        } break;
+
+        case 'f': {
+          const char* q = p + 1;
+
+          corner first{};
+          corner prev{};
+          uint32_t n = 0;
+
+          skip_space(q, eol);
+
+          while (q < eol && c.ok) {
+            corner cur{k_absent, k_absent, k_absent, 0};
+            bool local = false;
+
+            c.ok = parse_face_index(q, eol, c.positions.size(), cur.v, local);
+            cur.local |= local ? corner::local_v : 0;
+
+            if (c.ok && q < eol && *q == '/') {
+              ++q;
+
+              if (q < eol && *q != '/') {
+                c.ok = parse_face_index(q, eol, c.uvs.size(), cur.t, local);
+                cur.local |= local ? corner::local_t : 0;
+              }
+
+              if (c.ok && q < eol && *q == '/') {
+                ++q;
+                c.ok = parse_face_index(q, eol, c.normals.size(), cur.n, local);
+                cur.local |= local ? corner::local_n : 0;
+              }
+            }
+
+            if (c.ok) {
+              if (n == 0) {
+                first = cur;
+              }
+              else if (n >= 2) {
+                c.corners.push_back(first);
+                c.corners.push_back(prev);
+                c.corners.push_back(cur);
+              }
+
+              prev = cur;
+              n++;
+            }
+
+            skip_space(q, eol);
+          }
+        } break;
+
+        case 'o':
+        case 'g':
+          if (p + 1 == eol || is_space(p[1])) {
+            group_change g{};
+            g.has_object = true;
+            g.object = rest_of_line(p + 1, eol);
+            g.first_corner = c.corners.size();
+            c.groups.push_back(g);
+          }
+          break;
+
+        case 'u':
+          if (eol - p > 6 && strncmp(p, "usemtl", 6) == 0) {
+            group_change g{};
+            g.has_material = true;
+            g.material = rest_of_line(p + 6, eol);
+            g.first_corner = c.corners.size();
+            c.groups.push_back(g);
+          }
+          break;
+
+        default:
+          break;
+        }
+      }
+
+      if (!c.ok) {
+        c.error = std::string(p, std::min(eol, p + 64));
+      }
+
+      p = eol < c.end ? eol + 1 : c.end;
+    }
+  }
+
+  static darray<chunk> make_chunks(const char* begin, const char* end, const params& p, uint32_t num_threads) {
+    const size_t size = end - begin;
+
+    size_t count = std::max<size_t>(1, size / std::max<size_t>(p.min_chunk_size, 1));
+
+    // a few chunks per thread evens out the load
+    count = std::min<size_t>(count, static_cast<size_t>(num_threads) * 4);
+
+    darray<chunk> chunks{};
+
+    const char* start = begin;
+
+    for (size_t i = 1; i <= count && start < end; ++i) {
+      const char* split = i == count ? end : begin + (size * i) / count;
+
+      if (split < start) {
+        split = start;
+      }
+
+      // always end a chunk right after a newline
+      split = line_end(split, end);
+      split = split < end ? split + 1 : end;
+
+      chunk c{};
+      c.begin = start;
+      c.end = split;
+
+      chunks.push_back(std::move(c));
+
+      start = split;
+    }
+
+    return chunks;
+  }
+
+  //
+  // merging
+  //
+
+  // Open addressing (linear probing) map from a corner's
+  // attribute indices to its welded vertex. This is the hot loop
+  // when building meshes, and std::unordered_map's per node
+  // allocations dominate it otherwise.
+  struct corner_table {
+    static constexpr mesh_optimize::index_t k_empty = num_max<mesh_optimize::index_t>();
+
+    struct slot {
+      int32_t v;
+      int32_t t;
+      int32_t n;
+      mesh_optimize::index_t index;
+    };
+
+    darray<slot> slots;
+    size_t mask;
+    size_t count{0};
+
+    // Welded meshes usually have far fewer vertices than corners,
+    // so this starts small and grows rather than sizing for the worst case.
+    corner_table(size_t expected_entries) {
+      resize(next_power_2<size_t>(std::max<size_t>(expected_entries * 2, 16)));
+    }
+
+    void resize(size_t capacity) {
+      darray<slot> old{};
+      old.swap(slots);
+
+      slots.assign(capacity, slot{0, 0, 0, k_empty});
+      mask = capacity - 1;
+
+      for (const slot& s: old) {
+        if (s.index != k_empty) {
+          slot& dst = find({s.v, s.t, s.n, 0});
+          dst = s;
+        }
+      }
+    }
+
+    static size_t hash(const corner& c) {
+      uint64_t h = static_cast<uint32_t>(c.v);
+      h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(c.t);
+      h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(c.n);
+      return static_cast<size_t>(h ^ (h >> 29));
+    }
+
+    // Returns c's index, or new_index if c hasn't been seen before
+    // (in which case inserted is set).
+    mesh_optimize::index_t insert(const corner& c, mesh_optimize::index_t new_index, bool& inserted) {
+      if ((count + 1) * 2 > slots.size()) {
+        resize(slots.size() * 2);
+      }
+
+      slot& s = find(c);
+
+      inserted = s.index == k_empty;
+
+      if (inserted) {
+        s = { c.v, c.t, c.n, new_index };
+        count++;
+      }
+
+      return s.index;
+    }
+
+    slot& find(const corner& c) {
+      size_t i = hash(c) & mask;
+      while (slots[i].index != k_empty &&
+             !(slots[i].v == c.v && slots[i].t == c.t && slots[i].n == c.n)) {
+        i = (i + 1) & mask;
+      }
+      return slots[i];
+    }
+  };
+
+  struct group_range {
+    std::string object;
+    std::string material;
+    size_t first;
+    size_t last;
+  };
+
+  static bool build_mesh(const darray<vec3_t>& positions,
+                         const darray<vec2_t>& uvs,
+                         const darray<vec3_t>& normals,
+                         const darray<corner>& corners,
+                         const group_range& range,
+                         imported_mesh& out) {
+    bool ok = true;
+
+    out.name = range.object;
+    out.material = range.material;
+
+    corner_table unique((range.last - range.first) / 4);
+
+    auto& mesh = out.mesh;
+
+    mesh.indices.reserve(range.last - range.first);
+
+    bool missing_normals = false;
+
+    for (size_t i = range.first; i < range.last && ok; ++i) {
+      const corner& c = corners[i];
+
+      ok =
+        c.v >= 0 && static_cast<size_t>(c.v) < positions.size() &&
+        (c.t == k_absent || (c.t >= 0 && static_cast<size_t>(c.t) < uvs.size())) &&
+        (c.n == k_absent || (c.n >= 0 && static_cast<size_t>(c.n) < normals.size()));
+
+      if (ok) {
+        bool inserted = false;
+
+        mesh_optimize::index_t index =
+          unique.insert(c,
+                        static_cast<mesh_optimize::index_t>(mesh.vertices.size()),
+                        inserted);
+
+        if (inserted) {
+          vertex v{};
+          v.position = positions[c.v];
+          v.color = vec4_t{R(1)};
+          v.uv = c.t != k_absent ? uvs[c.t] : vec2_t{R(0)};
+          v.normal = c.n != k_absent ? normals[c.n] : vec3_t{R(0)};
+
+          missing_normals = missing_normals || c.n == k_absent;
+
+          mesh.vertices.push_back(v);
+        }
+
+        mesh.indices.push_back(index);
+      }
+    }
+
+    if (ok && missing_normals) {
+      // smooth across uv seams by
+      // accumulating on the OBJ position index
+      corner_table position_slots(mesh.vertices.size());
+      darray<vec3_t> accum{};
+
+      auto accum_slot = [&position_slots, &accum](int32_t v) -> vec3_t& {
+        bool inserted = false;
+
+        mesh_optimize::index_t index =
+          position_slots.insert({v, 0, 0, 0},
+                                static_cast<mesh_optimize::index_t>(accum.size()),
+                                inserted);
+        if (inserted) {
+          accum.push_back(vec3_t{R(0)});
+        }
+        return accum[index];
+      };
+
+      for (size_t i = range.first; i + 2 < range.last; i += 3) {
+        const vec3_t& a = positions[corners[i + 0].v];
+        const vec3_t& b = positions[corners[i + 1].v];
+        const vec3_t& c = positions[corners[i + 2].v];
+
+        vec3_t n{glm::cross(b - a, c - a)};
+
+        for (size_t k = 0; k < 3; ++k) {
+          accum_slot(corners[i + k].v) += n;
+        }
+      }
+
+      for (const corner_table::slot& s: unique.slots) {
+        if (s.index != corner_table::k_empty && s.n == k_absent) {
+          vec3_t n{accum_slot(s.v)};
+          real_t len = glm::length(n);
+          mesh.vertices[s.index].normal = len > R(0) ? n / len : V3_UP;
+        }
+      }
+    }
+
+    return ok;
+  }
+
+  std::optional<darray<imported_mesh>> parse(const char* begin,
+                                             const char* end,
+                                             const params& p,
+                                             stats* out_stats) {
+    std::optional<darray<imported_mesh>> ret{};
+
+    stats st{};
+
+    st.num_bytes = end - begin;
+
+    const uint32_t num_threads =
+      p.num_threads != 0
+      ? p.num_threads
+      : parallel_default_thread_count();
+
+    auto t0 = clock_type::now();
+
+    darray<chunk> chunks{make_chunks(begin, end, p, num_threads)};
+
+    st.num_chunks = static_cast<uint32_t>(chunks.size());
+
+    parallel_for(chunks.size(),
+                 [&chunks](size_t i) { parse_chunk(chunks[i]); },
+                 num_threads);
+
+    st.parse_ms = elapsed_ms(t0);
+
+    bool ok = true;
+
+    for (const chunk& c: chunks) {
+      if (!c.ok) {
+        write_logf("OBJ parse error near: \"%s\"", c.error.c_str());
+        ok = false;
+      }
+    }
+
+    if (ok) {
+      t0 = clock_type::now();
+
+      // prefix sums give every chunk its global offsets
+      struct bases {
+        size_t v{0}, t{0}, n{0}, c{0};
+      };
+
+      darray<bases> chunk_bases(chunks.size() + 1);
+
+      for (size_t i = 0; i < chunks.size(); ++i) {
+        chunk_bases[i + 1].v = chunk_bases[i].v + chunks[i].positions.size();
+        chunk_bases[i + 1].t = chunk_bases[i].t + chunks[i].uvs.size();
+        chunk_bases[i + 1].n = chunk_bases[i].n + chunks[i].normals.size();
+        chunk_bases[i + 1].c = chunk_bases[i].c + chunks[i].corners.size();
+      }
+
+      const bases& total = chunk_bases.back();
+
+      darray<vec3_t> positions(total.v);
+      darray<vec2_t> uvs(total.t);
+      darray<vec3_t> normals(total.n);
+      darray<corner> corners(total.c);
+
+      parallel_for(chunks.size(),
+                   [&](size_t i) {
+                     chunk& c = chunks[i];
+                     const bases& b = chunk_bases[i];
+
+                     std::copy(c.positions.begin(), c.positions.end(), positions.begin() + b.v);
+                     std::copy(c.uvs.begin(), c.uvs.end(), uvs.begin() + b.t);
+                     std::copy(c.normals.begin(), c.normals.end(), normals.begin() + b.n);
+
+                     for (size_t k = 0; k < c.corners.size(); ++k) {
+                       corner x = c.corners[k];
+
+                       if (x.local & corner::local_v) x.v += static_cast<int32_t>(b.v);
+                       if (x.local & corner::local_t) x.t += static_cast<int32_t>(b.t);
+                       if (x.local & corner::local_n) x.n += static_cast<int32_t>(b.n);
+
+                       x.local = 0;
+
+                       corners[b.c + k] = x;
+                     }
+
+                     // parsed data is no longer needed
+                     c.positions = darray<vec3_t>{};
+                     c.uvs = darray<vec2_t>{};
+                     c.normals = darray<vec3_t>{};
+                     c.corners = darray<corner>{};
+                   },
+                   num_threads);
+
+      // group state carries over chunk boundaries,
+      // so ranges are resolved in file order
+      darray<group_range> ranges{};
+
+      {
+        group_range current{"default", "", 0, 0};
+
+        auto close_range = [&ranges, &current](size_t at) {
+          current.last = at;
+          if (current.last > current.first) {
+            ranges.push_back(current);
+          }
+          current.first = at;
+        };
+
+        for (size_t i = 0; i < chunks.size(); ++i) {
+          for (const group_change& g: chunks[i].groups) {
+            const size_t at = chunk_bases[i].c + g.first_corner;
+
+            if (g.has_object) {
+              close_range(at);
+              current.object = g.object;
+            }
+            else if (g.has_material) {
+              if (p.split_by_material) {
+                close_range(at);
+              }
+              current.material = g.material;
+            }
+          }
+        }
+
+        close_range(total.c);
+      }
+
+      st.merge_ms = elapsed_ms(t0);
+
+      t0 = clock_type::now();
+
+      darray<imported_mesh> meshes(ranges.size());
+      darray<uint8_t> mesh_ok(ranges.size(), 0);
+
+      parallel_for(ranges.size(),
+                   [&](size_t i) {
+                     mesh_ok[i] = build_mesh(positions,
+                                             uvs,
+                                             normals,
+                                             corners,
+                                             ranges[i],
+                                             meshes[i]) ? 1 : 0;
+                   },
+                   num_threads);
+
+      st.build_ms = elapsed_ms(t0);
+
+      for (size_t i = 0; i < ranges.size(); ++i) {
+        if (mesh_ok[i] == 0) {
+          write_logf("OBJ mesh %s has an out of range index", ranges[i].object.c_str());
+          ok = false;
+        }
+      }
+
+      st.num_triangles = static_cast<uint32_t>(total.c / 3);
+
+      if (ok) {
+        ret = std::move(meshes);
+      }
+    }
+
+    if (out_stats != nullptr) {
+      *out_stats = st;
+    }
+
+    return ret;
+  }
+
+  std::optional<darray<imported_mesh>> load(const std::string& path,
+                                            const params& p,
+                                            stats* out_stats) {
+    std::optional<darray<imported_mesh>> ret{};
+
+    auto t0 = clock_type::now();
+
+    mapped_file file{};
+
+    if (file.open(path, mapped_file::access_hint::sequential)) {
+      real_t map_ms = elapsed_ms(t0);
+
+      ret = parse(file.begin_chars(), file.end_chars(), p, out_stats);
+
+      if (out_stats != nullptr) {
+        out_stats->map_ms = map_ms;
+      }
+    }
+
+    return ret;
+  }
+}
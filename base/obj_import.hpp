@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.hpp"
+#include "mesh_import.hpp"
+
+#include <optional>
+
+//
+// Wavefront OBJ importer.
+//
+// The file is memory mapped and split into line aligned chunks, which
+// are parsed in parallel. Each chunk only records what it sees (attributes,
+// triangulated faces with their raw indices, and object/material changes);
+// relative indices and group state that cross chunk boundaries are resolved
+// in a merge step, after which each object/material group is welded into
+// an indexed mesh (again in parallel, one group per work item).
+//
+// Supported: v, vt, vn, f (any polygon, fan triangulated, with
+// positive or negative indices), o, g and usemtl.
+// Everything else (mtllib, s, l, p, curves...) is skipped.
+//
+// Output is deterministic, regardless of thread count.
+//
+
+namespace obj_import {
+  struct params {
+    // 0 means every hardware thread
+    uint32_t num_threads{0};
+    // don't bother splitting work smaller than this
+    size_t min_chunk_size{1 << 20};
+    // a usemtl line starts a new mesh
+    bool split_by_material{true};
+  };
+
+  struct stats {
+    size_t num_bytes{0};
+    uint32_t num_chunks{0};
+    uint32_t num_triangles{0};
+    real_t map_ms{R(0)};
+    real_t parse_ms{R(0)};
+    real_t merge_ms{R(0)};
+    real_t build_ms{R(0)};
+
+    std::string to_string(const std::string& prefix = "obj_import::stats") const {
+      std::stringstream ss;
+      ss << prefix << ": { "
+         << AS_STRING_SS(num_bytes) SEP_SS
+        AS_STRING_SS(num_chunks) SEP_SS
+        AS_STRING_SS(num_triangles) SEP_SS
+        AS_STRING_SS(map_ms) SEP_SS
+        AS_STRING_SS(parse_ms) SEP_SS
+        AS_STRING_SS(merge_ms) SEP_SS
+        AS_STRING_SS(build_ms) << " }";
+      return ss.str();
+    }
+  };
+
+  std::optional<darray<imported_mesh>> load(const std::string& path,
+                                            const params& p = params{},
+                                            stats* out_stats = nullptr);
+
+  // same as load(), for text that's already in memory
+  std::optional<darray<imported_mesh>> parse(const char* begin,
+                                             const char* end,
+                                             const params& p = params{},
+                                             stats* out_stats = nullptr);
+
+  // Parses a decimal float at p (optional sign, digits, fraction, exponent),
+  // advancing p past it. Faster than strtof since it ignores locale and
+  // hex/inf/nan forms; those fall back to strtof.
+  bool parse_float(const char*& p, const char* end, real_t& out);
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//
+// Minimal CPU parallelism helpers.
+//
+// Work items are claimed through an atomic counter, so which thread
+// runs which item is not deterministic. Callers that need deterministic
+// output should have each item write only to its own slot
+// (e.g. out[i] for item i) and merge afterward on the calling thread.
+//
+
+static inline uint32_t parallel_default_thread_count() {
+  uint32_t n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+// Calls fn(i) for every i in [0, count).
+// num_threads == 0 means parallel_default_thread_count().
+// The calling thread participates, and this returns only once
+// every item has finished.
+static inline void parallel_for(size_t count,
+                                const std::function<void(size_t)>& fn,
+                                uint32_t num_threads = 0) {
+  if (num_threads == 0) {
+    num_threads = parallel_default_thread_count();
+  }
+
+  if (count < num_threads) {
+    num_threads = static_cast<uint32_t>(count);
+  }
+
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+  }
+  else {
+    std::atomic<size_t> next{0};
+
+    auto work = [&next, &fn, count]() {
+      for (size_t i = next++; i < count; i = next++) {
+        fn(i);
+      }
+    };
+
+    darray<std::thread> threads{};
+    threads.reserve(num_threads - 1);
+
+    for (uint32_t t = 0; t < num_threads - 1; ++t) {
+      threads.emplace_back(work);
+    }
+
+    work();
+
+    for (std::thread& t: threads) {
+      t.join();
+    }
+  }
+}
+
+//
+// parallel_for() starts and joins its threads on every call, which is
+// fine at import time but too slow for work that happens every frame.
+// worker_pool keeps its threads parked between calls; run() has the
+// same contract as parallel_for(), including the nondeterministic
+// item to thread assignment.
+//
+// run() isn't reentrant, and only one thread should call it at a time.
+//
+class worker_pool {
+  darray<std::thread> m_threads{};
+
+  std::mutex m_mutex{};
+  std::condition_variable m_wake{};
+  std::condition_variable m_done{};
+
+  const std::function<void(size_t)>* m_fn{nullptr};
+  size_t m_count{0};
+  std::atomic<size_t> m_next{0};
+
+  uint32_t m_generation{0}; // bumped once per run()
+  uint32_t m_busy{0}; // workers that haven't finished the current run()
+  bool m_quit{false};
+
+  void work() {
+    for (size_t i = m_next++; i < m_count; i = m_next++) {
+      (*m_fn)(i);
+    }
+  }
+
+  void worker_main() {
+    uint32_t generation = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+      m_wake.wait(lock, [this, generation]() {
+        return m_quit || m_generation != generation;
+      });
+
+      if (m_quit) {
+        break;
+      }
+
+      generation = m_generation;
+
+      lock.unlock();
+      work();
+      lock.lock();
+
+      if (--m_busy == 0) {
+        m_done.notify_one();
+      }
+    }
+  }
+
+public:
+  // num_threads == 0 means parallel_default_thread_count();
+  // the thread calling run() counts as one of them
+  explicit worker_pool(uint32_t num_threads = 0) {
+    if (num_threads == 0) {
+      num_threads = parallel_default_thread_count();
+    }
+
+    m_threads.reserve(num_threads - 1);
+
+    for (uint32_t t = 0; t < num_threads - 1; ++t) {
+      m_threads.emplace_back(&worker_pool::worker_main, this);
+    }
+  }
+
+  ~worker_pool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    for (std::thread& t: m_threads) {
+      t.join();
+    }
+  }
+
+  worker_pool(const worker_pool&) = delete;
+  worker_pool& operator=(const worker_pool&) = delete;
+
+  uint32_t num_threads() const {
+    return static_cast<uint32_t>(m_threads.size()) + 1;
+  }
+
+  // calls fn(i) for every i in [0, count)
+  // and returns once they've all finished
+  void run(size_t count, const std::function<void(size_t)>& fn) {
+    if (m_threads.empty() || count <= 1) {
+      for (size_t i = 0; i < count; ++i) {
+        fn(i);
+      }
+    }
+    else {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_fn = &fn;
+        m_count = count;
+        m_next = 0;
+        m_busy = static_cast<uint32_t>(m_threads.size());
+        m_generation++;
+      }
+
+      m_wake.notify_all();
+
+      work();
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+
+      m_done.wait(lock, [this]() { return m_busy == 0; });
+
+      m_fn = nullptr;
+    }
+  }
+};
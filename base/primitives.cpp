@@ -0,0 +1,9 @@
+#include "primitives.hpp"
+
+namespace primitives {
+  constexpr table<engine_vertex, k_num_engine_sphere_vertices> k_engine_sphere =
+    detail::make_engine_sphere<k_num_engine_sphere_vertices>(k_engine_sphere_step);
+
+  constexpr table<vulkan_vertex, k_num_vulkan_sphere_vertices> k_vulkan_sphere =
+    detail::make_vulkan_sphere<k_num_vulkan_sphere_vertices>(k_vulkan_sphere_step);
+}
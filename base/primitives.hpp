@@ -0,0 +1,434 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <array>
+
+//
+// Fixed primitives (cubes, quads, walls and spheres), generated at
+// compile time.
+//
+// Every table is a constexpr array in the vertex layout it's drawn with,
+// so it lives in the binary's read-only data and is added to a vertex
+// buffer with a single memcpy. The generators replicate the runtime
+// code they replace exactly, including its float accumulation, so the
+// geometry hasn't changed.
+//
+// The large tables (spheres) are defined in primitives.cpp, so their
+// generators are only evaluated once per build.
+//
+
+namespace primitives {
+  // ::vertex
+  struct engine_vertex {
+    float position[3];
+    float color[4];
+    float normal[3];
+    float uv[2];
+  };
+
+  // vulkan::vertex_data
+  struct vulkan_vertex {
+    float position[3];
+    float st[2];
+    float color[3];
+    float normal[3];
+  };
+
+  static_assert(sizeof(engine_vertex) == sizeof(vertex));
+  static_assert(sizeof(vulkan_vertex) == 44);
+
+  template <class vertexType, size_t N>
+  using table = std::array<vertexType, N>;
+
+  namespace detail {
+    static constexpr inline double k_pi = 3.14159265358979323846;
+
+    // glm's (and std's) trig functions aren't constexpr
+    constexpr double sin(double x) {
+      double turns = x / (2.0 * k_pi);
+      auto n = static_cast<int64_t>(turns >= 0.0 ? turns + 0.5 : turns - 0.5);
+
+      x -= 2.0 * k_pi * static_cast<double>(n);
+
+      // x is in [-pi, pi]; the error after 12 terms is below 1e-12
+      double term = x;
+      double sum = x;
+
+      for (int i = 1; i < 12; ++i) {
+        term *= -x * x / static_cast<double>((2 * i) * (2 * i + 1));
+        sum += term;
+      }
+
+      return sum;
+    }
+
+    constexpr double cos(double x) {
+      return sin(x + 0.5 * k_pi);
+    }
+
+    struct float3 {
+      float x, y, z;
+    };
+
+    struct float2 {
+      float x, y;
+    };
+
+    constexpr engine_vertex engine(float3 p, float3 n) {
+      return {
+        { p.x, p.y, p.z },
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        { n.x, n.y, n.z },
+        { 0.0f, 0.0f }
+      };
+    }
+
+    constexpr vulkan_vertex vulkan(float3 p, float2 st, float3 n) {
+      return {
+        { p.x, p.y, p.z },
+        { st.x, st.y },
+        { 1.0f, 1.0f, 1.0f },
+        { n.x, n.y, n.z }
+      };
+    }
+
+    // same as the cart() lambdas the sphere generators used
+    constexpr float3 sphere_point(float phi, float theta) {
+      return {
+        static_cast<float>(cos(theta) * cos(phi)),
+        static_cast<float>(sin(phi)),
+        static_cast<float>(sin(theta) * cos(phi))
+      };
+    }
+
+    static constexpr inline float k_half_pi = static_cast<float>(0.5 * k_pi);
+    static constexpr inline float k_two_pi = static_cast<float>(2.0 * k_pi);
+
+    // the counts of the original "x <= max; x += step" loops
+    constexpr size_t num_steps(float start, float end, float step) {
+      size_t n = 0;
+
+      for (float x = start; x <= end; x += step) {
+        n++;
+      }
+
+      return n;
+    }
+
+    constexpr size_t num_sphere_vertices(float step) {
+      return 6 *
+        num_steps(-k_half_pi, k_half_pi, step) *
+        num_steps(0.0f, k_two_pi, step);
+    }
+
+    // positions of module_models' unit cube; the
+    // normal of each vertex is its position
+    static constexpr inline float k_cube_positions[36 * 3] = {
+      -1.0f, 1.0f, -1.0f,
+      -1.0f, -1.0f, -1.0f,
+      1.0f, -1.0f, -1.0f,
+      1.0f, -1.0f, -1.0f,
+      1.0f, 1.0f, -1.0f,
+      -1.0f, 1.0f, -1.0f,
+
+      -1.0f, -1.0f, 1.0f,
+      -1.0f, -1.0f, -1.0f,
+      -1.0f, 1.0f, -1.0f,
+      -1.0f, 1.0f, -1.0f,
+      -1.0f, 1.0f, 1.0f,
+      -1.0f, -1.0f, 1.0f,
+
+      1.0f, -1.0f, -1.0f,
+      1.0f, -1.0f, 1.0f,
+      1.0f, 1.0f, 1.0f,
+      1.0f, 1.0f, 1.0f,
+      1.0f, 1.0f, -1.0f,
+      1.0f, -1.0f, -1.0f,
+
+      -1.0f, -1.0f, 1.0f,
+      -1.0f, 1.0f, 1.0f,
+      1.0f, 1.0f, 1.0f,
+      1.0f, 1.0f, 1.0f,
+      1.0f, -1.0f, 1.0f,
+      -1.0f, -1.0f, 1.0f,
+
+      -1.0f, 1.0f, -1.0f,
+      1.0f, 1.0f, -1.0f,
+      1.0f, 1.0f, 1.0f,
+      1.0f, 1.0f, 1.0f,
+      -1.0f, 1.0f, 1.0f,
+      -1.0f, 1.0f, -1.0f,
+
+      -1.0f, -1.0f, -1.0f,
+      -1.0f, -1.0f, 1.0f,
+      1.0f, -1.0f, -1.0f,
+      1.0f, -1.0f, -1.0f,
+      -1.0f, -1.0f, 1.0f,
+      1.0f, -1.0f, 1.0f
+    };
+
+    // TODO:
+    // rewrite this so that the API
+    // takes planes XY, XZ, and YZ
+    // instead of wall types,
+    // since the scaling that's used
+    // is going to offset the faces
+    // in directions (in terms of translation)
+    // which we don't want them to be offset
+    // in.
+    static constexpr inline float k_wall_positions[36 * 3] = {
+      // front
+      -1.0f, 1.0f, 0.0f,
+      -1.0f, -1.0f, 0.0f,
+      1.0f, -1.0f, 0.0f,
+      1.0f, -1.0f, 0.0f,
+      1.0f, 1.0f, 0.0f,
+      -1.0f, 1.0f, 0.0f,
+
+      // left
+      0.0f, -1.0f, 1.0f,
+      0.0f, -1.0f, -1.0f,
+      0.0f, 1.0f, -1.0f,
+      0.0f, 1.0f, -1.0f,
+      0.0f, 1.0f, 1.0f,
+      0.0f, -1.0f, 1.0f,
+
+      // right
+      0.0f, -1.0f, -1.0f,
+      0.0f, -1.0f, 1.0f,
+      0.0f, 1.0f, 1.0f,
+      0.0f, 1.0f, 1.0f,
+      0.0f, 1.0f, -1.0f,
+      0.0f, -1.0f, -1.0f,
+
+      // back
+      -1.0f, -1.0f, 0.0f,
+      -1.0f, 1.0f, 0.0f,
+      1.0f, 1.0f, 0.0f,
+      1.0f, 1.0f, 0.0f,
+      1.0f, -1.0f, 0.0f,
+      -1.0f, -1.0f, 0.0f,
+
+      // top
+      -1.0f, 0.0f, -1.0f,
+      1.0f, 0.0f, -1.0f,
+      1.0f, 0.0f, 1.0f,
+      1.0f, 0.0f, 1.0f,
+      -1.0f, 0.0f, 1.0f,
+      -1.0f, 0.0f, -1.0f,
+
+      // bottom
+      -1.0f, 0.0f, -1.0f,
+      -1.0f, 0.0f, 1.0f,
+      1.0f, 0.0f, -1.0f,
+      1.0f, 0.0f, -1.0f,
+      -1.0f, 0.0f, 1.0f,
+      1.0f, 0.0f, 1.0f
+    };
+
+    // front, left, right, back, top, bottom (module_models::wall_type)
+    static constexpr inline float3 k_wall_normals[6] = {
+      { 0.0f, 0.0f, -1.0f },
+      { -1.0f, 0.0f, 0.0f },
+      { 1.0f, 0.0f, 0.0f },
+      { 0.0f, 0.0f, 1.0f },
+      { 0.0f, 1.0f, 0.0f },
+      { 0.0f, -1.0f, 0.0f }
+    };
+
+    constexpr float3 position_at(const float* positions, size_t vertex) {
+      return { positions[vertex * 3 + 0], positions[vertex * 3 + 1], positions[vertex * 3 + 2] };
+    }
+
+    constexpr table<engine_vertex, 36> make_engine_cube() {
+      table<engine_vertex, 36> ret{};
+
+      for (size_t i = 0; i < ret.size(); ++i) {
+        float3 p{position_at(k_cube_positions, i)};
+        ret[i] = engine(p, p);
+      }
+
+      return ret;
+    }
+
+    // all six walls, back to back
+    constexpr table<engine_vertex, 36> make_engine_walls() {
+      table<engine_vertex, 36> ret{};
+
+      for (size_t i = 0; i < ret.size(); ++i) {
+        ret[i] = engine(position_at(k_wall_positions, i), k_wall_normals[i / 6]);
+      }
+
+      return ret;
+    }
+
+    template <size_t N>
+    constexpr table<engine_vertex, N> make_engine_sphere(float step) {
+      table<engine_vertex, N> ret{};
+      size_t k = 0;
+
+      for (float phi = -k_half_pi; phi <= k_half_pi; phi += step) {
+        for (float theta = 0.0f; theta <= k_two_pi; theta += step) {
+          float3 a{sphere_point(phi, theta)};
+          float3 b{sphere_point(phi, theta + step)};
+          float3 c{sphere_point(phi + step, theta + step)};
+          float3 d{sphere_point(phi + step, theta)};
+
+          ret[k++] = engine(a, a);
+          ret[k++] = engine(d, d);
+          ret[k++] = engine(c, c);
+
+          ret[k++] = engine(c, c);
+          ret[k++] = engine(a, a);
+          ret[k++] = engine(b, b);
+        }
+      }
+
+      return ret;
+    }
+
+    static constexpr inline float2 k_tc_tl = { 0.0f, 0.0f };
+    static constexpr inline float2 k_tc_tr = { 1.0f, 0.0f };
+    static constexpr inline float2 k_tc_br = { 1.0f, 1.0f };
+    static constexpr inline float2 k_tc_bl = { 0.0f, 1.0f };
+
+    // mesh_builder's quad: two triangles in the XY
+    // plane, spanning [-1, 1], facing +z
+    constexpr table<vulkan_vertex, 6> make_vulkan_quad() {
+      constexpr float3 n{ 0.0f, 0.0f, 1.0f };
+
+      return {{
+        vulkan({ -1.0f, 1.0f, 0.0f }, k_tc_tl, n),
+        vulkan({ 1.0f, 1.0f, 0.0f }, k_tc_tr, n),
+        vulkan({ 1.0f, -1.0f, 0.0f }, k_tc_br, n),
+
+        vulkan({ -1.0f, 1.0f, 0.0f }, k_tc_tl, n),
+        vulkan({ 1.0f, -1.0f, 0.0f }, k_tc_br, n),
+        vulkan({ -1.0f, -1.0f, 0.0f }, k_tc_bl, n)
+      }};
+    }
+
+    // Quarter turns are exact swaps, which is what
+    // with_rotate(..., half_pi) computed up to rounding.
+    constexpr float3 rotate_y_90(float3 v) { return { v.z, v.y, -v.x }; }
+    constexpr float3 rotate_x_90(float3 v) { return { v.x, -v.z, v.y }; }
+    constexpr float3 rotate_x_neg_90(float3 v) { return { v.x, v.z, -v.y }; }
+
+    // The faces of mesh_builder's cube, in the order it built them.
+    // The left and back faces keep the +x and +z normals they had.
+    enum cube_face {
+      cube_left = 0,
+      cube_right,
+      cube_up,
+      cube_down,
+      cube_front,
+      cube_back
+    };
+
+    constexpr float3 cube_face_transform(cube_face face, float3 v, bool normal) {
+      float3 r{v};
+
+      switch (face) {
+      case cube_left:
+      case cube_right: r = rotate_y_90(v); break;
+      case cube_up: r = rotate_x_neg_90(v); break;
+      case cube_down: r = rotate_x_90(v); break;
+      default: break;
+      }
+
+      if (!normal) {
+        switch (face) {
+        case cube_left: r.x -= 1.0f; break;
+        case cube_right: r.x += 1.0f; break;
+        case cube_up: r.y += 1.0f; break;
+        case cube_down: r.y -= 1.0f; break;
+        case cube_front: r.z += 1.0f; break;
+        case cube_back: r.z -= 1.0f; break;
+        }
+      }
+
+      return r;
+    }
+
+    constexpr table<vulkan_vertex, 36> make_vulkan_cube() {
+      table<vulkan_vertex, 36> ret{};
+      table<vulkan_vertex, 6> quad{make_vulkan_quad()};
+
+      for (size_t f = 0; f < 6; ++f) {
+        for (size_t i = 0; i < quad.size(); ++i) {
+          const vulkan_vertex& q = quad[i];
+
+          float3 p{cube_face_transform(static_cast<cube_face>(f),
+                                       { q.position[0], q.position[1], q.position[2] },
+                                       false)};
+
+          float3 n{cube_face_transform(static_cast<cube_face>(f),
+                                       { q.normal[0], q.normal[1], q.normal[2] },
+                                       true)};
+
+          ret[f * 6 + i] = vulkan(p, { q.st[0], q.st[1] }, n);
+        }
+      }
+
+      return ret;
+    }
+
+    template <size_t N>
+    constexpr table<vulkan_vertex, N> make_vulkan_sphere(float step) {
+      table<vulkan_vertex, N> ret{};
+      size_t k = 0;
+
+      for (float phi = -k_half_pi; phi <= k_half_pi; phi += step) {
+        for (float theta = 0.0f; theta <= k_two_pi; theta += step) {
+          float3 bl{sphere_point(phi, theta)};
+          float3 br{sphere_point(phi, theta + step)};
+          float3 tr{sphere_point(phi + step, theta + step)};
+          float3 tl{sphere_point(phi + step, theta)};
+
+          // upper triangle; the normals are the
+          // same as the lower one's, as they were
+          ret[k++] = vulkan(tl, k_tc_tl, tl);
+          ret[k++] = vulkan(tr, k_tc_tr, br);
+          ret[k++] = vulkan(br, k_tc_br, bl);
+
+          // lower triangle
+          ret[k++] = vulkan(tl, k_tc_tl, tl);
+          ret[k++] = vulkan(br, k_tc_br, br);
+          ret[k++] = vulkan(bl, k_tc_bl, bl);
+        }
+      }
+
+      return ret;
+    }
+  }
+
+  //
+  // OpenGL path (module_models)
+  //
+
+  static constexpr inline table<engine_vertex, 36> k_engine_cube = detail::make_engine_cube();
+
+  // indexed by module_models::wall_type, 6 vertices each
+  static constexpr inline table<engine_vertex, 36> k_engine_walls = detail::make_engine_walls();
+
+  static constexpr inline float k_engine_sphere_step = 0.05f;
+  static constexpr inline size_t k_num_engine_sphere_vertices =
+    detail::num_sphere_vertices(k_engine_sphere_step);
+
+  extern const table<engine_vertex, k_num_engine_sphere_vertices> k_engine_sphere;
+
+  //
+  // Vulkan path (vulkan::mesh_builder)
+  //
+
+  static constexpr inline table<vulkan_vertex, 6> k_vulkan_quad = detail::make_vulkan_quad();
+
+  static constexpr inline table<vulkan_vertex, 36> k_vulkan_cube = detail::make_vulkan_cube();
+
+  static constexpr inline float k_vulkan_sphere_step = 0.33333333333f;
+  static constexpr inline size_t k_num_vulkan_sphere_vertices =
+    detail::num_sphere_vertices(k_vulkan_sphere_step);
+
+  extern const table<vulkan_vertex, k_num_vulkan_sphere_vertices> k_vulkan_sphere;
+}
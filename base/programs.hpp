@@ -2,6 +2,7 @@
 
 #include "common.hpp"
 #include "gapi.hpp"
+#include "debug_draw.hpp"
 #include <inttypes.h>
 #include <unordered_map>
 
@@ -94,6 +95,14 @@ static inline darray<std::string> uniform_location_color() {
   };
 }
 
+// per model tint; required by any program
+// whose vertex shader uses vshader_frag_color
+static inline darray<std::string> uniform_location_model_color() {
+  return {
+    "unif_ModelColor"
+  };
+}
+
 static inline darray<std::string> uniform_location_toggle_quad() {
   return {
     "unif_ToggleQuadColor",       // vec4
@@ -163,6 +172,8 @@ struct module_programs: public type_module {
 
     if (unif_model) ss << GLSL_L(uniform mat4 unif_Model;);
 
+    if (frag_color) ss << GLSL_L(uniform vec4 unif_ModelColor;);
+
     ss << GLSL_L(uniform mat4 unif_ModelView;);
     ss << GLSL_L(uniform mat4 unif_Projection;);
     ss << GLSL_L(void main() {
@@ -191,7 +202,7 @@ struct module_programs: public type_module {
     }
 
     if (frag_color) {
-      ss << GLSL_TL(frag_Color = in_Color;);
+      ss << GLSL_TL(frag_Color = in_Color * unif_ModelColor;);
     }
 
 #undef ASSIGN_FRAG
@@ -460,12 +471,26 @@ struct module_programs: public type_module {
       "basic",
       gen_vshader(vshader_frag_color, "basic"),
       gen_fshader(fshader_frag_color, {}, "basic"),
-      uniform_location_mv_proj(),
+      uniform_location_mv_proj() +
+      uniform_location_model_color(),
     {
       gapi::constants::k_vertex_layout_position,
       gapi::constants::k_vertex_layout_color
     }
     },
+#if BASE_ENABLE_DEBUG_DRAW == 1
+    {
+      "debug_lines",
+      gen_vshader(vshader_frag_color, "debug_lines"),
+      gen_fshader(fshader_frag_color, {}, "debug_lines"),
+      uniform_location_mv_proj() +
+      uniform_location_model_color(),
+    {
+      gapi::constants::k_vertex_layout_debug_position,
+      gapi::constants::k_vertex_layout_debug_color
+    }
+    },
+#endif
     {
       "single_color",
       gen_vshader(0, "single_color"),
@@ -490,7 +515,8 @@ struct module_programs: public type_module {
         "unif_Projection",
         "unif_Model"
     } + uniform_location_pointlight(0)
-        + uniform_location_shine();
+        + uniform_location_shine()
+        + uniform_location_model_color();
   })(),
   {
     gapi::constants::k_vertex_layout_position,
@@ -557,7 +583,8 @@ struct module_programs: public type_module {
         "unif_TexCubeMap",
         "unif_Model"
     }  + uniform_location_pointlight(0)
-        + uniform_location_shine();
+        + uniform_location_shine()
+        + uniform_location_model_color();
   })(),
   {
     gapi::constants::k_vertex_layout_position,
@@ -619,7 +646,7 @@ struct module_programs: public type_module {
       "unif_Projection",
       "unif_TexCubeMap",
       "unif_CameraPosition"
-    };
+    } + uniform_location_model_color();
   })(),
   {
     gapi::constants::k_vertex_layout_position,
@@ -646,6 +673,7 @@ struct module_programs: public type_module {
   const std::string default_mir = "reflection_sphere";
   const std::string sphere_cubemap = "reflection_sphere_cubemap";
   const std::string skybox = "cubemap";
+  const std::string debug_lines = "debug_lines";
 
   using id_type = std::string;
 
@@ -26,6 +26,8 @@ public:
     m_frame_start_s = glfwGetTime();
   };
   virtual void render() = 0;
+  // the window's framebuffer changed size
+  virtual void framebuffer_resized(int width, int height) {}
 
   void post_update() {
     m_present_count++;
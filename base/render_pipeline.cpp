@@ -130,3 +130,66 @@ void shader_uniform_storage::upload_uniform(const std::string& name) const {
   }
 
 }
+
+pass_timings g_pass_timings {};
+
+void pass_timings::collect(const std::string& name, scope& s, uint32_t slot) {
+  if (s.pending[slot] &&
+      g_m.gpu->query_object_available(s.queries[slot * 2 + 1])) {
+    uint64_t begin_ns = g_m.gpu->query_object_result(s.queries[slot * 2]);
+    uint64_t end_ns = g_m.gpu->query_object_result(s.queries[slot * 2 + 1]);
+
+    milliseconds[name] = static_cast<double>(end_ns - begin_ns) / 1000000.0;
+    s.pending[slot] = false;
+  }
+}
+
+void pass_timings::begin(const std::string& name) {
+  uint32_t slot = static_cast<uint32_t>(frame % k_latency);
+
+  scope& s = scopes[name];
+
+  if (s.queries.empty()) {
+    for (uint32_t i = 0; i < k_latency * 2; ++i) {
+      s.queries.push_back(g_m.gpu->query_object_new());
+    }
+
+    s.pending.resize(k_latency, false);
+  }
+
+  collect(name, s, slot);
+
+  s.open = !s.pending[slot];
+
+  if (s.open) {
+    g_m.gpu->query_object_timestamp(s.queries[slot * 2]);
+  }
+}
+
+void pass_timings::end(const std::string& name) {
+  uint32_t slot = static_cast<uint32_t>(frame % k_latency);
+
+  scope& s = scopes.at(name);
+
+  if (s.open) {
+    g_m.gpu->query_object_timestamp(s.queries[slot * 2 + 1]);
+
+    s.pending[slot] = true;
+    s.open = false;
+  }
+}
+
+void pass_timings::end_frame() {
+  frame++;
+}
+
+void pass_timings::free_mem() {
+  for (auto& kv: scopes) {
+    for (auto& query: kv.second.queries) {
+      g_m.gpu->query_object_delete(query);
+    }
+  }
+
+  scopes.clear();
+  milliseconds.clear();
+}
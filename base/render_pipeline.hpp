@@ -154,6 +154,48 @@ struct bind_texture {
   }
 };
 
+//
+// GPU time spent in each pass_info::apply(), from a pair of
+// GL_TIMESTAMP queries written around it. A scope's queries are
+// kept in k_latency slots, one per frame, and a slot's results are
+// read when it comes around again, by which point the GPU has
+// normally finished with them. Nothing ever waits on a result: a
+// slot that's still pending is left alone and that frame goes
+// untimed.
+//
+struct pass_timings {
+  static constexpr inline uint32_t k_latency = 3;
+
+  struct scope {
+    // begin and end for each slot
+    darray<gapi::query_object_handle> queries;
+    darray<bool> pending;
+    bool open {false};
+  };
+
+  std::unordered_map<std::string, scope> scopes;
+
+  // the latest result for each scope, in milliseconds
+  std::unordered_map<std::string, double> milliseconds;
+
+  uint64_t frame {0};
+
+  void begin(const std::string& name);
+
+  void end(const std::string& name);
+
+  void end_frame();
+
+  const std::unordered_map<std::string, double>& get_stats() const {
+    return milliseconds;
+  }
+
+  void free_mem();
+
+private:
+  void collect(const std::string& name, scope& s, uint32_t slot);
+} extern g_pass_timings;
+
 struct pass_info {
   using ptr_type = std::unique_ptr<pass_info>;
 
@@ -217,6 +259,8 @@ struct pass_info {
     if (active) {
       CLOG(logflag_render_pipeline_pass_info_apply, "pass: %s", name.c_str());
 
+      g_pass_timings.begin(name);
+
       if (frametype != frame_render_to_quad) {
         g_m.vertex_buffer->bind();
       }
@@ -301,6 +345,8 @@ struct pass_info {
       if (frametype != frame_render_to_quad) {
         g_m.vertex_buffer->unbind();
       }
+
+      g_pass_timings.end(name);
     }
   }
 };
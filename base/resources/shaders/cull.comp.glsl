@@ -0,0 +1,82 @@
+#version 450
+
+//
+// One invocation per object. Objects whose bounding sphere passes
+// module_geom::frustum::intersects_sphere()'s test - it straddles
+// each of the four side planes - append an indexed indirect draw
+// covering all of their instances. The draws are consumed by
+// vkCmdDrawIndexedIndirectCount, with drawCount as the count.
+//
+
+layout(local_size_x = 64) in;
+
+const uint k_object_never_cull = 0x1u;
+
+struct object {
+  vec4 sphere; // xyz: world space center, w: radius
+  uint indexCount;
+  uint firstIndex;
+  int vertexOffset;
+  uint firstInstance;
+  uint instanceCount;
+  uint flags;
+  uint padding0;
+  uint padding1;
+};
+
+// a VkDrawIndexedIndirectCommand, plus the
+// object it came from for validation
+struct draw {
+  uint indexCount;
+  uint instanceCount;
+  uint firstIndex;
+  int vertexOffset;
+  uint firstInstance;
+  uint object;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer object_buffer {
+  object objects[];
+};
+
+layout(std430, set = 0, binding = 1) buffer frame_buffer {
+  vec4 planes[4]; // xyz: normal, w: d
+  uint numObjects;
+  uint drawCount; // zeroed before the dispatch
+};
+
+layout(std430, set = 0, binding = 2) writeonly buffer draw_buffer {
+  draw draws[];
+};
+
+bool straddles(in vec4 sphere, in vec4 plane) {
+  return abs(dot(sphere.xyz, plane.xyz) - plane.w) <= sphere.w * length(plane.xyz);
+}
+
+void main() {
+  uint i = gl_GlobalInvocationID.x;
+
+  if (i >= numObjects) {
+    return;
+  }
+
+  object o = objects[i];
+
+  bool visible =
+    (o.flags & k_object_never_cull) != 0u ||
+    (straddles(o.sphere, planes[0]) &&
+     straddles(o.sphere, planes[1]) &&
+     straddles(o.sphere, planes[2]) &&
+     straddles(o.sphere, planes[3]));
+
+  if (visible) {
+    uint slot = atomicAdd(drawCount, 1u);
+
+    draws[slot].indexCount = o.indexCount;
+    draws[slot].instanceCount = o.instanceCount;
+    draws[slot].firstIndex = o.firstIndex;
+    draws[slot].vertexOffset = o.vertexOffset;
+    draws[slot].firstInstance = o.firstInstance;
+    draws[slot].object = i;
+  }
+}
@@ -0,0 +1,9 @@
+#version 450
+
+layout(location = 0) in vec4 frag_Color;
+
+layout(location = 0) out vec4 out_Color;
+
+void main() {
+  out_Color = frag_Color;
+}
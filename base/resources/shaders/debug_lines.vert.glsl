@@ -0,0 +1,24 @@
+#version 450
+
+layout(location = 0) in vec3 in_Position;
+layout(location = 1) in vec4 in_Color;
+
+layout(location = 0) out vec4 frag_Color;
+
+layout(set = 1, binding = 0) uniform transforms_uniform_block {
+  mat4 viewToClip;
+  mat4 worldToView;
+};
+
+vec4 fixup_position(in vec4 p) {
+  // invert y axis since vulkan's coordinate system is inverted on Y
+  p.y = -p.y;
+  p.z = (p.z + p.w) * 0.5; // map NDC [-1,1] to NDC [0, 1]
+  return p;
+}
+
+void main() {
+  // positions are already in world space
+  gl_Position = fixup_position(viewToClip * worldToView * vec4(in_Position, 1.0));
+  frag_Color = in_Color;
+}
@@ -1,5 +1,6 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 // closure definitions can be found in the following document,
 // which this shader references:
@@ -83,6 +84,7 @@ layout(location = 0) in vec2 frag_TexCoord;
 layout(location = 1) in vec3 frag_Color;
 layout(location = 2) in vec3 frag_Normal;
 layout(location = 3) in vec3 frag_WorldPosition;
+layout(location = 4) flat in uint frag_Material;
 
 layout(location = 0) out vec4 out_Color;
 
@@ -95,7 +97,6 @@ layout(push_constant) uniform basic_pbr {
   layout(offset = 32) float metallic;
   layout(offset = 36) float roughness;
   layout(offset = 40) float ao;
-  layout(offset = 44) int samplerIndex;
 } basicPbr;
 
 const float PI = 3.1415926535;
@@ -197,10 +198,12 @@ vec3 sample_radiance(in vec3 F0, in vec3 N, in vec3 V, in vec3 lightPosition, in
   return (kD * basicPbr.albedo / PI + specular) * radiance * NdotL;  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again  
 }
 
+// the material index is just a sampler index for now. It can
+// differ between the instances of a draw, so it isn't dynamically
+// uniform: the index has to be marked nonuniformEXT
+// (shaderSampledImageArrayNonUniformIndexing, which the renderer enables).
 vec4 sample_texture() {
-  return
-    texture(unif_Samplers[basicPbr.samplerIndex & 0x1],
-	    frag_TexCoord);
+  return texture(unif_Samplers[nonuniformEXT(frag_Material & 0x1u)], frag_TexCoord);
 }
 
 const vec3 gamma = vec3(1.0 / 2.2);
@@ -9,15 +9,23 @@ layout(location = 0) out vec2 frag_TexCoord;
 layout(location = 1) out vec3 frag_Color;
 layout(location = 2) out vec3 frag_Normal;
 layout(location = 3) out vec3 frag_WorldPosition;
+layout(location = 4) flat out uint frag_Material;
 
 layout(set = 1, binding = 0) uniform transforms_uniform_block {
   mat4 viewToClip;
   mat4 worldToView;
 };
 
-layout(push_constant) uniform model_buffer {
-  layout(offset = 64) mat4 modelToWorld;
-} modelBuffer;
+// one record per drawn instance; a draw's instances
+// are contiguous, starting at its firstInstance
+struct instance {
+  mat4 modelToWorld;
+  uint material;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer instance_buffer {
+  instance instances[];
+};
 
 vec4 fixup_position(in vec4 p) {
   // invert y axis since vulkan's coordinate system is inverted on Y
@@ -27,12 +35,15 @@ vec4 fixup_position(in vec4 p) {
 }
 
 void main() {
-  vec4 worldPosition = modelBuffer.modelToWorld * vec4(in_Position, 1.0);
+  mat4 modelToWorld = instances[gl_InstanceIndex].modelToWorld;
+  
+  vec4 worldPosition = modelToWorld * vec4(in_Position, 1.0);
   
   gl_Position = fixup_position(viewToClip * worldToView * worldPosition);
   
   frag_TexCoord = in_TexCoord;
   frag_Color = in_Color;
-  frag_Normal = mat3(modelBuffer.modelToWorld) * in_Normal;
+  frag_Normal = mat3(modelToWorld) * in_Normal;
   frag_WorldPosition = worldPosition.xyz;
+  frag_Material = instances[gl_InstanceIndex].material;
 }
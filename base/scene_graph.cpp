@@ -1,6 +1,7 @@
 #include "scene_graph.hpp"
 
 #include <iostream>
+#include <algorithm>
 
 scene_graph::scene_graph()
   : pickfbo(g_m.framebuffer->add_fbo(g_m.framebuffer->width, g_m.framebuffer->height)),
@@ -174,6 +175,21 @@ mat4_t scene_graph::modaccum_transform(scene_graph::index_type node) const {
   return m;
 }
 
+// The LOD for model drawn at world, from its distance to the camera.
+// Simplification errors are fractions of the mesh's extent; select_lod()
+// scales them by the extent and by world's largest scale, so that the
+// error and the distance are both in world units.
+static module_models::index_type select_lod(module_models::index_type model, const mat4_t& world) {
+  vec3_t eye {glm::inverse(g_m.view->view())[3]};
+  vec3_t center {world[3]};
+
+  real_t scale = std::max({ glm::length(vec3_t {world[0]}),
+                            glm::length(vec3_t {world[1]}),
+                            glm::length(vec3_t {world[2]}) });
+
+  return g_m.models->select_lod(model, glm::distance(eye, center), scale);
+}
+
 void scene_graph::draw_node(scene_graph::index_type node,
           scene_graph::index_type traverse_node,
           node_id* id,
@@ -183,7 +199,9 @@ void scene_graph::draw_node(scene_graph::index_type node,
 
     mat4_t world_accum {world * model_transform(node)};
 
-    g_m.models->render(model_indices[node], world_accum);
+    g_m.models->render(model_indices[node],
+                       world_accum,
+                       select_lod(model_indices[node], world_accum));
 
   }
   else {
@@ -222,7 +240,9 @@ void scene_graph::draw_all(index_type current, const mat4_t& world) const {
     }
 
     mat4_t raccum {world * model_transform(current)};
-    g_m.models->render(model_indices[current], raccum);
+    g_m.models->render(model_indices[current],
+                       raccum,
+                       select_lod(model_indices[current], raccum));
   }
 
   for (auto child: child_lists[current]) {
@@ -120,8 +120,6 @@ namespace {
 // has taken place
 bool settings::vk::ok() const {
   return
-    c_assert((renderer.max_frames_in_flight == renderer.swapchain_image_count) ||
-	     renderer.render.allow_more_frames_than_fences) &&
     c_assert(renderer.select_present_mode.select_method != settings::vk::present_mode_select::best_fit);
 }
 
@@ -245,7 +243,6 @@ bool settings::read() {
        Q_entry(renderer.enable_validation_layers, q.get_bool()),
 
        Q_entry(renderer.render.use_frustum_culling, q.get_bool()),
-       Q_entry(renderer.render.allow_more_frames_than_fences, q.get_bool()),
 
        Q_entry(renderer.setup_vertex_buffer.use_staging, q.get_bool()),
 
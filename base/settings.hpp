@@ -64,7 +64,6 @@ public:
     struct class_renderer {
       struct method_render {
 	bool use_frustum_culling{false};
-	bool allow_more_frames_than_fences{false};
       };
       struct method_setup_vertex_buffer {
 	bool use_staging{false};
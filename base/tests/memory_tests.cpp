@@ -0,0 +1,236 @@
+// CPU tests for the device memory sub-allocator: the tlsf allocator
+// (backend/tlsf.hpp) and the rules device_memory_pool uses to place
+// requests in blocks (backend/memory_placement.hpp).
+//
+// Neither depends on Vulkan, GL or glm, so this builds
+// on its own with make test.
+
+#include "backend/tlsf.hpp"
+#include "backend/memory_placement.hpp"
+
+#include <map>
+#include <random>
+#include <stdio.h>
+
+// c_assert() records failures here instead of killing the
+// process, so that one run reports every failing check
+static uint32_t g_failures = 0;
+
+void assert_impl(bool cond,
+                 int line,
+                 const char* func,
+                 const char* file,
+                 const char* expr) {
+  if (!cond) {
+    printf("%s:%i (%s): check failed: %s\n", file, line, func, expr);
+    g_failures++;
+  }
+}
+
+static void tlsf_random() {
+  constexpr tlsf::size_type k_capacity = tlsf::size_type{1} << 20;
+  constexpr uint32_t k_operations = 20000;
+
+  constexpr tlsf::size_type k_alignments[] = { 1, 4, 16, 64, 256, 4096 };
+
+  tlsf t{k_capacity};
+
+  // offset -> allocation, for overlap checks
+  std::map<tlsf::size_type, tlsf::allocation> live{};
+
+  std::mt19937 rng{1234};
+  std::uniform_int_distribution<tlsf::size_type> size_dist{1, 16384};
+  std::uniform_int_distribution<size_t> align_dist{0, std::size(k_alignments) - 1};
+  std::uniform_int_distribution<uint32_t> op_dist{0, 99};
+
+  uint32_t failed_allocations = 0;
+
+  for (uint32_t i = 0; i < k_operations && g_failures == 0; ++i) {
+    // lean towards allocating, so that the range fills up
+    // and allocations start failing too
+    if (live.empty() || op_dist(rng) < 55) {
+      tlsf::size_type size = size_dist(rng);
+      tlsf::size_type alignment = k_alignments[align_dist(rng)];
+
+      tlsf::allocation a = t.allocate(size, alignment);
+
+      if (a.ok()) {
+	c_assert(a.offset % alignment == 0);
+	c_assert(a.size >= size);
+	c_assert(a.offset + a.size <= k_capacity);
+
+	auto next = live.lower_bound(a.offset);
+
+	if (next != live.end()) {
+	  c_assert(a.offset + a.size <= next->second.offset);
+	}
+
+	if (next != live.begin()) {
+	  auto prev = std::prev(next);
+	  c_assert(prev->second.offset + prev->second.size <= a.offset);
+	}
+
+	live[a.offset] = a;
+      }
+      else {
+	failed_allocations++;
+      }
+    }
+    else {
+      auto it = live.begin();
+      std::advance(it, std::uniform_int_distribution<size_t>{0, live.size() - 1}(rng));
+
+      t.free(it->second.node);
+      live.erase(it);
+    }
+
+    c_assert(t.validate());
+    c_assert(t.num_allocations() == live.size());
+  }
+
+  c_assert(failed_allocations > 0);
+
+  for (const auto& [offset, a]: live) {
+    t.free(a.node);
+    c_assert(t.validate());
+  }
+
+  tlsf::stats s = t.get_stats();
+
+  c_assert(t.empty());
+  c_assert(s.used == 0);
+  c_assert(s.free_ranges == 1);
+  c_assert(s.largest_free == k_capacity);
+}
+
+static void tlsf_merge() {
+  constexpr tlsf::size_type k_size = 1024;
+
+  tlsf t{4 * k_size};
+
+  tlsf::allocation a[4] = {};
+
+  for (uint32_t i = 0; i < 4; ++i) {
+    a[i] = t.allocate(k_size);
+    c_assert(a[i].ok() && a[i].offset == i * k_size);
+  }
+
+  c_assert(!t.allocate(1).ok());
+  c_assert(t.get_stats().free_ranges == 0);
+
+  // 1 and 2 merge with each other, then with 0 on either side
+  t.free(a[1].node);
+  t.free(a[2].node);
+
+  c_assert(t.validate());
+  c_assert(t.get_stats().free_ranges == 1);
+  c_assert(t.get_stats().largest_free == 2 * k_size);
+
+  t.free(a[0].node);
+
+  c_assert(t.validate());
+  c_assert(t.get_stats().free_ranges == 1);
+  c_assert(t.get_stats().largest_free == 3 * k_size);
+
+  // only fits if 0, 1 and 2 became one range
+  tlsf::allocation b = t.allocate(3 * k_size);
+  c_assert(b.ok() && b.offset == 0);
+
+  t.free(b.node);
+  t.free(a[3].node);
+
+  c_assert(t.validate());
+  c_assert(t.empty());
+  c_assert(t.get_stats().free_ranges == 1);
+  c_assert(t.get_stats().largest_free == 4 * k_size);
+
+  // alignment padding in front of an allocation is its own free
+  // range, and has to merge back once the allocation is freed
+  tlsf::allocation c = t.allocate(64);
+  tlsf::allocation d = t.allocate(64, 1024);
+
+  c_assert(c.ok() && d.ok() && d.offset == 1024);
+  c_assert(t.get_stats().free_ranges == 2);
+
+  t.free(d.node);
+  t.free(c.node);
+
+  c_assert(t.validate());
+  c_assert(t.get_stats().free_ranges == 1);
+}
+
+static void pool_placement() {
+  using namespace vulkan;
+
+  constexpr uint64_t k_mb = uint64_t{1} << 20;
+  constexpr uint64_t k_block = 64 * k_mb;
+  constexpr uint64_t k_fraction = 8;
+
+  // large heaps get full blocks, small heaps a fraction of the heap
+  c_assert(placement::block_size(8192 * k_mb, k_block, k_fraction) == k_block);
+  c_assert(placement::block_size(256 * k_mb, k_block, k_fraction) == 32 * k_mb);
+
+  // the dedicated block threshold is half a normal block
+  c_assert(!placement::dedicated(k_block / 2, k_block));
+  c_assert(placement::dedicated(k_block / 2 + 1, k_block));
+  c_assert(!placement::dedicated(1, k_block));
+
+  // a granularity of 1 puts everything in linear blocks
+  c_assert(placement::block_tiling(resource_tiling::optimal, 1) == resource_tiling::linear);
+  c_assert(placement::block_tiling(resource_tiling::linear, 1) == resource_tiling::linear);
+  c_assert(placement::block_tiling(resource_tiling::optimal, 0) == resource_tiling::linear);
+
+  // above 1 linear and optimal resources get separate blocks
+  constexpr uint64_t k_granularity = 1024;
+
+  resource_tiling linear = placement::block_tiling(resource_tiling::linear, k_granularity);
+  resource_tiling optimal = placement::block_tiling(resource_tiling::optimal, k_granularity);
+
+  c_assert(linear == resource_tiling::linear);
+  c_assert(optimal == resource_tiling::optimal);
+
+  c_assert(placement::shares_block(0, linear, false, 0, linear));
+  c_assert(placement::shares_block(0, optimal, false, 0, optimal));
+  c_assert(!placement::shares_block(0, linear, false, 0, optimal));
+  c_assert(!placement::shares_block(0, optimal, false, 0, linear));
+
+  // ...but not with a granularity of 1
+  c_assert(placement::shares_block(0,
+				   placement::block_tiling(resource_tiling::linear, 1),
+				   false,
+				   0,
+				   placement::block_tiling(resource_tiling::optimal, 1)));
+
+  // dedicated blocks and other memory types are never shared
+  c_assert(!placement::shares_block(0, linear, true, 0, linear));
+  c_assert(!placement::shares_block(1, linear, false, 0, linear));
+}
+
+int main() {
+  struct {
+    const char* name;
+    void (*fn)();
+  } tests[] = {
+    { "tlsf_random", tlsf_random },
+    { "tlsf_merge", tlsf_merge },
+    { "pool_placement", pool_placement }
+  };
+
+  uint32_t failed = 0;
+
+  for (const auto& test: tests) {
+    uint32_t before = g_failures;
+
+    test.fn();
+
+    bool ok = g_failures == before;
+
+    printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+
+    if (!ok) {
+      failed++;
+    }
+  }
+
+  return failed == 0 ? 0 : 1;
+}
@@ -4,12 +4,64 @@
 #include "util.hpp"
 #include "gapi.hpp"
 #include <glm/gtc/constants.hpp>
-
+#include <string.h>
+
+// Vertices are appended on the CPU and uploaded by reset(), which
+// only sends what was appended since the last call. The GL buffer
+// grows geometrically, and a grown buffer is filled with a GPU side
+// copy of the old one, so adding N models uploads each vertex once
+// instead of the whole buffer N times.
+//
+// With keep_cpu_copy off, uploaded vertices are dropped from data;
+// data then only holds the pending ones, starting at data_base().
 struct module_vertex_buffer {
+  static constexpr inline size_t k_min_capacity = 1 << 16; // vertices
+
   darray<vertex> data;
 
   mutable gapi::buffer_object_handle vbo;
 
+  bool keep_cpu_copy {true};
+
+private:
+  size_t m_data_base {0}; // index of data[0] in the whole buffer
+  size_t m_num_uploaded {0};
+  size_t m_capacity {0};
+  size_t m_bytes_uploaded {0};
+
+  static gapi::bytesize_t bytes(size_t num_vertices) {
+    return static_cast<gapi::bytesize_t>(sizeof(vertex) * num_vertices);
+  }
+
+  void grow(size_t num_vertices) {
+    size_t capacity = std::max(m_capacity, k_min_capacity);
+
+    while (capacity < num_vertices) {
+      capacity *= 2;
+    }
+
+    auto old = vbo;
+
+    vbo = g_m.gpu->buffer_object_new();
+
+    bind();
+
+    g_m.gpu->buffer_object_set_data(gapi::buffer_object_target::vertex,
+                                    bytes(capacity),
+                                    nullptr,
+                                    gapi::buffer_object_usage::static_draw);
+
+    unbind();
+
+    if (!old.is_null()) {
+      g_m.gpu->buffer_object_copy(old, vbo, 0, 0, bytes(m_num_uploaded));
+      g_m.gpu->buffer_object_delete(old);
+    }
+
+    m_capacity = capacity;
+  }
+
+public:
   module_vertex_buffer()
     : vbo(gapi::buffer_object_handle{}) {
   }
@@ -26,23 +78,108 @@ struct module_vertex_buffer {
     data.push_back(v);
   }
 
-  void reset() const {
-    if (vbo.is_null()) {
-      vbo = g_m.gpu->buffer_object_new();
+  // src has to be in ::vertex's layout (e.g. primitives::engine_vertex)
+  void push(const void* src, size_t count) {
+    size_t first = data.size();
+    data.resize(first + count);
+    memcpy(&data[first], src, sizeof(vertex) * count);
+  }
+
+  // Uploads every vertex pushed since the last call.
+  void reset() {
+    size_t total = num_vertices();
+
+    if (total > m_capacity || vbo.is_null()) {
+      grow(total);
     }
 
-    bind();
+    if (total > m_num_uploaded) {
+      bind();
 
-    g_m.gpu->buffer_object_set_data(gapi::buffer_object_target::vertex,
-                                    sizeof(data[0]) * data.size(),
-                                    data.data(),
-                                    gapi::buffer_object_usage::static_draw);
+      g_m.gpu->buffer_object_set_sub_data(gapi::buffer_object_target::vertex,
+                                          bytes(m_num_uploaded),
+                                          bytes(total - m_num_uploaded),
+                                          &data[m_num_uploaded - m_data_base]);
 
-    unbind();
+      unbind();
+
+      m_bytes_uploaded += bytes(total - m_num_uploaded);
+      m_num_uploaded = total;
+    }
+
+    if (!keep_cpu_copy) {
+      m_data_base = total;
+      data.clear();
+      data.shrink_to_fit();
+    }
   }
 
-  auto num_vertices() const {
-    return static_cast<int>(data.size());
+  // Reads back from the GPU for vertices which are no longer on the CPU,
+  // so use this for one off processing (LODs, meshlets) only.
+  darray<vertex> read_vertices(size_t offset, size_t count) const {
+    ASSERT(offset + count <= static_cast<size_t>(num_vertices()));
+
+    darray<vertex> ret(count);
+
+    size_t num_gpu = offset < m_data_base ? std::min(count, m_data_base - offset) : 0;
+
+    if (num_gpu > 0) {
+      bind();
+
+      g_m.gpu->buffer_object_get_sub_data(gapi::buffer_object_target::vertex,
+                                          bytes(offset),
+                                          bytes(num_gpu),
+                                          ret.data());
+
+      unbind();
+    }
+
+    std::copy(data.begin() + (offset + num_gpu - m_data_base),
+              data.begin() + (offset + count - m_data_base),
+              ret.begin() + num_gpu);
+
+    return ret;
+  }
+
+  // Overwrites vertices in place: the CPU copy for those still held,
+  // and the GPU buffer for those already uploaded.
+  void write_vertices(size_t offset, const darray<vertex>& vertices) {
+    size_t count = vertices.size();
+
+    ASSERT(offset + count <= static_cast<size_t>(num_vertices()));
+
+    size_t cpu_begin = std::max(offset, m_data_base);
+
+    if (cpu_begin < offset + count) {
+      std::copy(vertices.begin() + (cpu_begin - offset),
+                vertices.end(),
+                data.begin() + (cpu_begin - m_data_base));
+    }
+
+    size_t num_gpu = offset < m_num_uploaded ? std::min(count, m_num_uploaded - offset) : 0;
+
+    if (num_gpu > 0) {
+      bind();
+
+      g_m.gpu->buffer_object_set_sub_data(gapi::buffer_object_target::vertex,
+                                          bytes(offset),
+                                          bytes(num_gpu),
+                                          vertices.data());
+
+      unbind();
+
+      m_bytes_uploaded += bytes(num_gpu);
+    }
+  }
+
+  size_t data_base() const { return m_data_base; }
+
+  size_t capacity() const { return m_capacity; }
+
+  size_t bytes_uploaded() const { return m_bytes_uploaded; }
+
+  int num_vertices() const {
+    return static_cast<int>(m_data_base + data.size());
   }
 
   auto add_triangle(const vec3_t& a_position, const vec4_t& a_color, const vec3_t& a_normal, const vec2_t& a_uv,